@@ -0,0 +1,78 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bed-mesh.h"
+
+#include <assert.h>
+#include <math.h>
+
+#include <algorithm>
+
+BedMesh::BedMesh(float x_min, float y_min, float x_max, float y_max,
+                 int columns, int rows, const std::vector<float> &offsets)
+    : x_min_(x_min),
+      y_min_(y_min),
+      columns_(columns),
+      rows_(rows),
+      x_spacing_((x_max - x_min) / (columns - 1)),
+      y_spacing_((y_max - y_min) / (rows - 1)) {
+  assert(columns >= 2 && rows >= 2);
+  assert((int)offsets.size() == columns * rows);
+  cells_.reserve((columns - 1) * (rows - 1));
+  for (int r = 0; r < rows - 1; ++r) {
+    for (int c = 0; c < columns - 1; ++c) {
+      const float z00 = offsets[r * columns + c];
+      const float z10 = offsets[r * columns + c + 1];
+      const float z01 = offsets[(r + 1) * columns + c];
+      const float z11 = offsets[(r + 1) * columns + c + 1];
+      cells_.push_back({z00, z10 - z00, z01 - z00, z11 - z10 - z01 + z00});
+    }
+  }
+}
+
+float BedMesh::OffsetAt(float x, float y) const {
+  const float gx = (x - x_min_) / x_spacing_;
+  const float gy = (y - y_min_) / y_spacing_;
+  const int c = std::clamp((int)floorf(gx), 0, columns_ - 2);
+  const int r = std::clamp((int)floorf(gy), 0, rows_ - 2);
+  const float u = std::clamp(gx - c, 0.0f, 1.0f);
+  const float v = std::clamp(gy - r, 0.0f, 1.0f);
+  const Cell &cell = cells_[r * (columns_ - 1) + c];
+  return cell.z + u * (cell.dx + v * cell.dxy) + v * cell.dy;
+}
+
+void BedMesh::AddCrossings(float from, float to, float grid_start,
+                           float spacing, int lines,
+                           std::vector<float> *fractions) const {
+  if (from == to) return;
+  // Only the inner grid lines separate cells; the border cells extend.
+  for (int i = 1; i < lines - 1; ++i) {
+    const float t = (grid_start + i * spacing - from) / (to - from);
+    if (t > 0 && t < 1) fractions->push_back(t);
+  }
+}
+
+void BedMesh::GetCellCrossings(float x0, float y0, float x1, float y1,
+                               std::vector<float> *fractions) const {
+  const size_t start = fractions->size();
+  AddCrossings(x0, x1, x_min_, x_spacing_, columns_, fractions);
+  AddCrossings(y0, y1, y_min_, y_spacing_, rows_, fractions);
+  std::sort(fractions->begin() + start, fractions->end());
+  fractions->push_back(1.0f);
+}
@@ -0,0 +1,69 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_BED_MESH_H_
+#define _BEAGLEG_BED_MESH_H_
+
+#include <vector>
+
+// Z-offsets of the bed, probed on a regular grid in XY.
+//
+// In between grid points, the offset is interpolated bilinearly. The
+// interpolation coefficients of each grid cell are precomputed into one
+// contiguous table, so a lookup is a cell index calculation and three
+// multiply-adds. Outside the grid, the border cells are extended.
+class BedMesh {
+ public:
+  // Grid of "columns" x "rows" points (each at least 2) spanning the
+  // rectangle (x_min, y_min) .. (x_max, y_max). The "offsets" are given
+  // row by row, starting at y_min; each row from x_min to x_max.
+  BedMesh(float x_min, float y_min, float x_max, float y_max, int columns,
+          int rows, const std::vector<float> &offsets);
+
+  int columns() const { return columns_; }
+  int rows() const { return rows_; }
+
+  // Interpolated Z-offset at the given position.
+  float OffsetAt(float x, float y) const;
+
+  // Append to "fractions" the points along the line from (x0, y0) to
+  // (x1, y1), as fraction 0..1 of its length, where it crosses a grid line,
+  // in increasing order; finally 1.0 for the end point. Between these
+  // points, the offset changes linearly along the line, so it only needs
+  // to be applied there.
+  void GetCellCrossings(float x0, float y0, float x1, float y1,
+                        std::vector<float> *fractions) const;
+
+ private:
+  struct Cell {
+    float z;     // Offset at the lower left corner.
+    float dx;    // Change along x within the cell, 0..1
+    float dy;    // Change along y within the cell, 0..1
+    float dxy;   // Twist.
+  };
+
+  void AddCrossings(float from, float to, float grid_start, float spacing,
+                    int lines, std::vector<float> *fractions) const;
+
+  const float x_min_, y_min_;
+  const int columns_, rows_;
+  const float x_spacing_, y_spacing_;
+  std::vector<Cell> cells_;  // (columns_ - 1) * (rows_ - 1), row by row.
+};
+
+#endif  // _BEAGLEG_BED_MESH_H_
@@ -0,0 +1,73 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "bed-mesh.h"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+TEST(BedMesh, InterpolatesBilinear) {
+  // 3x2 grid over (0,0)..(20,10)
+  const BedMesh mesh(0, 0, 20, 10, 3, 2,
+                     {0.0, 1.0, 0.0,    // y = 0
+                      2.0, 3.0, 4.0});  // y = 10
+  EXPECT_FLOAT_EQ(0.0, mesh.OffsetAt(0, 0));
+  EXPECT_FLOAT_EQ(1.0, mesh.OffsetAt(10, 0));
+  EXPECT_FLOAT_EQ(4.0, mesh.OffsetAt(20, 10));
+  EXPECT_FLOAT_EQ(0.5, mesh.OffsetAt(5, 0));
+  EXPECT_FLOAT_EQ(1.0, mesh.OffsetAt(0, 5));
+  EXPECT_FLOAT_EQ((0.0 + 1.0 + 2.0 + 3.0) / 4, mesh.OffsetAt(5, 5));
+  EXPECT_FLOAT_EQ((1.0 + 0.0 + 3.0 + 4.0) / 4, mesh.OffsetAt(15, 5));
+}
+
+TEST(BedMesh, ClampsOutsideOfGrid) {
+  const BedMesh mesh(0, 0, 10, 10, 2, 2, {1.0, 2.0, 3.0, 4.0});
+  EXPECT_FLOAT_EQ(1.0, mesh.OffsetAt(-5, -5));
+  EXPECT_FLOAT_EQ(4.0, mesh.OffsetAt(15, 15));
+  EXPECT_FLOAT_EQ(1.5, mesh.OffsetAt(5, -100));
+}
+
+TEST(BedMesh, CellCrossings) {
+  // Grid lines at x = 0, 10, 20, 30 and y = 0, 10, 20
+  const BedMesh mesh(0, 0, 30, 20, 4, 3, std::vector<float>(12, 0.0f));
+  std::vector<float> fractions;
+  mesh.GetCellCrossings(5, 5, 25, 5, &fractions);  // crosses x=10, x=20
+  ASSERT_EQ(3u, fractions.size());
+  EXPECT_FLOAT_EQ(0.25, fractions[0]);
+  EXPECT_FLOAT_EQ(0.75, fractions[1]);
+  EXPECT_FLOAT_EQ(1.0, fractions[2]);
+
+  fractions.clear();
+  mesh.GetCellCrossings(25, 15, 5, 5, &fractions);  // x=20, x=10, y=10
+  ASSERT_EQ(4u, fractions.size());
+  EXPECT_FLOAT_EQ(0.25, fractions[0]);
+  EXPECT_FLOAT_EQ(0.5, fractions[1]);
+  EXPECT_FLOAT_EQ(0.75, fractions[2]);
+  EXPECT_FLOAT_EQ(1.0, fractions[3]);
+
+  fractions.clear();
+  mesh.GetCellCrossings(1, 1, 2, 2, &fractions);  // within one cell.
+  ASSERT_EQ(1u, fractions.size());
+  EXPECT_FLOAT_EQ(1.0, fractions[0]);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
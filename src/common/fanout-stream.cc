@@ -0,0 +1,157 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common/fanout-stream.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "common/logging.h"
+
+FanoutStream::FanoutStream(FDMultiplexer *event_server,
+                           size_t max_observer_buffer)
+    : event_server_(event_server), max_observer_buffer_(max_observer_buffer) {
+  cookie_io_functions_t functions = {};
+  functions.write = &FanoutStream::CookieWrite;
+  stream_ = fopencookie(this, "w", functions);
+  setvbuf(stream_, NULL, _IONBF, 0);
+}
+
+FanoutStream::~FanoutStream() {
+  fclose(stream_);
+  for (const Observer &observer : observers_) {
+    if (!observer.disconnected) close(observer.fd);
+  }
+}
+
+ssize_t FanoutStream::CookieWrite(void *cookie, const char *buf, size_t size) {
+  ((FanoutStream *)cookie)->Write(buf, size);
+  return size;
+}
+
+void FanoutStream::Write(const char *buf, size_t size) {
+  // The primary connection gets everything, even if we have to wait.
+  for (size_t written = 0; primary_fd_ >= 0 && written < size; /**/) {
+    const ssize_t r = write(primary_fd_, buf + written, size - written);
+    if (r >= 0) {
+      written += r;
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      struct pollfd p = {primary_fd_, POLLOUT, 0};
+      poll(&p, 1, -1);
+    } else if (errno != EINTR) {
+      break;  // Gone. The GCodeStreamer will notice on reading.
+    }
+  }
+
+  for (Observer &observer : observers_) {
+    Mirror(&observer, buf, size);
+  }
+}
+
+void FanoutStream::Mirror(Observer *observer, const char *buf, size_t size) {
+  if (observer->disconnected) return;
+  if (observer->pending.empty()) {
+    const ssize_t r = write(observer->fd, buf, size);
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      Disconnect(observer, strerror(errno));
+      return;
+    }
+    if (r > 0) {
+      buf += r;
+      size -= r;
+    }
+  }
+  if (size == 0) return;
+  if (observer->pending.size() + size > max_observer_buffer_) {
+    Disconnect(observer, "too slow");
+    return;
+  }
+  observer->pending.append(buf, size);
+  if (!observer->waiting_writable) {
+    observer->waiting_writable = true;
+    event_server_->RunOnWritable(observer->fd,
+                                 [this, observer]() {
+                                   return FlushPending(observer);
+                                 });
+  }
+}
+
+bool FanoutStream::FlushPending(Observer *observer) {
+  if (!observer->disconnected) {
+    const ssize_t r =
+      write(observer->fd, observer->pending.data(), observer->pending.size());
+    if (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+      Disconnect(observer, strerror(errno));
+    } else if (r > 0) {
+      observer->pending.erase(0, r);
+    }
+  }
+  if (!observer->disconnected && !observer->pending.empty()) return true;
+  observer->waiting_writable = false;
+  return false;
+}
+
+// Observers don't send anything we care about, but we need to notice when
+// they hang up.
+bool FanoutStream::ReadAndDiscard(Observer *observer) {
+  char buffer[1024];
+  const ssize_t r = read(observer->fd, buffer, sizeof(buffer));
+  if (r > 0 || (r < 0 && (errno == EAGAIN || errno == EINTR))) {
+    return true;
+  }
+  // Hangup, or our own shutdown() in Disconnect().
+  if (!observer->disconnected) {
+    Log_info("Observer connection closed.");
+  }
+  observer->disconnected = true;
+  if (observer->waiting_writable) {
+    // The write handler is still registered; it removes itself with the
+    // next call, so closing has to wait until then.
+    return true;
+  }
+  close(observer->fd);
+  for (auto it = observers_.begin(); it != observers_.end(); ++it) {
+    if (&*it == observer) {
+      observers_.erase(it);
+      break;
+    }
+  }
+  return false;
+}
+
+// Disconnecting happens while writing, which can be anywhere. So we only
+// shut down the connection here and let ReadAndDiscard() do the cleanup once
+// the event loop reports the hangup.
+void FanoutStream::Disconnect(Observer *observer, const char *reason) {
+  Log_info("Disconnecting observer (%s).", reason);
+  observer->disconnected = true;
+  observer->pending.clear();
+  shutdown(observer->fd, SHUT_RDWR);
+}
+
+void FanoutStream::AddObserver(int fd) {
+  observers_.emplace_back();
+  Observer *observer = &observers_.back();
+  observer->fd = fd;
+  event_server_->RunOnReadable(fd, [this, observer]() {
+    return ReadAndDiscard(observer);
+  });
+}
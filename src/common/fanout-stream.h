@@ -0,0 +1,90 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_FANOUT_STREAM_H
+#define _BEAGLEG_FANOUT_STREAM_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <list>
+#include <string>
+
+#include "common/fd-mux.h"
+
+// A message stream that goes to one primary connection and is mirrored to
+// any number of observer connections.
+//
+// The primary connection is written to directly; if it does not keep up, the
+// writer waits, as with any other FILE. Observers are written to
+// non-blocking: whatever they can't take right away is buffered and sent
+// when they become writable. An observer that falls behind by more than
+// "max_observer_buffer" bytes is disconnected; it never slows down the
+// writer.
+//
+// Observers are read-only; anything they send is discarded. They are
+// closed when they hang up.
+class FanoutStream {
+ public:
+  // FanoutStream needs to outlive the Loop() of the "event_server".
+  explicit FanoutStream(FDMultiplexer *event_server,
+                        size_t max_observer_buffer = 65536);
+  ~FanoutStream();
+
+  FanoutStream(const FanoutStream &) = delete;
+  FanoutStream &operator=(const FanoutStream &) = delete;
+
+  // The stream to write messages to. Unbuffered.
+  FILE *stream() { return stream_; }
+
+  // Set the primary connection. Does not take ownership, but the file
+  // descriptor is not written to anymore after it has been replaced with
+  // another one or -1.
+  void SetPrimary(int fd) { primary_fd_ = fd; }
+
+  // Add an observer connection. It needs to be non-blocking. Takes
+  // ownership of the file descriptor.
+  void AddObserver(int fd);
+
+  // Number of connected observers.
+  int observer_count() const { return observers_.size(); }
+
+ private:
+  struct Observer {
+    int fd;
+    std::string pending;  // Data not written yet.
+    bool waiting_writable = false;
+    bool disconnected = false;
+  };
+
+  static ssize_t CookieWrite(void *cookie, const char *buf, size_t size);
+  void Write(const char *buf, size_t size);
+  void Mirror(Observer *observer, const char *buf, size_t size);
+  bool FlushPending(Observer *observer);
+  bool ReadAndDiscard(Observer *observer);
+  void Disconnect(Observer *observer, const char *reason);
+
+  FDMultiplexer *const event_server_;
+  const size_t max_observer_buffer_;
+  FILE *stream_;
+  int primary_fd_ = -1;
+  std::list<Observer> observers_;
+};
+
+#endif  // _BEAGLEG_FANOUT_STREAM_H
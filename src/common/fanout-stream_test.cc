@@ -0,0 +1,139 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common/fanout-stream.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+class TestMultiplexer : public FDMultiplexer {
+ public:
+  using FDMultiplexer::SingleCycle;
+};
+
+// A connection with our end non-blocking, as accept()ed connections are set
+// up in machine-control.
+class Connection {
+ public:
+  Connection() {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd_) < 0) abort();
+    fcntl(fd_[0], F_SETFL, fcntl(fd_[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fd_[1], F_SETFL, fcntl(fd_[1], F_GETFL) | O_NONBLOCK);
+  }
+  ~Connection() {
+    if (fd_[1] >= 0) close(fd_[1]);
+  }
+
+  int server_fd() const { return fd_[0]; }
+  void CloseClient() {
+    close(fd_[1]);
+    fd_[1] = -1;
+  }
+
+  // Everything that arrived on the client side so far. Empty string if the
+  // connection has been closed.
+  std::string Receive() {
+    std::string result;
+    char buffer[4096];
+    ssize_t r;
+    while ((r = read(fd_[1], buffer, sizeof(buffer))) > 0) {
+      result.append(buffer, r);
+    }
+    if (r == 0) closed_ = true;
+    return result;
+  }
+  bool closed() const { return closed_; }
+
+ private:
+  int fd_[2];
+  bool closed_ = false;
+};
+
+TEST(FanoutStream, PrimaryAndObserversGetMessages) {
+  TestMultiplexer mux;
+  FanoutStream fanout(&mux);
+  Connection primary, observer1, observer2;
+  fanout.SetPrimary(primary.server_fd());
+  fanout.AddObserver(observer1.server_fd());
+  fanout.AddObserver(observer2.server_fd());
+  EXPECT_EQ(2, fanout.observer_count());
+
+  fprintf(fanout.stream(), "ok\n");
+  fprintf(fanout.stream(), "X:%d\n", 42);
+  EXPECT_EQ("ok\nX:42\n", primary.Receive());
+  EXPECT_EQ("ok\nX:42\n", observer1.Receive());
+  EXPECT_EQ("ok\nX:42\n", observer2.Receive());
+
+  // Without primary, only observers get messages.
+  fanout.SetPrimary(-1);
+  fprintf(fanout.stream(), "hello\n");
+  EXPECT_EQ("", primary.Receive());
+  EXPECT_EQ("hello\n", observer1.Receive());
+
+  // Observer hangs up and is removed.
+  observer2.CloseClient();
+  mux.SingleCycle(0);
+  EXPECT_EQ(1, fanout.observer_count());
+  close(primary.server_fd());
+}
+
+TEST(FanoutStream, SlowObserverIsBufferedThenDisconnected) {
+  TestMultiplexer mux;
+  FanoutStream fanout(&mux, 100000);
+  Connection primary, slow;
+  fanout.SetPrimary(primary.server_fd());
+  fanout.AddObserver(slow.server_fd());
+
+  // Write more than the socket buffer takes, but within what we buffer for
+  // an observer. The primary needs to keep up; we read it as we go.
+  const std::string chunk(1000, 'x');
+  std::string primary_received;
+  for (int i = 0; i < 90; ++i) {
+    fwrite(chunk.data(), 1, chunk.size(), fanout.stream());
+    primary_received += primary.Receive();
+  }
+  EXPECT_EQ(90000u, primary_received.size());
+  EXPECT_EQ(1, fanout.observer_count());
+
+  // Reading the observer, and let the event loop send what is pending.
+  std::string slow_received;
+  for (int i = 0; i < 100 && slow_received.size() < 90000; ++i) {
+    slow_received += slow.Receive();
+    mux.SingleCycle(0);
+  }
+  EXPECT_EQ(90000u, slow_received.size());
+
+  // Now, the observer does not read anymore and falls too far behind.
+  for (int i = 0; i < 200; ++i) {
+    fwrite(chunk.data(), 1, chunk.size(), fanout.stream());
+    primary.Receive();
+  }
+  for (int i = 0; i < 3; ++i) mux.SingleCycle(0);
+  EXPECT_EQ(0, fanout.observer_count());
+  while (!slow.closed()) slow.Receive();
+  close(primary.server_fd());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -22,7 +22,9 @@
 #include <errno.h>
 #include <signal.h>
 #include <string.h>
-#include <sys/select.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -45,6 +47,12 @@ static void receive_signal(int signo) {
 
 static void ignore_signal(int signo) { caught_ignored_signal = 1; }
 
+static int64_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 static void arm_signal_handler() {
   caught_exit_trigger_signal = 0;
   caught_ignored_signal = 0;
@@ -77,55 +85,188 @@ static void disarm_signal_handler() {
   signal(SIGFPE, SIG_DFL);
 }
 
-bool FDMultiplexer::RunOnReadable(int fd, const Handler &handler) {
-  return read_handlers_.insert({fd, handler}).second;
+struct FDMultiplexer::Watch {
+  int fd;
+  bool is_timer;
+  bool one_shot;
+  Trigger trigger;
+  Handler on_readable;  // For timers: the timer handler.
+  Handler on_writable;
+};
+
+FDMultiplexer::FDMultiplexer(unsigned idle_ms)
+    : idle_ms_(idle_ms),
+      epoll_fd_(epoll_create1(EPOLL_CLOEXEC)),
+      idle_since_ms_(now_ms()) {
+  if (epoll_fd_ < 0) {
+    Log_error("epoll_create1(): %s", strerror(errno));
+  }
+}
+
+FDMultiplexer::~FDMultiplexer() {
+  for (const auto &it : watches_) {
+    if (it.second->is_timer) close(it.first);
+  }
+  close(epoll_fd_);
 }
 
-bool FDMultiplexer::RunOnWritable(int fd, const Handler &handler) {
-  return write_handlers_.insert({fd, handler}).second;
+static struct epoll_event EpollEventFor(FDMultiplexer::Trigger trigger,
+                                        bool read, bool write, int fd) {
+  struct epoll_event event = {};
+  if (read) event.events |= EPOLLIN;
+  if (write) event.events |= EPOLLOUT;
+  if (trigger == FDMultiplexer::Trigger::kEdge) event.events |= EPOLLET;
+  event.data.fd = fd;
+  return event;
+}
+
+bool FDMultiplexer::AddHandler(int fd, const Handler &handler,
+                               Trigger trigger, bool for_write) {
+  auto found = watches_.find(fd);
+  if (found == watches_.end()) {
+    Watch *watch = new Watch{fd, false, false, trigger, nullptr, nullptr};
+    (for_write ? watch->on_writable : watch->on_readable) = handler;
+    struct epoll_event event =
+      EpollEventFor(trigger, !for_write, for_write, fd);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+      if (errno != EPERM) {
+        Log_error("epoll_ctl(fd=%d): %s", fd, strerror(errno));
+        delete watch;
+        return false;
+      }
+      // Regular files are not supported by epoll, but select() would
+      // always report them as ready. So that is what we do.
+      always_ready_.push_back(watch);
+    }
+    watches_[fd].reset(watch);
+    ++fd_handler_count_;
+    return true;
+  }
+
+  Watch *watch = found->second.get();
+  Handler &slot = for_write ? watch->on_writable : watch->on_readable;
+  if (watch->is_timer || slot || watch->trigger != trigger) return false;
+  slot = handler;
+  struct epoll_event event = EpollEventFor(
+    trigger, watch->on_readable != nullptr, watch->on_writable != nullptr, fd);
+  if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0 && errno != ENOENT) {
+    Log_error("epoll_ctl(fd=%d): %s", fd, strerror(errno));
+  }
+  return true;
+}
+
+bool FDMultiplexer::RunOnReadable(int fd, const Handler &handler,
+                                  Trigger trigger) {
+  return AddHandler(fd, handler, trigger, false);
+}
+
+bool FDMultiplexer::RunOnWritable(int fd, const Handler &handler,
+                                  Trigger trigger) {
+  return AddHandler(fd, handler, trigger, true);
 }
 
 void FDMultiplexer::RunOnIdle(const Handler &handler) {
   idle_handlers_.push_back(handler);
 }
 
-void FDMultiplexer::CallHandlers(fd_set *to_call_fd_set, int *available_fds,
-                                 HandlerMap *handlers) {
-  for (auto it = handlers->begin(); *available_fds && it != handlers->end();) {
-    bool keep_handler = true;
-    if (FD_ISSET(it->first, to_call_fd_set)) {
-      --*available_fds;
-      keep_handler = it->second();
-    }
-    it = keep_handler ? std::next(it) : handlers->erase(it);
+void FDMultiplexer::RunAtEndOfCycle(const Handler &handler) {
+  end_of_cycle_handlers_.push_back(handler);
+}
+
+static struct timespec ToTimespec(unsigned ms) {
+  struct timespec result;
+  result.tv_sec = ms / 1000;
+  result.tv_nsec = (ms % 1000) * 1000000L;
+  return result;
+}
+
+bool FDMultiplexer::AddTimer(unsigned delay_ms, unsigned period_ms,
+                             const Handler &handler) {
+  const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd < 0) {
+    Log_error("timerfd_create(): %s", strerror(errno));
+    return false;
   }
+  struct itimerspec spec;
+  spec.it_value = ToTimespec(delay_ms);
+  spec.it_interval = ToTimespec(period_ms);
+  if (delay_ms == 0) spec.it_value.tv_nsec = 1;  // Zero would disarm.
+  Watch *watch = new Watch{fd, true, period_ms == 0, Trigger::kLevel, handler,
+                           nullptr};
+  struct epoll_event event =
+    EpollEventFor(Trigger::kLevel, true, false, fd);
+  if (timerfd_settime(fd, 0, &spec, nullptr) < 0 ||
+      epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    Log_error("Setting up timer: %s", strerror(errno));
+    close(fd);
+    delete watch;
+    return false;
+  }
+  watches_[fd].reset(watch);
+  return true;
 }
 
-bool FDMultiplexer::SingleCycle(unsigned int timeout_ms) {
-  fd_set read_fds;
-  fd_set write_fds;
+bool FDMultiplexer::RunEvery(unsigned period_ms, const Handler &handler) {
+  return AddTimer(period_ms, period_ms == 0 ? 1 : period_ms, handler);
+}
+
+bool FDMultiplexer::RunAfter(unsigned delay_ms, const Handler &handler) {
+  return AddTimer(delay_ms, 0, handler);
+}
 
-  struct timeval timeout;
-  timeout.tv_sec = timeout_ms / 1000;
-  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+void FDMultiplexer::RemoveWatch(Watch *watch) {
+  const int fd = watch->fd;
+  // The file descriptor might already be closed by the handler, so errors
+  // are expected here.
+  epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  if (watch->is_timer) {
+    close(fd);
+  } else {
+    --fd_handler_count_;
+  }
+  always_ready_.erase(
+    std::remove(always_ready_.begin(), always_ready_.end(), watch),
+    always_ready_.end());
+  watches_.erase(fd);  // Deletes watch.
+}
 
-  int maxfd = -1;
-  FD_ZERO(&read_fds);
-  FD_ZERO(&write_fds);
+void FDMultiplexer::Dispatch(Watch *watch, uint32_t events) {
+  if (watch->is_timer) {
+    uint64_t expirations;
+    if (read(watch->fd, &expirations, sizeof(expirations)) < 0) return;
+    if (!watch->on_readable() || watch->one_shot) RemoveWatch(watch);
+    return;
+  }
 
-  // Readers
-  for (const auto &it : read_handlers_) {
-    maxfd = std::max(maxfd, it.first);
-    FD_SET(it.first, &read_fds);
+  // Like select(), report hangup and errors to all handlers, so that they
+  // see them when reading or writing.
+  bool changed = false;
+  if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && watch->on_readable) {
+    if (!watch->on_readable()) {
+      watch->on_readable = nullptr;
+      changed = true;
+    }
+  }
+  if ((events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) && watch->on_writable) {
+    if (!watch->on_writable()) {
+      watch->on_writable = nullptr;
+      changed = true;
+    }
   }
+  if (!changed) return;
 
-  // Writers
-  for (const auto &it : write_handlers_) {
-    maxfd = std::max(maxfd, it.first);
-    FD_SET(it.first, &write_fds);
+  if (!watch->on_readable && !watch->on_writable) {
+    RemoveWatch(watch);
+    return;
   }
+  struct epoll_event event = EpollEventFor(
+    watch->trigger, watch->on_readable != nullptr,
+    watch->on_writable != nullptr, watch->fd);
+  epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, watch->fd, &event);
+}
 
-  if (maxfd < 0) {
+bool FDMultiplexer::SingleCycle(unsigned int timeout_ms) {
+  if (fd_handler_count_ == 0) {
     // file descriptors only can be registred from within handlers
     // or before running the Loop(). So if no filedesctiptors are left,
     // there is no chance for any to re-appear, so we can exit.
@@ -133,26 +274,59 @@ bool FDMultiplexer::SingleCycle(unsigned int timeout_ms) {
     return false;
   }
 
-  int fds_ready = select(maxfd + 1, &read_fds, &write_fds, nullptr, &timeout);
+  // Idle is measured from the last file descriptor activity, so that timers
+  // firing more often than the idle timeout don't starve the idle handlers.
+  static constexpr int kMaxEvents = 64;
+  struct epoll_event events[kMaxEvents];
+  const int64_t idle_in_ms = idle_since_ms_ + timeout_ms - now_ms();
+  const int timeout =
+    always_ready_.empty() ? (int)std::max<int64_t>(0, idle_in_ms) : 0;
+  const int fds_ready = epoll_wait(epoll_fd_, events, kMaxEvents, timeout);
   if (fds_ready < 0) {
-    if (!caught_exit_trigger_signal) perror("select() failed");
+    if (errno == EINTR) return !caught_exit_trigger_signal;
+    perror("epoll_wait() failed");
     return false;
   }
 
-  if (fds_ready == 0) {  // No FDs ready: timeout situation.
-    for (auto it = idle_handlers_.begin(); it != idle_handlers_.end(); /**/) {
-      const bool keep_handler = (*it)();
-      it = keep_handler ? std::next(it) : idle_handlers_.erase(it);
-    }
-    return true;
+  // Look up by file descriptor: a handler might have closed its file
+  // descriptor and removed its watch while events are still pending.
+  bool fd_activity = !always_ready_.empty();
+  for (int i = 0; i < fds_ready; ++i) {
+    auto found = watches_.find(events[i].data.fd);
+    if (found == watches_.end()) continue;
+    if (!found->second->is_timer) fd_activity = true;
+    Dispatch(found->second.get(), events[i].events);
+  }
+  const std::vector<Watch *> always_ready(always_ready_);
+  for (Watch *watch : always_ready) {
+    Dispatch(watch, EPOLLIN | EPOLLOUT);
   }
 
-  CallHandlers(&read_fds, &fds_ready, &read_handlers_);
-  CallHandlers(&write_fds, &fds_ready, &write_handlers_);
+  if (fd_activity) {
+    idle_since_ms_ = now_ms();
+  } else if (now_ms() >= idle_since_ms_ + timeout_ms) {
+    RunIdleHandlers();
+    idle_since_ms_ = now_ms();
+  }
+  RunEndOfCycleHandlers();
 
   return true;
 }
 
+void FDMultiplexer::RunIdleHandlers() {
+  for (auto it = idle_handlers_.begin(); it != idle_handlers_.end(); /**/) {
+    const bool keep_handler = (*it)();
+    it = keep_handler ? std::next(it) : idle_handlers_.erase(it);
+  }
+}
+
+void FDMultiplexer::RunEndOfCycleHandlers() {
+  // Handlers might register new ones for the next cycle.
+  std::vector<Handler> handlers;
+  handlers.swap(end_of_cycle_handlers_);
+  for (const Handler &handler : handlers) handler();
+}
+
 int FDMultiplexer::Loop() {
   const unsigned timeout = idle_ms_;
 
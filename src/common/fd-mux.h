@@ -20,58 +20,103 @@
 #ifndef FD_MUX_H_
 #define FD_MUX_H_
 
-#include <sys/select.h>
+#include <stdint.h>
 
 #include <functional>
 #include <list>
-#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 // This needs a better name.
+//
+// Event loop based on epoll(7). Handlers are dispatched directly from the
+// epoll events, so the cost of a loop turn only depends on the number of
+// file descriptors that are ready, not on the number registered. Timers are
+// timerfd(2) based and fire on time, independent of other traffic.
 class FDMultiplexer {
  public:
-  explicit FDMultiplexer(unsigned idle_ms = 50) : idle_ms_(idle_ms) {}
+  explicit FDMultiplexer(unsigned idle_ms = 50);
+  ~FDMultiplexer();
+
+  FDMultiplexer(const FDMultiplexer &) = delete;
+  FDMultiplexer &operator=(const FDMultiplexer &) = delete;
 
   // Handlers for events from this multiplexer.
   // Returns true if we want to continue to be called in the future or false
   // if we wish to be taken out of the multiplexer.
   typedef std::function<bool()> Handler;
 
+  // How a file descriptor is watched.
+  enum class Trigger {
+    kLevel,  // Handler is called as long as the condition is true.
+    kEdge,   // Handler is called once after the condition became true. The
+             // handler must read/write until EAGAIN to be called again.
+  };
+
   // These can only be set before Loop() is called or from a
   // running handler itself.
-  // Returns false if that filedescriptor is already registered.
-  bool RunOnReadable(int fd, const Handler &handler);
-  bool RunOnWritable(int fd, const Handler &handler);
+  // Returns false if that filedescriptor is already registered. If there
+  // are both, a read and a write handler, they need the same Trigger.
+  bool RunOnReadable(int fd, const Handler &handler,
+                     Trigger trigger = Trigger::kLevel);
+  bool RunOnWritable(int fd, const Handler &handler,
+                     Trigger trigger = Trigger::kLevel);
 
-  // Handler called regularly every idle_ms in case there's nothing to do.
+  // Handler called regularly every idle_ms in case there's nothing to do,
+  // i.e. no file descriptor handler has been called. Timers don't count as
+  // activity, so they don't hold off the idle handlers.
   void RunOnIdle(const Handler &handler);
 
+  // Call handler every "period_ms" milliseconds until it returns false.
+  // Returns false if the timer could not be created.
+  bool RunEvery(unsigned period_ms, const Handler &handler);
+
+  // Call handler once after "delay_ms" milliseconds. The return value of the
+  // handler is ignored. Returns false if the timer could not be created.
+  bool RunAfter(unsigned delay_ms, const Handler &handler);
+
+  // Call handler once at the end of the current loop cycle, after all
+  // handlers for ready file descriptors and timers have run. Useful to
+  // coalesce work triggered by several events. The return value of the
+  // handler is ignored.
+  void RunAtEndOfCycle(const Handler &handler);
+
   // Run the main loop. Blocks while there is still a filedescriptor
   // registered (return 0) or until a signal is triggered (return 1).
+  // Timers alone don't keep the loop running.
   int Loop();
 
  protected:
-  // Run a single cycle resulting in exactly one call of a handler function.
-  // This means that one of these happened:
-  //   (1) The next file descriptor became ready and its Handler is called
-  //   (2) We encountered a timeout and the idle-Handler has been called.
-  //   (3) Signal received or select() issue. Returns false in this case.
+  // Run a single cycle resulting in calls of the handlers of one batch of
+  // ready file descriptors or timers. This means that one of these happened:
+  //   (1) File descriptors became ready and their Handlers are called
+  //   (2) There was no file descriptor activity for "timeout_ms" and the
+  //       idle-Handlers have been called (possibly after timers).
+  //   (3) Signal received or epoll issue. Returns false in this case.
   //
   // This is broken out to make it simple to test steps in unit tests.
   bool SingleCycle(unsigned timeout_ms);
 
  private:
-  typedef std::map<int, Handler> HandlerMap;
+  struct Watch;
 
-  // Call all the handlers available in fd_set, removing the ones that
-  // return 'false'. "available_fds" is an optimizatin that tells CallHandlers
-  // how many fds there are in the first place.
-  void CallHandlers(fd_set *to_call_fd_set, int *available_fds,
-                    HandlerMap *handlers);
+  bool AddHandler(int fd, const Handler &handler, Trigger trigger,
+                  bool for_write);
+  bool AddTimer(unsigned delay_ms, unsigned period_ms, const Handler &handler);
+  void Dispatch(Watch *watch, uint32_t events);
+  void RemoveWatch(Watch *watch);
+  void RunIdleHandlers();
+  void RunEndOfCycleHandlers();
 
   const unsigned idle_ms_;
-  HandlerMap read_handlers_;
-  HandlerMap write_handlers_;
+  const int epoll_fd_;
+  std::unordered_map<int, std::unique_ptr<Watch>> watches_;
+  int fd_handler_count_ = 0;  // Watches with file descriptor handlers.
+  std::vector<Watch *> always_ready_;  // Can't be watched by epoll.
   std::list<Handler> idle_handlers_;
+  int64_t idle_since_ms_;  // Last file descriptor activity or idle call.
+  std::vector<Handler> end_of_cycle_handlers_;
 };
 
 #endif  // FD_MUX_H_
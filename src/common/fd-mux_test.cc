@@ -0,0 +1,247 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common/fd-mux.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+class TestMultiplexer : public FDMultiplexer {
+ public:
+  TestMultiplexer() : FDMultiplexer(10) {}
+  using FDMultiplexer::SingleCycle;
+};
+
+class Pipe {
+ public:
+  Pipe() {
+    if (pipe(fd_) < 0) abort();
+  }
+  ~Pipe() {
+    close(fd_[0]);
+    close(fd_[1]);
+  }
+  int read_fd() const { return fd_[0]; }
+  int write_fd() const { return fd_[1]; }
+  void Send(const char *str) {
+    if (write(fd_[1], str, strlen(str)) < 0) abort();
+  }
+
+ private:
+  int fd_[2];
+};
+
+TEST(FDMultiplexer, ReadableHandlerIsCalledUntilItReturnsFalse) {
+  TestMultiplexer mux;
+  Pipe p;
+  int called = 0;
+  EXPECT_TRUE(mux.RunOnReadable(p.read_fd(), [&]() {
+    char c;
+    EXPECT_EQ(1, read(p.read_fd(), &c, 1));
+    return ++called < 2;
+  }));
+  EXPECT_FALSE(mux.RunOnReadable(p.read_fd(), []() { return true; }));
+
+  // Nothing to read: idle handler is called instead.
+  int idle_called = 0;
+  mux.RunOnIdle([&]() {
+    ++idle_called;
+    return true;
+  });
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(0, called);
+  EXPECT_EQ(1, idle_called);
+
+  p.Send("ab");
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(1, called);
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(2, called);
+  EXPECT_EQ(1, idle_called);
+
+  // Handler is gone, so is the last file descriptor.
+  EXPECT_FALSE(mux.SingleCycle(0));
+}
+
+TEST(FDMultiplexer, ReadAndWriteHandlerOnSameFd) {
+  TestMultiplexer mux;
+  int sockets[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+  int reads = 0, writes = 0;
+  EXPECT_TRUE(mux.RunOnWritable(sockets[0], [&]() {
+    ++writes;
+    return false;
+  }));
+  EXPECT_TRUE(mux.RunOnReadable(sockets[0], [&]() {
+    ++reads;
+    return true;
+  }));
+  // Different trigger for the same file descriptor is not possible.
+  EXPECT_FALSE(mux.RunOnWritable(
+    sockets[0], []() { return true; }, FDMultiplexer::Trigger::kEdge));
+
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(0, reads);
+  EXPECT_EQ(1, writes);
+
+  ASSERT_EQ(1, write(sockets[1], "x", 1));
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(1, reads);
+  EXPECT_EQ(1, writes);  // Removed after returning false.
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+TEST(FDMultiplexer, EdgeTriggeredOnlyCalledOnNewData) {
+  TestMultiplexer mux;
+  Pipe p;
+  int called = 0;
+  mux.RunOnReadable(
+    p.read_fd(),
+    [&]() {
+      ++called;
+      return true;
+    },
+    FDMultiplexer::Trigger::kEdge);
+  p.Send("a");
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(1, called);
+  EXPECT_TRUE(mux.SingleCycle(0));  // Data not consumed, but no new edge.
+  EXPECT_EQ(1, called);
+  p.Send("b");
+  EXPECT_TRUE(mux.SingleCycle(0));
+  EXPECT_EQ(2, called);
+}
+
+TEST(FDMultiplexer, RegularFilesAreAlwaysReady) {
+  TestMultiplexer mux;
+  FILE *f = tmpfile();
+  int called = 0;
+  EXPECT_TRUE(mux.RunOnReadable(fileno(f), [&]() { return ++called < 3; }));
+  while (mux.SingleCycle(1000)) {
+  }
+  EXPECT_EQ(3, called);
+  fclose(f);
+}
+
+TEST(FDMultiplexer, Timers) {
+  TestMultiplexer mux;
+  Pipe p;  // Keeps the loop alive.
+  mux.RunOnReadable(p.read_fd(), []() { return true; });
+
+  int one_shot = 0;
+  int periodic = 0;
+  EXPECT_TRUE(mux.RunAfter(1, [&]() {
+    ++one_shot;
+    return true;  // Ignored.
+  }));
+  EXPECT_TRUE(mux.RunEvery(1, [&]() { return ++periodic < 3; }));
+  for (int i = 0; i < 100 && periodic < 3; ++i) {
+    EXPECT_TRUE(mux.SingleCycle(100));
+  }
+  for (int i = 0; i < 5; ++i) {
+    EXPECT_TRUE(mux.SingleCycle(5));
+  }
+  EXPECT_EQ(1, one_shot);
+  EXPECT_EQ(3, periodic);
+}
+
+// Timers firing more often than the idle timeout must not starve the idle
+// handlers; only file descriptor activity does hold them off.
+TEST(FDMultiplexer, IdleHandlersRunWithFastTimer) {
+  TestMultiplexer mux;
+  Pipe p;  // Keeps the loop alive.
+  mux.RunOnReadable(p.read_fd(), [&]() {
+    char c;
+    EXPECT_EQ(1, read(p.read_fd(), &c, 1));
+    return true;
+  });
+  int timer_called = 0;
+  int idle_called = 0;
+  EXPECT_TRUE(mux.RunEvery(2, [&]() {
+    ++timer_called;
+    return true;
+  }));
+  mux.RunOnIdle([&]() {
+    ++idle_called;
+    return true;
+  });
+  for (int i = 0; i < 200 && idle_called < 2; ++i) {
+    EXPECT_TRUE(mux.SingleCycle(20));
+  }
+  EXPECT_EQ(2, idle_called);
+  EXPECT_GT(timer_called, 2);
+
+  // Activity on the file descriptor holds off the idle handler.
+  p.Send("x");
+  EXPECT_TRUE(mux.SingleCycle(20));
+  const int idle_before = idle_called;
+  for (int i = 0; i < 3; ++i) {
+    p.Send("x");
+    EXPECT_TRUE(mux.SingleCycle(1000));
+  }
+  EXPECT_EQ(idle_before, idle_called);
+}
+
+TEST(FDMultiplexer, EndOfCycleHandlersRunOnceAfterAllEvents) {
+  TestMultiplexer mux;
+  Pipe a, b;
+  std::string sequence;
+  auto handler = [&](int fd) {
+    char c;
+    EXPECT_EQ(1, read(fd, &c, 1));
+    sequence.append(1, c);
+    if (sequence.find('.') == std::string::npos) {
+      sequence.append(".");
+      mux.RunAtEndOfCycle([&]() {
+        sequence.append("|");
+        return true;
+      });
+    }
+    return true;
+  };
+  mux.RunOnReadable(a.read_fd(), [&]() { return handler(a.read_fd()); });
+  mux.RunOnReadable(b.read_fd(), [&]() { return handler(b.read_fd()); });
+  a.Send("a");
+  b.Send("b");
+  EXPECT_TRUE(mux.SingleCycle(100));
+  ASSERT_EQ(4u, sequence.size());
+  EXPECT_EQ('|', sequence[3]);  // After both handlers.
+
+  EXPECT_TRUE(mux.SingleCycle(0));  // Not called again.
+  EXPECT_EQ(4u, sequence.size());
+}
+
+TEST(FDMultiplexer, TimersDontKeepLoopAlive) {
+  FDMultiplexer mux;
+  int called = 0;
+  mux.RunEvery(1, [&]() { return ++called; });
+  EXPECT_EQ(0, mux.Loop());
+  EXPECT_EQ(0, called);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
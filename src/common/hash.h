@@ -0,0 +1,62 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BEAGLEG_HASH_H_
+#define _BEAGLEG_HASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string_view>
+#include <type_traits>
+
+// Incremental 64 bit FNV-1a hash. Not cryptographically secure; meant to
+// create fingerprints of content and configurations, e.g. for cache keys.
+class Fnv1aHash {
+ public:
+  Fnv1aHash &Add(const void *data, size_t len) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    for (size_t i = 0; i < len; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 0x100000001b3ULL;
+    }
+    return *this;
+  }
+
+  // Strings are hashed with their length, so that a sequence of strings
+  // is not ambiguous.
+  Fnv1aHash &Add(std::string_view str) {
+    AddValue(str.size());
+    return Add(str.data(), str.size());
+  }
+
+  // Add the memory representation of a value. Only to be used with types
+  // that don't have padding bytes with undefined content.
+  template <typename T>
+  Fnv1aHash &AddValue(const T &value) {
+    static_assert(std::is_standard_layout<T>::value, "Need plain data type");
+    return Add(&value, sizeof(value));
+  }
+
+  uint64_t value() const { return hash_; }
+
+ private:
+  uint64_t hash_ = 0xcbf29ce484222325ULL;
+};
+
+#endif  // _BEAGLEG_HASH_H_
@@ -18,52 +18,133 @@
  */
 #include "common/linebuf-reader.h"
 
-#include "common/string-util.h"
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static size_t RoundUpToPages(size_t size) {
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  if (size == 0) size = 1;
+  return (size + page_size - 1) / page_size * page_size;
+}
+
+// Map a memory file of "size" bytes twice, back-to-back. Returns nullptr
+// if not possible.
+static char *CreateMirroredBuffer(size_t size) {
+  const int fd = memfd_create("linebuf-reader", MFD_CLOEXEC);
+  if (fd < 0) return nullptr;
+  char *result = nullptr;
+  if (ftruncate(fd, size) == 0) {
+    // Reserve the address space for both halves, then map over it.
+    void *base = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1, 0);
+    if (base != MAP_FAILED) {
+      char *const first = (char *)base;
+      char *const second = first + size;
+      if (mmap(first, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+               fd, 0) != MAP_FAILED &&
+          mmap(second, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+               fd, 0) != MAP_FAILED) {
+        result = first;
+      } else {
+        munmap(base, 2 * size);
+      }
+    }
+  }
+  close(fd);
+  return result;
+}
 
 LinebufReader::LinebufReader(size_t buffer_size)
-    : len_(buffer_size),
-      buffer_start_(new char[len_]),
-      buffer_end_(buffer_start_ + len_),
-      content_start_(buffer_start_),
-      content_end_(buffer_start_),
-      cr_seen_(false) {}
-LinebufReader::~LinebufReader() { delete[] buffer_start_; }
+    : len_(RoundUpToPages(buffer_size)),
+      buffer_(CreateMirroredBuffer(len_)),
+      mirrored_(buffer_ != nullptr),
+      read_pos_(0),
+      write_pos_(0),
+      long_line_returned_(false),
+      cr_seen_(false) {
+  if (!mirrored_) buffer_ = new char[2 * len_];
+}
+
+LinebufReader::~LinebufReader() {
+  if (mirrored_) {
+    munmap(buffer_, 2 * len_);
+  } else {
+    delete[] buffer_;
+  }
+}
+
+// The buffer is full, but there is no complete line yet. Keep what we have
+// aside, so that we can continue reading.
+void LinebufReader::MoveToLongLine() {
+  long_line_.append(at(read_pos_), write_pos_ - read_pos_);
+  read_pos_ = write_pos_;
+}
 
 ssize_t LinebufReader::Update(const ReadFun &read_fun) {
-  if (content_start_ - buffer_start_ > (int)(len_ / 2)) {
-    const size_t copy_len = size();
-    memmove(buffer_start_, content_start_, copy_len);
-    content_start_ = buffer_start_;
-    content_end_ = buffer_start_ + copy_len;
+  if (long_line_returned_) {
+    long_line_.clear();
+    long_line_returned_ = false;
+  }
+  if (write_pos_ - read_pos_ == len_) MoveToLongLine();
+
+  char *const write_at = at(write_pos_);
+  const ssize_t r = read_fun(write_at, len_ - (write_pos_ - read_pos_));
+  if (r <= 0) return r;
+  write_pos_ += r;
+
+  // Without MMU help, we keep both halves the same by copying.
+  if (!mirrored_) {
+    const size_t offset = write_at - buffer_;
+    const size_t end_offset = offset + r;
+    if (end_offset > len_) {
+      memcpy(buffer_, buffer_ + len_, end_offset - len_);
+      memcpy(buffer_ + len_ + offset, write_at, len_ - offset);
+    } else {
+      memcpy(buffer_ + len_ + offset, write_at, r);
+    }
   }
-  const ssize_t r = read_fun(content_end_, buffer_end_ - content_end_);
-  // TODO(hzeller): if we get zero, we should consider this as end-of-stream
-  // and potentially regard the buffer as 'complete' even if it doesn't have a
-  // full line yet.
-  if (r >= 0) content_end_ += r;  // so, what if r < 0 ?
   return r;
 }
 
 const char *LinebufReader::IncompleteLine() {
-  *content_end_ = '\n';
-  content_end_++;
+  if (long_line_returned_) {
+    long_line_.clear();
+    long_line_returned_ = false;
+  }
+  if (write_pos_ - read_pos_ == len_) MoveToLongLine();
+  *at(write_pos_) = '\n';
+  if (!mirrored_) *(at(write_pos_) + len_) = '\n';
+  ++write_pos_;
   return ReadAndConsumeLine();
 }
 
 const char *LinebufReader::ReadAndConsumeLine() {
-  for (char *i = content_start_; i < content_end_; ++i) {
-    if (cr_seen_ && *i == '\n') {
-      cr_seen_ = false;
-      content_start_ = i + 1;
-      continue;
-    }
-    if (*i == '\r' || *i == '\n') {
-      cr_seen_ = (*i == '\r');
-      *i = '\0';
-      const char *line = content_start_;
-      content_start_ = i + 1;
-      return line;
-    }
+  if (long_line_returned_) {
+    long_line_.clear();
+    long_line_returned_ = false;
+  }
+  if (cr_seen_ && read_pos_ < write_pos_) {
+    // Second half of a \r\n line ending.
+    if (*at(read_pos_) == '\n') ++read_pos_;
+    cr_seen_ = false;
+  }
+
+  char *const start = at(read_pos_);
+  const size_t available = write_pos_ - read_pos_;
+  char *end = (char *)memchr(start, '\n', available);
+  char *const cr =
+    (char *)memchr(start, '\r', end ? end - start : available);
+  if (cr) end = cr;
+  if (end == nullptr) return nullptr;
+
+  cr_seen_ = (*end == '\r');
+  *end = '\0';
+  read_pos_ += end - start + 1;
+  if (!long_line_.empty()) {
+    long_line_.append(start);
+    long_line_returned_ = true;
+    return long_line_.c_str();
   }
-  return nullptr;
+  return start;
 }
@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #include <functional>
+#include <string>
 
 // Tokenizes a non-contiguous sequence of incoming data into lines.
 //
@@ -33,6 +34,12 @@
 // such as select() or poll() which yield a random amount of bytes from a
 // file-descriptor.
 //
+// Internally, this is a ring buffer that is mapped twice back-to-back into
+// memory, so that every line is contiguous in memory even if it wraps
+// around the end of the buffer. So data is never moved around, and lines
+// are found with memchr(). Lines longer than the buffer are assembled in a
+// separate, growing, buffer.
+//
 // Usage:
 // void NewDataReady() {
 //   reader.Update(/* with new data, see method signatures */);
@@ -50,11 +57,14 @@ class LinebufReader {
   // and a negative number to indicate error.
   typedef std::function<ssize_t(char *buf, size_t size)> ReadFun;
 
-  // The "buffer_size" determines the longest line we expect at maximum.
-  // TODO(hzeller): right now, we don't gracefully deal with overlong lines.
+  // The "buffer_size" is the maximum number of bytes read at once; it is
+  // rounded up to a multiple of the page size. Lines can be longer.
   explicit LinebufReader(size_t buffer_size = 16384);
   ~LinebufReader();
 
+  LinebufReader(const LinebufReader &) = delete;
+  LinebufReader &operator=(const LinebufReader &) = delete;
+
   // Update content. It will be calling the ReadFun exactly once and updates
   // its internal buffer.
   // After this, you may call ReadLine() to extract as many lines as had
@@ -83,24 +93,36 @@ class LinebufReader {
 
   // Get the current incomplete line. This is useful to receive the final
   // data when finishing in case of a missing newline.
-  // TODO(hzeller): maybe a function to get the remaining buffer when we
-  // are closing the connection ? There might be some incomplete line in there.
   const char *IncompleteLine();
 
   void Flush() {
-    content_start_ = buffer_start_;
-    content_end_ = buffer_start_;
+    read_pos_ = write_pos_;
+    long_line_.clear();
+    long_line_returned_ = false;
   }
 
   // Currently stored in buffer.
-  size_t size() const { return content_end_ - content_start_; }
+  size_t size() const {
+    const size_t long_line_size = long_line_returned_ ? 0 : long_line_.size();
+    return write_pos_ - read_pos_ + long_line_size;
+  }
 
  private:
+  char *at(size_t pos) const { return buffer_ + pos % len_; }
+  void MoveToLongLine();
+
   const size_t len_;
-  char *const buffer_start_;
-  const char *const buffer_end_;
-  char *content_start_;
-  char *content_end_;
+  char *buffer_;   // 2 * len_ bytes; the second half mirrors the first.
+  bool mirrored_;  // Mirrored by the MMU, otherwise we copy.
+
+  // Positions of the data in the stream; the buffer holds the bytes
+  // [read_pos_, write_pos_).
+  size_t read_pos_;
+  size_t write_pos_;
+
+  // Beginning of a line that didn't fit into the buffer.
+  std::string long_line_;
+  bool long_line_returned_;
 
   bool cr_seen_;
 };
@@ -0,0 +1,145 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the LinebufReader with the previous implementation, that moved
+// partial lines to the front of its buffer and scanned byte by byte.
+//   make linebuf-reader_benchmark && ./linebuf-reader_benchmark [<MiB>]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+
+#include "common/linebuf-reader.h"
+
+namespace {
+class PreviousLinebufReader {
+ public:
+  explicit PreviousLinebufReader(size_t buffer_size = 16384)
+      : len_(buffer_size),
+        buffer_start_(new char[len_]),
+        buffer_end_(buffer_start_ + len_),
+        content_start_(buffer_start_),
+        content_end_(buffer_start_) {}
+  ~PreviousLinebufReader() { delete[] buffer_start_; }
+
+  ssize_t Update(const LinebufReader::ReadFun &read_fun) {
+    if (content_start_ - buffer_start_ > (int)(len_ / 2)) {
+      const size_t copy_len = content_end_ - content_start_;
+      memmove(buffer_start_, content_start_, copy_len);
+      content_start_ = buffer_start_;
+      content_end_ = buffer_start_ + copy_len;
+    }
+    const ssize_t r = read_fun(content_end_, buffer_end_ - content_end_);
+    if (r >= 0) content_end_ += r;
+    return r;
+  }
+
+  const char *ReadAndConsumeLine() {
+    for (char *i = content_start_; i < content_end_; ++i) {
+      if (cr_seen_ && *i == '\n') {
+        cr_seen_ = false;
+        content_start_ = i + 1;
+        continue;
+      }
+      if (*i == '\r' || *i == '\n') {
+        cr_seen_ = (*i == '\r');
+        *i = '\0';
+        const char *line = content_start_;
+        content_start_ = i + 1;
+        return line;
+      }
+    }
+    return nullptr;
+  }
+
+ private:
+  const size_t len_;
+  char *const buffer_start_;
+  const char *const buffer_end_;
+  char *content_start_;
+  char *content_end_;
+  bool cr_seen_ = false;
+};
+}  // namespace
+
+static double now_seconds() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Read all of "content" in chunks of "chunk_size" like from a socket.
+// Returns number of lines seen.
+template <class Reader>
+static size_t ReadAllLines(const std::string &content, size_t chunk_size,
+                           size_t *checksum) {
+  Reader reader;
+  size_t pos = 0;
+  size_t lines = 0;
+  auto read_fun = [&](char *buf, size_t size) {
+    const size_t len = std::min(std::min(size, chunk_size),
+                                content.size() - pos);
+    memcpy(buf, content.data() + pos, len);
+    pos += len;
+    return (ssize_t)len;
+  };
+  while (reader.Update(read_fun) > 0) {
+    const char *line;
+    while ((line = reader.ReadAndConsumeLine()) != nullptr) {
+      *checksum += line[0];
+      ++lines;
+    }
+  }
+  return lines;
+}
+
+template <class Reader>
+static void RunBenchmark(const char *name, const std::string &content,
+                         size_t chunk_size) {
+  size_t checksum = 0;
+  const double start = now_seconds();
+  const size_t lines = ReadAllLines<Reader>(content, chunk_size, &checksum);
+  const double duration = now_seconds() - start;
+  printf("%-10s chunk %5zu: %9zu lines %8.3fs %8.1f MiB/s (checksum %zu)\n",
+         name, chunk_size, lines, duration,
+         content.size() / duration / (1 << 20), checksum);
+}
+
+int main(int argc, char *argv[]) {
+  const int mib = argc > 1 ? atoi(argv[1]) : 64;
+  std::string content;
+  char line[128];
+  for (int i = 0; content.size() < (size_t)mib << 20; ++i) {
+    snprintf(line, sizeof(line), "G1 X%.3f Y%.3f Z%.3f E%.5f F%d\n",
+             (i % 2000) * 0.1, (i % 3000) * 0.1, (i % 100) * 0.2, i * 0.01,
+             1200 + i % 600);
+    content.append(line);
+  }
+  printf("%d MiB of G-code\n", mib);
+
+  for (size_t chunk_size : {512, 4096, 16384}) {
+    RunBenchmark<PreviousLinebufReader>("previous", content, chunk_size);
+    RunBenchmark<LinebufReader>("current", content, chunk_size);
+  }
+  return 0;
+}
@@ -21,8 +21,10 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 
 // Raw lines that we use as samples
 constexpr int kSampleLineCount = 4;
@@ -137,9 +139,70 @@ INSTANTIATE_TEST_SUITE_P(PortableEndLineTests, LinebufReaderTest,
                          ::testing::Values("\n", "\r", "\r\n"));
 #endif
 
-// TODO(hzeller): more testing
-//   - Implementation of a more graceful handling if our buffer is too small
-//     to hold a full line.
+// Reads from a string in chunks of the given size.
+static LinebufReader::ReadFun StringReader(const std::string &content,
+                                           size_t chunk_size, size_t *pos) {
+  return [&content, chunk_size, pos](char *buf, size_t size) {
+    const size_t len =
+      std::min(std::min(size, chunk_size), content.size() - *pos);
+    memcpy(buf, content.data() + *pos, len);
+    *pos += len;
+    return (ssize_t)len;
+  };
+}
+
+TEST(LinebufReader, LinesWrappingAroundTheBuffer) {
+  // Line lengths not aligned with the buffer size, so that lines wrap
+  // around at all kinds of positions.
+  std::string content;
+  std::vector<std::string> expected;
+  for (int i = 0; i < 5000; ++i) {
+    expected.push_back(std::string(i % 97, 'a' + i % 26));
+    content.append(expected.back()).append(i % 3 == 0 ? "\r\n" : "\n");
+  }
+
+  for (size_t chunk_size : {1, 7, 100, 4096}) {
+    LinebufReader reader(4096);
+    size_t pos = 0;
+    size_t line_no = 0;
+    const LinebufReader::ReadFun read_fun =
+      StringReader(content, chunk_size, &pos);
+    while (pos < content.size()) {
+      ASSERT_GT(reader.Update(read_fun), 0);
+      const char *line;
+      while ((line = reader.ReadAndConsumeLine()) != nullptr) {
+        ASSERT_LT(line_no, expected.size());
+        ASSERT_EQ(expected[line_no], line) << "Line " << line_no;
+        ++line_no;
+      }
+    }
+    EXPECT_EQ(expected.size(), line_no) << "Chunk size " << chunk_size;
+    EXPECT_EQ(0u, reader.size());
+  }
+}
+
+TEST(LinebufReader, LinesLongerThanBuffer) {
+  const std::string long_line(20000, 'x');
+  const std::string content = "short\n" + long_line + "\nend\n" + long_line;
+  LinebufReader reader(4096);
+  size_t pos = 0;
+  const LinebufReader::ReadFun read_fun = StringReader(content, 1000, &pos);
+  std::vector<std::string> lines;
+  while (reader.Update(read_fun) > 0) {
+    const char *line;
+    while ((line = reader.ReadAndConsumeLine()) != nullptr) {
+      lines.push_back(line);
+    }
+  }
+  lines.push_back(reader.IncompleteLine());  // The last one without newline.
+  ASSERT_EQ(4u, lines.size());
+  EXPECT_EQ("short", lines[0]);
+  EXPECT_EQ(long_line, lines[1]);
+  EXPECT_EQ("end", lines[2]);
+  EXPECT_EQ(long_line, lines[3]);
+  EXPECT_EQ(0u, reader.size());
+}
+
 int main(int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
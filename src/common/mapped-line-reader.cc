@@ -0,0 +1,72 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "common/mapped-line-reader.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedLineReader::~MappedLineReader() { Unmap(); }
+
+void MappedLineReader::Unmap() {
+  if (mapping_) munmap(mapping_, mapping_size_);
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+  start_ = pos_ = end_ = nullptr;
+}
+
+bool MappedLineReader::Map(int fd, off_t offset) {
+  Unmap();
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) return false;
+  if (offset < 0 || offset > st.st_size) return false;
+  if (st.st_size == 0) return true;  // Nothing to map, but valid.
+
+  mapping_ = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapping_ == MAP_FAILED) {
+    mapping_ = nullptr;
+    return false;
+  }
+  mapping_size_ = st.st_size;
+
+  // We read the file front to back exactly once. Let the kernel know, so
+  // that it reads ahead a larger window and can drop pages behind us.
+  posix_fadvise(fd, offset, 0, POSIX_FADV_SEQUENTIAL);
+  madvise(mapping_, mapping_size_, MADV_SEQUENTIAL);
+
+  start_ = (const char *)mapping_;
+  pos_ = start_ + offset;
+  end_ = start_ + mapping_size_;
+  return true;
+}
+
+bool MappedLineReader::ReadLine(std::string_view *line) {
+  if (pos_ >= end_) return false;
+  const char *newline = (const char *)memchr(pos_, '\n', end_ - pos_);
+  const char *line_end = newline ? newline : end_;
+  const char *const cr = (const char *)memchr(pos_, '\r', line_end - pos_);
+  if (cr) line_end = cr;  // Old Mac line ending, or first half of DOS one.
+  const char *next = line_end < end_ ? line_end + 1 : end_;
+  if (cr && next < end_ && *next == '\n') ++next;
+  *line = std::string_view(pos_, line_end - pos_);
+  pos_ = next;
+  return true;
+}
@@ -0,0 +1,81 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_MAPPED_LINE_READER_H
+#define _BEAGLEG_MAPPED_LINE_READER_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <string_view>
+
+// Reads lines of a regular file that is mapped into memory.
+//
+// Unlike reading with read(2) or stdio, the lines are not copied into
+// a buffer, but are handed out as std::string_view directly pointing into
+// the mapped file. The kernel is advised that the file is read
+// sequentially, so that it reads ahead aggressively; useful for large
+// files on slow storage such as SD cards.
+//
+// Usage:
+//   MappedLineReader reader;
+//   if (reader.Map(fd)) {
+//     std::string_view line;
+//     while (reader.ReadLine(&line)) {
+//        // do something with line
+//     }
+//   }
+class MappedLineReader {
+ public:
+  MappedLineReader() {}
+  ~MappedLineReader();
+
+  MappedLineReader(const MappedLineReader &) = delete;
+  MappedLineReader &operator=(const MappedLineReader &) = delete;
+
+  // Map the file "fd", starting at byte "offset". Only works for regular
+  // files, returns false for anything else, such as pipes or sockets, or
+  // if mapping failed. The file descriptor is not needed after this
+  // call and can be closed.
+  bool Map(int fd, off_t offset = 0);
+
+  // Get the next line without the newline character(s). Lines end with
+  // "\n", "\r\n" or a lone "\r", as in LinebufReader. Returns false at the
+  // end of the file. The last line does not need to be terminated with a
+  // newline.
+  // The line is valid as long as this reader exists.
+  bool ReadLine(std::string_view *line);
+
+  // Returns true if all lines have been read.
+  bool at_end() const { return pos_ >= end_; }
+
+  // Number of bytes already read.
+  size_t consumed() const { return pos_ - start_; }
+
+  // Release the mapping. Lines handed out before are not valid anymore.
+  void Unmap();
+
+ private:
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  const char *start_ = nullptr;
+  const char *pos_ = nullptr;
+  const char *end_ = nullptr;
+};
+
+#endif  // _BEAGLEG_MAPPED_LINE_READER_H
@@ -0,0 +1,120 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common/mapped-line-reader.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+// Creates a temporary file with the given content and returns an
+// open file descriptor.
+static int TempFileWithContent(const std::string &content) {
+  char filename[] = "/tmp/mapped-line-reader-test.XXXXXX";
+  const int fd = mkstemp(filename);
+  EXPECT_GE(fd, 0);
+  unlink(filename);
+  EXPECT_EQ((ssize_t)content.size(), write(fd, content.data(), content.size()));
+  return fd;
+}
+
+TEST(MappedLineReader, ReadLinesWithDifferentLineEndings) {
+  const int fd = TempFileWithContent("foo\nbar\r\n\nlast-without-newline");
+  MappedLineReader reader;
+  ASSERT_TRUE(reader.Map(fd));
+  close(fd);  // Not needed anymore.
+
+  std::string_view line;
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("foo", line);
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("bar", line);
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("", line);
+  EXPECT_FALSE(reader.at_end());
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("last-without-newline", line);
+  EXPECT_TRUE(reader.at_end());
+  EXPECT_FALSE(reader.ReadLine(&line));
+}
+
+TEST(MappedLineReader, CarriageReturnOnlyLineEndings) {
+  const int fd = TempFileWithContent("G1 X1\rG1 X2\r\rG1 X3\r\nlast\r");
+  MappedLineReader reader;
+  ASSERT_TRUE(reader.Map(fd));
+  close(fd);
+
+  std::string_view line;
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("G1 X1", line);
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("G1 X2", line);
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("", line);
+  EXPECT_EQ(13u, reader.consumed());
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("G1 X3", line);
+  EXPECT_EQ(20u, reader.consumed());  // Both of "\r\n" are consumed.
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("last", line);
+  EXPECT_TRUE(reader.at_end());
+  EXPECT_FALSE(reader.ReadLine(&line));
+}
+
+TEST(MappedLineReader, StartAtOffset) {
+  const int fd = TempFileWithContent("skipped\nfirst\nsecond\n");
+  MappedLineReader reader;
+  ASSERT_TRUE(reader.Map(fd, 8));
+  close(fd);
+
+  std::string_view line;
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("first", line);
+  ASSERT_TRUE(reader.ReadLine(&line));
+  EXPECT_EQ("second", line);
+  EXPECT_EQ(21u, reader.consumed());
+  EXPECT_FALSE(reader.ReadLine(&line));
+}
+
+TEST(MappedLineReader, EmptyFile) {
+  const int fd = TempFileWithContent("");
+  MappedLineReader reader;
+  ASSERT_TRUE(reader.Map(fd));
+  close(fd);
+  std::string_view line;
+  EXPECT_TRUE(reader.at_end());
+  EXPECT_FALSE(reader.ReadLine(&line));
+}
+
+TEST(MappedLineReader, OnlyRegularFilesAreMapped) {
+  int pipe_fd[2];
+  ASSERT_EQ(0, pipe(pipe_fd));
+  MappedLineReader reader;
+  EXPECT_FALSE(reader.Map(pipe_fd[0]));
+  close(pipe_fd[0]);
+  close(pipe_fd[1]);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
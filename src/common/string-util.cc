@@ -46,6 +46,16 @@ bool HasPrefix(std::string_view s, std::string_view prefix) {
   return strncmp(s.data(), prefix.data(), prefix.length()) == 0;
 }
 
+std::string HiddenSidecarFile(std::string_view filename,
+                              std::string_view suffix) {
+  const size_t slash = filename.find_last_of('/');
+  const size_t base = (slash == std::string_view::npos) ? 0 : slash + 1;
+  std::string result(filename.substr(0, base));
+  if (base == filename.size() || filename[base] != '.') result.append(".");
+  result.append(filename.substr(base)).append(suffix);
+  return result;
+}
+
 static inline bool contains(std::string_view str, char c) {
   return str.find_first_of(c) != std::string_view::npos;
 }
@@ -162,6 +172,34 @@ int64_t ParseInt64(std::string_view s, int64_t fallback) {
   return convert_strto64(s, &result) ? result : fallback;
 }
 
+static int base64_value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+bool DecodeBase64(std::string_view in, std::string *out) {
+  out->clear();
+  while (!in.empty() && in.back() == '=') in.remove_suffix(1);
+  out->reserve(in.size() * 3 / 4);
+  uint32_t bits = 0;
+  int bit_count = 0;
+  for (const char c : in) {
+    const int value = base64_value(c);
+    if (value < 0) return false;
+    bits = (bits << 6) | value;
+    bit_count += 6;
+    if (bit_count >= 8) {
+      bit_count -= 8;
+      out->push_back((char)((bits >> bit_count) & 0xff));
+    }
+  }
+  return true;
+}
+
 static void vAppendf(std::string *str, const char *format, va_list ap) {
   const size_t orig_len = str->length();
   const size_t space = 1024;  // there should be better ways to do this...
@@ -43,6 +43,12 @@ std::string ToLower(std::string_view in);
 // Test if given std::string_view is prefix of the other.
 bool HasPrefix(std::string_view s, std::string_view prefix);
 
+// Name of a hidden file with "suffix" next to "filename", e.g.
+// "dir/.part.gcode.index" for "dir/part.gcode" and ".index". Directories
+// scanning for jobs skip such files.
+std::string HiddenSidecarFile(std::string_view filename,
+                              std::string_view suffix);
+
 // Formatted printing into a string.
 std::string StringPrintf(const char *format, ...) PRINTF_FMT_CHECK(1, 2);
 
@@ -66,5 +72,9 @@ const char *convert_strtod(std::string_view s, double *result);
 // Parse integer. On success, return parsed number, fallback otherwise.
 int64_t ParseInt64(std::string_view s, int64_t fallback);
 
+// Decode base64 (RFC 4648, with optional '=' padding) into "out".
+// Returns false if the input contains characters outside the alphabet.
+bool DecodeBase64(std::string_view in, std::string *out);
+
 #undef PRINTF_FMT_CHECK
 #endif  // _BEAGLEG_STRING_UTIL_H
@@ -36,6 +36,13 @@ TEST(StringUtilTest, HasPrefix) {
   EXPECT_FALSE(HasPrefix("hello world", "hellO"));
 }
 
+TEST(StringUtilTest, HiddenSidecarFile) {
+  EXPECT_EQ(".part.gcode.idx", HiddenSidecarFile("part.gcode", ".idx"));
+  EXPECT_EQ("/spool/.part.gcode.idx",
+            HiddenSidecarFile("/spool/part.gcode", ".idx"));
+  EXPECT_EQ("/spool/.part.idx", HiddenSidecarFile("/spool/.part", ".idx"));
+}
+
 TEST(StringUtilTest, SplitString) {
   std::vector<std::string_view> result = SplitString("foo", ",");
   EXPECT_EQ(1, (int)result.size());
@@ -126,6 +133,21 @@ TEST(StringUtilTest, ParseDouble) {
   EXPECT_EQ(remain_string, expected_remain.data());  // pointers must match.
 }
 
+TEST(StringUtilTest, DecodeBase64) {
+  std::string out;
+  EXPECT_TRUE(DecodeBase64("", &out));
+  EXPECT_EQ("", out);
+  EXPECT_TRUE(DecodeBase64("TWFu", &out));
+  EXPECT_EQ("Man", out);
+  EXPECT_TRUE(DecodeBase64("TWE=", &out));
+  EXPECT_EQ("Ma", out);
+  EXPECT_TRUE(DecodeBase64("TQ", &out));  // Padding is optional.
+  EXPECT_EQ("M", out);
+  EXPECT_TRUE(DecodeBase64("AP8=", &out));
+  EXPECT_EQ(std::string("\x00\xff", 2), out);
+  EXPECT_FALSE(DecodeBase64("TW*u", &out));
+}
+
 int main(int argc, char *argv[]) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
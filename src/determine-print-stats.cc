@@ -58,10 +58,8 @@ class StatsCollectingEventDelegator : public GCodeParser::EventReceiver {
   }
 
   void dwell(float value) final {
-    stats_->total_time_seconds += value / 1000.0f;
-    // We call the original dell() with zero time as we don't want to spend
-    // _real_ time.
-    delegatee_->dwell(0);
+    // The dwell time is accounted for in StatsSegmentQueue::Dwell()
+    delegatee_->dwell(value);
   }
 
   bool rapid_move(float feed, const AxesRegister &axes) final {
@@ -106,6 +104,7 @@ class StatsSegmentQueue : public SegmentQueue {
       int steps = abs(param.steps[i]);
       if (steps > max_steps) max_steps = steps;
     }
+    if (max_steps == 0) return true;  // Only setting aux bits.
 
     // max_steps = a/2*t^2 + v0*t; a = (v1-v0)/t
     print_stats_->total_time_seconds += 2 * max_steps / (param.v0 + param.v1);
@@ -113,8 +112,13 @@ class StatsSegmentQueue : public SegmentQueue {
     return true;
   }
 
+  bool Dwell(float seconds) final {
+    print_stats_->total_time_seconds += seconds;
+    return true;
+  }
   void MotorEnable(bool on) final {}
   void WaitQueueEmpty() final {}
+  float GetQueuedSeconds() final { return 0; }
   bool GetPhysicalStatus(PhysicalStatus *status) final { return false; }
   void SetExternalPosition(int axis, int pos) final {}
 
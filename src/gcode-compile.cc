@@ -0,0 +1,127 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compile a G-code file into the binary format that machine-control can
+// replay without parsing.
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "common/logging.h"
+#include "config-parser.h"
+#include "gcode-machine-control.h"
+#include "gcode-parser/compiled-gcode.h"
+#include "gcode-parser/gcode-parser.h"
+
+static int usage(const char *prog) {
+  fprintf(stderr,
+          "Usage: %s [options] -o <output-file> <gcode-file>\n"
+          "Options:\n"
+          "\t-c <config>       : Machine config. Needed to determine the "
+          "home position.\n"
+          "\t--param <file>    : Parameter file to read.\n"
+          "\t-o <output-file>  : Compiled output.\n"
+          "Use filename '-' for stdin.\n",
+          prog);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  enum LongOptionsOnly {
+    OPT_PARAM_FILE = 1000,
+  };
+  static struct option long_options[] = {
+    { "param", required_argument, NULL, OPT_PARAM_FILE },
+    { 0,       0,                 0,    0              },
+  };
+
+  const char *config_file = NULL;
+  const char *output_file = NULL;
+  std::string paramfile;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "c:o:", long_options, NULL)) != -1) {
+    switch (opt) {
+    case 'c': config_file = optarg; break;
+    case 'o': output_file = optarg; break;
+    case OPT_PARAM_FILE: paramfile = optarg; break;
+    default: return usage(argv[0]);
+    }
+  }
+
+  if (optind != argc - 1 || !output_file) return usage(argv[0]);
+  const char *gcode_file = argv[optind];
+
+  Log_init("/dev/stderr");
+
+  GCodeParser::Config parser_cfg(paramfile);
+  GCodeParser::Config::ParamMap parameters;
+  parser_cfg.parameters = &parameters;
+  parser_cfg.LoadParams();
+
+  if (config_file) {
+    ConfigParser config_parser;
+    if (!config_parser.SetContentFromFile(config_file)) {
+      fprintf(stderr, "Cannot read config file '%s'\n", config_file);
+      return 1;
+    }
+    MachineControlConfig machine_config;
+    if (!machine_config.ConfigureFromFile(config_parser)) {
+      fprintf(stderr, "Exiting. Parse error in configuration file '%s'\n",
+              config_file);
+      return 1;
+    }
+    // Same as GCodeMachineControl::GetHomePos()
+    for (const GCodeParserAxis axis : AllAxes()) {
+      const HardwareMapping::AxisTrigger trigger =
+        machine_config.homing_trigger[axis];
+      parser_cfg.machine_origin[axis] = (trigger & HardwareMapping::TRIGGER_MAX)
+                                          ? machine_config.move_range_mm[axis]
+                                          : 0;
+    }
+  }
+
+  FILE *in = strcmp(gcode_file, "-") == 0 ? stdin : fopen(gcode_file, "r");
+  if (!in) {
+    perror(gcode_file);
+    return 1;
+  }
+  FILE *out = fopen(output_file, "wb");
+  if (!out) {
+    perror(output_file);
+    return 1;
+  }
+
+  GCodeCompiler compiler(out, parser_cfg.machine_origin);
+  GCodeParser parser(parser_cfg, &compiler);
+  parser.ReadFile(in, stderr);
+  const bool write_error = ferror(out);
+  fclose(out);
+
+  if (parser.error_count() || compiler.error_count() || write_error) {
+    fprintf(stderr, "Compilation of %s failed.\n", gcode_file);
+    unlink(output_file);
+    return 1;
+  }
+  return 0;
+}
@@ -35,7 +35,13 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "adc.h"
+#include "bed-mesh.h"
 #include "common/container.h"
 #include "common/logging.h"
 #include "common/string-util.h"
@@ -54,6 +60,49 @@
   "PROTOCOL_VERSION:0.1 FIRMWARE_NAME:BeagleG " \
   "CAPE:" CAPE_NAME " FIRMWARE_URL:http%3A//github.com/hzeller/beagleg"
 
+// Duty cycle a PWM output is started with before the motion queue sets the
+// actual value; the PWM timer clamps it to its minimal duty cycle.
+static constexpr float kPWMStartDuty = 1e-6;
+
+// Spindle outputs that change in sequence with the moves, so that the path
+// doesn't need to be halted and waited for when switching the spindle.
+namespace {
+class MotionSyncedSpindleOutputs final : public SpindleOutputs {
+ public:
+  MotionSyncedSpindleOutputs(Planner *planner, SegmentQueue *motor_ops,
+                             HardwareMapping *hardware_mapping)
+      : planner_(planner),
+        motor_ops_(motor_ops),
+        hardware_mapping_(hardware_mapping) {}
+
+  void SetAux(HardwareMapping::NamedOutput out, bool is_on) final {
+    hardware_mapping_->UpdateAuxBitmap(out, is_on);
+  }
+  void SetSpeedPWM(float duty) final {
+    // The motion queue can only change the duty cycle of a running timer.
+    if (duty > 0) {
+      hardware_mapping_->StartPWMOutput(
+        HardwareMapping::NamedOutput::SPINDLE_SPEED, kPWMStartDuty);
+    }
+    planner_->SetSpindlePWM(duty);
+  }
+  void Delay(int ms) final {
+    if (ms <= 0) return;
+    planner_->BringPathToHalt();
+    motor_ops_->Dwell(ms / 1000.0f);
+  }
+  void Sync() final {
+    planner_->BringPathToHalt();
+    motor_ops_->WaitQueueEmpty();
+  }
+
+ private:
+  Planner *const planner_;
+  SegmentQueue *const motor_ops_;
+  HardwareMapping *const hardware_mapping_;
+};
+}  // namespace
+
 // The GCode control implementation. Essentially we are a state machine
 // driven by the events we get from the gcode parsing.
 // We implement the event receiver interface directly.
@@ -67,7 +116,10 @@ class GCodeMachineControl::Impl final : public GCodeParser::EventReceiver {
   // object.
   bool Init();
 
-  ~Impl() final { delete planner_; }
+  ~Impl() final {
+    if (spindle_) spindle_->SetOutputs(nullptr);
+    delete planner_;
+  }
 
   const MachineControlConfig &config() const { return cfg_; }
   void set_msg_stream(FILE *msg) { msg_stream_ = msg; }
@@ -75,9 +127,12 @@ class GCodeMachineControl::Impl final : public GCodeParser::EventReceiver {
   HomingState GetHomeStatus();
   bool GetMotorsEnabled();
   void GetCurrentPosition(AxesRegister *pos);
+  bool CheckMotionAllowed();
   bool SetLookahead(int size) { return planner_->SetLookahead(size); }
   int Lookahead() const { return planner_->Lookahead(); }
   int GetMaxLookahead() const { return planner_->GetMaxLookahead(); }
+  int GetPlannerQueueDepth() const { return planner_->PendingSegments(); }
+  uint16_t GetAuxBits() { return hardware_mapping_->GetAuxBits(); }
 
   // -- GCodeParser::Events interface implementation --
   void gcode_start(GCodeParser *parser) final;
@@ -126,6 +181,10 @@ class GCodeMachineControl::Impl final : public GCodeParser::EventReceiver {
   void home_axis(enum GCodeParserAxis axis);
   void set_output_flags(HardwareMapping::NamedOutput out, bool is_on);
   const char *handle_set_lookahead(const char *);
+  const char *handle_raster_line(const char *);
+  bool raster_move(float feedrate, const AxesRegister &absolute_pos);
+  const char *handle_probe_bed_mesh(const char *);
+  const char *handle_bed_mesh_enable(const char *);
   void handle_M105();
   // Parse GCode spindle M3/M4 block.
   const char *set_spindle_on(bool is_ccw, const char *);
@@ -141,6 +200,7 @@ class GCodeMachineControl::Impl final : public GCodeParser::EventReceiver {
   Spindle *const spindle_;
 
   Planner *planner_ = nullptr;
+  std::unique_ptr<SpindleOutputs> spindle_outputs_;
   FILE *msg_stream_ = nullptr;
   GCodeParser *parser_ = nullptr;
 
@@ -156,12 +216,26 @@ class GCodeMachineControl::Impl final : public GCodeParser::EventReceiver {
   time_t next_auto_disable_motor_;
   time_t next_auto_disable_fan_;
   bool pause_enabled_;  // Enabled via M120, disabled via M121
+  int spindle_rpm_ = -1;  // Last M3/M4 speed; -1 if the spindle is off.
+  bool spindle_ccw_ = false;
+  std::string raster_pixels_;  // M649 pixel powers for the next G1 move.
+  std::unique_ptr<BedMesh> bed_mesh_;  // Last G29 probing result.
 
   GCodeMachineControl::HomingState homing_state_;
 };
 
 static inline int round2int(float x) { return (int)roundf(x); }
 
+// Laser power of unlit raster pixels. Needs to be non-zero to still update the
+// PWM with the movement; the PWM timer clamps it to its minimal duty cycle.
+static constexpr float kRasterOffPower = 1e-6;
+
+// Limit of G29 probe points, so that a typo doesn't keep us probing for hours.
+static constexpr int kMaxBedMeshPoints = 400;
+
+// Default distance G29 lifts the probe to travel between probe points (mm).
+static constexpr float kBedMeshLiftMM = 5;
+
 GCodeMachineControl::Impl::Impl(const MachineControlConfig &config,
                                 SegmentQueue *motor_ops,
                                 HardwareMapping *hardware_mapping,
@@ -251,6 +325,24 @@ bool GCodeMachineControl::Impl::Init() {
     }
   }
 
+  if (cfg_.kinematics == Kinematics::Type::DELTA) {
+    if (cfg_.delta_radius <= 0 ||
+        cfg_.delta_arm_length <= cfg_.delta_radius) {
+      Log_error("Delta kinematics need a delta-radius and a longer "
+                "delta-arm-length.");
+      ++error_count;
+    }
+    if (cfg_.delta_segments_per_second <= 0) {
+      Log_error("delta-segments-per-second needs to be positive.");
+      ++error_count;
+    }
+  }
+  if (cfg_.kinematics == Kinematics::Type::COREXY &&
+      cfg_.steps_per_mm[AXIS_X] != cfg_.steps_per_mm[AXIS_Y]) {
+    Log_error("CoreXY kinematics need the same steps-per-mm for X and Y.");
+    ++error_count;
+  }
+
   axis_clamped_ = 0;
   for (char c : cfg_.clamp_to_range) {
     const GCodeParserAxis clamped_axis = gcodep_letter2axis(c);
@@ -335,6 +427,11 @@ bool GCodeMachineControl::Impl::Init() {
   if (error_count) return false;
 
   planner_ = new Planner(&cfg_, hardware_mapping_, motor_ops_);
+  if (spindle_) {
+    spindle_outputs_.reset(new MotionSyncedSpindleOutputs(
+      planner_, motor_ops_, hardware_mapping_));
+    spindle_->SetOutputs(spindle_outputs_.get());
+  }
   return true;
 }
 
@@ -373,10 +470,15 @@ void GCodeMachineControl::Impl::inform_origin_offset(const AxesRegister &o,
 void GCodeMachineControl::Impl::set_fanspeed(float speed) {
   if (speed < 0.0 || speed > 255.0) return;
   float duty_cycle = speed / 255.0;
-  // The fan can be mapped to an aux and/or pwm signal
+  // The fan can be mapped to an aux and/or pwm signal; both are switched
+  // with the motion. The motion queue can only change the duty cycle of
+  // a running PWM timer, so switched off it stays at its minimal duty cycle.
   set_output_flags(HardwareMapping::NamedOutput::FAN, duty_cycle > 0.0);
-  hardware_mapping_->SetPWMOutput(HardwareMapping::NamedOutput::FAN,
-                                  duty_cycle);
+  if (duty_cycle > 0.0) {
+    hardware_mapping_->StartPWMOutput(HardwareMapping::NamedOutput::FAN,
+                                      kPWMStartDuty);
+  }
+  planner_->SetFanPWM(duty_cycle);
 }
 
 // number of checks to ensure the pause switch is inactive
@@ -417,7 +519,17 @@ bool GCodeMachineControl::Impl::in_estop() {
 }
 
 void GCodeMachineControl::Impl::set_estop(bool hard) {
-  set_spindle_off();
+  if (spindle_) {
+    // Immediately, regardless of queued motion.
+    spindle_->SetOutputs(nullptr);
+    spindle_->Off();
+    spindle_->SetOutputs(spindle_outputs_.get());
+  }
+  spindle_rpm_ = -1;
+  planner_->SetVelocityScaledPower(0);
+  planner_->SetSpindlePWM(0);
+  planner_->SetFanPWM(0);
+  raster_pixels_.clear();
   hardware_mapping_->AuxOutputsOff();
   set_output_flags(HardwareMapping::NamedOutput::ESTOP, true);
   motors_enable(false);
@@ -483,6 +595,193 @@ const char *GCodeMachineControl::Impl::handle_set_lookahead(
   return after_pair;
 }
 
+// M649 P<base64-data>: the following G1 is a raster scanline. The payload
+// is one byte per pixel with a power of 0..255 relative to the M3 laser power.
+const char *GCodeMachineControl::Impl::handle_raster_line(
+  const char *remaining) {
+  while (isspace(*remaining)) ++remaining;
+  if (toupper(*remaining) != 'P') {
+    mprintf("// ERROR: M649 expects P<base64 pixel data>\n");
+    return NULL;
+  }
+  const char *const data = ++remaining;
+  while (*remaining && !isspace(*remaining)) ++remaining;
+
+  if (!spindle_ || spindle_->VelocityScaledPower() <= 0) {
+    mprintf("// ERROR: M649 needs a laser switched on with M3\n");
+    return remaining;
+  }
+  if (!DecodeBase64(std::string_view(data, remaining - data),
+                    &raster_pixels_)) {
+    mprintf("// ERROR: M649 pixel data is not valid base64\n");
+    raster_pixels_.clear();
+  }
+  return remaining;
+}
+
+// Split the move to "absolute_pos" into equally spaced pixels. Neighboring
+// pixels of the same power are combined to a single segment; the planner
+// keeps the speed between them as they are all in the same direction.
+bool GCodeMachineControl::Impl::raster_move(float feedrate,
+                                            const AxesRegister &absolute_pos) {
+  AxesRegister start;
+  planner_->GetTargetPosition(&start);
+  bool moves = false;
+  for (const GCodeParserAxis a : AllAxes()) {
+    moves |= fabsf(absolute_pos[a] - start[a]) > 1e-6;
+  }
+  if (!moves) return true;  // Just a feedrate change; keep for the next move.
+
+  std::string pixels;
+  pixels.swap(raster_pixels_);
+  const float full_power = spindle_->VelocityScaledPower();
+  if (full_power <= 0) return planner_->Enqueue(absolute_pos, feedrate);
+
+  const size_t count = pixels.size();
+  bool ret = true;
+  for (size_t i = 0; i < count && ret;) {
+    const uint8_t value = pixels[i];
+    size_t run_end = i + 1;
+    while (run_end < count && (uint8_t)pixels[run_end] == value) ++run_end;
+
+    AxesRegister pos = absolute_pos;
+    if (run_end < count) {
+      const float fraction = 1.0f * run_end / count;
+      for (const GCodeParserAxis a : AllAxes()) {
+        pos[a] = start[a] + (absolute_pos[a] - start[a]) * fraction;
+      }
+    }
+    planner_->SetVelocityScaledPower(
+      std::max(full_power * value / 255, kRasterOffPower));
+    ret = planner_->Enqueue(pos, feedrate);
+    i = run_end;
+  }
+  planner_->SetVelocityScaledPower(full_power);
+  return ret;
+}
+
+// G29 [X<x> Y<y>] [I<x> J<y>] [P<columns> Q<rows>] [R<lift>]: probe the bed on
+// a grid from X/Y to I/J (machine coordinates; default: full XY range) and
+// compensate the following moves with the interpolated height relative to the
+// first probed point. Between the probe points, the probe travels lifted by R
+// (default: kBedMeshLiftMM) from the current Z; in the end, it returns to the
+// position it started from.
+const char *GCodeMachineControl::Impl::handle_probe_bed_mesh(
+  const char *remaining) {
+  float x_min = 0, y_min = 0;
+  float x_max = cfg_.move_range_mm[AXIS_X];
+  float y_max = cfg_.move_range_mm[AXIS_Y];
+  float lift = kBedMeshLiftMM;
+  int columns = 3, rows = 3;
+  const char *after_pair;
+  char letter;
+  float value;
+  for (;;) {
+    after_pair = parser_->ParsePair(remaining, &letter, &value, msg_stream_);
+    if (after_pair == NULL) break;
+    if (letter == 'X') x_min = value;
+    else if (letter == 'Y') y_min = value;
+    else if (letter == 'I') x_max = value;
+    else if (letter == 'J') y_max = value;
+    else if (letter == 'P') columns = round2int(value);
+    else if (letter == 'Q') rows = round2int(value);
+    else if (letter == 'R') lift = value;
+    else break;
+    remaining = after_pair;
+  }
+  if (columns < 2 || rows < 2 || columns * rows > kMaxBedMeshPoints ||
+      x_max <= x_min || y_max <= y_min) {
+    mprintf("// ERROR: G29 needs at least 2x2, at most %d points in a "
+            "non-empty area\n", kMaxBedMeshPoints);
+    return remaining;
+  }
+  if (lift < 0) {
+    mprintf("// ERROR: G29 lift R needs to be positive\n");
+    return remaining;
+  }
+  if (!move_allowed_homing_status() || !move_allowed_estop_status())
+    return remaining;
+  if (!hardware_mapping_->HasProbeSwitch(AXIS_Z)) {
+    mprintf("// ERROR: G29 needs a Z probe switch\n");
+    return remaining;
+  }
+
+  // Measure the bed as it is.
+  planner_->SetBedMesh(nullptr);
+  bed_mesh_.reset();
+
+  AxesRegister start;
+  planner_->GetTargetPosition(&start);
+  AxesRegister pos = start;
+
+  // Lift away from the bed, which is in the direction we probe in.
+  const int probe_dir =
+    cfg_.homing_trigger[AXIS_Z] == HardwareMapping::TRIGGER_MIN ? 1 : -1;
+  float clearance_z = start[AXIS_Z] - probe_dir * lift;
+  if (cfg_.move_range_mm[AXIS_Z] > 0) {
+    clearance_z =
+      std::clamp(clearance_z, 0.0f, cfg_.move_range_mm[AXIS_Z]);
+  }
+  pos[AXIS_Z] = clearance_z;
+  planner_->Enqueue(pos, g0_feedrate_mm_per_sec_);
+
+  std::vector<float> offsets(columns * rows);
+  for (int r = 0; r < rows; ++r) {
+    for (int i = 0; i < columns; ++i) {
+      const int c = (r % 2 == 0) ? i : columns - 1 - i;  // Zig-zag.
+      pos[AXIS_X] = x_min + (x_max - x_min) * c / (columns - 1);
+      pos[AXIS_Y] = y_min + (y_max - y_min) * r / (rows - 1);
+      pos[AXIS_Z] = clearance_z;
+      float probed_z;
+      if (!planner_->Enqueue(pos, g0_feedrate_mm_per_sec_) ||
+          !probe_axis(0, AXIS_Z, &probed_z)) {
+        mprintf("// ERROR: G29 probing failed\n");
+        return remaining;
+      }
+      offsets[r * columns + c] = probed_z;
+      planner_->Enqueue(pos, g0_feedrate_mm_per_sec_);
+    }
+  }
+
+  // Back to where we started, which is where the parser thinks we are.
+  pos[AXIS_X] = start[AXIS_X];
+  pos[AXIS_Y] = start[AXIS_Y];
+  planner_->Enqueue(pos, g0_feedrate_mm_per_sec_);
+  planner_->Enqueue(start, g0_feedrate_mm_per_sec_);
+
+  const float reference = offsets[0];
+  for (int r = rows - 1; r >= 0; --r) {
+    mprintf("// Bed mesh Y%.3f:", y_min + (y_max - y_min) * r / (rows - 1));
+    for (int c = 0; c < columns; ++c) {
+      offsets[r * columns + c] -= reference;
+      mprintf(" %7.3f", offsets[r * columns + c]);
+    }
+    mprintf("\n");
+  }
+  bed_mesh_.reset(
+    new BedMesh(x_min, y_min, x_max, y_max, columns, rows, offsets));
+  planner_->SetBedMesh(bed_mesh_.get());
+  return remaining;
+}
+
+// M420 S<0|1>: switch bed mesh compensation off or back on.
+const char *GCodeMachineControl::Impl::handle_bed_mesh_enable(
+  const char *remaining) {
+  char letter;
+  float value;
+  const char *after_pair =
+    parser_->ParsePair(remaining, &letter, &value, msg_stream_);
+  if (after_pair != NULL && letter == 'S') {
+    remaining = after_pair;
+    if (value > 0 && !bed_mesh_) {
+      mprintf("// ERROR: M420: no bed mesh; probe with G29 first\n");
+    } else {
+      planner_->SetBedMesh(value > 0 ? bed_mesh_.get() : nullptr);
+    }
+  }
+  return remaining;
+}
+
 void GCodeMachineControl::Impl::handle_M105() {
   mprintf("// ");
   for (int chan = 0; chan < 8; chan++) {
@@ -502,8 +801,6 @@ const char *GCodeMachineControl::Impl::set_spindle_on(bool is_ccw,
   char letter;
   float value;
 
-  // Ensure that the PRU queue is flushed before turning on the spindle.
-  planner_->BringPathToHalt();
   for (;;) {
     after_pair = parser_->ParsePair(remaining, &letter, &value, msg_stream_);
     if (after_pair == NULL)
@@ -514,19 +811,31 @@ const char *GCodeMachineControl::Impl::set_spindle_on(bool is_ccw,
       break;
     remaining = after_pair;
   }
-  if (spindle_rpm >= 0) spindle_->On(is_ccw, spindle_rpm);
+  if (spindle_rpm < 0) return remaining;
+  if (spindle_rpm == spindle_rpm_ && is_ccw == spindle_ccw_) {
+    return remaining;  // No change, no need to interrupt the path.
+  }
+  // The spindle outputs are switched in sequence with the motion; only
+  // spindle delays halt the path.
+  spindle_->On(is_ccw, spindle_rpm);
+  planner_->SetVelocityScaledPower(spindle_->VelocityScaledPower());
+  spindle_rpm_ = spindle_rpm;
+  spindle_ccw_ = is_ccw;
   return remaining;
 }
 
 void GCodeMachineControl::Impl::set_spindle_off() {
-  if (!spindle_) return;
-  // Ensure that the PRU queue is flushed before turning off the spindle.
-  planner_->BringPathToHalt();
+  if (!spindle_ || spindle_rpm_ < 0) return;
   spindle_->Off();
+  planner_->SetVelocityScaledPower(0);
+  spindle_rpm_ = -1;
 }
 
 const char *GCodeMachineControl::Impl::unprocessed(char letter, float value,
                                                    const char *remaining) {
+  if (letter == 'G' && (int)value == 29) {
+    return handle_probe_bed_mesh(remaining);
+  }
   return special_commands(letter, value, remaining);
 }
 
@@ -570,6 +879,12 @@ const char *GCodeMachineControl::Impl::special_commands(char letter,
   case 181:
     remaining = handle_set_lookahead(remaining);
     break;
+  case 420:
+    remaining = handle_bed_mesh_enable(remaining);
+    break;
+  case 649:
+    remaining = handle_raster_line(remaining);
+    break;
   default:
     mprintf("// BeagleG: didn't understand ('%c', %d, '%s')\n",
             letter, code, remaining);
@@ -672,6 +987,16 @@ GCodeMachineControl::HomingState GCodeMachineControl::Impl::GetHomeStatus() {
   return homing_state_;
 }
 
+bool GCodeMachineControl::Impl::CheckMotionAllowed() {
+  check_for_estop();
+  if (!move_allowed_estop_status()) return false;
+  if (pause_enabled_ && check_for_pause()) {
+    Log_debug("Pause input detected, waiting for Start");
+    wait_for_start();
+  }
+  return !check_for_estop();
+}
+
 bool GCodeMachineControl::Impl::GetMotorsEnabled() {
   return hardware_mapping_->MotorsEnabled();
 }
@@ -760,8 +1085,8 @@ void GCodeMachineControl::Impl::gcode_start(GCodeParser *parser) {
 }
 
 void GCodeMachineControl::Impl::gcode_finished(bool end_of_stream) {
-  planner_->BringPathToHalt();
   set_spindle_off();
+  planner_->BringPathToHalt();
   if (end_of_stream && cfg_.auto_motor_disable_seconds > 0)
     motors_enable(false);
 }
@@ -784,6 +1109,13 @@ bool GCodeMachineControl::Impl::move_allowed_estop_status() {
 
 bool GCodeMachineControl::Impl::move_allowed_within_machine_limits(
   const AxesRegister &axes) {
+  if (!planner_->IsReachable(axes)) {
+    mprintf(
+      "// ERROR outside machine limit: X%.1f Y%.1f is out of reach. "
+      "Ignoring move!\n",
+      axes[AXIS_X], axes[AXIS_Y]);
+    return false;
+  }
   if (!cfg_.range_check) return true;
 
   for (const GCodeParserAxis i : AllAxes()) {
@@ -872,7 +1204,10 @@ bool GCodeMachineControl::Impl::coordinated_move(
   }
 
   float feedrate = prog_speed_factor_ * current_feedrate_mm_per_sec_;
-  if (!planner_->Enqueue(absolute_pos, feedrate)) {
+  const bool enqueued = raster_pixels_.empty()
+                          ? planner_->Enqueue(absolute_pos, feedrate)
+                          : raster_move(feedrate, absolute_pos);
+  if (!enqueued) {
     if (check_for_estop()) return false;
   }
   return true;
@@ -897,18 +1232,17 @@ bool GCodeMachineControl::Impl::rapid_move(float feed,
 
 void GCodeMachineControl::Impl::dwell(float time_ms) {
   planner_->BringPathToHalt();
-  motor_ops_->WaitQueueEmpty();
-  if (hardware_mapping_->IsHardwareSimulated()) {
-    if (time_ms > 999.0) {
+  if (time_ms <= 0) {
+    // G4 P0 and M400: wait until all moves are finished.
+    motor_ops_->WaitQueueEmpty();
+  } else {
+    if (hardware_mapping_->IsHardwareSimulated() && time_ms > 999.0) {
       // Let some interactive user know that they can't expect dwell time here.
-      mprintf("// FYI: hardware simulated. All dwelling is immediate.\n",
-              time_ms);
+      mprintf("// FYI: hardware simulated. All dwelling is immediate.\n");
     }
-  } else {
-    // TODO: this needs to wait in the event multiplexer.
-    // Since we might need pretty high precision (see rpt2pnp), this can't
-    // just be quantized to 50ms.
-    usleep(static_cast<useconds_t>((time_ms * 1000)));
+    // The dwell is queued in sequence with the motion, so we can continue
+    // planning while the machine waits.
+    motor_ops_->Dwell(time_ms / 1000.0f);
   }
 
   if (!check_for_estop()) {
@@ -920,7 +1254,13 @@ void GCodeMachineControl::Impl::dwell(float time_ms) {
 }
 
 void GCodeMachineControl::Impl::input_idle(bool is_first) {
-  planner_->BringPathToHalt();
+  // The planner holds back the last segments until it knows how to continue.
+  // Only if the motion already queued is about to run out, we have to
+  // commit to decelerating to zero; input might continue before that.
+  if (cfg_.underrun_margin_ms <= 0 ||
+      motor_ops_->GetQueuedSeconds() * 1000 < cfg_.underrun_margin_ms) {
+    planner_->BringPathToHalt();
+  }
   if (cfg_.auto_motor_disable_seconds > 0) {
     if (is_first) {
       next_auto_disable_motor_ = time(NULL) + cfg_.auto_motor_disable_seconds;
@@ -936,6 +1276,7 @@ void GCodeMachineControl::Impl::input_idle(bool is_first) {
   }
   if (next_auto_disable_fan_ != -1 && time(NULL) >= next_auto_disable_fan_) {
     set_fanspeed(0);
+    planner_->BringPathToHalt();  // No more moves to send it along with.
     next_auto_disable_fan_ = -1;
   }
   check_for_estop();
@@ -962,9 +1303,30 @@ int GCodeMachineControl::Impl::move_to_endstop(
 
   const float kHomingMM = 0.5;                // TODO: make configurable?
   const float kBackoffMM = kHomingMM / 10.0;  // TODO: make configurable?
+  const float kMaxOvershootMM = 2.0;          // TODO: make configurable?
 
   int total_movement = 0;
   const int dir = trigger == HardwareMapping::TRIGGER_MIN ? -1 : 1;
+
+  // If the hardware watches the switch while moving, we seek it in one move
+  // as fast as we can while still being able to stop within the overshoot.
+  const float range = cfg_.move_range_mm[axis];
+  const float accel = cfg_.acceleration[axis];
+  if (range > 0 && accel > 0) {
+    const float seek_speed = std::min(cfg_.max_feedrate[axis],
+                                      sqrtf(2 * accel * kMaxOvershootMM));
+    int trigger_steps, moved_steps;
+    if (planner_->DirectDriveToSwitch(axis, dir * 1.5f * range,
+                                      std::min(seek_speed, feedrate), trigger,
+                                      &trigger_steps, &moved_steps)) {
+      total_movement += moved_steps;
+      if (trigger_steps < 0) {
+        mprintf("// BeagleG: Axis %c endstop did not trigger within range.\n",
+                gcodep_axis2letter(axis));
+      }
+    }
+  }
+
   float v0 = 0;
   float v1 = feedrate;
   while (!hardware_mapping_->TestAxisSwitch(axis, trigger)) {
@@ -1018,6 +1380,11 @@ void GCodeMachineControl::Impl::home_axis(enum GCodeParserAxis axis) {
 
   planner_->BringPathToHalt();
   move_to_endstop(axis, kHomingSpeed, trigger);
+  if (axis == AXIS_Z && cfg_.kinematics == Kinematics::Type::DELTA) {
+    // With all carriages at the same height, the effector is in the center.
+    planner_->SetExternalPosition(AXIS_X, cfg_.move_range_mm[AXIS_X] / 2);
+    planner_->SetExternalPosition(AXIS_Y, cfg_.move_range_mm[AXIS_Y] / 2);
+  }
   planner_->SetExternalPosition(axis, home_pos);
 }
 
@@ -1100,6 +1467,10 @@ GCodeMachineControl::HomingState GCodeMachineControl::GetHomeStatus() {
   return impl_->GetHomeStatus();
 }
 
+bool GCodeMachineControl::CheckMotionAllowed() {
+  return impl_->CheckMotionAllowed();
+}
+
 bool GCodeMachineControl::GetMotorsEnabled() {
   return impl_->GetMotorsEnabled();
 }
@@ -1108,6 +1479,12 @@ void GCodeMachineControl::GetCurrentPosition(AxesRegister *pos) {
   impl_->GetCurrentPosition(pos);
 }
 
+int GCodeMachineControl::GetPlannerQueueDepth() {
+  return impl_->GetPlannerQueueDepth();
+}
+
+uint16_t GCodeMachineControl::GetAuxBits() { return impl_->GetAuxBits(); }
+
 GCodeParser::EventReceiver *GCodeMachineControl::ParseEventReceiver() {
   return impl_;
 }
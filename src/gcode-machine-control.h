@@ -24,6 +24,8 @@
 #include "common/container.h"
 #include "gcode-parser/gcode-parser.h"
 #include "hardware-mapping.h"
+#include "input-shaper.h"
+#include "kinematics.h"
 
 class SegmentQueue;
 class ConfigParser;
@@ -40,6 +42,10 @@ struct MachineControlConfig {
   // Read values from configuration file.
   bool ConfigureFromFile(const ConfigParser &parser);
 
+  // Returns a hash over all values. Two configurations with the same
+  // fingerprint result in the same motion for the same G-code.
+  uint64_t Fingerprint() const;
+
   // Arrays with values for each axis
   FloatAxisConfig steps_per_mm;  // Steps per mm for each logical axis.
   FloatAxisConfig
@@ -50,6 +56,20 @@ struct MachineControlConfig {
 
   FloatAxisConfig max_probe_feedrate;  // Max probe feedrate for axis (mm/s)
 
+  Kinematics::Type kinematics;  // How motors move the X, Y and Z axes.
+  float delta_radius;           // Delta: tower to center, minus effector (mm)
+  float delta_arm_length;       // Delta: length of the diagonal arms (mm)
+  float delta_segments_per_second;  // Delta: pieces moves are split into.
+
+  // Input shaping of acceleration ramps against ringing at the resonance
+  // frequency (Hz) and damping ratio of the axis.
+  FixedArray<InputShaper::Type, GCODE_NUM_AXES> input_shaper;
+  FloatAxisConfig input_shaper_freq;
+  FloatAxisConfig input_shaper_damping;
+
+  // Pressure advance (s): extruder steps ahead per extruder speed.
+  FloatAxisConfig pressure_advance;
+
   float speed_factor;      // Multiply feed with. Should be 1.0 by default.
   float threshold_angle;   // Threshold angle to ignore speed changes
   float speed_tune_angle;  // Angle added to the angle between vectors for speed
@@ -64,6 +84,9 @@ struct MachineControlConfig {
   int auto_fan_disable_seconds;    // Disable fan automatically after these
                                    // seconds.
   int auto_fan_pwm;            // PWM value to automatically enable fan with.
+  int underrun_margin_ms;      // Idle input: bring the path to a halt once
+                               // less motion than this is queued. <= 0: halt
+                               // on first idle.
   bool acknowledge_lines;      // Respond w/ 'ok' on each command on msg_stream.
   bool require_homing;         // Require homing before any moves.
   bool range_check;            // Do machine limit checks. Default 1.
@@ -115,6 +138,12 @@ class GCodeMachineControl {
   // Can only be called in the same thread that also handles gcode updates.
   HomingState GetHomeStatus();
 
+  // For motion that bypasses the parser, e.g. replayed from a segment cache:
+  // check the E-Stop switch and wait while the pause switch is pressed.
+  // Returns false if the machine is in E-Stop and must not move.
+  // Can only be called in the same thread that also handles gcode updates.
+  bool CheckMotionAllowed();
+
   // Return the motors enabled status.
   // Can only be called in the same thread that also handles gcode updates.
   bool GetMotorsEnabled();
@@ -123,6 +152,15 @@ class GCodeMachineControl {
   // Can only be called in the same thread that also handles gcode updates.
   void GetCurrentPosition(AxesRegister *pos);
 
+  // Return the number of segments in the planning queue not yet sent to
+  // the motors.
+  // Can only be called in the same thread that also handles gcode updates.
+  int GetPlannerQueueDepth();
+
+  // Return the current state of the aux bits.
+  // Can only be called in the same thread that also handles gcode updates.
+  uint16_t GetAuxBits();
+
   // Set the internal planner queue size.
   // Used to trade-off between command sent - executed motion latency
   // and maximum achievable speed.
@@ -17,6 +17,7 @@
 #include "gcode-parser/gcode-parser.h"
 #include "hardware-mapping.h"
 #include "segment-queue.h"
+#include "spindle-control.h"
 
 #define END_SENTINEL 0x42
 
@@ -35,6 +36,7 @@ static void init_test_config(struct MachineControlConfig *c,
 }
 
 namespace {
+// If "expected" is nullptr, the segments are only recorded, not verified.
 class MockMotorOps final : public SegmentQueue {
  public:
   explicit MockMotorOps(const LinearSegmentSteps *expected)
@@ -43,10 +45,14 @@ class MockMotorOps final : public SegmentQueue {
   ~MockMotorOps() final {
     EXPECT_EQ(0, errors_);
     // Did we walk through all states ?
-    EXPECT_EQ(END_SENTINEL, current_->aux_bits);  // reached end ?
+    if (expect_) {
+      EXPECT_EQ(END_SENTINEL, current_->aux_bits);  // reached end ?
+    }
   }
 
   bool Enqueue(const LinearSegmentSteps &param) final {
+    recorded.push_back(param);
+    if (!expect_) return true;
     const int number = (int)(current_ - expect_);
     EXPECT_NE(END_SENTINEL, current_->aux_bits);
     ExpectEq(current_, param, number);
@@ -55,12 +61,22 @@ class MockMotorOps final : public SegmentQueue {
   }
 
   void WaitQueueEmpty() final { call_count_wait_queue_empty++; }
+  float GetQueuedSeconds() final { return queued_seconds; }
+  bool Dwell(float seconds) final {
+    dwell_seconds.push_back(seconds);
+    return true;
+  }
 
   void MotorEnable(bool on) final {}
   bool GetPhysicalStatus(PhysicalStatus *status) final { return false; }
   void SetExternalPosition(int axis, int steps) final {}
 
+  int enqueued_count() const { return (int)(current_ - expect_); }
+
   int call_count_wait_queue_empty = 0;
+  float queued_seconds = 0;
+  std::vector<float> dwell_seconds;
+  std::vector<LinearSegmentSteps> recorded;
 
  private:
   // Helpers to compare and print MotorMovements.
@@ -96,13 +112,14 @@ class Harness {
  public:
   // Initialize harness with the expected sequence of motor movements
   // and return the callback struct to receive simulated gcode calls.
-  explicit Harness(const LinearSegmentSteps *expected)
+  explicit Harness(const LinearSegmentSteps *expected,
+                   Spindle *spindle = nullptr)
       : expect_motor_ops(expected) {
     struct MachineControlConfig config;
     init_test_config(&config, &hardware_);
     machine_control =
       GCodeMachineControl::Create(config, &expect_motor_ops, &hardware_,
-                                  nullptr,   // spindle
+                                  spindle,
                                   nullptr);  // msg-stream
     assert(machine_control != nullptr);
   }
@@ -171,6 +188,36 @@ TEST(GCodeMachineControlTest, straight_segments_same_speed) {
   harness.gcode_emit()->motors_enable(false);  // finish movement.
 }
 
+// While enough motion is buffered, idle input does not force a halt.
+TEST(GCodeMachineControlTest, input_idle_only_halts_before_underrun) {
+  // clang-format off
+  static const struct LinearSegmentSteps expected[] = {
+    { /*v0*/     0.0, /*v1*/ 10000.0, 0, /*steps*/ { 500}},  // accel
+    { /*v0*/ 10000.0, /*v1*/ 10000.0, 0, /*steps*/ {9500}},  // 1st @100mm/s
+    { /*v0*/ 10000.0, /*v1*/ 10000.0, 0, /*steps*/ {9500}},  // 2nd @100mm/s
+    { /*v0*/ 10000.0, /*v1*/     0.0, 0, /*steps*/ { 500}},  // decel back to 0
+    { 0.0, 0.0, END_SENTINEL, {}},
+  };
+  // clang-format on
+  Harness harness(expected);
+
+  AxesRegister coordinates;
+  coordinates[AXIS_X] = 100;
+  harness.gcode_emit()->coordinated_move(100, coordinates);
+  coordinates[AXIS_X] = 200;
+  harness.gcode_emit()->coordinated_move(100, coordinates);
+  const int planned = harness.expect_motor_ops.enqueued_count();
+  EXPECT_LT(planned, 4);
+
+  harness.expect_motor_ops.queued_seconds = 1.0;
+  harness.gcode_emit()->input_idle(true);
+  EXPECT_EQ(planned, harness.expect_motor_ops.enqueued_count());
+
+  harness.expect_motor_ops.queued_seconds = 0.010;
+  harness.gcode_emit()->input_idle(false);
+  EXPECT_EQ(4, harness.expect_motor_ops.enqueued_count());
+}
+
 // Since the speed limit of Y doubles the X speed limit, and the steps ratio is
 // 1:12 we expect the speed of the defining axis (Y) to be 6/5 of the X speed
 // limit. The same concept in the same way is extended to acceleration.
@@ -224,6 +271,99 @@ TEST(GCodeMachineControlTest, straight_segments_speed_change) {
   harness.gcode_emit()->motors_enable(false);  // finish movement.
 }
 
+namespace {
+class FakeLaser final : public Spindle {
+ public:
+  void SetOutputs(SpindleOutputs *outputs) final {}
+  void On(bool ccw, int rpm) final { power_ = rpm / 1000.0f; }
+  void Off() final { power_ = 0; }
+  float VelocityScaledPower() const final { return power_; }
+
+ private:
+  float power_ = 0;
+};
+
+// Spindle that sets its speed PWM duty cycle from the rpm.
+class FakePWMSpindle final : public Spindle {
+ public:
+  void SetOutputs(SpindleOutputs *outputs) final { outputs_ = outputs; }
+  void On(bool ccw, int rpm) final { outputs_->SetSpeedPWM(rpm / 1000.0f); }
+  void Off() final { outputs_->SetSpeedPWM(0); }
+
+ private:
+  SpindleOutputs *outputs_ = nullptr;
+};
+}  // namespace
+
+// Spindle and fan PWM changes are sent along with the moves, without waiting
+// for the machine to finish the preceding moves.
+TEST(GCodeMachineControlTest, spindle_and_fan_switch_with_motion) {
+  FakePWMSpindle spindle;
+  Harness harness(nullptr, &spindle);
+  GCodeParser::Config config;
+  GCodeParser::Config::ParamMap parameters;
+  config.parameters = &parameters;
+  GCodeParser parser = GCodeParser(config, harness.gcode_emit());
+  harness.gcode_emit()->gcode_start(&parser);
+  parser.ParseBlock("G1 X10 F1000", nullptr);
+  parser.ParseBlock("M3 S500", nullptr);
+  parser.ParseBlock("M106 S255", nullptr);
+  parser.ParseBlock("G1 X20", nullptr);
+  parser.ParseBlock("M5", nullptr);
+  harness.gcode_emit()->gcode_finished(true);
+  EXPECT_EQ(0, harness.expect_motor_ops.call_count_wait_queue_empty);
+
+  std::vector<LinearSegmentSteps> pwm_changes;
+  int steps_before_spindle_on = -1;
+  int steps = 0;
+  for (const LinearSegmentSteps &s : harness.expect_motor_ops.recorded) {
+    if (s.spindle_pwm >= 0 || s.fan_pwm >= 0) {
+      for (int motor_steps : s.steps) EXPECT_EQ(0, motor_steps);
+      if (pwm_changes.empty()) steps_before_spindle_on = steps;
+      pwm_changes.push_back(s);
+    }
+    steps += s.steps[AXIS_X];
+  }
+  ASSERT_EQ(2u, pwm_changes.size());
+  EXPECT_EQ(1000, steps_before_spindle_on);  // After the first move.
+  EXPECT_FLOAT_EQ(0.5, pwm_changes[0].spindle_pwm);
+  EXPECT_FLOAT_EQ(1.0, pwm_changes[0].fan_pwm);
+  EXPECT_FLOAT_EQ(0, pwm_changes[1].spindle_pwm);  // Off after the move.
+  EXPECT_LT(pwm_changes[1].fan_pwm, 0);            // Unchanged.
+  EXPECT_EQ(2000, steps);
+}
+
+TEST(GCodeMachineControlTest, raster_line_combines_pixels_of_same_power) {
+  FakeLaser laser;
+  Harness harness(nullptr, &laser);
+  laser.On(false, 1000);
+  // Pixels 255, 255, 0, 0, 0, 255
+  harness.gcode_emit()->unprocessed('M', 649, "P//8AAAD/");
+
+  AxesRegister coordinates;
+  coordinates[AXIS_X] = 6;  // 600 steps; 100 steps per pixel.
+  harness.gcode_emit()->coordinated_move(20, coordinates);
+  harness.gcode_emit()->motors_enable(false);  // finish movement.
+
+  const auto &segments = harness.expect_motor_ops.recorded;
+  ASSERT_FALSE(segments.empty());
+  // Segments are in order, the middle ones are unlit.
+  int steps = 0;
+  int lit_steps = 0;
+  for (const LinearSegmentSteps &s : segments) {
+    const int pixel = (steps + s.steps[AXIS_X] / 2) / 100;
+    const bool lit = (pixel < 2 || pixel >= 5);
+    const float duty = s.laser_power_per_speed * (s.v0 + s.v1) / 2;
+    if (s.v0 == s.v1) {
+      EXPECT_EQ(lit, duty > 0.5) << "pixel " << pixel;
+    }
+    if (lit) lit_steps += s.steps[AXIS_X];
+    steps += s.steps[AXIS_X];
+  }
+  EXPECT_EQ(600, steps);
+  EXPECT_EQ(300, lit_steps);
+}
+
 TEST(GCodeMachineControlTest, m181_stops_and_sets_lookahead) {
   static const struct LinearSegmentSteps expected[] = {
     {0.0, 0.0, END_SENTINEL, {}},
@@ -0,0 +1,568 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gcode-parser/compiled-gcode.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "common/hash.h"
+#include "common/logging.h"
+
+namespace {
+struct CompiledHeader {
+  char magic[4];
+  uint32_t byte_order;  // kByteOrderMark in the byte order of the writer.
+  uint8_t version;
+  uint8_t num_axes;
+  uint8_t reserved[6];
+  uint64_t machine_origin_hash;  // Programs are only valid for this origin.
+};
+
+constexpr char kMagic[4] = {'B', 'G', 'C', 'G'};
+constexpr uint32_t kByteOrderMark = 0x01020304;
+constexpr uint8_t kVersion = 2;
+
+// Opcodes of the records following the header.
+enum Opcode : char {
+  OP_START = 's',
+  OP_FINISHED = 'f',
+  OP_ORIGIN_OFFSET = 'o',
+  OP_WAIT_FOR_START = 'w',
+  OP_HOME = 'h',
+  OP_SPINDLE_SPEED = 'S',
+  OP_SPEED_FACTOR = 'F',
+  OP_FANSPEED = 'a',
+  OP_SET_TEMPERATURE = 't',
+  OP_WAIT_TEMPERATURE = 'T',
+  OP_DWELL = 'd',
+  OP_MOTORS_ENABLE = 'm',
+  OP_COORDINATED_MOVE = '1',
+  OP_RAPID_MOVE = '0',
+  OP_ARC = 'c',
+  OP_SPLINE = '5',
+  OP_UNPROCESSED = 'u',
+};
+
+// Reads values from the mmap()ed region. Values are not necessarily aligned,
+// so everything is copied out with memcpy().
+class RecordReader {
+ public:
+  RecordReader(const char *data, size_t len) : pos_(data), end_(data + len) {}
+
+  bool at_end() const { return pos_ >= end_; }
+  const char *pos() const { return pos_; }
+  bool ok() const { return ok_; }
+
+  void Read(void *dest, size_t len) {
+    if (!ok_ || (size_t)(end_ - pos_) < len) {
+      ok_ = false;
+      memset(dest, 0, len);
+      return;
+    }
+    memcpy(dest, pos_, len);
+    pos_ += len;
+  }
+
+  char ReadOp() {
+    char op;
+    Read(&op, sizeof(op));
+    return op;
+  }
+  uint8_t ReadByte() {
+    uint8_t b;
+    Read(&b, sizeof(b));
+    return b;
+  }
+  float ReadFloat() {
+    float f;
+    Read(&f, sizeof(f));
+    return f;
+  }
+  void ReadRegister(AxesRegister *reg) {
+    for (const GCodeParserAxis a : AllAxes()) (*reg)[a] = ReadFloat();
+  }
+  // Reads a string into "buffer". The string is NUL-terminated as receivers
+  // expect regular C-strings.
+  const char *ReadString(std::string *buffer) {
+    uint16_t len;
+    Read(&len, sizeof(len));
+    if (!ok_ || (size_t)(end_ - pos_) < len) {
+      ok_ = false;
+      return "";
+    }
+    buffer->assign(pos_, len);
+    pos_ += len;
+    return buffer->c_str();
+  }
+
+ private:
+  const char *pos_;
+  const char *const end_;
+  bool ok_ = true;
+};
+
+// Whether "rest", following the command "letter""value" that is handed to
+// unprocessed(), only holds arguments of that command. Another G or M word
+// is a command of its own, and so are axis words and F after an M-code,
+// which the parser takes as a move. Comments, expressions and parameter
+// names are skipped.
+bool OnlyArguments(char letter, float value, const char *rest) {
+  if (letter == 'M' && value == 117) return true;  // Message text.
+  int depth = 0;  // Within [] expressions.
+  for (const char *p = rest; p && *p && *p != ';'; ++p) {
+    if (*p == '(') {
+      p = strchr(p, ')');
+      if (p == nullptr) break;
+    } else if (*p == '[') {
+      ++depth;
+    } else if (*p == ']') {
+      --depth;
+    } else if (*p == '#' && p[1] == '<') {
+      p = strchr(p, '>');
+      if (p == nullptr) break;
+    } else if (*p == '#' && isalpha(p[1])) {
+      while (isalnum(p[1]) || p[1] == '_') ++p;
+    } else if (depth == 0 && isalpha(*p)) {
+      const char word = toupper(*p);
+      if (word == 'G' || word == 'M') return false;
+      if (letter == 'M' &&
+          (word == 'F' || gcodep_letter2axis(word) != GCODE_NUM_AXES)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+uint64_t MachineOriginHash(const AxesRegister &machine_origin) {
+  Fnv1aHash hash;
+  for (const GCodeParserAxis a : AllAxes()) {
+    hash.AddValue<float>(machine_origin[a]);
+  }
+  return hash.value();
+}
+}  // namespace
+
+GCodeCompiler::GCodeCompiler(FILE *out, const AxesRegister &machine_origin)
+    : out_(out) {
+  last_pos_.zero();
+  WriteHeader(machine_origin);
+}
+
+void GCodeCompiler::WriteHeader(const AxesRegister &machine_origin) {
+  CompiledHeader header = {};
+  memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.byte_order = kByteOrderMark;
+  header.version = kVersion;
+  header.num_axes = GCODE_NUM_AXES;
+  header.machine_origin_hash = MachineOriginHash(machine_origin);
+  Write(&header, sizeof(header));
+}
+
+void GCodeCompiler::Write(const void *data, size_t len) {
+  fwrite(data, len, 1, out_);
+}
+
+void GCodeCompiler::WriteOp(char op) { Write(&op, sizeof(op)); }
+
+void GCodeCompiler::WriteFloat(float value) { Write(&value, sizeof(value)); }
+
+void GCodeCompiler::WriteString(const char *str) {
+  size_t len = str ? strlen(str) : 0;
+  if (len > UINT16_MAX) len = UINT16_MAX;
+  const uint16_t stored_len = len;
+  Write(&stored_len, sizeof(stored_len));
+  if (len) Write(str, len);
+}
+
+void GCodeCompiler::WriteRegister(const AxesRegister &reg) {
+  for (const GCodeParserAxis a : AllAxes()) WriteFloat(reg[a]);
+}
+
+// Moves only store the axes that changed compared to the previous move,
+// prefixed by a bitmap of these axes.
+void GCodeCompiler::WriteMove(char op, float feed, const AxesRegister &pos) {
+  uint16_t changed = 0;
+  for (const GCodeParserAxis a : AllAxes()) {
+    if (pos[a] != last_pos_[a]) changed |= (1 << a);
+  }
+  WriteOp(op);
+  WriteFloat(feed);
+  Write(&changed, sizeof(changed));
+  for (const GCodeParserAxis a : AllAxes()) {
+    if (changed & (1 << a)) WriteFloat(pos[a]);
+  }
+  last_pos_ = pos;
+}
+
+void GCodeCompiler::gcode_start(GCodeParser *parser) { WriteOp(OP_START); }
+
+void GCodeCompiler::gcode_finished(bool end_of_stream) {
+  WriteOp(OP_FINISHED);
+  const uint8_t b = end_of_stream;
+  Write(&b, sizeof(b));
+  fflush(out_);
+}
+
+void GCodeCompiler::inform_origin_offset(const AxesRegister &offset,
+                                         const char *named_offset) {
+  WriteOp(OP_ORIGIN_OFFSET);
+  WriteRegister(offset);
+  WriteString(named_offset);
+}
+
+void GCodeCompiler::wait_for_start() { WriteOp(OP_WAIT_FOR_START); }
+
+void GCodeCompiler::go_home(AxisBitmap_t axis_bitmap) {
+  WriteOp(OP_HOME);
+  const uint32_t bitmap = axis_bitmap;
+  Write(&bitmap, sizeof(bitmap));
+}
+
+bool GCodeCompiler::probe_axis(float feed_mm_p_sec, enum GCodeParserAxis axis,
+                               float *probed_position) {
+  Log_error("Probing depends on the machine; can't be compiled.");
+  ++error_count_;
+  return false;
+}
+
+void GCodeCompiler::change_spindle_speed(float value) {
+  WriteOp(OP_SPINDLE_SPEED);
+  WriteFloat(value);
+}
+
+void GCodeCompiler::set_speed_factor(float factor) {
+  WriteOp(OP_SPEED_FACTOR);
+  WriteFloat(factor);
+}
+
+void GCodeCompiler::set_fanspeed(float speed) {
+  WriteOp(OP_FANSPEED);
+  WriteFloat(speed);
+}
+
+void GCodeCompiler::set_temperature(float degrees_c) {
+  WriteOp(OP_SET_TEMPERATURE);
+  WriteFloat(degrees_c);
+}
+
+void GCodeCompiler::wait_temperature() { WriteOp(OP_WAIT_TEMPERATURE); }
+
+void GCodeCompiler::dwell(float time_ms) {
+  WriteOp(OP_DWELL);
+  WriteFloat(time_ms);
+}
+
+void GCodeCompiler::motors_enable(bool enable) {
+  WriteOp(OP_MOTORS_ENABLE);
+  const uint8_t b = enable;
+  Write(&b, sizeof(b));
+}
+
+bool GCodeCompiler::coordinated_move(float feed_mm_p_sec,
+                                     const AxesRegister &absolute_pos) {
+  WriteMove(OP_COORDINATED_MOVE, feed_mm_p_sec, absolute_pos);
+  return true;
+}
+
+bool GCodeCompiler::rapid_move(float feed_mm_p_sec,
+                               const AxesRegister &absolute_pos) {
+  WriteMove(OP_RAPID_MOVE, feed_mm_p_sec, absolute_pos);
+  return true;
+}
+
+bool GCodeCompiler::arc_move(float feed_mm_p_sec, GCodeParserAxis normal_axis,
+                             bool clockwise, const AxesRegister &start,
+                             const AxesRegister &center,
+                             const AxesRegister &end) {
+  WriteOp(OP_ARC);
+  WriteFloat(feed_mm_p_sec);
+  const uint8_t axis_and_direction[2] = {(uint8_t)normal_axis,
+                                         (uint8_t)clockwise};
+  Write(axis_and_direction, sizeof(axis_and_direction));
+  WriteRegister(start);
+  WriteRegister(center);
+  WriteRegister(end);
+  return true;
+}
+
+bool GCodeCompiler::spline_move(float feed_mm_p_sec, const AxesRegister &start,
+                                const AxesRegister &cp1,
+                                const AxesRegister &cp2,
+                                const AxesRegister &end) {
+  WriteOp(OP_SPLINE);
+  WriteFloat(feed_mm_p_sec);
+  WriteRegister(start);
+  WriteRegister(cp1);
+  WriteRegister(cp2);
+  WriteRegister(end);
+  return true;
+}
+
+// The receiver only takes the arguments of the command from the rest of the
+// line, and the parser continues with whatever it leaves. As that is not
+// known here, lines with more commands after this one are refused.
+const char *GCodeCompiler::unprocessed(char letter, float value,
+                                       const char *rest_of_line) {
+  if (!OnlyArguments(letter, value, rest_of_line)) {
+    Log_error("Can't compile commands following %c%g in the same line "
+              "('%s'); put them on a line of their own.",
+              letter, value, rest_of_line);
+    ++error_count_;
+    return NULL;
+  }
+  WriteOp(OP_UNPROCESSED);
+  Write(&letter, sizeof(letter));
+  WriteFloat(value);
+  WriteString(rest_of_line);
+  return NULL;  // Only arguments of the command, for the receiver to parse.
+}
+
+static bool CheckHeader(const char *data, size_t len,
+                        const AxesRegister &machine_origin, FILE *err_stream) {
+  CompiledHeader header;
+  if (len < sizeof(header) || memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+    if (err_stream) fprintf(err_stream, "// Not a compiled G-code file.\n");
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.byte_order != kByteOrderMark || header.version != kVersion ||
+      header.num_axes != GCODE_NUM_AXES) {
+    if (err_stream) {
+      fprintf(err_stream,
+              "// Compiled G-code created by an incompatible version or "
+              "machine. Please re-compile.\n");
+    }
+    return false;
+  }
+  if (header.machine_origin_hash != MachineOriginHash(machine_origin)) {
+    if (err_stream) {
+      fprintf(err_stream,
+              "// Compiled G-code created for a different machine origin. "
+              "Please re-compile with the current configuration.\n");
+    }
+    return false;
+  }
+  return true;
+}
+
+bool IsCompiledGCode(int fd) {
+  CompiledHeader header;
+  return pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header) &&
+         memcmp(header.magic, kMagic, sizeof(kMagic)) == 0;
+}
+
+bool IsCompiledGCodeFile(const char *filename) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  const bool is_compiled = IsCompiledGCode(fd);
+  close(fd);
+  return is_compiled;
+}
+
+CompiledGCodeReplay::CompiledGCodeReplay(GCodeParser *parser,
+                                         GCodeParser::EventReceiver *receiver,
+                                         FILE *err_stream)
+    : parser_(parser), receiver_(receiver), err_stream_(err_stream) {
+  last_pos_.zero();
+}
+
+CompiledGCodeReplay::~CompiledGCodeReplay() { Unmap(); }
+
+void CompiledGCodeReplay::Unmap() {
+  if (mapping_) munmap(mapping_, mapping_size_);
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+}
+
+bool CompiledGCodeReplay::Start(const char *data, size_t len,
+                                const AxesRegister &machine_origin) {
+  pos_ = end_ = nullptr;
+  records_replayed_ = 0;
+  last_pos_.zero();
+  ok_ = CheckHeader(data, len, machine_origin, err_stream_);
+  if (!ok_) return false;
+  pos_ = data + sizeof(CompiledHeader);
+  end_ = data + len;
+  return true;
+}
+
+bool CompiledGCodeReplay::Map(int fd, const AxesRegister &machine_origin) {
+  Unmap();
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    ok_ = false;
+    return false;
+  }
+  void *const mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) {
+    Log_error("Can't mmap() compiled G-code: %s", strerror(errno));
+    ok_ = false;
+    return false;
+  }
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+  mapping_ = mapped;
+  mapping_size_ = st.st_size;
+  return Start((const char *)mapped, st.st_size, machine_origin);
+}
+
+bool CompiledGCodeReplay::Continue(int max_records) {
+  if (!ok_) return false;
+  RecordReader reader(pos_, end_ - pos_);
+  AxesRegister start, center, cp1, cp2, end;
+  std::string text;
+  for (int i = 0; i < max_records && reader.ok() && !reader.at_end(); ++i) {
+    const char op = reader.ReadOp();
+    ++records_replayed_;
+    switch (op) {
+    case OP_START: receiver_->gcode_start(parser_); break;
+    case OP_FINISHED: {
+      const bool end_of_stream = reader.ReadByte();
+      if (!end_of_stream || !skip_end_of_stream_) {
+        receiver_->gcode_finished(end_of_stream);
+      }
+      break;
+    }
+    case OP_ORIGIN_OFFSET:
+      reader.ReadRegister(&start);
+      receiver_->inform_origin_offset(start, reader.ReadString(&text));
+      break;
+    case OP_WAIT_FOR_START: receiver_->wait_for_start(); break;
+    case OP_HOME: {
+      uint32_t bitmap;
+      reader.Read(&bitmap, sizeof(bitmap));
+      receiver_->go_home(bitmap);
+      break;
+    }
+    case OP_SPINDLE_SPEED:
+      receiver_->change_spindle_speed(reader.ReadFloat());
+      break;
+    case OP_SPEED_FACTOR:
+      receiver_->set_speed_factor(reader.ReadFloat());
+      break;
+    case OP_FANSPEED: receiver_->set_fanspeed(reader.ReadFloat()); break;
+    case OP_SET_TEMPERATURE:
+      receiver_->set_temperature(reader.ReadFloat());
+      break;
+    case OP_WAIT_TEMPERATURE: receiver_->wait_temperature(); break;
+    case OP_DWELL: receiver_->dwell(reader.ReadFloat()); break;
+    case OP_MOTORS_ENABLE: receiver_->motors_enable(reader.ReadByte()); break;
+    case OP_COORDINATED_MOVE:
+    case OP_RAPID_MOVE: {
+      const float feed = reader.ReadFloat();
+      uint16_t changed;
+      reader.Read(&changed, sizeof(changed));
+      for (const GCodeParserAxis a : AllAxes()) {
+        if (changed & (1 << a)) last_pos_[a] = reader.ReadFloat();
+      }
+      if (!reader.ok()) break;
+      if (op == OP_COORDINATED_MOVE) {
+        receiver_->coordinated_move(feed, last_pos_);
+      } else {
+        receiver_->rapid_move(feed, last_pos_);
+      }
+      break;
+    }
+    case OP_ARC: {
+      const float feed = reader.ReadFloat();
+      const GCodeParserAxis normal_axis = (GCodeParserAxis)reader.ReadByte();
+      const bool clockwise = reader.ReadByte();
+      reader.ReadRegister(&start);
+      reader.ReadRegister(&center);
+      reader.ReadRegister(&end);
+      if (!reader.ok()) break;
+      receiver_->arc_move(feed, normal_axis, clockwise, start, center, end);
+      break;
+    }
+    case OP_SPLINE: {
+      const float feed = reader.ReadFloat();
+      reader.ReadRegister(&start);
+      reader.ReadRegister(&cp1);
+      reader.ReadRegister(&cp2);
+      reader.ReadRegister(&end);
+      if (!reader.ok()) break;
+      receiver_->spline_move(feed, start, cp1, cp2, end);
+      break;
+    }
+    case OP_UNPROCESSED: {
+      char letter;
+      reader.Read(&letter, sizeof(letter));
+      const float value = reader.ReadFloat();
+      const char *rest = reader.ReadString(&text);
+      if (!reader.ok()) break;
+      // Only arguments follow, see GCodeCompiler::unprocessed().
+      receiver_->unprocessed(letter, value, rest);
+      break;
+    }
+    default:
+      if (err_stream_) {
+        fprintf(err_stream_, "// Invalid opcode 0x%02x in compiled G-code\n",
+                (uint8_t)op);
+      }
+      ok_ = false;
+      return false;
+    }
+  }
+  if (!reader.ok()) {
+    if (err_stream_) fprintf(err_stream_, "// Truncated compiled G-code\n");
+    ok_ = false;
+    return false;
+  }
+  pos_ = reader.pos();
+  return !reader.at_end();
+}
+
+bool ReplayCompiledGCode(const char *data, size_t len,
+                         const AxesRegister &machine_origin,
+                         GCodeParser *parser,
+                         GCodeParser::EventReceiver *receiver,
+                         FILE *err_stream) {
+  CompiledGCodeReplay replay(parser, receiver, err_stream);
+  if (!replay.Start(data, len, machine_origin)) return false;
+  while (replay.Continue(1 << 16)) {
+  }
+  return replay.success();
+}
+
+bool ReplayCompiledGCodeFile(const char *filename,
+                             const AxesRegister &machine_origin,
+                             GCodeParser *parser,
+                             GCodeParser::EventReceiver *receiver,
+                             FILE *err_stream) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    Log_error("Can't open %s: %s", filename, strerror(errno));
+    return false;
+  }
+  CompiledGCodeReplay replay(parser, receiver, err_stream);
+  const bool started = replay.Map(fd, machine_origin);
+  close(fd);  // mapping stays valid.
+  if (!started) return false;
+  while (replay.Continue(1 << 16)) {
+  }
+  return replay.success();
+}
@@ -0,0 +1,178 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_COMPILED_GCODE_H
+#define _BEAGLEG_COMPILED_GCODE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "gcode-parser/gcode-parser.h"
+
+// Compiled G-code.
+//
+// A G-code program that is run many times does not need to be lexed,
+// evaluated and transformed into machine coordinates every time. The
+// GCodeCompiler is an EventReceiver that records the callbacks the
+// GCodeParser emits into a compact binary file. Replaying that file later
+// calls the same callbacks with the same (absolute) coordinates on another
+// EventReceiver, e.g. the one of GCodeMachineControl, without any parsing.
+//
+// The file is a header followed by a sequence of records, each being one
+// opcode byte followed by its arguments. Values are stored in native byte
+// order; the header allows to detect files that were compiled on a machine
+// with a different byte order or number of axes.
+// As the coordinates are absolute, they depend on the machine origin of the
+// configuration the program was compiled with. A fingerprint of it is kept
+// in the header, and programs compiled for a different origin are rejected.
+//
+// Things that depend on the machine at runtime can not be precompiled:
+//  - G30 probing is rejected at compile time.
+//  - clamp_to_range() is not applied while compiling, the machine still
+//    checks ranges when moves are replayed.
+//  - Commands handed to unprocessed() (typically M-codes) are stored with
+//    their remaining line as text, so the receiver can parse their arguments
+//    as usual with GCodeParser::ParsePair(). Lines with other commands or
+//    moves following such a command are rejected at compile time; they need
+//    to go on a line of their own.
+class GCodeCompiler : public GCodeParser::EventReceiver {
+ public:
+  // Writes the compiled program to "out", which is parsed by a parser
+  // configured with "machine_origin". Does not take ownership.
+  GCodeCompiler(FILE *out, const AxesRegister &machine_origin);
+
+  // Number of events that could not be compiled.
+  int error_count() const { return error_count_; }
+
+  void gcode_start(GCodeParser *parser) final;
+  void gcode_finished(bool end_of_stream) final;
+  void inform_origin_offset(const AxesRegister &offset,
+                            const char *named_offset) final;
+  void wait_for_start() final;
+  void go_home(AxisBitmap_t axis_bitmap) final;
+  bool probe_axis(float feed_mm_p_sec, enum GCodeParserAxis axis,
+                  float *probed_position) final;
+  void change_spindle_speed(float value) final;
+  void set_speed_factor(float factor) final;
+  void set_fanspeed(float speed) final;
+  void set_temperature(float degrees_c) final;
+  void wait_temperature() final;
+  void dwell(float time_ms) final;
+  void motors_enable(bool enable) final;
+  bool coordinated_move(float feed_mm_p_sec,
+                        const AxesRegister &absolute_pos) final;
+  bool rapid_move(float feed_mm_p_sec, const AxesRegister &absolute_pos) final;
+  bool arc_move(float feed_mm_p_sec, GCodeParserAxis normal_axis,
+                bool clockwise, const AxesRegister &start,
+                const AxesRegister &center, const AxesRegister &end) final;
+  bool spline_move(float feed_mm_p_sec, const AxesRegister &start,
+                   const AxesRegister &cp1, const AxesRegister &cp2,
+                   const AxesRegister &end) final;
+  const char *unprocessed(char letter, float value,
+                          const char *rest_of_line) final;
+
+ private:
+  void WriteHeader(const AxesRegister &machine_origin);
+  void Write(const void *data, size_t len);
+  void WriteOp(char op);
+  void WriteFloat(float value);
+  void WriteString(const char *str);
+  void WriteRegister(const AxesRegister &reg);
+  void WriteMove(char op, float feed, const AxesRegister &pos);
+
+  FILE *const out_;
+  AxesRegister last_pos_;  // Moves are stored as delta to this.
+  int error_count_ = 0;
+};
+
+// Replays a compiled program into a receiver, a limited number of records
+// at a time, so that an event loop can do other work in between.
+class CompiledGCodeReplay {
+ public:
+  // Replay into "receiver". The "parser" is handed to gcode_start(), so that
+  // the receiver can use it to parse the arguments of unprocessed() commands.
+  // Error messages are sent to "err_stream" if non-NULL.
+  CompiledGCodeReplay(GCodeParser *parser,
+                      GCodeParser::EventReceiver *receiver, FILE *err_stream);
+  ~CompiledGCodeReplay();
+
+  CompiledGCodeReplay(const CompiledGCodeReplay &) = delete;
+  CompiledGCodeReplay &operator=(const CompiledGCodeReplay &) = delete;
+
+  // Start replaying the program in the memory region "data" of size "len",
+  // which needs to outlive the replay. Returns false if it is not a
+  // compiled program for "machine_origin".
+  bool Start(const char *data, size_t len, const AxesRegister &machine_origin);
+
+  // Same, but with the compiled file "fd", which is memory mapped. The file
+  // descriptor is not needed after this call and can be closed.
+  bool Map(int fd, const AxesRegister &machine_origin);
+
+  // Don't replay the gcode_finished(true) at the end of the compiled stream,
+  // e.g. if the caller finishes the stream itself.
+  void set_skip_end_of_stream(bool skip) { skip_end_of_stream_ = skip; }
+
+  // Replay up to "max_records" records. Returns true while there is more
+  // to replay, false at the end or if the program is broken.
+  bool Continue(int max_records);
+
+  // Returns true if the whole program has been replayed without errors.
+  bool success() const { return ok_ && pos_ == end_; }
+
+  // Number of records replayed so far.
+  int records_replayed() const { return records_replayed_; }
+
+ private:
+  void Unmap();
+
+  GCodeParser *const parser_;
+  GCodeParser::EventReceiver *const receiver_;
+  FILE *const err_stream_;
+  bool skip_end_of_stream_ = false;
+
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  const char *pos_ = nullptr;
+  const char *end_ = nullptr;
+  bool ok_ = false;
+  int records_replayed_ = 0;
+  AxesRegister last_pos_;  // Moves are stored as delta to this.
+};
+
+// Returns true if the file "filename" or the regular file "fd" starts with
+// a compiled G-code header.
+bool IsCompiledGCodeFile(const char *filename);
+bool IsCompiledGCode(int fd);
+
+// Replay the compiled program in the memory region "data" of size "len"
+// into "receiver" at once. See CompiledGCodeReplay for the parameters.
+// Returns true if the whole program could be replayed.
+bool ReplayCompiledGCode(const char *data, size_t len,
+                         const AxesRegister &machine_origin,
+                         GCodeParser *parser,
+                         GCodeParser::EventReceiver *receiver,
+                         FILE *err_stream);
+
+// Convenience function: mmap() file "filename" and replay it.
+bool ReplayCompiledGCodeFile(const char *filename,
+                             const AxesRegister &machine_origin,
+                             GCodeParser *parser,
+                             GCodeParser::EventReceiver *receiver,
+                             FILE *err_stream);
+
+#endif  // _BEAGLEG_COMPILED_GCODE_H
@@ -0,0 +1,280 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gcode-parser/compiled-gcode.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "common/string-util.h"
+
+// Receiver that writes all relevant events into a string, so that we can
+// compare the events of a parsed with a replayed program.
+class EventLogger : public GCodeParser::EventReceiver {
+ public:
+  const std::string &log() const { return log_; }
+
+  void gcode_start(GCodeParser *parser) final { log_ += "start\n"; }
+  void gcode_finished(bool eos) final {
+    log_ += StringPrintf("finished %d\n", eos);
+  }
+  void inform_origin_offset(const AxesRegister &o, const char *name) final {
+    log_ += StringPrintf("origin %s %s\n", Pos(o).c_str(), name);
+  }
+  void go_home(AxisBitmap_t axes) final {
+    log_ += StringPrintf("home %x\n", axes);
+  }
+  bool probe_axis(float feed, GCodeParserAxis axis, float *pos) final {
+    *pos = 42;
+    return true;
+  }
+  void change_spindle_speed(float v) final {
+    log_ += StringPrintf("spindle %.3f\n", v);
+  }
+  void set_speed_factor(float f) final {
+    log_ += StringPrintf("factor %.3f\n", f);
+  }
+  void set_fanspeed(float s) final { log_ += StringPrintf("fan %.3f\n", s); }
+  void set_temperature(float t) final {
+    log_ += StringPrintf("temp %.3f\n", t);
+  }
+  void wait_temperature() final { log_ += "wait-temp\n"; }
+  void dwell(float ms) final { log_ += StringPrintf("dwell %.3f\n", ms); }
+  void motors_enable(bool on) final {
+    log_ += StringPrintf("motors %d\n", on);
+  }
+  bool coordinated_move(float feed, const AxesRegister &p) final {
+    log_ += StringPrintf("G1 %.3f %s\n", feed, Pos(p).c_str());
+    return true;
+  }
+  bool rapid_move(float feed, const AxesRegister &p) final {
+    log_ += StringPrintf("G0 %.3f %s\n", feed, Pos(p).c_str());
+    return true;
+  }
+  bool arc_move(float feed, GCodeParserAxis normal, bool cw,
+                const AxesRegister &start, const AxesRegister &center,
+                const AxesRegister &end) final {
+    log_ += StringPrintf("arc %.3f %d %d %s %s %s\n", feed, normal, cw,
+                         Pos(start).c_str(), Pos(center).c_str(),
+                         Pos(end).c_str());
+    return true;
+  }
+  const char *unprocessed(char letter, float value, const char *rest) final {
+    log_ += StringPrintf("unprocessed %c%.0f '%s'\n", letter, value, rest);
+    return NULL;
+  }
+
+ private:
+  static std::string Pos(const AxesRegister &p) {
+    std::string result;
+    for (const GCodeParserAxis a : AllAxes()) {
+      result += StringPrintf("%.3f,", p[a]);
+    }
+    return result;
+  }
+
+  std::string log_;
+};
+
+// Programs are parsed with the default configuration, which has the
+// machine origin at zero.
+static AxesRegister ZeroOrigin() {
+  AxesRegister origin;
+  origin.zero();
+  return origin;
+}
+
+static void ParseInto(const char *program, GCodeParser::EventReceiver *r) {
+  GCodeParser::Config config;
+  GCodeParser::Config::ParamMap parameters;
+  config.parameters = &parameters;
+  GCodeParser parser(config, r);
+  FILE *in = fmemopen((void *)program, strlen(program), "r");
+  parser.ReadFile(in, NULL);
+}
+
+static std::string Compile(const char *program) {
+  char *buffer = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&buffer, &len);
+  {
+    GCodeCompiler compiler(out, ZeroOrigin());
+    ParseInto(program, &compiler);
+  }
+  fclose(out);
+  std::string result(buffer, len);
+  free(buffer);
+  return result;
+}
+
+static const char kProgram[] =
+  "G21 G90\n"
+  "G10 L2 P1 X10 Y20\n"
+  "G54\n"
+  "M17\n"
+  "G28 X0 Y0\n"
+  "G0 X1 Y2 Z3\n"
+  "G1 X5 F600\n"
+  "#1 = 3\n"
+  "G91 G1 X#1 Y1\n"
+  "G90 G2 X10 Y10 I2 J2\n"
+  "G4 P500\n"
+  "M106 S127\n"
+  "M104 S210\n"
+  "M109\n"
+  "M220 S50\n"
+  "M42 P1 S1\n"
+  "M84\n"
+  "M2\n";
+
+// Compile "program", returns the number of errors of the compiler.
+static int CompileErrors(const char *program) {
+  char *buffer = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&buffer, &len);
+  int errors;
+  {
+    GCodeCompiler compiler(out, ZeroOrigin());
+    ParseInto(program, &compiler);
+    errors = compiler.error_count();
+  }
+  fclose(out);
+  free(buffer);
+  return errors;
+}
+
+TEST(CompiledGCode, RejectsCommandsAfterUnprocessed) {
+  EXPECT_EQ(0, CompileErrors("M3 S12000 (spindle) ; on\n"));
+  EXPECT_EQ(0, CompileErrors("M42 P[1 + #<pin>] S1\n"));
+  EXPECT_EQ(0, CompileErrors("G29 X0 Y0 I100 J100\n"));
+  EXPECT_EQ(0, CompileErrors("M117 Moving X now\n"));
+
+  // The parser would continue with these after the M-code.
+  EXPECT_EQ(1, CompileErrors("M3 S12000 G1 X5\n"));
+  EXPECT_EQ(1, CompileErrors("M3 S12000 M8\n"));
+  EXPECT_EQ(1, CompileErrors("M3 S12000 X5\n"));
+}
+
+TEST(CompiledGCode, ReplayIsSameAsParsing) {
+  EventLogger parsed;
+  ParseInto(kProgram, &parsed);
+  EXPECT_NE(std::string::npos, parsed.log().find("arc "));
+  EXPECT_NE(std::string::npos, parsed.log().find("unprocessed M42"));
+
+  const std::string compiled = Compile(kProgram);
+  EventLogger replayed;
+  EXPECT_TRUE(ReplayCompiledGCode(compiled.data(), compiled.size(),
+                                  ZeroOrigin(), nullptr, &replayed, NULL));
+  EXPECT_EQ(parsed.log(), replayed.log());
+}
+
+TEST(CompiledGCode, MovesOnlyStoreChangedAxes) {
+  const std::string one_move = Compile("G1 X1 F100\n");
+  const std::string two_moves = Compile("G1 X1 F100\nG1 Y1\n");
+  // op + feed + bitmap + one float for the changed axis.
+  EXPECT_EQ(1 + 4 + 2 + 4, (int)(two_moves.size() - one_move.size()));
+}
+
+TEST(CompiledGCode, ProbingCanNotBeCompiled) {
+  FILE *out = fopen("/dev/null", "w");
+  GCodeCompiler compiler(out, ZeroOrigin());
+  ParseInto("G30 Z0\n", &compiler);
+  EXPECT_EQ(1, compiler.error_count());
+  fclose(out);
+}
+
+TEST(CompiledGCode, RejectInvalidData) {
+  EventLogger replayed;
+  const char garbage[] = "G1 X1 Y1 this is not compiled";
+  EXPECT_FALSE(ReplayCompiledGCode(garbage, strlen(garbage), ZeroOrigin(),
+                                   nullptr, &replayed, NULL));
+
+  // Truncated program.
+  const std::string compiled = Compile(kProgram);
+  EXPECT_FALSE(ReplayCompiledGCode(compiled.data(), compiled.size() - 3,
+                                   ZeroOrigin(), nullptr, &replayed, NULL));
+}
+
+TEST(CompiledGCode, RejectDifferentMachineOrigin) {
+  // Coordinates are absolute, so they are only valid for the machine origin
+  // the program was compiled with.
+  const std::string compiled = Compile(kProgram);
+  AxesRegister other_origin = ZeroOrigin();
+  other_origin[AXIS_Z] = 100;
+  EventLogger replayed;
+  EXPECT_FALSE(ReplayCompiledGCode(compiled.data(), compiled.size(),
+                                   other_origin, nullptr, &replayed, NULL));
+  EXPECT_EQ("", replayed.log());
+}
+
+TEST(CompiledGCode, ReplayInSteps) {
+  const std::string compiled = Compile(kProgram);
+  EventLogger all_at_once;
+  EXPECT_TRUE(ReplayCompiledGCode(compiled.data(), compiled.size(),
+                                  ZeroOrigin(), nullptr, &all_at_once, NULL));
+
+  EventLogger replayed;
+  CompiledGCodeReplay replay(nullptr, &replayed, NULL);
+  ASSERT_TRUE(replay.Start(compiled.data(), compiled.size(), ZeroOrigin()));
+  int steps = 0;
+  while (replay.Continue(1)) {
+    ++steps;
+    EXPECT_FALSE(replay.success());
+  }
+  EXPECT_TRUE(replay.success());
+  EXPECT_GT(steps, 10);
+  EXPECT_EQ(all_at_once.log(), replayed.log());
+
+  // The caller can take care of finishing the stream itself.
+  EventLogger no_end;
+  CompiledGCodeReplay replay_no_end(nullptr, &no_end, NULL);
+  replay_no_end.set_skip_end_of_stream(true);
+  ASSERT_TRUE(
+    replay_no_end.Start(compiled.data(), compiled.size(), ZeroOrigin()));
+  while (replay_no_end.Continue(100)) {
+  }
+  EXPECT_EQ(std::string::npos, no_end.log().find("finished 1"));
+}
+
+TEST(CompiledGCode, ReplayFromFile) {
+  char filename[] = "/tmp/compiled-gcode-test.XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  const std::string compiled = Compile(kProgram);
+  ASSERT_EQ((ssize_t)compiled.size(),
+            write(fd, compiled.data(), compiled.size()));
+  close(fd);
+
+  EXPECT_TRUE(IsCompiledGCodeFile(filename));
+  EventLogger parsed;
+  ParseInto(kProgram, &parsed);
+  EventLogger replayed;
+  EXPECT_TRUE(ReplayCompiledGCodeFile(filename, ZeroOrigin(), nullptr,
+                                      &replayed, NULL));
+  EXPECT_EQ(parsed.log(), replayed.log());
+  unlink(filename);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
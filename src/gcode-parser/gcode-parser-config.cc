@@ -17,13 +17,91 @@
  * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <ctype.h>
+#include <limits.h>
 #include <stdio.h>
+#include <strings.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
+#include "common/hash.h"
 #include "common/logging.h"
+#include "common/string-util.h"
 #include "gcode-parser/gcode-parser.h"
 
+typedef GCodeParser::Config::ParamMap ParamMap;
+
+// If "name" is a plain decimal number, store it in "number" and return true.
+// Numbers too long for an int are stored as INT_MAX, so they are out of range.
+static bool ParseParameterNumber(std::string_view name, int *number) {
+  if (name.empty()) return false;
+  int result = 0;
+  for (char c : name) {
+    if (c < '0' || c > '9') return false;
+    result = (result > INT_MAX / 10 - 1) ? INT_MAX : result * 10 + (c - '0');
+  }
+  *number = result;
+  return true;
+}
+
+bool ParamMap::NameLess::operator()(std::string_view a,
+                                    std::string_view b) const {
+  const size_t common_len = std::min(a.size(), b.size());
+  const int cmp = strncasecmp(a.data(), b.data(), common_len);
+  if (cmp != 0) return cmp < 0;
+  return a.size() < b.size();
+}
+
+ParamMap::ParamMap() { clear(); }
+
+void ParamMap::clear() {
+  bzero(numeric_, sizeof(numeric_));
+  numeric_set_.reset();
+  named_.clear();
+}
+
+bool ParamMap::Get(std::string_view name, float *value) const {
+  name = TrimWhitespace(name);
+  int number;
+  if (ParseParameterNumber(name, &number)) return Get(number, value);
+  const auto found = named_.find(name);
+  if (found == named_.end()) {
+    *value = 0;
+    return false;
+  }
+  *value = found->second;
+  return true;
+}
+
+bool ParamMap::Set(std::string_view name, float value) {
+  name = TrimWhitespace(name);
+  int number;
+  if (ParseParameterNumber(name, &number)) return Set(number, value);
+  if (name.empty()) return false;
+  auto found = named_.find(name);
+  if (found == named_.end()) {
+    // Only allocating when we see a new name for the first time.
+    found = named_.emplace(ToLower(name), 0.0f).first;
+  }
+  found->second = value;
+  return true;
+}
+
+uint64_t ParamMap::Fingerprint() const {
+  // Same selection as SaveParams(): zero values and local names don't count.
+  Fnv1aHash hash;
+  for (int i = 1; i < kNumericParameters; ++i) {
+    if (numeric_[i] != 0) hash.AddValue(i).AddValue(numeric_[i]);
+  }
+  for (const auto &name_value : named_) {
+    if (name_value.first[0] != '_' || name_value.second == 0) continue;
+    hash.Add(name_value.first).AddValue(name_value.second);
+  }
+  return hash.value();
+}
+
 bool GCodeParser::Config::LoadParams() {
   if (paramfile.empty()) return false;
   if (parameters == NULL) {
@@ -32,7 +110,7 @@ bool GCodeParser::Config::LoadParams() {
   }
 
   // The default coordinate system at start-up is G54
-  (*parameters)["5220"] = 1.0f;  // Only non-zero default.  // NOLINT
+  parameters->Set(5220, 1.0f);  // Only non-zero default.
 
   FILE *fp = fopen(paramfile.c_str(), "r");
   if (!fp) {
@@ -50,7 +128,11 @@ bool GCodeParser::Config::LoadParams() {
       // Technically, we should ignore parameters which are not coming in
       // order according to RS274NGC. But that sounds like a non-userfriendly
       // restriction.
-      (*parameters)[name] = value;  // NOLINT
+      if (!parameters->Set(name, value)) {
+        Log_error("Ignoring invalid parameter %s in %s", name,
+                  paramfile.c_str());
+        continue;
+      }
       ++pcount;
     }
   }
@@ -84,33 +166,23 @@ bool GCodeParser::Config::SaveParams() const {
   }
 
   int pcount = 0;
-  // We have to go through the list twice. The numeric parameters need to be
-  // stored in numerical order, followed by all the alphanumeric fields.
-  //
-  // Given that we are using a string-key in the map, the numeric fields are
-  // sorted alphanumerically, which is not the same as numerically. So we
-  // simply copy them to a temporary structure that sorts them numerically.
-  std::map<int, float> numeric_params;
-  for (const auto &name_value : *parameters) {
-    if (name_value.first.empty()) continue;    // Should not happen.
-    if (!isdigit(name_value.first[0])) break;  // last one with digit.
-    numeric_params[atoi(name_value.first.c_str())] = name_value.second;
-  }
-
-  for (const auto &num_value : numeric_params) {
-    if (num_value.first == 0)
-      continue;  // Never write this parameter. It should always be zero
-    if (num_value.second != 0) {
-      fprintf(fp, "%i\t%f\n", num_value.first, num_value.second);
+  // The numeric parameters need to be stored in numerical order, followed by
+  // all the alphanumeric fields.
+  // Parameter #0 is never written. It should always be zero.
+  for (int i = 1; i < ParamMap::kNumericParameters; ++i) {
+    float value;
+    parameters->Get(i, &value);
+    if (value != 0) {
+      fprintf(fp, "%i\t%f\n", i, value);
       ++pcount;
     }
   }
 
   // Now, all the non-numeric parmeters
   int start_alpha = pcount;
-  for (const auto &name_value : *parameters) {
+  for (const auto &name_value : parameters->named()) {
     if (name_value.first.empty()) continue;      // Should not happen.
-    if (isdigit(name_value.first[0])) continue;  // Numeric: already written
+    if (isdigit(name_value.first[0])) continue;  // Out of range numeric.
     if (name_value.first[0] != '_') continue;    // Only write global parameters
     if (name_value.second == 0) continue;        // Don't write boring zeroes.
     if (pcount == start_alpha) {
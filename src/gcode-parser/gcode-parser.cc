@@ -39,8 +39,16 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 #include "common/logging.h"
+#include "common/mapped-line-reader.h"
 #include "common/string-util.h"
+#include "gcode-parser/parse-ahead.h"
 #include "gcode-parser/simple-lexer.h"
 
 const AxisBitmap_t kAllAxesBitmap =
@@ -88,6 +96,64 @@ enum GCodeParserAxis gcodep_letter2axis(char letter) {
 static const char *const kCoordinateSystemNames[9] = {
   "G54", "G55", "G56", "G57", "G58", "G59", "G59.1", "G59.2", "G59.3"};
 
+namespace {
+// Plain memory representation of the parser state (see SaveState()). It is
+// only read back by the same program, so no portability is needed.
+class StateWriter {
+ public:
+  explicit StateWriter(std::string *out) : out_(out) {}
+
+  template <typename T>
+  void Put(const T &value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Need plain data");
+    out_->append((const char *)&value, sizeof(value));
+  }
+  void Put(const AxesRegister &axes) {
+    for (GCodeParserAxis a : AllAxes()) Put(axes[a]);
+  }
+  void Put(std::string_view str) {
+    Put((uint32_t)str.size());
+    out_->append(str.data(), str.size());
+  }
+
+ private:
+  std::string *const out_;
+};
+
+// Reads what StateWriter wrote. Once reading failed, ok() is false.
+class StateReader {
+ public:
+  explicit StateReader(std::string_view in) : in_(in) {}
+
+  template <typename T>
+  bool Get(T *value) {
+    static_assert(std::is_trivially_copyable<T>::value, "Need plain data");
+    if (in_.size() < sizeof(T)) return ok_ = false;
+    memcpy(value, in_.data(), sizeof(T));
+    in_.remove_prefix(sizeof(T));
+    return ok_;
+  }
+  bool Get(AxesRegister *axes) {
+    for (GCodeParserAxis a : AllAxes()) Get(&(*axes)[a]);
+    return ok_;
+  }
+  bool Get(std::string *str) {
+    uint32_t len;
+    if (!Get(&len) || in_.size() < len) return ok_ = false;
+    str->assign(in_.data(), len);
+    in_.remove_prefix(len);
+    return ok_;
+  }
+
+  bool ok() const { return ok_; }
+  bool at_end() const { return in_.empty(); }
+
+ private:
+  std::string_view in_;
+  bool ok_ = true;
+};
+}  // namespace
+
 // We keep the implementation with all its unnecessary details for the user
 // in this implementation.
 class GCodeParser::Impl {
@@ -97,13 +163,32 @@ class GCodeParser::Impl {
   ~Impl();
 
   void ParseBlock(GCodeParser *owner, const char *line, FILE *err_stream);
+  void ParseBlock(GCodeParser *owner, const PrelexedBlock &block,
+                  FILE *err_stream);
+
+  // Blocks not terminated by a nul-byte are copied here first. Keeps its
+  // capacity, so it does not allocate for every line.
+  std::string *block_buffer() { return &block_buffer_; }
+  bool parse_ahead() const { return config_.parse_ahead; }
   int ParseStream(GCodeParser *owner, int input_fd, FILE *err_stream);
   const char *gcodep_parse_pair_with_linenumber(int line_num, const char *line,
                                                 char *letter, float *value,
                                                 FILE *err_stream);
   int error_count() const { return error_count_; }
+  const AxesRegister &machine_origin() const { return machine_origin_; }
   EventReceiver *callbacks() { return callbacks_; }
 
+  // Continue with a new program without finishing the current one, so
+  // that the machine does not stop in between.
+  void StartNewProgram() {
+    InitModalState();
+    modal_g0_g1_ = 0;
+    line_number_ = 0;
+  }
+
+  std::string SaveState() const;
+  bool RestoreState(std::string_view state);
+
  private:
   enum DebugLevel {
     DEBUG_NONE = 0,
@@ -116,6 +201,16 @@ class GCodeParser::Impl {
   // should be in the beginning.
   // Does _not_ reset the machine position.
   void InitProgramDefaults() {
+    InitModalState();
+
+    // Some initial machine states emitted as events.
+    callbacks()->set_speed_factor(1.0);
+    callbacks()->set_fanspeed(0);
+    callbacks()->set_temperature(0);
+  }
+
+  // The part of the program defaults that only concerns the parser itself.
+  void InitModalState() {
     xyz_unit_to_mm_factor_ = 1.0f;           // G21
     rotation_unit_to_degree_factor_ = 1.0f;  // Offer degree to radian switch ?
     set_all_axis_to_absolute(true);          // G90
@@ -129,11 +224,6 @@ class GCodeParser::Impl {
     have_first_spline_ = false;
 
     do_while_ = false;
-
-    // Some initial machine states emitted as events.
-    callbacks()->set_speed_factor(1.0);
-    callbacks()->set_fanspeed(0);
-    callbacks()->set_temperature(0);
   }
 
   void InitCoordSystems();
@@ -224,9 +314,14 @@ class GCodeParser::Impl {
   void gcodep_while_start(const char *line);
 
   const char *gparse_pair(const char *line, char *letter, float *value) {
+    if (prelexed_ && !do_while_ && line) {
+      const char *remaining = prelexed_pair(line, letter, value);
+      if (remaining) return remaining;
+    }
     return gcodep_parse_pair_with_linenumber(line_number_, line, letter, value,
                                              err_msg_);
   }
+  const char *prelexed_pair(const char *line, char *letter, float *value);
 
   // Given the axis and the given value passed in the block, convert
   // this value into absolute metric coordinates. Takes into account if
@@ -248,6 +343,7 @@ class GCodeParser::Impl {
   void handle_G90_G91(float value);
   const char *handle_G92(float sub_command, const char *line);
   const char *handle_move(const char *line, bool force_change);
+  float modal_feedrate(float given);
   const char *handle_arc(const char *line, bool is_cw);
   const char *handle_spline(float sub_command, const char *line);
   const char *handle_z_probe(const char *line);
@@ -262,38 +358,53 @@ class GCodeParser::Impl {
 
   const char *gcodep_parameter(const char *line, float *value);
 
+  // Name of a parameter as found after the '#'. Numeric parameters are
+  // kept as number, so that they can be accessed without string conversion.
+  struct ParamName {
+    int number = -1;  // Numeric parameter if >= 0
+    // Alphanumeric parameter if number < 0. For numeric parameters, it is
+    // only filled in when needed for a message, see c_str().
+    mutable std::string name;
+
+    // Readable name for messages.
+    const char *c_str() const {
+      if (number >= 0 && name.empty()) name = std::to_string(number);
+      return name.c_str();
+    }
+  };
+
   // Read name of parameter (after #) which is either a number or a
   // non-alphanumeric character.
-  const char *read_param_name(const char *line, std::string *result);
+  const char *read_param_name(const char *line, ParamName *result);
 
   // Read parameter. Do range check.
-  bool read_parameter(std::string_view param_name, float *result) const {
+  bool read_parameter(int number, float *result) const {
     *result = 0;
     if (config_.parameters == NULL) return false;
-    param_name = TrimWhitespace(param_name);
-    Config::ParamMap::const_iterator found =
-      config_.parameters->find(ToLower(param_name));
-    if (found != config_.parameters->end()) {
-      *result = found->second;
-      return true;
-    } else {
-      *result = 0;
-      return false;
-    }
+    return config_.parameters->Get(number, result);
+  }
+  bool read_parameter(const ParamName &param, float *result) const {
+    if (param.number >= 0) return read_parameter(param.number, result);
+    *result = 0;
+    if (config_.parameters == NULL) return false;
+    return config_.parameters->Get(param.name, result);
   }
 
-  // Read parameter. Do range check.
-  bool store_parameter(std::string_view param_name, float value) {
+  // Store parameter. Do range check.
+  bool store_parameter(int number, float value) {
     if (config_.parameters == NULL) return false;
-    param_name = TrimWhitespace(param_name);
     // zero parameter can never be written.
-    if (param_name == "0" || ParseInt64(param_name, 0) >= 5400) {
-      gprintf(GLOG_SEMANTIC_ERR, "writing unsupported parameter number (%s)\n",
-              std::string(param_name.begin(), param_name.end()).c_str());
+    if (number <= 0 || number >= 5400) {
+      gprintf(GLOG_SEMANTIC_ERR, "writing unsupported parameter number (%d)\n",
+              number);
       return false;
     }
-    (*config_.parameters)[ToLower(param_name)] = value;
-    return true;
+    return config_.parameters->Set(number, value);
+  }
+  bool store_parameter(const ParamName &param, float value) {
+    if (param.number >= 0) return store_parameter(param.number, value);
+    if (config_.parameters == NULL) return false;
+    return config_.parameters->Set(param.name, value);
   }
 
   const AxesRegister &current_origin() const { return *current_origin_; }
@@ -332,6 +443,8 @@ class GCodeParser::Impl {
 
   FILE *err_msg_ = NULL;
   int modal_g0_g1_ = 0;
+  float feedrate_ = -1;           // Last F in mm/s; -1 if none yet.
+  bool resend_feedrate_ = false;  // Receiver hasn't seen it yet.
   int line_number_ = 0;
   float xyz_unit_to_mm_factor_ = 1.0f;  // metric: 1.0; imperial 25.4
   float rotation_unit_to_degree_factor_ = 1.0f;
@@ -382,6 +495,13 @@ class GCodeParser::Impl {
   std::string while_condition_;
   std::string while_loop_;
 
+  std::string block_buffer_;
+
+  // The block currently parsed, if it came pre-lexed, and the index of the
+  // next word in it we expect.
+  const PrelexedBlock *prelexed_ = nullptr;
+  size_t next_prelexed_word_ = 0;
+
   unsigned int debug_level_ = DEBUG_NONE;  // OR-ed bits from DebugLevel enum
 
   // TODO(hzeller): right now, we hook the error count to the gprintf(), but
@@ -507,12 +627,35 @@ static const char *ParseGcodeNumber(const char *line, float *value) {
   return successful_parse_endpos ? successful_parse_endpos : line;
 }
 
+// Look up the letter/value pair at "line" in the pre-lexed words of the
+// current block. Returns the remaining line, or NULL if we don't have it and
+// need to parse it the regular way.
+const char *GCodeParser::Impl::prelexed_pair(const char *line, char *letter,
+                                             float *value) {
+  const uintptr_t text = (uintptr_t)prelexed_->text.c_str();
+  const uintptr_t pos = (uintptr_t)skip_white(line);
+  if (pos < text || pos >= text + prelexed_->text.size()) return NULL;
+  const std::vector<PrelexedBlock::Word> &words = prelexed_->words;
+  // Words are requested in order, but the same word might be requested again
+  // after a handler stopped in front of it.
+  while (next_prelexed_word_ < words.size() &&
+         text + words[next_prelexed_word_].pos < pos) {
+    ++next_prelexed_word_;
+  }
+  if (next_prelexed_word_ >= words.size()) return NULL;
+  const PrelexedBlock::Word &word = words[next_prelexed_word_];
+  if (text + word.pos != pos) return NULL;
+  *letter = word.letter;
+  *value = word.value;
+  return (const char *)(text + word.end);
+}
+
 // Parameter/variable names can be simple integers (traditional NIST), or
 // a named one.
 // Returns the remainder of the line or NULL if parameter name could not
 // be parsed.
 const char *GCodeParser::Impl::read_param_name(const char *line,
-                                               std::string *result) {
+                                               ParamName *result) {
   line = skip_white(line);
   if (*line == '\0') {
     gprintf(GLOG_SYNTAX_ERR, "expected value after '#'\n");
@@ -541,16 +684,18 @@ const char *GCodeParser::Impl::read_param_name(const char *line,
       return NULL;
     }
     line = endptr;
-    *result = StringPrintf("%d", (int)index);
+    result->number = (int)index;
+    result->name.clear();
   } else {
-    result->clear();
+    result->number = -1;
+    result->name.clear();
     // Allowing alpha-numeric parameters.
     while (*line &&
            ((*line >= '0' && *line <= '9') || (*line >= 'A' && *line <= 'Z') ||
             (*line >= 'a' && *line <= 'z') || *line == '_' ||
             (bracketed && isspace(*line)))) {
       if (!isspace(*line)) {
-        result->append(1, *line);
+        result->name.append(1, *line);
       }
       ++line;
     }
@@ -559,18 +704,19 @@ const char *GCodeParser::Impl::read_param_name(const char *line,
   if (bracketed) {
     if (*line != '>') {
       gprintf(GLOG_SYNTAX_ERR, "Missed closing bracket for parameter <%s>\n",
-              result->c_str());
+              result->name.c_str());
       return NULL;
     }
     ++line;
   }
 
-  return result->empty() ? NULL : skip_white(line);
+  if (result->number < 0 && result->name.empty()) return NULL;
+  return skip_white(line);
 }
 
 const char *GCodeParser::Impl::gcodep_parameter(const char *line,
                                                 float *value) {
-  std::string param_name;
+  ParamName param_name;
   line = read_param_name(line, &param_name);
   if (line == NULL) return NULL;
 
@@ -866,10 +1012,9 @@ const char *GCodeParser::Impl::gcodep_value(const char *line, float *value) {
 }
 
 const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
-  std::string param_name;
+  ParamName param_name;
   line = read_param_name(line, &param_name);
   if (line == NULL) return NULL;
-  const char *log_name = param_name.c_str();
 
   float value;
   if (*line == '+' && *(line + 1) == '+') {
@@ -877,7 +1022,10 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
     read_parameter(param_name, &value);
     value++;
     store_parameter(param_name, value);
-    gprintf(GLOG_EXPRESSION, "#%s++ -> #%s=%f\n", log_name, log_name, value);
+    if (debug_level_ & DEBUG_EXPRESSION) {
+      gprintf(GLOG_EXPRESSION, "#%s++ -> #%s=%f\n", param_name.c_str(),
+              param_name.c_str(), value);
+    }
     return line;
   }
   if (*line == '-' && *(line + 1) == '-') {
@@ -885,7 +1033,10 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
     read_parameter(param_name, &value);
     value--;
     store_parameter(param_name, value);
-    gprintf(GLOG_EXPRESSION, "#%s-- -> #%s=%f\n", log_name, log_name, value);
+    if (debug_level_ & DEBUG_EXPRESSION) {
+      gprintf(GLOG_EXPRESSION, "#%s-- -> #%s=%f\n", param_name.c_str(),
+              param_name.c_str(), value);
+    }
     return line;
   }
 
@@ -908,11 +1059,11 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
     if (*line == '\0') {
       value = 0.0;
       read_parameter(param_name, &value);
-      gprintf(GLOG_INFO, "#%s = %f\n", log_name, value);
+      gprintf(GLOG_INFO, "#%s = %f\n", param_name.c_str(), value);
     } else {
       gprintf(GLOG_SYNTAX_ERR,
               "gcodep_set_parameter: expected '=' after '#%s' got '%s'\n",
-              log_name, line);
+              param_name.c_str(), line);
     }
     return NULL;
   }
@@ -923,7 +1074,7 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
   if (endptr == NULL) {
     gprintf(GLOG_SYNTAX_ERR,
             "gcodep_set_parameter: expected value after '#%s=' got '%s'\n",
-            log_name, line);
+            param_name.c_str(), line);
     return NULL;
   }
   line = skip_white(endptr);
@@ -944,7 +1095,7 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
         gprintf(GLOG_SYNTAX_ERR,
                 "gcodep_set_parameter: expected value after '#%s=[%d] ? ' got "
                 "'%s'\n",
-                log_name, line, condition);
+                param_name.c_str(), line, condition);
         return NULL;
       }
       line = skip_white(endptr);
@@ -957,7 +1108,7 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
           gprintf(GLOG_SYNTAX_ERR,
                   "gcodep_set_parameter: expected value after '#%s=[%d] ? %f "
                   ":' got '%s'\n",
-                  log_name, line, condition, true_value);
+                  param_name.c_str(), line, condition, true_value);
           return NULL;
         }
         line = skip_white(endptr);
@@ -967,7 +1118,7 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
         gprintf(GLOG_SYNTAX_ERR,
                 "gcodep_set_parameter: expected ':' after '#%s=[%d] ? %f' got "
                 "'%s'\n",
-                log_name, line, condition, true_value);
+                param_name.c_str(), line, condition, true_value);
         return NULL;
       }
     }
@@ -976,7 +1127,9 @@ const char *GCodeParser::Impl::gcodep_set_parameter(const char *line) {
   store_parameter(param_name, value);
   callbacks()->gcode_command_done('#', value);
 
-  gprintf(GLOG_EXPRESSION, "#%s=%f\n", log_name, value);
+  if (debug_level_ & DEBUG_EXPRESSION) {
+    gprintf(GLOG_EXPRESSION, "#%s=%f\n", param_name.c_str(), value);
+  }
 
   return line;
 }
@@ -1199,7 +1352,7 @@ void GCodeParser::Impl::InitCoordSystems() {
     value = 0.0;
     std::string coords;
     for (GCodeParserAxis axis : AllAxes()) {
-      read_parameter(StringPrintf("%d", 5221 + offset + axis), &value);
+      read_parameter(5221 + offset + axis, &value);
       coord_system_[i][axis] = machine_origin_[axis] + value;
       if (axis <= AXIS_Y || value)
         coords += StringPrintf(" %c:%.3f", gcodep_axis2letter(axis), value);
@@ -1211,9 +1364,9 @@ void GCodeParser::Impl::InitCoordSystems() {
     }
   }
 
-  if (!read_parameter("5220", &value) || value < 1 || value > 9) {
+  if (!read_parameter(5220, &value) || value < 1 || value > 9) {
     value = 1;  // If not set or invalid, force G54
-    store_parameter("5220", value);
+    store_parameter(5220, value);
   }
 
   const int coord_system = (int)value - 1;
@@ -1286,7 +1439,7 @@ const char *GCodeParser::Impl::handle_G10(const char *line) {
   for (GCodeParserAxis a : AllAxes()) {
     if (!have_val[a]) continue;
     // We always store the absolute offset from home.
-    store_parameter(StringPrintf("%d", 5221 + variable_offset + a),
+    store_parameter(5221 + variable_offset + a,
                     coord_system_[cs][a] - machine_origin_[a]);
   }
   if (current_origin_ == &coord_system_[cs]) {
@@ -1339,7 +1492,7 @@ void GCodeParser::Impl::change_coord_system(float sub_command) {
     gprintf(GLOG_SYNTAX_ERR, "invalid coordinate system %.1f\n", sub_command);
     return;
   }
-  store_parameter("5220", coord_system);
+  store_parameter(5220, coord_system);
   current_origin_ = &coord_system_[coord_system - 1];
   inform_origin_offset_change(kCoordinateSystemNames[coord_system - 1]);
 }
@@ -1393,6 +1546,18 @@ static float f_param_to_feedrate(const float unit_value) {
   return unit_value / 60.0f;  // feedrates are units per minute.
 }
 
+// F is modal; the receiver keeps the last one given. After RestoreState(),
+// it never got the F of the lines before, so it gets it with the next move.
+float GCodeParser::Impl::modal_feedrate(float given) {
+  if (given > 0) {
+    feedrate_ = given;
+  } else if (resend_feedrate_) {
+    given = feedrate_;
+  }
+  resend_feedrate_ = false;
+  return given;
+}
+
 const char *GCodeParser::Impl::handle_move(const char *line,
                                            bool force_change) {
   char axis_l;
@@ -1424,9 +1589,10 @@ const char *GCodeParser::Impl::handle_move(const char *line,
   if (any_change) {
     callbacks()->clamp_to_range(affected_axes, &new_pos);
     if (modal_g0_g1_) {
-      did_move = callbacks()->coordinated_move(feedrate, new_pos);
+      did_move =
+        callbacks()->coordinated_move(modal_feedrate(feedrate), new_pos);
     } else {
-      did_move = callbacks()->rapid_move(feedrate, new_pos);
+      did_move = callbacks()->rapid_move(modal_feedrate(feedrate), new_pos);
     }
   }
   if (did_move) {
@@ -1595,8 +1761,8 @@ const char *GCodeParser::Impl::handle_arc(const char *line, bool is_cw) {
   absolute_center[AXIS_X] += offset[AXIS_X];
   absolute_center[AXIS_Y] += offset[AXIS_Y];
   absolute_center[AXIS_Z] += offset[AXIS_Z];
-  if (callbacks()->arc_move(feedrate, arc_normal_, is_cw, axes_pos_,
-                            absolute_center, target)) {
+  if (callbacks()->arc_move(modal_feedrate(feedrate), arc_normal_, is_cw,
+                            axes_pos_, absolute_center, target)) {
     axes_pos_ = target;
   }
   return line;
@@ -1755,7 +1921,8 @@ const char *GCodeParser::Impl::handle_spline(float sub_command,
     cp2 = _cp2;
   }
 
-  if (callbacks()->spline_move(feedrate, axes_pos_, cp1, cp2, target)) {
+  if (callbacks()->spline_move(modal_feedrate(feedrate), axes_pos_, cp1, cp2,
+                               target)) {
     axes_pos_ = target;
   }
   return line;
@@ -1810,6 +1977,161 @@ const char *GCodeParser::Impl::handle_M111(const char *line) {
 }
 
 // Note: changes here should be documented in G-code.md as well.
+static constexpr uint32_t kStateVersion = 2;
+
+std::string GCodeParser::Impl::SaveState() const {
+  if (do_while_) return "";  // The loop body read so far is not kept.
+  std::string result;
+  StateWriter out(&result);
+  out.Put(kStateVersion);
+  out.Put(machine_origin_);
+  out.Put(line_number_);
+  out.Put(modal_g0_g1_);
+  out.Put(feedrate_);
+  out.Put(xyz_unit_to_mm_factor_);
+  out.Put(rotation_unit_to_degree_factor_);
+  out.Put(axis_is_absolute_);
+  out.Put(ijk_is_absolute_);
+  out.Put(modal_absolute_g90_);
+  out.Put(axes_pos_);
+  for (const AxesRegister &coord_system : coord_system_) out.Put(coord_system);
+  out.Put(global_offset_g92_);
+  // The origin and offset are pointers to one of the registers.
+  const int8_t origin = (current_origin_ == &machine_origin_)
+                          ? -1
+                          : (int8_t)(current_origin_ - coord_system_);
+  out.Put(origin);
+  out.Put(current_global_offset_ == &global_offset_g92_);
+  out.Put(arc_normal_);
+  out.Put(last_spline_cp2_);
+  out.Put(have_first_spline_);
+
+  // Parameters: only the few numeric ones that are set, and the named ones.
+  std::vector<std::pair<int32_t, float>> numeric;
+  if (config_.parameters) {
+    for (int i = 0; i < Config::ParamMap::kNumericParameters; ++i) {
+      float value;
+      if (config_.parameters->Get(i, &value)) numeric.emplace_back(i, value);
+    }
+  }
+  out.Put((uint32_t)numeric.size());
+  for (const auto &number_value : numeric) {
+    out.Put(number_value.first);
+    out.Put(number_value.second);
+  }
+  out.Put((uint32_t)(config_.parameters ? config_.parameters->named().size()
+                                        : 0));
+  if (config_.parameters) {
+    for (const auto &name_value : config_.parameters->named()) {
+      out.Put(std::string_view(name_value.first));
+      out.Put(name_value.second);
+    }
+  }
+  return result;
+}
+
+bool GCodeParser::Impl::RestoreState(std::string_view state) {
+  // Everything is read into temporaries first, so that nothing changes
+  // if the state turns out to be broken.
+  StateReader in(state);
+  uint32_t version = 0;
+  AxesRegister origin;
+  in.Get(&version);
+  in.Get(&origin);
+  if (!in.ok() || version != kStateVersion) return false;
+  for (GCodeParserAxis a : AllAxes()) {
+    // Coordinate systems are relative to the machine origin.
+    if (origin[a] != machine_origin_[a]) return false;
+  }
+  int line_number = 0;
+  int modal_g0_g1 = 0;
+  float feedrate = -1;
+  float xyz_unit_to_mm_factor = 1.0f, rotation_unit_to_degree_factor = 1.0f;
+  bool axis_is_absolute[GCODE_NUM_AXES] = {};
+  bool ijk_is_absolute = false, modal_absolute_g90 = true;
+  AxesRegister axes_pos;
+  AxesRegister coord_system[9];
+  AxesRegister global_offset_g92;
+  int8_t origin_index = -1;
+  bool use_g92 = false;
+  GCodeParserAxis arc_normal = AXIS_Z;
+  AxesRegister last_spline_cp2;
+  bool have_first_spline = false;
+  in.Get(&line_number);
+  in.Get(&modal_g0_g1);
+  in.Get(&feedrate);
+  in.Get(&xyz_unit_to_mm_factor);
+  in.Get(&rotation_unit_to_degree_factor);
+  in.Get(&axis_is_absolute);
+  in.Get(&ijk_is_absolute);
+  in.Get(&modal_absolute_g90);
+  in.Get(&axes_pos);
+  for (AxesRegister &cs : coord_system) in.Get(&cs);
+  in.Get(&global_offset_g92);
+  in.Get(&origin_index);
+  in.Get(&use_g92);
+  in.Get(&arc_normal);
+  in.Get(&last_spline_cp2);
+  in.Get(&have_first_spline);
+
+  uint32_t count = 0;
+  std::vector<std::pair<int32_t, float>> numeric;
+  in.Get(&count);
+  for (uint32_t i = 0; in.ok() && i < count; ++i) {
+    std::pair<int32_t, float> number_value;
+    in.Get(&number_value.first);
+    in.Get(&number_value.second);
+    numeric.push_back(number_value);
+  }
+  std::vector<std::pair<std::string, float>> named;
+  in.Get(&count);
+  for (uint32_t i = 0; in.ok() && i < count; ++i) {
+    std::pair<std::string, float> name_value;
+    in.Get(&name_value.first);
+    in.Get(&name_value.second);
+    named.push_back(name_value);
+  }
+  if (!in.ok() || !in.at_end() || origin_index < -1 || origin_index >= 9 ||
+      arc_normal < AXIS_X || arc_normal >= GCODE_NUM_AXES) {
+    return false;
+  }
+
+  line_number_ = line_number;
+  modal_g0_g1_ = modal_g0_g1;
+  feedrate_ = feedrate;
+  resend_feedrate_ = (feedrate > 0);
+  xyz_unit_to_mm_factor_ = xyz_unit_to_mm_factor;
+  rotation_unit_to_degree_factor_ = rotation_unit_to_degree_factor;
+  memcpy(axis_is_absolute_, axis_is_absolute, sizeof(axis_is_absolute_));
+  ijk_is_absolute_ = ijk_is_absolute;
+  modal_absolute_g90_ = modal_absolute_g90;
+  axes_pos_ = axes_pos;
+  for (int i = 0; i < 9; ++i) coord_system_[i] = coord_system[i];
+  global_offset_g92_ = global_offset_g92;
+  current_origin_ =
+    (origin_index < 0) ? &machine_origin_ : &coord_system_[origin_index];
+  arc_normal_ = arc_normal;
+  last_spline_cp2_ = last_spline_cp2;
+  have_first_spline_ = have_first_spline;
+  do_while_ = false;
+  if (config_.parameters) {
+    config_.parameters->clear();
+    for (const auto &number_value : numeric) {
+      config_.parameters->Set(number_value.first, number_value.second);
+    }
+    for (const auto &name_value : named) {
+      config_.parameters->Set(name_value.first, name_value.second);
+    }
+  }
+
+  const bool visible_g92 = use_g92 && !(global_offset_g92_ == kZeroOffset);
+  set_current_offset(use_g92 ? global_offset_g92_ : kZeroOffset,
+                     visible_g92        ? "G92"
+                     : origin_index < 0 ? "H"
+                                        : kCoordinateSystemNames[origin_index]);
+  return true;
+}
+
 void GCodeParser::Impl::ParseBlock(GCodeParser *owner, const char *line,
                                    FILE *err_stream) {
   if (debug_level_ & DEBUG_PARSER) {
@@ -1905,7 +2227,7 @@ void GCodeParser::Impl::ParseBlock(GCodeParser *owner, const char *line,
     } else if (letter == 'F') {
       // Feedrate is sometimes used in absence of a move command.
       const float unit_value = value * xyz_unit_to_mm_factor_;
-      const float feedrate = f_param_to_feedrate(unit_value);
+      const float feedrate = modal_feedrate(f_param_to_feedrate(unit_value));
       callbacks()->coordinated_move(feedrate, axes_pos_);  // No move, just feed
     } else if (letter == 'N') {
       // Line number? Yeah, ignore for now :)
@@ -1939,11 +2261,54 @@ void GCodeParser::ParseBlock(const char *line, FILE *err_stream) {
   impl_->ParseBlock(this, line, err_stream);
 }
 
+void GCodeParser::Impl::ParseBlock(GCodeParser *owner,
+                                   const PrelexedBlock &block,
+                                   FILE *err_stream) {
+  prelexed_ = &block;
+  next_prelexed_word_ = 0;
+  ParseBlock(owner, block.text.c_str(), err_stream);
+  prelexed_ = nullptr;
+}
+
+void GCodeParser::ParseBlock(const PrelexedBlock &block, FILE *err_stream) {
+  impl_->ParseBlock(this, block, err_stream);
+}
+
+void GCodeParser::ParseBlock(std::string_view line, FILE *err_stream) {
+  std::string *buffer = impl_->block_buffer();
+  buffer->assign(line.data(), line.size());
+  impl_->ParseBlock(this, buffer->c_str(), err_stream);
+}
+
 bool GCodeParser::ReadFile(FILE *input_gcode_stream, FILE *err_stream) {
   if (input_gcode_stream == nullptr) return false;
-  char buffer[8192];  // "8kB ought to be enough for everybody"
-  while (fgets(buffer, sizeof(buffer), input_gcode_stream) != nullptr) {
-    impl_->ParseBlock(this, buffer, err_stream);
+  // Regular files are memory mapped, everything else (e.g. stdin) is read
+  // line by line.
+  MappedLineReader mapped_file;
+  const int fd = fileno(input_gcode_stream);
+  const off_t offset = ftello(input_gcode_stream);
+  if (impl_->parse_ahead()) {
+    GCodeParseAhead parse_ahead(fd, offset < 0 ? 0 : offset);
+    parse_ahead.Start();
+    for (;;) {
+      const PrelexedBlock *block;
+      while ((block = parse_ahead.Peek()) != nullptr) {
+        ParseBlock(*block, err_stream);
+        parse_ahead.Pop();
+      }
+      if (parse_ahead.at_end()) break;
+      parse_ahead.WaitForData();
+    }
+  } else if (offset >= 0 && mapped_file.Map(fd, offset)) {
+    std::string_view line;
+    while (mapped_file.ReadLine(&line)) {
+      ParseBlock(line, err_stream);
+    }
+  } else {
+    char buffer[8192];  // "8kB ought to be enough for everybody"
+    while (fgets(buffer, sizeof(buffer), input_gcode_stream) != nullptr) {
+      impl_->ParseBlock(this, buffer, err_stream);
+    }
   }
   if (err_stream) {
     fflush(err_stream);
@@ -1955,8 +2320,20 @@ bool GCodeParser::ReadFile(FILE *input_gcode_stream, FILE *err_stream) {
   return true;
 }
 
+void GCodeParser::StartNewProgram() { impl_->StartNewProgram(); }
+
+std::string GCodeParser::SaveState() const { return impl_->SaveState(); }
+
+bool GCodeParser::RestoreState(std::string_view state) {
+  return impl_->RestoreState(state);
+}
+
 int GCodeParser::error_count() const { return impl_->error_count(); }
 
+const AxesRegister &GCodeParser::machine_origin() const {
+  return impl_->machine_origin();
+}
+
 const char *GCodeParser::ParsePair(const char *line, char *letter, float *value,
                                    FILE *err_stream) {
   return impl_->gcodep_parse_pair_with_linenumber(-1, line, letter, value,
@@ -35,8 +35,10 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <bitset>
 #include <map>
 #include <string>
+#include <string_view>
 
 #include "common/container.h"
 
@@ -82,6 +84,8 @@ inline bool is_rotational_axis(GCodeParserAxis axis) {
 // evaluation, loops etc. and sends callbacks with plain numbers in absolute
 // coordinates based on (0,0,0) of the machine cube.
 //
+struct PrelexedBlock;  // parse-ahead.h
+
 // The parser neesds a configuration and an implementation of the EventReceiver
 // that processes the callbacks coming from the parser.
 class GCodeParser {
@@ -98,8 +102,17 @@ class GCodeParser {
   // If "err_stream" is non-NULL, sends error messages that way.
   void ParseBlock(const char *line, FILE *err_stream);
 
+  // Same, but with a line that does not need to be nul-terminated, such as
+  // a std::string_view pointing into a memory-mapped file.
+  void ParseBlock(std::string_view line, FILE *err_stream);
+
+  // Same, but with a block that has been pre-lexed by GCodeParseAhead.
+  void ParseBlock(const PrelexedBlock &block, FILE *err_stream);
+
   // Convenience function: Read gcode from file. This reads the file
   // line-by-line, parses these blocks and call the EventReceiver.
+  // Regular files are memory mapped instead of read through the stream.
+  // With Config::parse_ahead, reading and lexing is done in a separate thread.
   // Closes input stream after EOF.
   // The input is expected to be a stream with no stalls, so no input_idle()
   // will be called (Reading from a socket ? Use GCodeStreamer instead.).
@@ -128,9 +141,36 @@ class GCodeParser {
   const char *ParsePair(const char *line, char *letter, float *value,
                         FILE *err_stream);
 
+  // The following blocks are the start of a new program, e.g. the next file
+  // of a job queue. The modal state (G20/G21, G90/G91, G92 offsets, arc
+  // plane, G0/G1) and the line numbers are reset, but unlike M2 the current
+  // program is not finished: there is no gcode_finished() and there are no
+  // machine state events, so motion continues seamlessly into the new one.
+  void StartNewProgram();
+
+  // Get the state of the parser that the following blocks depend on: the
+  // modal state (G20/G21, G90/G91, arc plane, G0/G1, F), coordinate systems,
+  // G92 offsets, the current position, the line number and all parameters.
+  // This is an opaque blob, only to be passed to RestoreState() of a parser
+  // with the same machine origin.
+  // Returns an empty string in the middle of a while loop, which can't be
+  // restored.
+  std::string SaveState() const;
+
+  // Continue from a state returned by SaveState(), e.g. to resume a program
+  // in the middle without running everything before. Like with
+  // StartNewProgram(), there are no machine state events, except that the
+  // event receiver is informed about the restored origin offset, and that
+  // the next move is given the restored feedrate if it has no F.
+  // Returns false and leaves the parser unchanged if "state" is not valid.
+  bool RestoreState(std::string_view state);
+
   // Number of errors seen.
   int error_count() const;
 
+  // The machine origin this parser has been configured with.
+  const AxesRegister &machine_origin() const;
+
  private:
   class Impl;
   Impl *impl_;
@@ -138,7 +178,7 @@ class GCodeParser {
 
 // Configuration for the parser.
 struct GCodeParser::Config {
-  typedef std::map<std::string, float> ParamMap;
+  class ParamMap;
   Config() : parameters(NULL) {}
   explicit Config(const std::string &filename)
       : parameters(NULL), paramfile(filename) {}
@@ -149,6 +189,9 @@ struct GCodeParser::Config {
   // Allow using M111 to change debug messages.
   bool allow_m111 = false;
 
+  // Let ReadFile() read and pre-lex the input in a separate thread.
+  bool parse_ahead = false;
+
   // The machine origin. This is where the end-switches are. Typically,
   // for CNC machines, that might have Z at the highest point for instance,
   // while 3D printers have Z at zero.
@@ -163,6 +206,74 @@ struct GCodeParser::Config {
   const std::string paramfile;
 };
 
+// Storage of the RS274NGC parameters.
+//
+// Numeric parameters (#0..#5999) are the ones used all the time in programs
+// and the parser itself (e.g. coordinate systems #5221...), so these are kept
+// in a flat array, indexed directly by their number.
+// Only the alphanumeric parameters are kept in a map. These are looked up
+// case-insensitively with std::string_view, so accessing them does not
+// allocate memory.
+class GCodeParser::Config::ParamMap {
+ public:
+  // All numeric parameters are below this number.
+  static constexpr int kNumericParameters = 6000;
+
+  // Case-insensitive comparison of parameter names. Transparent, so that
+  // lookups can be done with std::string_view without creating a std::string.
+  struct NameLess {
+    typedef void is_transparent;
+    bool operator()(std::string_view a, std::string_view b) const;
+  };
+  typedef std::map<std::string, float, NameLess> NamedMap;
+
+  ParamMap();
+
+  // Get numeric parameter. Returns true if it has been set, otherwise
+  // (also if out of range) sets "value" to 0 and returns false.
+  bool Get(int number, float *value) const {
+    if (number < 0 || number >= kNumericParameters || !numeric_set_[number]) {
+      *value = 0;
+      return false;
+    }
+    *value = numeric_[number];
+    return true;
+  }
+
+  // Set numeric parameter. Returns false if out of range.
+  bool Set(int number, float value) {
+    if (number < 0 || number >= kNumericParameters) return false;
+    numeric_[number] = value;
+    numeric_set_[number] = true;
+    return true;
+  }
+
+  // Get parameter by name. A name that is a plain number is always treated
+  // as numeric parameter, everything else is looked up case-insensitively.
+  // Returns true if parameter exists, otherwise sets "value" to 0 and returns
+  // false.
+  bool Get(std::string_view name, float *value) const;
+
+  // Set parameter by name. Same name rules as Get(). Returns false if the
+  // name is an out-of-range number or empty.
+  bool Set(std::string_view name, float value);
+
+  // All alphanumeric parameters, sorted case-insensitively by name.
+  const NamedMap &named() const { return named_; }
+
+  // Returns a hash over the values that are kept in the parameter file, so
+  // it can be determined if a program changed them.
+  uint64_t Fingerprint() const;
+
+  // Clear all values.
+  void clear();
+
+ private:
+  float numeric_[kNumericParameters];
+  std::bitset<kNumericParameters> numeric_set_;
+  NamedMap named_;
+};
+
 // Parse Event Callbacks called by the parser and to be implemented by the
 // user with meaningful actions.
 //
@@ -54,10 +54,16 @@ class ParseTester : public GCodeParser::EventReceiver {
   }
   ~ParseTester() override { delete parser_; }
 
-  float get_parameter(int num) { return parameters_[StringPrintf("%d", num)]; }
+  float get_parameter(int num) {
+    float value;
+    parameters_.Get(num, &value);
+    return value;
+  }
 
   float get_parameter(const std::string &name) {
-    return parameters_[ToLower(name)];
+    float value;
+    parameters_.Get(name, &value);
+    return value;
   }
 
   // Main function to test. Returns 'false' if parsing failed.
@@ -109,6 +115,12 @@ class ParseTester : public GCodeParser::EventReceiver {
 
   bool has_errors() const { return parser_->error_count() != 0; }
 
+  void StartNewProgram() { parser_->StartNewProgram(); }
+  std::string SaveState() const { return parser_->SaveState(); }
+  bool RestoreState(std::string_view state) {
+    return parser_->RestoreState(state);
+  }
+
  public:
   // public counters.
   int call_count[NUM_COUNTED_CALLS] = {};
@@ -288,6 +300,92 @@ TEST(GCodeParserTest, absolute_relative) {
   EXPECT_EQ(HOME_Y + 21 + 6 + 11, counter.abs_pos[AXIS_Y]);
 }
 
+TEST(GCodeParserTest, StartNewProgramResetsModalState) {
+  ParseTester counter;
+  counter.TestParseLine("G20 G91");
+  counter.TestParseLine("G92 X5");
+  counter.TestParseLine("G1 X1 Y1");
+  EXPECT_EQ(1, counter.call_count[CALL_gcode_start]);
+
+  counter.StartNewProgram();
+  EXPECT_EQ(HOME_X, counter.parser_offset[AXIS_X]);  // G92 gone.
+  counter.TestParseLine("G1 X10 Y20");  // Metric, absolute
+  EXPECT_EQ(HOME_X + 10, counter.abs_pos[AXIS_X]);
+  EXPECT_EQ(HOME_Y + 20, counter.abs_pos[AXIS_Y]);
+
+  // Without a pause in between: no finish, no new start.
+  EXPECT_EQ(0, counter.call_count[CALL_gcode_finished]);
+  EXPECT_EQ(1, counter.call_count[CALL_gcode_start]);
+}
+
+TEST(GCodeParserTest, RestoreStateContinuesProgram) {
+  ParseTester original;
+  original.TestParseLine("G10 L2 P2 X100 Y100 Z0");
+  original.TestParseLine("G55 G20");
+  original.TestParseLine("#1=2 #foo=3");
+  original.TestParseLine("G1 X1 Y1");
+  original.TestParseLine("G92 X0 G91");
+  const std::string state = original.SaveState();
+  ASSERT_FALSE(state.empty());
+
+  ParseTester resumed;
+  EXPECT_TRUE(resumed.RestoreState(state));
+  EXPECT_EQ(original.parser_offset, resumed.parser_offset);
+  EXPECT_EQ(2, resumed.get_parameter(5220));
+  EXPECT_EQ(3, resumed.get_parameter("foo"));
+  EXPECT_EQ(0, resumed.call_count[CALL_gcode_start]);
+
+  // Both continue the same way: relative, imperial, with the parameters.
+  for (ParseTester *tester : {&original, &resumed}) {
+    EXPECT_TRUE(tester->TestParseLine("G1 X#1 Y#foo"));
+  }
+  EXPECT_EQ(original.abs_pos, resumed.abs_pos);
+  EXPECT_FLOAT_EQ(HOME_X + 100 + 3 * 25.4, resumed.abs_pos[AXIS_X]);
+  EXPECT_FLOAT_EQ(HOME_Y + 100 + 4 * 25.4, resumed.abs_pos[AXIS_Y]);
+}
+
+TEST(GCodeParserTest, RestoreStateKeepsFeedrate) {
+  ParseTester original;
+  original.TestParseLine("G1 X1 F600");
+  original.TestParseLine("G1 X2");
+  const std::string state = original.SaveState();
+
+  ParseTester resumed;
+  EXPECT_TRUE(resumed.RestoreState(state));
+  EXPECT_TRUE(resumed.TestParseLine("G1 X3"));
+  EXPECT_FLOAT_EQ(10, resumed.feedrate);  // F of the lines before.
+  EXPECT_TRUE(resumed.TestParseLine("G1 X4"));
+  EXPECT_EQ(-1, resumed.feedrate);  // Like the original without F.
+  EXPECT_TRUE(resumed.TestParseLine("G1 X5 F1200"));
+  EXPECT_FLOAT_EQ(20, resumed.feedrate);
+}
+
+TEST(GCodeParserTest, RestoreStateRejectsBrokenState) {
+  ParseTester tester;
+  tester.TestParseLine("G1 X10");
+  std::string state = tester.SaveState();
+  tester.TestParseLine("G1 X20");
+
+  EXPECT_FALSE(tester.RestoreState(""));
+  EXPECT_FALSE(tester.RestoreState(state.substr(0, state.size() - 1)));
+  EXPECT_FALSE(tester.RestoreState(state + "x"));
+  state[0] ^= 0xff;  // Version.
+  EXPECT_FALSE(tester.RestoreState(state));
+
+  tester.TestParseLine("G91 G1 X1");  // Unchanged: continues at X20.
+  EXPECT_EQ(HOME_X + 21, tester.abs_pos[AXIS_X]);
+}
+
+TEST(GCodeParserTest, NoStateInsideWhileLoop) {
+  ParseTester tester;
+  EXPECT_TRUE(tester.TestParseLine("#1=0"));
+  EXPECT_TRUE(tester.TestParseLine("WHILE [#1 < 10] DO"));
+  EXPECT_EQ("", tester.SaveState());
+  EXPECT_TRUE(tester.TestParseLine("  #1++"));
+  EXPECT_TRUE(tester.TestParseLine("END"));
+  EXPECT_NE("", tester.SaveState());
+}
+
 TEST(GCodeParserTest, set_origin_G92) {
   ParseTester counter;
   counter.TestParseLine("G1 X100 Y100");  // Some position.
@@ -492,6 +590,65 @@ TEST(GCodeParserTest, alphanumeric_parameters) {
   EXPECT_FALSE(counter.TestParseLine("#<3>=42"));
 }
 
+TEST(GCodeParserTest, ParamMapNumericAndNamedStorage) {
+  typedef GCodeParser::Config::ParamMap ParamMap;
+  ParamMap params;
+  float value = -1;
+
+  // Numeric parameters only exist once set; they read as zero before.
+  EXPECT_FALSE(params.Get(5221, &value));
+  EXPECT_EQ(0, value);
+  EXPECT_TRUE(params.Set(5221, 42));
+  EXPECT_TRUE(params.Get(5221, &value));
+  EXPECT_EQ(42, value);
+  EXPECT_TRUE(params.Get(" 5221 ", &value));  // Name as number.
+  EXPECT_EQ(42, value);
+  EXPECT_TRUE(params.Set("5222", 0));
+  EXPECT_TRUE(params.Get(5222, &value));
+
+  // Out of range numbers are rejected, by number as well as by name.
+  EXPECT_FALSE(params.Set(ParamMap::kNumericParameters, 1));
+  EXPECT_FALSE(params.Set("6000", 1));
+  EXPECT_FALSE(params.Set("12345678901234", 1));
+  EXPECT_FALSE(params.Get("6000", &value));
+  EXPECT_FALSE(params.Get(-1, &value));
+  EXPECT_EQ(0, value);
+  EXPECT_TRUE(params.named().empty());
+
+  // Named parameters are case insensitive.
+  EXPECT_FALSE(params.Get("foo", &value));
+  EXPECT_TRUE(params.Set("FoO", 17));
+  EXPECT_TRUE(params.Get("foo", &value));
+  EXPECT_EQ(17, value);
+  EXPECT_TRUE(params.Get("FOO", &value));
+  EXPECT_EQ(17, value);
+  ASSERT_EQ(1u, params.named().size());
+  EXPECT_EQ("foo", params.named().begin()->first);  // Stored lower-case.
+
+  params.clear();
+  EXPECT_FALSE(params.Get(5221, &value));
+  EXPECT_EQ(0, value);
+  EXPECT_TRUE(params.named().empty());
+}
+
+TEST(GCodeParserTest, ParamMapFingerprintOfSavedValues) {
+  GCodeParser::Config::ParamMap params;
+  const uint64_t empty = params.Fingerprint();
+
+  // Only values that would be written to the parameter file count.
+  params.Set(5221, 0);
+  params.Set("local", 3);
+  EXPECT_EQ(empty, params.Fingerprint());
+
+  params.Set(5221, 42);
+  const uint64_t with_offset = params.Fingerprint();
+  EXPECT_NE(empty, with_offset);
+  params.Set("_global", 3);
+  EXPECT_NE(with_offset, params.Fingerprint());
+  params.Set("_global", 0);
+  EXPECT_EQ(with_offset, params.Fingerprint());
+}
+
 // todo: test G28
 
 TEST(GCodeParserTest, CoordinateSystemNamesRepresentedIn5220) {
@@ -20,6 +20,7 @@
 
 #include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "common/logging.h"
 
@@ -49,8 +50,36 @@ bool GCodeStreamer::ConnectStream(int fd, FILE *msg_stream) {
   msg_stream_ = msg_stream;
   connection_fd_ = fd;
   lines_processed_ = 0;
+  GrantCredits(credit_window_);
 
-  event_server_->RunOnReadable(connection_fd_, [this]() { return ReadData(); });
+  // Files might start somewhere in the middle, e.g. when resuming a program.
+  const off_t offset = lseek(fd, 0, SEEK_CUR);
+  if (offset == 0 && IsCompiledGCode(fd)) {
+    // The end of the stream is finished by us, which also allows to continue
+    // with a next stream.
+    compiled_replay_.reset(
+      new CompiledGCodeReplay(parser_, parse_events_, msg_stream_));
+    compiled_replay_->set_skip_end_of_stream(true);
+    if (!compiled_replay_->Map(fd, parser_->machine_origin())) {
+      Log_error("Can't replay compiled G-code.");
+    }
+    event_server_->RunOnReadable(connection_fd_,
+                                 [this]() { return ReadCompiledData(); });
+  } else if (use_parse_ahead_) {
+    parse_ahead_.reset(new GCodeParseAhead(fd, offset < 0 ? 0 : offset));
+    parse_ahead_->Start();
+    parse_ahead_->RequestNotification();
+    event_server_->RunOnReadable(parse_ahead_->notification_fd(),
+                                 [this]() { return ReadParseAheadData(); });
+  } else if (offset >= 0 && mapped_file_.Map(fd, offset)) {
+    // Regular files are always ready to read, so the mapped file is consumed
+    // chunk by chunk whenever the event loop comes around.
+    event_server_->RunOnReadable(connection_fd_,
+                                 [this]() { return ReadMappedData(); });
+  } else {
+    event_server_->RunOnReadable(connection_fd_,
+                                 [this]() { return ReadData(); });
+  }
   return true;
 }
 
@@ -58,8 +87,12 @@ void GCodeStreamer::CloseStream() {
   if (msg_stream_) {
     fflush(msg_stream_);
   }
+  parse_ahead_.reset();  // Stops the thread before we close its input.
+  if (on_disconnect_) on_disconnect_();
   close(connection_fd_);
   connection_fd_ = -1;
+  mapped_file_.Unmap();
+  compiled_replay_.reset();
   Log_info("Processed %d GCode blocks.", lines_processed_);
 }
 
@@ -81,27 +114,116 @@ bool GCodeStreamer::ReadData() {
       parser_->ParseBlock(line, msg_stream_);
     }
 
-    // always call gcode_finished() to disable motors at end of stream
-    parse_events_->gcode_finished(true);
-    CloseStream();
-    is_processing_ = false;
+    FinishStream();
     return false;  // We're done processing, remove us from fd-mux
   }
 
   is_processing_ = true;
   const char *line;
+  int lines = 0;
   while ((line = line_tokenize_buffer_.ReadAndConsumeLine())) {
     // NOTE:(important)
     // This should return true or false in case the line was movement or not
     // and only if is, reset the timer.
     parser_->ParseBlock(line, msg_stream_);
-    ++lines_processed_;
+    ++lines;
   }
+  lines_processed_ += lines;
+  GrantCredits(lines);
 
   // Loop again
   return true;
 }
 
+// Process the next chunk of lines of a memory mapped file. Roughly the
+// amount ReadData() would get from a read() call, so that other handlers
+// on the event loop still get their turn.
+bool GCodeStreamer::ReadMappedData() {
+  static constexpr size_t kChunkBytes = 16384;
+  const size_t chunk_end = mapped_file_.consumed() + kChunkBytes;
+  std::string_view line;
+  while (mapped_file_.consumed() < chunk_end && mapped_file_.ReadLine(&line)) {
+    parser_->ParseBlock(line, msg_stream_);
+    ++lines_processed_;
+  }
+  if (!mapped_file_.at_end()) {
+    is_processing_ = true;
+    return true;
+  }
+
+  Log_info("Reached EOF.");
+  FinishStream();
+  return false;
+}
+
+// Parse the blocks that the parse-ahead thread has prepared. Like the other
+// readers, handle a limited number per call, so that other handlers on the
+// event loop get their turn.
+bool GCodeStreamer::ReadParseAheadData() {
+  static constexpr int kMaxBlocks = 256;
+  parse_ahead_->ClearNotification();
+  const PrelexedBlock *block;
+  int lines = 0;
+  while (lines < kMaxBlocks && (block = parse_ahead_->Peek())) {
+    parser_->ParseBlock(*block, msg_stream_);
+    parse_ahead_->Pop();
+    ++lines;
+    is_processing_ = true;
+  }
+  lines_processed_ += lines;
+  GrantCredits(lines);
+  if (parse_ahead_->at_end()) {
+    Log_info("Reached EOF.");
+    FinishStream();
+    return false;
+  }
+  parse_ahead_->RequestNotification();
+  return true;
+}
+
+// Replay the next records of a compiled program. As with the other readers,
+// only a limited number per call.
+bool GCodeStreamer::ReadCompiledData() {
+  static constexpr int kMaxRecords = 256;
+  const bool more = compiled_replay_->Continue(kMaxRecords);
+  lines_processed_ = compiled_replay_->records_replayed();
+  if (more) {
+    is_processing_ = true;
+    return true;
+  }
+  if (!compiled_replay_->success()) {
+    Log_error("Stopped replaying broken compiled G-code.");
+  }
+  Log_info("Reached EOF.");
+  FinishStream();
+  return false;
+}
+
+void GCodeStreamer::FinishStream() {
+  const int next_fd = next_stream_ ? next_stream_() : -1;
+  if (next_fd < 0) {
+    // always call gcode_finished() to disable motors at end of stream
+    parse_events_->gcode_finished(true);
+  }
+  FILE *const msg_stream = msg_stream_;
+  CloseStream();
+  is_processing_ = false;
+  if (next_fd >= 0) {
+    parser_->StartNewProgram();
+    // Our watch is only removed after we return, so the next stream can
+    // only be connected at the end of the cycle.
+    event_server_->RunAtEndOfCycle([this, next_fd, msg_stream]() {
+      ConnectStream(next_fd, msg_stream);
+      return false;
+    });
+  }
+}
+
+void GCodeStreamer::GrantCredits(int lines) {
+  if (credit_window_ <= 0 || lines <= 0 || !msg_stream_) return;
+  fprintf(msg_stream_, "credits %d\n", lines);
+}
+
 // We didn't receive a line within x milliseconds.
 bool GCodeStreamer::Timeout() {
   parse_events_->input_idle(is_processing_);
@@ -19,9 +19,15 @@
 #ifndef FD_GCODE_STREAMER_H_
 #define FD_GCODE_STREAMER_H_
 
+#include <functional>
+#include <memory>
+
 #include "common/fd-mux.h"
 #include "common/linebuf-reader.h"
+#include "common/mapped-line-reader.h"
+#include "gcode-parser/compiled-gcode.h"
 #include "gcode-parser/gcode-parser.h"
+#include "gcode-parser/parse-ahead.h"
 
 class GCodeStreamer {
  public:
@@ -31,13 +37,51 @@ class GCodeStreamer {
 
   // Reads GCode lines from "fd" and feeds them to the GCodeParser.
   // Error messages are sent to "err_stream" if non-NULL.
-  // Reads until EOF.
-  // The input file descriptor is closed.
+  // Reads from the current position of "fd" until EOF. If "fd" is a regular
+  // file, it is memory mapped. The input file descriptor is closed.
+  // Files compiled with gcode-compile are replayed without parsing; they
+  // need to be compiled for the machine origin of the parser.
   bool ConnectStream(int fd, FILE *msg_stream);
 
+  // Read and pre-lex the input of the following streams in a separate
+  // thread (see GCodeParseAhead).
+  void set_parse_ahead(bool on) { use_parse_ahead_ = on; }
+
+  // Opt-in flow control for senders that want to pipeline lines instead of
+  // waiting for an 'ok' after each of them. When "lines" is > 0, the
+  // following streams use a credit based window:
+  //   * On connect, "credits <lines>" is sent to the msg_stream: the sender
+  //     may send that many lines without waiting for a response.
+  //   * Whenever lines have been parsed and accepted by the receiver, these
+  //     lines are returned as "credits <n>".
+  // Parsing blocks while the motion queue is full, so credits only come back
+  // when there is capacity to plan more. The sender can keep the queue full
+  // while there are never more than "lines" lines buffered on the way.
+  // Typically used with acknowledge_lines switched off.
+  void set_credit_window(int lines) { credit_window_ = lines; }
+
+  // Called when the current stream is closed, right before its file
+  // descriptor is closed.
+  void set_on_disconnect(const std::function<void()> &on_disconnect) {
+    on_disconnect_ = on_disconnect;
+  }
+
+  // Called at the end of each stream to get the next one of a job queue.
+  // Returns its file descriptor or -1 if there is none. A next stream
+  // continues as a new program (see GCodeParser::StartNewProgram()) without
+  // gcode_finished(), so the planned path is not brought to a halt between
+  // the jobs.
+  void set_next_stream(const std::function<int()> &next_stream) {
+    next_stream_ = next_stream;
+  }
+
   // Returns true if we are already connected to a stream.
   bool IsStreaming() { return connection_fd_ >= 0; }
 
+  // Number of lines (or compiled records) read from the current stream so
+  // far.
+  int lines_processed() const { return lines_processed_; }
+
  private:
   void CloseStream();
 
@@ -46,6 +90,13 @@ class GCodeStreamer {
   GCodeParser::EventReceiver *const parse_events_;
 
   LinebufReader line_tokenize_buffer_;
+  MappedLineReader mapped_file_;
+  bool use_parse_ahead_ = false;
+  int credit_window_ = 0;
+  std::function<void()> on_disconnect_;
+  std::function<int()> next_stream_;
+  std::unique_ptr<GCodeParseAhead> parse_ahead_;
+  std::unique_ptr<CompiledGCodeReplay> compiled_replay_;
   bool is_processing_;
 
   FILE *msg_stream_;
@@ -53,6 +104,11 @@ class GCodeStreamer {
   int lines_processed_;
 
   bool ReadData();
+  bool ReadMappedData();
+  bool ReadParseAheadData();
+  bool ReadCompiledData();
+  void FinishStream();
+  void GrantCredits(int lines);
   bool Timeout();
 };
 
@@ -24,9 +24,12 @@
 #include <string.h>
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "common/fd-mux.h"
 #include "common/logging.h"
+#include "gcode-parser/compiled-gcode.h"
 #include "gcode-parser/gcode-parser.h"
 
 class MockStream {
@@ -59,13 +62,15 @@ class StreamTester : public GCodeParser::EventReceiver {
         streamer_(new GCodeStreamer(&event_server_, parser_.get(), this)),
         stream_mock_(NULL) {}
 
-  bool OpenStream() {
+  bool OpenStream(FILE *msg_stream = NULL) {
     assert(stream_mock_ == NULL);
     stream_mock_ = new MockStream();
     return streamer_->ConnectStream(stream_mock_->GetReceiverFiledescriptor(),
-                                    NULL);
+                                    msg_stream);
   }
 
+  bool OpenFile(int fd) { return streamer_->ConnectStream(fd, NULL); }
+
   void CloseStream() {
     stream_mock_->CloseSender();
     delete stream_mock_;
@@ -74,7 +79,25 @@ class StreamTester : public GCodeParser::EventReceiver {
 
   void SendString(const char *line) { stream_mock_->SendData(line); }
 
-  void Cycle() { event_server_.SingleCycle(0); }
+  void Cycle(unsigned timeout_ms = 0) { event_server_.SingleCycle(timeout_ms); }
+
+  void EnableParseAhead() { streamer_->set_parse_ahead(true); }
+  void SetCreditWindow(int lines) { streamer_->set_credit_window(lines); }
+  bool IsStreaming() { return streamer_->IsStreaming(); }
+
+  // Queue a complete stream with "content" to be read after the current one.
+  void QueueNextStream(const char *content) {
+    next_mocks_.emplace_back(new MockStream());
+    next_mocks_.back()->SendData(content);
+    next_mocks_.back()->CloseSender();
+    next_streams_.push_back(next_mocks_.back()->GetReceiverFiledescriptor());
+    streamer_->set_next_stream([this]() {
+      if (next_streams_.empty()) return -1;
+      const int fd = next_streams_.front();
+      next_streams_.erase(next_streams_.begin());
+      return fd;
+    });
+  }
 
   MOCK_METHOD1(gcode_start, void(GCodeParser *parser));
   MOCK_METHOD1(gcode_finished, void(bool end_of_stream));
@@ -107,9 +130,12 @@ class StreamTester : public GCodeParser::EventReceiver {
   std::unique_ptr<GCodeParser> parser_;
   std::unique_ptr<GCodeStreamer> streamer_;
   MockStream *stream_mock_;
+  std::vector<std::unique_ptr<MockStream>> next_mocks_;
+  std::vector<int> next_streams_;
 };
 
 using testing::_;
+using testing::AnyNumber;
 using testing::FloatEq;
 using testing::InSequence;
 
@@ -174,6 +200,157 @@ TEST(Streaming, basic_stream) {
   tester.Cycle();  // Wait the stream to close
 }
 
+// With parse-ahead, lines are read in a separate thread, so we can't
+// predict in which cycle they arrive; but all of them need to be parsed.
+TEST(Streaming, parse_ahead_stream) {
+  StreamTester tester;
+  tester.EnableParseAhead();
+  EXPECT_CALL(tester, gcode_start(_)).Times(1);
+  EXPECT_CALL(tester, coordinated_move(FloatEq(1000.0 / 60), _)).Times(3);
+  EXPECT_CALL(tester, input_idle(_)).Times(AnyNumber());
+  EXPECT_CALL(tester, gcode_finished(true)).Times(1);
+  tester.OpenStream();
+  tester.SendString("G1X200F1000\nG1X200F1000\n");
+  tester.SendString("G1X200F1000");  // Incomplete last line.
+  tester.CloseStream();
+  for (int i = 0; i < 50 && tester.IsStreaming(); ++i) {
+    tester.Cycle(100);
+  }
+  EXPECT_FALSE(tester.IsStreaming());
+}
+
+// Streams of a job queue are read back-to-back as one program: only the
+// last one finishes it. Modal state such as G91 does not leak into the next.
+TEST(Streaming, next_stream_continues_without_finishing) {
+  StreamTester tester;
+  tester.QueueNextStream("G1X10F1000\n");
+  EXPECT_CALL(tester, input_idle(_)).Times(AnyNumber());
+  {
+    InSequence s;
+    EXPECT_CALL(tester, gcode_start(_)).Times(1);
+    EXPECT_CALL(tester, coordinated_move(_, _)).Times(2);
+    EXPECT_CALL(tester, coordinated_move(_, _))
+      .WillOnce([](float, const AxesRegister &pos) {
+        EXPECT_FLOAT_EQ(10, pos[AXIS_X]);  // Absolute again.
+        return true;
+      });
+    EXPECT_CALL(tester, gcode_finished(true)).Times(1);
+  }
+  tester.OpenStream();
+  tester.SendString("G91\nG1X200F1000\nG1X200\n");
+  tester.CloseStream();
+  for (int i = 0; i < 10 && tester.IsStreaming(); ++i) {
+    tester.Cycle();
+  }
+  EXPECT_FALSE(tester.IsStreaming());
+}
+
+// Files are read from their current position, e.g. to resume a program.
+TEST(Streaming, file_starts_at_current_position) {
+  for (const bool parse_ahead : {false, true}) {
+    StreamTester tester;
+    if (parse_ahead) tester.EnableParseAhead();
+    FILE *file = tmpfile();
+    fputs("G1X1F1000\nG1X2\nG1X3\n", file);
+    fflush(file);
+    const int fd = dup(fileno(file));
+    lseek(fd, strlen("G1X1F1000\n"), SEEK_SET);
+
+    EXPECT_CALL(tester, input_idle(_)).Times(AnyNumber());
+    {
+      InSequence s;
+      EXPECT_CALL(tester, gcode_start(_)).Times(1);
+      EXPECT_CALL(tester, coordinated_move(_, _))
+        .WillOnce([](float, const AxesRegister &pos) {
+          EXPECT_FLOAT_EQ(2, pos[AXIS_X]);
+          return true;
+        });
+      EXPECT_CALL(tester, coordinated_move(_, _)).Times(1);
+      EXPECT_CALL(tester, gcode_finished(true)).Times(1);
+    }
+    EXPECT_TRUE(tester.OpenFile(fd));
+    for (int i = 0; i < 50 && tester.IsStreaming(); ++i) {
+      tester.Cycle(100);
+    }
+    EXPECT_FALSE(tester.IsStreaming());
+    fclose(file);
+  }
+}
+
+// Compiled files are replayed a chunk at a time, so that the event loop
+// keeps running, and they are only finished once.
+TEST(Streaming, compiled_file_is_replayed_incrementally) {
+  StreamTester tester;
+  std::string program;
+  for (int i = 1; i <= 1000; ++i) {
+    program += "G1 F1000 X" + std::to_string(i) + "\n";
+  }
+  FILE *file = tmpfile();
+  {
+    GCodeCompiler compiler(file, GCodeParser::Config().machine_origin);
+    GCodeParser parser(GCodeParser::Config(), &compiler);
+    parser.ReadFile(fmemopen(&program[0], program.size(), "r"), NULL);
+  }
+  const int fd = dup(fileno(file));
+  lseek(fd, 0, SEEK_SET);
+
+  int moves = 0;
+  EXPECT_CALL(tester, input_idle(_)).Times(AnyNumber());
+  EXPECT_CALL(tester, gcode_start(_)).Times(1);
+  EXPECT_CALL(tester, coordinated_move(_, _))
+    .WillRepeatedly([&moves](float, const AxesRegister &pos) {
+      EXPECT_FLOAT_EQ(++moves, pos[AXIS_X]);
+      return true;
+    });
+  EXPECT_CALL(tester, gcode_finished(true)).Times(1);
+  EXPECT_TRUE(tester.OpenFile(fd));
+  tester.Cycle();
+  EXPECT_GT(moves, 0);
+  EXPECT_LT(moves, 1000);
+  for (int i = 0; i < 50 && tester.IsStreaming(); ++i) {
+    tester.Cycle();
+  }
+  EXPECT_FALSE(tester.IsStreaming());
+  EXPECT_EQ(1000, moves);
+  fclose(file);
+}
+
+static std::string ReadAll(FILE *f) {
+  std::string result;
+  char buffer[256];
+  rewind(f);
+  while (fgets(buffer, sizeof(buffer), f)) result += buffer;
+  fseek(f, 0, SEEK_END);  // Continue writing at the end.
+  return result;
+}
+
+// Initially, the whole window is granted as credits, then each batch of
+// parsed lines is returned.
+TEST(Streaming, credit_window) {
+  StreamTester tester;
+  tester.SetCreditWindow(4);
+  FILE *msg_stream = tmpfile();
+  EXPECT_CALL(tester, gcode_start(_)).Times(1);
+  EXPECT_CALL(tester, coordinated_move(FloatEq(1000.0 / 60), _)).Times(3);
+  EXPECT_CALL(tester, input_idle(_)).Times(AnyNumber());
+  tester.OpenStream(msg_stream);
+  EXPECT_EQ("credits 4\n", ReadAll(msg_stream));
+
+  tester.SendString("G1X200F1000\nG1X200F1000\n");
+  tester.Cycle();
+  EXPECT_EQ("credits 4\ncredits 2\n", ReadAll(msg_stream));
+
+  tester.SendString("G1X200F1000\nG1X2");  // Only complete lines count.
+  tester.Cycle();
+  EXPECT_EQ("credits 4\ncredits 2\ncredits 1\n", ReadAll(msg_stream));
+
+  EXPECT_CALL(tester, gcode_finished(true)).Times(1);
+  EXPECT_CALL(tester, coordinated_move(_, _)).Times(1);
+  tester.CloseStream();
+  tester.Cycle();
+  fclose(msg_stream);
+}
+
 int main(int argc, char *argv[]) {
   Log_init("/dev/stderr");
   ::testing::InitGoogleTest(&argc, argv);
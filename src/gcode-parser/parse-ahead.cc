@@ -0,0 +1,208 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gcode-parser/parse-ahead.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "common/linebuf-reader.h"
+#include "common/logging.h"
+#include "common/mapped-line-reader.h"
+#include "common/string-util.h"
+
+static const char *skip_white(const char *line) {
+  while (*line && isspace(*line)) line++;
+  return line;
+}
+
+// Lexes simple words exactly like GCodeParser::Impl does in
+// gcodep_parse_pair_with_linenumber(); everything else is left to the parser.
+void PrelexBlock(std::string_view line, PrelexedBlock *block) {
+  block->text.assign(line.data(), line.size());
+  block->words.clear();
+  const char *const start = block->text.c_str();
+  const char *remaining = start;
+  for (;;) {
+    const char *const pos = skip_white(remaining);
+    const char *p = pos;
+    if (*p == '(') {  // Comment between words.
+      while (*p && *p != ')') p++;
+      if (*p == '\0') return;
+      p = skip_white(p + 1);
+    }
+    // Anything not starting with a letter is either the end of the block,
+    // or a parameter assignment or checksum the parser has to deal with.
+    if (!isalpha(*p)) return;
+    const char letter = toupper(*p);
+    p = skip_white(p + 1);
+
+    // Only plain numbers. Expressions, parameters and unary functions
+    // depend on the parser state. This also makes sure that we never see
+    // the keywords IF or WHILE here.
+    if (!isdigit(*p) && *p != '.' && *p != '-' && *p != '+') return;
+    float value;
+    const char *end = convert_strtof(p, &value);
+    if (end == nullptr) return;  // Let the parser report the error.
+    end = skip_white(end);
+    block->words.push_back({(uint32_t)(pos - start), (uint32_t)(end - start),
+                            letter, value});
+    remaining = end;
+  }
+}
+
+static void Signal(int fd) {
+  const uint64_t one = 1;
+  if (write(fd, &one, sizeof(one)) < 0) {
+    Log_error("Parse-ahead: can't signal (%s)", strerror(errno));
+  }
+}
+
+static void ClearSignal(int fd) {
+  uint64_t value;
+  if (read(fd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+    Log_error("Parse-ahead: can't read signal (%s)", strerror(errno));
+  }
+}
+
+GCodeParseAhead::GCodeParseAhead(int fd, off_t offset, int capacity)
+    : fd_(fd),
+      offset_(offset),
+      capacity_(capacity),
+      ring_(capacity),
+      producer_wakeup_fd_(eventfd(0, EFD_NONBLOCK)),
+      consumer_wakeup_fd_(eventfd(0, EFD_NONBLOCK)),
+      head_(0),
+      tail_(0),
+      producer_waiting_(false),
+      consumer_waiting_(false),
+      input_done_(false),
+      shutdown_(false) {}
+
+GCodeParseAhead::~GCodeParseAhead() {
+  shutdown_.store(true);
+  Signal(producer_wakeup_fd_);
+  if (thread_.joinable()) thread_.join();
+  close(producer_wakeup_fd_);
+  close(consumer_wakeup_fd_);
+}
+
+void GCodeParseAhead::Start() {
+  thread_ = std::thread([this]() { Run(); });
+}
+
+const PrelexedBlock *GCodeParseAhead::Peek() {
+  const size_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail == head_.load(std::memory_order_acquire)) return nullptr;
+  return &ring_[tail % capacity_];
+}
+
+void GCodeParseAhead::Pop() {
+  tail_.store(tail_.load(std::memory_order_relaxed) + 1);
+  if (producer_waiting_.exchange(false)) Signal(producer_wakeup_fd_);
+}
+
+bool GCodeParseAhead::at_end() {
+  // Order matters: the producer sets input_done_ after publishing its last
+  // block.
+  return input_done_.load() && tail_.load() == head_.load();
+}
+
+void GCodeParseAhead::RequestNotification() {
+  consumer_waiting_.store(true);
+  if (input_done_.load() || tail_.load() != head_.load()) {
+    if (consumer_waiting_.exchange(false)) Signal(consumer_wakeup_fd_);
+  }
+}
+
+void GCodeParseAhead::ClearNotification() { ClearSignal(consumer_wakeup_fd_); }
+
+void GCodeParseAhead::WaitForData() {
+  RequestNotification();
+  struct pollfd p = {consumer_wakeup_fd_, POLLIN, 0};
+  while (poll(&p, 1, -1) < 0 && errno == EINTR) {
+  }
+  ClearNotification();
+}
+
+// Wait until the consumer made space in the ring. Returns false if we are
+// asked to shut down.
+bool GCodeParseAhead::WaitForSpace() {
+  const size_t head = head_.load(std::memory_order_relaxed);
+  while (head - tail_.load() >= capacity_) {
+    producer_waiting_.store(true);
+    if (head - tail_.load() < capacity_) {
+      producer_waiting_.store(false);
+      break;
+    }
+    struct pollfd p = {producer_wakeup_fd_, POLLIN, 0};
+    if (poll(&p, 1, -1) < 0 && errno != EINTR) return false;
+    ClearSignal(producer_wakeup_fd_);
+    if (shutdown_.load()) return false;
+  }
+  return !shutdown_.load();
+}
+
+bool GCodeParseAhead::Publish(std::string_view line) {
+  if (!WaitForSpace()) return false;
+  const size_t head = head_.load(std::memory_order_relaxed);
+  PrelexBlock(line, &ring_[head % capacity_]);
+  head_.store(head + 1);
+  if (consumer_waiting_.exchange(false)) Signal(consumer_wakeup_fd_);
+  return true;
+}
+
+void GCodeParseAhead::Run() {
+  MappedLineReader mapped_file;
+  if (mapped_file.Map(fd_, offset_)) {
+    std::string_view line;
+    while (mapped_file.ReadLine(&line)) {
+      if (!Publish(line)) break;
+    }
+  } else {
+    LinebufReader line_buffer;
+    struct pollfd fds[2] = {{fd_, POLLIN, 0}, {producer_wakeup_fd_, POLLIN, 0}};
+    for (;;) {
+      // Wait for input, but stay responsive to shutdown requests.
+      if (poll(fds, 2, -1) < 0) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      if (shutdown_.load()) break;
+      if (fds[1].revents) ClearSignal(producer_wakeup_fd_);
+      if (fds[0].revents == 0) continue;
+      if (line_buffer.Update(fd_) <= 0) {
+        const char *line = line_buffer.IncompleteLine();
+        if (line) Publish(line);
+        break;
+      }
+      const char *line;
+      bool ok = true;
+      while (ok && (line = line_buffer.ReadAndConsumeLine())) {
+        ok = Publish(line);
+      }
+      if (!ok) break;
+    }
+  }
+  input_done_.store(true);
+  if (consumer_waiting_.exchange(false)) Signal(consumer_wakeup_fd_);
+}
@@ -0,0 +1,144 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_GCODE_PARSE_AHEAD_H
+#define _BEAGLEG_GCODE_PARSE_AHEAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// A G-code block, with the words already lexed that can be lexed without
+// knowing the state of the parser.
+//
+// These are the plain words consisting of a letter followed by a number, such
+// as "G1" or "X-12.5" - which make up almost all of typical G-code. Lexing
+// stops at the first word that needs the parser state to be understood, such
+// as parameters, expressions or control statements. The GCodeParser uses the
+// pre-lexed words where it can and lexes the remaining text as usual, so the
+// result is exactly the same as parsing the text.
+struct PrelexedBlock {
+  struct Word {
+    uint32_t pos;  // Offset in text where parsing of this word starts.
+    uint32_t end;  // Offset of the remaining text after this word.
+    char letter;   // Upper-case letter.
+    float value;
+  };
+
+  std::string text;
+  std::vector<Word> words;
+};
+
+// Fill "block" with the given line and its pre-lexed words. The existing
+// capacity of "block" is re-used.
+void PrelexBlock(std::string_view line, PrelexedBlock *block);
+
+// Reads G-code from a file descriptor in a separate thread and pre-lexes the
+// blocks ahead of time, so that the costly byte-level work is not done in
+// the same call chain as the motion planning.
+//
+// The blocks are handed over in a bounded lock-free ring buffer with a single
+// producer (the parse-ahead thread) and a single consumer (the thread calling
+// the GCodeParser). All the parser state stays on the consumer side.
+//
+// Usage:
+//   GCodeParseAhead ahead(fd);
+//   ahead.Start();
+//   for (;;) {
+//     const PrelexedBlock *block;
+//     while ((block = ahead.Peek()) != nullptr) {
+//       parser->ParseBlock(*block, err_stream);
+//       ahead.Pop();
+//     }
+//     if (ahead.at_end()) break;
+//     ahead.WaitForData();  // Or: wait for notification_fd() in event loop.
+//   }
+class GCodeParseAhead {
+ public:
+  // Reads from "fd", which stays owned by the caller. Regular files are
+  // memory mapped and read starting at "offset", everything else is read
+  // from the current position. "capacity" is the number of blocks that can
+  // be parsed ahead.
+  explicit GCodeParseAhead(int fd, off_t offset = 0, int capacity = 1024);
+  ~GCodeParseAhead();
+
+  GCodeParseAhead(const GCodeParseAhead &) = delete;
+  GCodeParseAhead &operator=(const GCodeParseAhead &) = delete;
+
+  // Start the parse-ahead thread.
+  void Start();
+
+  // Returns the next block or nullptr if none is available right now.
+  // The block is valid until Pop() is called.
+  const PrelexedBlock *Peek();
+
+  // Done with the block returned by Peek(); hand the slot back to the
+  // parse-ahead thread.
+  void Pop();
+
+  // Returns true if the input reached EOF and all blocks have been consumed.
+  bool at_end();
+
+  // A file descriptor that becomes readable after a call to
+  // RequestNotification() as soon as blocks are available or the input
+  // is at its end. Useful to be included in an event loop.
+  int notification_fd() const { return consumer_wakeup_fd_; }
+
+  // Ask for notification_fd() to become readable once there is something to
+  // consume. If there already is, it becomes readable immediately.
+  void RequestNotification();
+
+  // Reset a readable notification_fd(). To be called in the handler.
+  void ClearNotification();
+
+  // Block until there is something to consume.
+  void WaitForData();
+
+ private:
+  void Run();
+  bool Publish(std::string_view line);
+  bool WaitForSpace();
+
+  const int fd_;
+  const off_t offset_;
+  const size_t capacity_;
+  std::vector<PrelexedBlock> ring_;
+
+  const int producer_wakeup_fd_;
+  const int consumer_wakeup_fd_;
+
+  // Only written by the producer or the consumer respectively. Kept on
+  // separate cache lines, so that they don't slow each other down.
+  alignas(64) std::atomic<size_t> head_;
+  alignas(64) std::atomic<size_t> tail_;
+
+  alignas(64) std::atomic<bool> producer_waiting_;
+  std::atomic<bool> consumer_waiting_;
+  std::atomic<bool> input_done_;
+  std::atomic<bool> shutdown_;
+
+  std::thread thread_;
+};
+
+#endif  // _BEAGLEG_GCODE_PARSE_AHEAD_H
@@ -0,0 +1,230 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gcode-parser/parse-ahead.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "common/string-util.h"
+#include "gcode-parser/gcode-parser.h"
+
+TEST(PrelexBlock, SimpleWords) {
+  PrelexedBlock block;
+  PrelexBlock("g1 X10.5 (comment) y -2 F.5", &block);
+  ASSERT_EQ(4u, block.words.size());
+  EXPECT_EQ('G', block.words[0].letter);
+  EXPECT_EQ(1.0f, block.words[0].value);
+  EXPECT_EQ('X', block.words[1].letter);
+  EXPECT_EQ(10.5f, block.words[1].value);
+  EXPECT_EQ('Y', block.words[2].letter);
+  EXPECT_EQ(-2.0f, block.words[2].value);
+  EXPECT_EQ('F', block.words[3].letter);
+  EXPECT_EQ(0.5f, block.words[3].value);
+  EXPECT_EQ(block.text.size(), block.words[3].end);
+
+  // Parsing of a word starts where the previous one ended.
+  EXPECT_EQ(0u, block.words[0].pos);
+  EXPECT_EQ(block.words[0].end, block.words[1].pos);
+}
+
+TEST(PrelexBlock, StopsAtWordsThatNeedParserState) {
+  PrelexedBlock block;
+  PrelexBlock("G1 X#1 Y2", &block);
+  EXPECT_EQ(1u, block.words.size());
+
+  PrelexBlock("G1 X[1+2] Y2", &block);
+  EXPECT_EQ(1u, block.words.size());
+
+  PrelexBlock("#1=5 G1 X1", &block);
+  EXPECT_EQ(0u, block.words.size());
+
+  PrelexBlock("IF [#1 GT 2] THEN G1 X1", &block);
+  EXPECT_EQ(0u, block.words.size());
+
+  PrelexBlock("G1 X1 ; comment Y2", &block);
+  EXPECT_EQ(2u, block.words.size());
+
+  PrelexBlock("G1 X- Y2", &block);  // Error, left to the parser to report.
+  EXPECT_EQ(1u, block.words.size());
+}
+
+// Receiver that writes the events into a string, so that we can compare
+// parsing text with parsing pre-lexed blocks.
+class EventLogger : public GCodeParser::EventReceiver {
+ public:
+  const std::string &log() const { return log_; }
+
+  void gcode_start(GCodeParser *parser) final { log_ += "start\n"; }
+  void go_home(AxisBitmap_t axes) final {}
+  void set_speed_factor(float f) final {}
+  void set_temperature(float t) final {}
+  void wait_temperature() final {}
+  void motors_enable(bool on) final {}
+  void gcode_command_done(char letter, float val) final {
+    log_ += StringPrintf("done %c%.3f\n", letter, val);
+  }
+  void dwell(float ms) final { log_ += StringPrintf("dwell %.3f\n", ms); }
+  void set_fanspeed(float s) final { log_ += StringPrintf("fan %.3f\n", s); }
+  bool coordinated_move(float feed, const AxesRegister &p) final {
+    log_ += StringPrintf("G1 %.3f %s\n", feed, Pos(p).c_str());
+    return true;
+  }
+  bool rapid_move(float feed, const AxesRegister &p) final {
+    log_ += StringPrintf("G0 %.3f %s\n", feed, Pos(p).c_str());
+    return true;
+  }
+  const char *unprocessed(char letter, float value, const char *rest) final {
+    log_ += StringPrintf("unprocessed %c%.0f '%s'\n", letter, value, rest);
+    return rest;  // Let the parser continue with the rest of the line.
+  }
+
+ private:
+  static std::string Pos(const AxesRegister &p) {
+    return StringPrintf("%.3f,%.3f,%.3f", p[AXIS_X], p[AXIS_Y], p[AXIS_Z]);
+  }
+
+  std::string log_;
+};
+
+static const char *const kProgram[] = {
+  "G21 G90",
+  "G0 X1 Y2 Z3",
+  "g1x5f600",
+  "G1 X 7 (comment) Y 8.5",
+  "G1 X1 ; comment Y2",
+  "#1 = 3",
+  "G91 G1 X#1 Y1",
+  "G90 G1 X[#1 * 2] Y-1",
+  "M42 P1 S1 G1 X4",
+  "M106 S127",
+  "G4 P500",
+  "#2 = 0",
+  "WHILE [#2 LT 3] DO",
+  "  G1 X#2 Y7",
+  "  #2 = [#2 + 1]",
+  "END",
+  "IF [#1 GT 2] THEN G1 X9",
+  "G1 X- Y2",
+  "X3 Y4",
+  "M2",
+};
+
+TEST(PrelexBlock, ParsingPrelexedBlocksYieldsSameEvents) {
+  GCodeParser::Config config;
+  GCodeParser::Config::ParamMap text_params;
+  config.parameters = &text_params;
+  EventLogger text_events;
+  GCodeParser text_parser(config, &text_events);
+
+  GCodeParser::Config::ParamMap prelexed_params;
+  config.parameters = &prelexed_params;
+  EventLogger prelexed_events;
+  GCodeParser prelexed_parser(config, &prelexed_events);
+
+  PrelexedBlock block;
+  for (const char *line : kProgram) {
+    text_parser.ParseBlock(line, NULL);
+    PrelexBlock(line, &block);
+    prelexed_parser.ParseBlock(block, NULL);
+  }
+  EXPECT_FALSE(text_events.log().empty());
+  EXPECT_EQ(text_events.log(), prelexed_events.log());
+  EXPECT_EQ(text_parser.error_count(), prelexed_parser.error_count());
+}
+
+static std::string ReadAll(GCodeParseAhead *parse_ahead) {
+  std::string result;
+  parse_ahead->Start();
+  for (;;) {
+    const PrelexedBlock *block;
+    while ((block = parse_ahead->Peek()) != nullptr) {
+      result.append(block->text).append("|");
+      parse_ahead->Pop();
+    }
+    if (parse_ahead->at_end()) break;
+    parse_ahead->WaitForData();
+  }
+  return result;
+}
+
+TEST(GCodeParseAhead, ReadFromPipe) {
+  int pipe_fd[2];
+  ASSERT_EQ(0, pipe(pipe_fd));
+  std::string content;
+  std::string expected;
+  for (int i = 0; i < 1000; ++i) {
+    content += StringPrintf("G1 X%d\n", i);
+    expected += StringPrintf("G1 X%d|", i);
+  }
+  content += "M2";  // Last line without newline.
+  expected += "M2|";
+
+  // Fill the pipe from another thread, as it would block on a full pipe.
+  std::thread writer([&]() {
+    ASSERT_EQ((ssize_t)content.size(),
+              write(pipe_fd[1], content.data(), content.size()));
+    close(pipe_fd[1]);
+  });
+
+  GCodeParseAhead parse_ahead(pipe_fd[0], 0, 16);  // Small ring: wraps around
+  EXPECT_EQ(expected, ReadAll(&parse_ahead));
+  writer.join();
+  close(pipe_fd[0]);
+}
+
+TEST(GCodeParseAhead, ReadFromRegularFile) {
+  char filename[] = "/tmp/parse-ahead-test.XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  unlink(filename);
+  const std::string content = "skipped\nG1 X1\r\nG1 X2\n";
+  ASSERT_EQ((ssize_t)content.size(), write(fd, content.data(), content.size()));
+
+  GCodeParseAhead parse_ahead(fd, 8, 2);
+  EXPECT_EQ("G1 X1|G1 X2|", ReadAll(&parse_ahead));
+  close(fd);
+}
+
+TEST(GCodeParseAhead, StopWithoutConsumingEverything) {
+  int pipe_fd[2];
+  ASSERT_EQ(0, pipe(pipe_fd));
+  const std::string content = "G1 X1\nG1 X2\nG1 X3\nG1 X4\n";
+  ASSERT_EQ((ssize_t)content.size(),
+            write(pipe_fd[1], content.data(), content.size()));
+  {
+    // Producer blocks on the full ring and on the open pipe. Destruction
+    // must still finish.
+    GCodeParseAhead parse_ahead(pipe_fd[0], 0, 2);
+    parse_ahead.Start();
+    parse_ahead.WaitForData();
+    ASSERT_NE(nullptr, parse_ahead.Peek());
+  }
+  close(pipe_fd[0]);
+  close(pipe_fd[1]);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,253 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gcode-parser/parser-checkpoints.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "common/hash.h"
+#include "common/logging.h"
+#include "common/mapped-line-reader.h"
+#include "common/string-util.h"
+
+namespace {
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  int32_t lines;
+  uint32_t count;
+};
+
+struct CheckpointHeader {
+  int32_t line;
+  uint32_t state_size;
+  uint64_t offset;
+};
+
+constexpr char kMagic[4] = {'B', 'G', 'C', 'P'};
+constexpr uint32_t kVersion = 1;
+
+// Only the parser state is of interest, so all events are ignored. Moves
+// are accepted, so that the parser follows the position.
+class NoMotionEventReceiver : public GCodeParser::EventReceiver {
+ public:
+  void gcode_start(GCodeParser *parser) final {}
+  void go_home(AxisBitmap_t axis_bitmap) final {}
+  bool probe_axis(float feed_mm_p_sec, enum GCodeParserAxis axis,
+                  float *probed_position) final {
+    return false;
+  }
+  void set_speed_factor(float factor) final {}
+  void set_fanspeed(float speed) final {}
+  void set_temperature(float degrees_c) final {}
+  void wait_temperature() final {}
+  void dwell(float time_ms) final {}
+  void motors_enable(bool enable) final {}
+  bool coordinated_move(float feed_mm_p_sec,
+                        const AxesRegister &absolute_pos) final {
+    return true;
+  }
+  bool rapid_move(float feed_mm_p_sec, const AxesRegister &absolute_pos) final {
+    return true;
+  }
+  bool arc_move(float feed_mm_p_sec, GCodeParserAxis normal_axis,
+                bool clockwise, const AxesRegister &start,
+                const AxesRegister &center, const AxesRegister &end) final {
+    return true;
+  }
+  bool spline_move(float feed_mm_p_sec, const AxesRegister &start,
+                   const AxesRegister &cp1, const AxesRegister &cp2,
+                   const AxesRegister &end) final {
+    return true;
+  }
+  const char *unprocessed(char letter, float value,
+                          const char *rest_of_line) final {
+    return rest_of_line;  // Continue with the other words in the line.
+  }
+};
+
+// Same parser setup as "config", but without a parameter file, so that
+// M500/M501 in the program don't touch it.
+GCodeParser::Config NoParamFileConfig(const GCodeParser::Config &config,
+                                      GCodeParser::Config::ParamMap *params) {
+  GCodeParser::Config result;
+  result.machine_origin = config.machine_origin;
+  result.parameters = params;
+  return result;
+}
+}  // namespace
+
+std::string ParserCheckpoints::IndexFile(const std::string &gcode_filename) {
+  return HiddenSidecarFile(gcode_filename, ".checkpoints");
+}
+
+uint64_t ParserCheckpoints::Key(const std::string &gcode_filename,
+                                const GCodeParser::Config &config) {
+  struct stat st;
+  if (stat(gcode_filename.c_str(), &st) != 0) return 0;
+  // The initial parser state covers the machine origin and parameters.
+  GCodeParser::Config::ParamMap parameters;
+  if (config.parameters) parameters = *config.parameters;
+  NoMotionEventReceiver receiver;
+  const GCodeParser parser(NoParamFileConfig(config, &parameters), &receiver);
+  Fnv1aHash hash;
+  hash.AddValue(kVersion)
+    .AddValue((uint64_t)st.st_size)
+    .AddValue((int64_t)st.st_mtim.tv_sec)
+    .AddValue((int64_t)st.st_mtim.tv_nsec)
+    .Add(parser.SaveState());
+  return hash.value();
+}
+
+bool ParserCheckpoints::Build(int fd, const GCodeParser::Config &config) {
+  MappedLineReader reader;
+  if (!reader.Map(fd)) return false;
+
+  GCodeParser::Config::ParamMap parameters;
+  if (config.parameters) parameters = *config.parameters;
+  NoMotionEventReceiver receiver;
+  GCodeParser parser(NoParamFileConfig(config, &parameters), &receiver);
+
+  checkpoints_.clear();
+  lines_ = 0;
+  int next_checkpoint = 0;
+  std::string_view line;
+  for (;;) {
+    if (lines_ >= next_checkpoint) {
+      // Inside a while loop there is no state; try again on the next line.
+      std::string state = parser.SaveState();
+      if (!state.empty()) {
+        checkpoints_.push_back({lines_, reader.consumed(), std::move(state)});
+        next_checkpoint = lines_ + kLinesPerCheckpoint;
+      }
+    }
+    if (!reader.ReadLine(&line)) break;
+    parser.ParseBlock(line, nullptr);
+    ++lines_;
+  }
+  return true;
+}
+
+bool ParserCheckpoints::Save(const std::string &index_file,
+                             uint64_t key) const {
+  const std::string tmp_file = index_file + ".tmp";
+  FILE *out = fopen(tmp_file.c_str(), "wb");
+  if (!out) return false;
+  IndexHeader header;
+  memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.key = key;
+  header.lines = lines_;
+  header.count = checkpoints_.size();
+  bool success = fwrite(&header, sizeof(header), 1, out) == 1;
+  for (const Checkpoint &c : checkpoints_) {
+    const CheckpointHeader checkpoint = {c.line, (uint32_t)c.state.size(),
+                                         c.offset};
+    success &= fwrite(&checkpoint, sizeof(checkpoint), 1, out) == 1;
+    success &= fwrite(c.state.data(), 1, c.state.size(), out) == c.state.size();
+  }
+  success &= (fclose(out) == 0);
+  // Only a complete file gets its final name.
+  if (!success || rename(tmp_file.c_str(), index_file.c_str()) != 0) {
+    unlink(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool ParserCheckpoints::Load(const std::string &index_file, uint64_t key) {
+  FILE *in = fopen(index_file.c_str(), "rb");
+  if (!in) return false;
+  IndexHeader header;
+  bool success = fread(&header, sizeof(header), 1, in) == 1 &&
+                 memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+                 header.version == kVersion && header.key == key &&
+                 header.lines >= 0 && header.count > 0;
+  checkpoints_.clear();
+  for (uint32_t i = 0; success && i < header.count; ++i) {
+    CheckpointHeader checkpoint;
+    success = fread(&checkpoint, sizeof(checkpoint), 1, in) == 1;
+    if (!success) break;
+    std::string state(checkpoint.state_size, '\0');
+    success = fread(&state[0], 1, state.size(), in) == state.size();
+    checkpoints_.push_back(
+      {checkpoint.line, checkpoint.offset, std::move(state)});
+  }
+  fclose(in);
+  if (success) {
+    lines_ = header.lines;
+  } else {
+    checkpoints_.clear();
+  }
+  return success;
+}
+
+bool ParserCheckpoints::LoadOrBuild(const std::string &gcode_filename,
+                                    const GCodeParser::Config &config) {
+  const uint64_t key = Key(gcode_filename, config);
+  if (key == 0) return false;
+  const std::string index_file = IndexFile(gcode_filename);
+  if (Load(index_file, key)) return true;
+  const int fd = open(gcode_filename.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  const bool built = Build(fd, config);
+  close(fd);
+  if (!built) return false;
+  if (!Save(index_file, key)) {
+    Log_info("Can't store parser checkpoints %s; keeping them in memory only.",
+             index_file.c_str());
+  }
+  return true;
+}
+
+bool ParserCheckpoints::Seek(int fd, int line,
+                             const GCodeParser::Config &config,
+                             GCodeParser *parser, off_t *offset) const {
+  if (line < 0 || line > lines_) return false;
+  // The last checkpoint at or before the line.
+  auto next = std::upper_bound(
+    checkpoints_.begin(), checkpoints_.end(), line,
+    [](int value, const Checkpoint &c) { return value < c.line; });
+  if (next == checkpoints_.begin()) return false;
+  const Checkpoint &start = *(next - 1);
+
+  MappedLineReader reader;
+  if (!reader.Map(fd, start.offset)) return false;
+  // The remaining lines are replayed in a separate parser with its own
+  // parameters, so that "parser" only changes if everything worked out.
+  GCodeParser::Config::ParamMap parameters;
+  if (config.parameters) parameters = *config.parameters;
+  NoMotionEventReceiver receiver;
+  GCodeParser replay(NoParamFileConfig(config, &parameters), &receiver);
+  if (!replay.RestoreState(start.state)) return false;
+  std::string_view text;
+  for (int i = start.line; i < line; ++i) {
+    if (!reader.ReadLine(&text)) return false;
+    replay.ParseBlock(text, nullptr);
+  }
+  if (!parser->RestoreState(replay.SaveState())) return false;
+  *offset = reader.consumed();
+  return true;
+}
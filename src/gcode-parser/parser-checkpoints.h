@@ -0,0 +1,99 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_GCODE_PARSER_CHECKPOINTS_H
+#define _BEAGLEG_GCODE_PARSER_CHECKPOINTS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "gcode-parser/gcode-parser.h"
+
+// Checkpoints of the parser state (see GCodeParser::SaveState()) of a G-code
+// file every kLinesPerCheckpoint lines. With these, the program can be
+// resumed at any line, e.g. after a crash or a broken tool: the nearest
+// checkpoint before that line is restored and only the few lines up to it
+// are parsed, without any motion. That takes milliseconds even for programs
+// that run for hours, while parsing everything before the line takes minutes.
+//
+// The checkpoints are created in a pre-pass over the file which is stored
+// next to it and only redone if the file or the initial parser state
+// changed.
+//
+// Only the parser state is restored. The state of the machine, such as the
+// spindle, fan or temperatures, needs to be set up by the user.
+class ParserCheckpoints {
+ public:
+  static constexpr int kLinesPerCheckpoint = 1024;
+
+  // Name of the file the checkpoints of "gcode_filename" are stored in, a
+  // hidden file next to it.
+  static std::string IndexFile(const std::string &gcode_filename);
+
+  // Key of the checkpoints of "gcode_filename" when parsed starting with
+  // "config". Changes with the file, the machine origin and the parameters.
+  // Returns 0 if the file can not be read.
+  static uint64_t Key(const std::string &gcode_filename,
+                      const GCodeParser::Config &config);
+
+  // Parse the G-code file "fd" with a parser set up with "config" and
+  // record the checkpoints. The parameters of "config" are not modified.
+  // The file needs to be a regular file; it is not closed.
+  // Returns false if the file can not be read.
+  bool Build(int fd, const GCodeParser::Config &config);
+
+  // Store and load the checkpoints with the given "key". Load() fails if
+  // the stored checkpoints have a different key.
+  bool Save(const std::string &index_file, uint64_t key) const;
+  bool Load(const std::string &index_file, uint64_t key);
+
+  // Load the stored checkpoints of "gcode_filename" if they are up to date,
+  // otherwise build and store them next to the file.
+  bool LoadOrBuild(const std::string &gcode_filename,
+                   const GCodeParser::Config &config);
+
+  // Number of lines in the file.
+  int lines() const { return lines_; }
+
+  // Number of checkpoints.
+  size_t size() const { return checkpoints_.size(); }
+
+  // Bring "parser", which is set up with "config", into the state it has
+  // after parsing the first "line" lines of the file "fd" the checkpoints
+  // are from. Sets "offset" to the byte offset of the next line, at which
+  // reading the file continues.
+  // Returns false if "line" is not within the file or can't be resumed
+  // (e.g. in the middle of a while loop); "parser" is unchanged then.
+  bool Seek(int fd, int line, const GCodeParser::Config &config,
+            GCodeParser *parser, off_t *offset) const;
+
+ private:
+  struct Checkpoint {
+    int line;         // Number of lines parsed before.
+    uint64_t offset;  // Byte offset of the next line.
+    std::string state;
+  };
+
+  std::vector<Checkpoint> checkpoints_;  // Ordered by line.
+  int lines_ = 0;
+};
+
+#endif  // _BEAGLEG_GCODE_PARSER_CHECKPOINTS_H
@@ -0,0 +1,246 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "gcode-parser/parser-checkpoints.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "common/string-util.h"
+
+namespace {
+// Just keeps track of the last position and feedrate given.
+class PositionReceiver : public GCodeParser::EventReceiver {
+ public:
+  void gcode_start(GCodeParser *parser) final {}
+  void go_home(AxisBitmap_t axis_bitmap) final {}
+  bool probe_axis(float feed_mm_p_sec, enum GCodeParserAxis axis,
+                  float *probed_position) final {
+    return false;
+  }
+  void set_speed_factor(float factor) final {}
+  void set_fanspeed(float speed) final {}
+  void set_temperature(float degrees_c) final {}
+  void wait_temperature() final {}
+  void dwell(float time_ms) final {}
+  void motors_enable(bool enable) final {}
+  bool coordinated_move(float feed, const AxesRegister &pos) final {
+    abs_pos = pos;
+    feedrate = feed;
+    return true;
+  }
+  bool rapid_move(float feed, const AxesRegister &pos) final {
+    abs_pos = pos;
+    return true;
+  }
+  const char *unprocessed(char letter, float value, const char *rest) final {
+    return nullptr;
+  }
+
+  AxesRegister abs_pos;
+  float feedrate = -1;
+};
+
+class ParserCheckpointsTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    config_.machine_origin[AXIS_X] = 100;
+    config_.machine_origin[AXIS_Y] = 200;
+    config_.parameters = &parameters_;
+
+    // A program that keeps changing the parser state.
+    lines_.push_back("G10 L2 P2 X10 Y10");
+    for (int i = 1; i < 3000; ++i) {
+      switch (i % 7) {
+      case 0:
+        lines_.push_back(StringPrintf("G1 X%d Y%d F3000", i % 50, i % 30));
+        break;
+      case 1: lines_.push_back("#1=[#1+1]"); break;
+      case 2: lines_.push_back("G91 G1 X1"); break;
+      case 3: lines_.push_back("G90"); break;
+      case 4: lines_.push_back("G1 Y#1"); break;
+      case 5: lines_.push_back((i / 7) % 2 ? "G55" : "G54"); break;
+      case 6: lines_.push_back("G20 G1 X1 G21"); break;
+      }
+    }
+    // A loop around the place of the second checkpoint.
+    lines_[1020] = "#2=0";
+    lines_[1021] = "WHILE [#2 < 3] DO";
+    lines_[1022] = "#2++";
+    lines_[1023] = "G91 G1 Y1";
+    lines_[1024] = "G90";
+    lines_[1025] = "END";
+
+    char filename[] = "/tmp/parser-checkpoints-test.XXXXXX";
+    close(mkstemp(filename));
+    gcode_file_ = filename;
+    WriteFile();
+  }
+
+  void WriteFile() {
+    FILE *f = fopen(gcode_file_.c_str(), "w");
+    for (const std::string &line : lines_) fprintf(f, "%s\n", line.c_str());
+    fclose(f);
+  }
+  void TearDown() override {
+    unlink(ParserCheckpoints::IndexFile(gcode_file_).c_str());
+    unlink(gcode_file_.c_str());
+  }
+
+  bool Build(ParserCheckpoints *checkpoints) {
+    const int fd = open(gcode_file_.c_str(), O_RDONLY);
+    const bool result = checkpoints->Build(fd, config_);
+    close(fd);
+    return result;
+  }
+
+  // State of a parser that ran the first "count" lines.
+  std::string StateAfterLines(int count) {
+    GCodeParser::Config::ParamMap parameters;
+    GCodeParser::Config config;
+    config.machine_origin = config_.machine_origin;
+    config.parameters = &parameters;
+    PositionReceiver receiver;
+    GCodeParser parser(config, &receiver);
+    for (int i = 0; i < count; ++i) parser.ParseBlock(lines_[i], nullptr);
+    return parser.SaveState();
+  }
+
+  GCodeParser::Config::ParamMap parameters_;
+  GCodeParser::Config config_;
+  std::vector<std::string> lines_;
+  std::string gcode_file_;
+};
+}  // namespace
+
+TEST_F(ParserCheckpointsTest, SeekRestoresStateOfLine) {
+  ParserCheckpoints checkpoints;
+  ASSERT_TRUE(Build(&checkpoints));
+  EXPECT_EQ(3000, checkpoints.lines());
+  EXPECT_EQ(3u, checkpoints.size());
+
+  const int fd = open(gcode_file_.c_str(), O_RDONLY);
+  for (int line : {0, 1, 500, 1019, 1026, 1027, 2048, 2999, 3000}) {
+    PositionReceiver receiver;
+    GCodeParser parser(config_, &receiver);
+    off_t offset = -1;
+    ASSERT_TRUE(checkpoints.Seek(fd, line, config_, &parser, &offset)) << line;
+    EXPECT_EQ(StateAfterLines(line), parser.SaveState()) << line;
+
+    // The offset is the start of the next line.
+    std::string next_line(64, '\0');
+    const ssize_t len = pread(fd, &next_line[0], next_line.size(), offset);
+    next_line.resize(len);
+    if (line < 3000) {
+      EXPECT_EQ(lines_[line], next_line.substr(0, next_line.find('\n')));
+    } else {
+      EXPECT_EQ("", next_line);
+    }
+  }
+
+  // Not possible inside a while loop or beyond the end.
+  PositionReceiver receiver;
+  GCodeParser parser(config_, &receiver);
+  off_t offset = -1;
+  EXPECT_FALSE(checkpoints.Seek(fd, 1023, config_, &parser, &offset));
+  EXPECT_FALSE(checkpoints.Seek(fd, 3001, config_, &parser, &offset));
+  EXPECT_EQ(-1, offset);
+  close(fd);
+}
+
+TEST_F(ParserCheckpointsTest, SeekKeepsFeedrateSetBeforeCheckpoint) {
+  lines_.assign(1, "G1 X1 F600");
+  for (int i = 1; i < 2000; ++i) {
+    lines_.push_back(StringPrintf("G1 X%d", i % 50));
+  }
+  WriteFile();
+  ParserCheckpoints checkpoints;
+  ASSERT_TRUE(Build(&checkpoints));
+
+  const int fd = open(gcode_file_.c_str(), O_RDONLY);
+  PositionReceiver receiver;
+  GCodeParser parser(config_, &receiver);
+  off_t offset;
+  ASSERT_TRUE(checkpoints.Seek(fd, 1500, config_, &parser, &offset));
+  close(fd);
+
+  // The receiver only sees the moves after the resumed line, which don't
+  // have an F; the first one gets the feedrate of the program there.
+  parser.ParseBlock(lines_[1500], nullptr);
+  EXPECT_FLOAT_EQ(10, receiver.feedrate);
+  parser.ParseBlock(lines_[1501], nullptr);
+  EXPECT_EQ(-1, receiver.feedrate);  // Modal, kept by the receiver.
+}
+
+TEST_F(ParserCheckpointsTest, SaveAndLoad) {
+  ParserCheckpoints checkpoints;
+  ASSERT_TRUE(Build(&checkpoints));
+  const std::string index_file = ParserCheckpoints::IndexFile(gcode_file_);
+  ASSERT_TRUE(checkpoints.Save(index_file, 42));
+
+  ParserCheckpoints loaded;
+  EXPECT_FALSE(loaded.Load(index_file, 43));  // Different key.
+  ASSERT_TRUE(loaded.Load(index_file, 42));
+  EXPECT_EQ(checkpoints.lines(), loaded.lines());
+  EXPECT_EQ(checkpoints.size(), loaded.size());
+
+  const int fd = open(gcode_file_.c_str(), O_RDONLY);
+  PositionReceiver receiver;
+  GCodeParser parser(config_, &receiver);
+  off_t offset;
+  ASSERT_TRUE(loaded.Seek(fd, 2500, config_, &parser, &offset));
+  EXPECT_EQ(StateAfterLines(2500), parser.SaveState());
+  close(fd);
+}
+
+TEST_F(ParserCheckpointsTest, KeyChangesWithInitialState) {
+  const uint64_t key = ParserCheckpoints::Key(gcode_file_, config_);
+  EXPECT_NE(0u, key);
+  EXPECT_EQ(key, ParserCheckpoints::Key(gcode_file_, config_));
+
+  parameters_.Set(5221, 10);  // G54 offset.
+  EXPECT_NE(key, ParserCheckpoints::Key(gcode_file_, config_));
+  EXPECT_EQ(0u, ParserCheckpoints::Key(gcode_file_ + ".nope", config_));
+}
+
+TEST_F(ParserCheckpointsTest, LoadOrBuildStoresCheckpoints) {
+  ParserCheckpoints built;
+  ASSERT_TRUE(built.LoadOrBuild(gcode_file_, config_));
+  EXPECT_EQ(0, access(ParserCheckpoints::IndexFile(gcode_file_).c_str(), R_OK));
+
+  ParserCheckpoints loaded;
+  ASSERT_TRUE(loaded.Load(ParserCheckpoints::IndexFile(gcode_file_),
+                          ParserCheckpoints::Key(gcode_file_, config_)));
+  EXPECT_EQ(built.size(), loaded.size());
+
+  // Building did not change our parameters.
+  float value;
+  parameters_.Get(1, &value);
+  EXPECT_EQ(0, value);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -872,6 +872,8 @@ class SegmentQueuePrinter final : public SegmentQueue {
     if (v < min_v_) min_v_ = v;
   }
 
+  bool Dwell(float seconds) final { return true; }
+
   bool Enqueue(const LinearSegmentSteps &param) final {
     GCodeParserAxis dominant_axis = AXIS_X;
     for (int i = 1; i < BEAGLEG_NUM_MOTORS; ++i) {
@@ -1036,6 +1038,7 @@ class SegmentQueuePrinter final : public SegmentQueue {
 
   void MotorEnable(bool on) final {}
   void WaitQueueEmpty() final {}
+  float GetQueuedSeconds() final { return 0; }
   bool GetPhysicalStatus(PhysicalStatus *status) final { return false; }
   void SetExternalPosition(int motor, int pos) final {
     current_pos_[motor] = pos;
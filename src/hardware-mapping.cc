@@ -22,6 +22,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "common/hash.h"
 #include "common/logging.h"
 #include "common/string-util.h"
 #include "config-parser.h"
@@ -268,6 +269,28 @@ void HardwareMapping::SetPWMOutput(NamedOutput type, float value) {
 #endif
 }
 
+void HardwareMapping::StartPWMOutput(NamedOutput type, float value) {
+#ifdef _DISABLE_PWM_TIMERS
+  return;
+#else
+  if (!is_hardware_initialized_) return;
+  if (pwm_timer_is_running(output_to_pwm_gpio_[type])) return;
+  SetPWMOutput(type, value);
+#endif
+}
+
+bool HardwareMapping::GetPWMOutputRegister(NamedOutput type, float value,
+                                           uint32_t *reg_address,
+                                           uint32_t *reg_value) {
+#ifdef _DISABLE_PWM_TIMERS
+  return false;
+#else
+  if (!is_hardware_initialized_) return false;
+  return pwm_timer_get_match(output_to_pwm_gpio_[type], value, reg_address,
+                             reg_value);
+#endif
+}
+
 std::string HardwareMapping::DebugMotorString(LogicAxis axis) {
   const MotorBitmap motormap_for_axis = axis_to_driver_[axis];
   std::string result;
@@ -281,6 +304,14 @@ std::string HardwareMapping::DebugMotorString(LogicAxis axis) {
   return result;
 }
 
+uint64_t HardwareMapping::Fingerprint() const {
+  Fnv1aHash hash;
+  hash.AddValue(axis_to_driver_)
+    .AddValue(driver_flip_)
+    .AddValue(output_to_aux_bits_);
+  return hash.value();
+}
+
 void HardwareMapping::AssignMotorSteps(LogicAxis axis, int steps,
                                        LinearSegmentSteps *out) {
   const MotorBitmap motormap_for_axis = axis_to_driver_[axis];
@@ -348,6 +379,24 @@ bool HardwareMapping::TestAxisSwitch(LogicAxis axis,
   return result;
 }
 
+bool HardwareMapping::GetAxisSwitchInput(LogicAxis axis, AxisTrigger trigger,
+                                         InputTrigger *input) {
+  if (!is_hardware_initialized_) return false;
+  int switch_number;
+  switch (trigger) {
+  case TRIGGER_MIN: switch_number = axis_to_min_endstop_[axis]; break;
+  case TRIGGER_MAX: switch_number = axis_to_max_endstop_[axis]; break;
+  default: return false;
+  }
+  if (switch_number == 0) return false;
+  const GPIODefinition gpio_def = get_endstop_gpio_descriptor(switch_number);
+  if (gpio_def == GPIO_NOT_MAPPED) return false;
+  input->input_register = (gpio_def & 0xfffff000) + GPIO_DATAIN;
+  input->mask = 1 << (gpio_def & 0x1f);
+  input->match = trigger_level_[switch_number - 1] ? input->mask : 0;
+  return true;
+}
+
 bool HardwareMapping::TestEStopSwitch() {
   return TestSwitch(estop_input_, false);
 }
@@ -199,6 +199,18 @@ class HardwareMapping {
   // Set PWM value for given output immediately.
   void SetPWMOutput(NamedOutput type, float value);
 
+  // Start the PWM output with the given duty cycle if it is not running yet;
+  // a running output is left unchanged. The motion hardware can only change
+  // the duty cycle of a running output (see GetPWMOutputRegister()).
+  void StartPWMOutput(NamedOutput type, float value);
+
+  // Get register address and value that change the running PWM output to
+  // the given value when written. Used to let the motion hardware change it
+  // in sync with the motion (see MotionSegment). Returns false if not
+  // available.
+  bool GetPWMOutputRegister(NamedOutput type, float value,
+                            uint32_t *reg_address, uint32_t *reg_value);
+
   // -- Motor outputs
 
   // Given the logic axis, return a mask of the physical output drivers.
@@ -227,6 +239,13 @@ class HardwareMapping {
   // AvailableAxisSwitch(), this will always return false.
   bool TestAxisSwitch(LogicAxis axis, AxisTrigger requested_trigger);
 
+  // Describe the endstop of given axis and trigger (MIN or MAX) as input
+  // register, to be watched by the realtime hardware while moving.
+  // Returns false if there is no such switch or the hardware is not
+  // initialized.
+  bool GetAxisSwitchInput(LogicAxis axis, AxisTrigger trigger,
+                          InputTrigger *input);
+
   // Returns true if the E-Stop input is active.
   bool TestEStopSwitch();
 
@@ -251,6 +270,10 @@ class HardwareMapping {
   // logic axis.
   std::string DebugMotorString(LogicAxis axis);
 
+  // Returns a hash over the mappings that influence the generated
+  // LinearSegmentSteps: motors assigned to axes and aux bits of outputs.
+  uint64_t Fingerprint() const;
+
  private:
   class ConfigReader;
 
@@ -0,0 +1,115 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "input-shaper.h"
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "common/string-util.h"
+
+bool InputShaper::ParseType(std::string_view name, Type *type) {
+  const std::string choice = ToLower(name);
+  if (choice == "none") {
+    *type = Type::NONE;
+  } else if (choice == "zv") {
+    *type = Type::ZV;
+  } else if (choice == "zvd") {
+    *type = Type::ZVD;
+  } else if (choice == "mzv") {
+    *type = Type::MZV;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+InputShaper::InputShaper(Type type, float frequency, float damping_ratio) {
+  if (type == Type::NONE || frequency <= 0) return;
+  damping_ratio = std::clamp(damping_ratio, 0.0f, 0.99f);
+  const float undamped = sqrtf(1 - damping_ratio * damping_ratio);
+  const float period = 1 / (frequency * undamped);  // Damped period.
+  const float k = expf(-damping_ratio * M_PI / undamped);
+  switch (type) {
+  case Type::NONE: break;
+  case Type::ZV: impulses_ = {{1, 0}, {k, period / 2}}; break;
+  case Type::ZVD:
+    impulses_ = {{1, 0}, {2 * k, period / 2}, {k * k, period}};
+    break;
+  case Type::MZV: {
+    const float k3 = expf(-0.75f * damping_ratio * M_PI / undamped);
+    const float a = 1 - (float)M_SQRT1_2;
+    impulses_ = {{a, 0},
+                 {((float)M_SQRT2 - 1) * k3, 0.375f * period},
+                 {a * k3 * k3, 0.75f * period}};
+    break;
+  }
+  }
+  float sum = 0;
+  for (const Impulse &i : impulses_) sum += i.amplitude;
+  for (Impulse &i : impulses_) i.amplitude /= sum;
+}
+
+float InputShaper::duration() const {
+  return impulses_.empty() ? 0 : impulses_.back().time;
+}
+
+// The shaped ramp is the sum of the ramp, delayed and scaled by each impulse.
+// As the shaped speed change lags behind, more distance is covered at v0 and
+// less at v1; the ramp itself is made shorter to keep the overall distance.
+bool InputShaper::ShapeRamp(float v0, float v1, float distance,
+                            std::vector<Piece> *pieces) const {
+  if (impulses_.empty() || v0 + v1 <= 0 || distance <= 0) return false;
+  float centroid = 0;
+  for (const Impulse &i : impulses_) centroid += i.amplitude * i.time;
+  const float span = duration();
+  const float ramp_time = 2 * distance / (v0 + v1);
+  const float shaped_time =
+    ramp_time - 2 * (v0 * centroid + v1 * (span - centroid)) / (v0 + v1);
+  // Shorter ramps would need excessive acceleration; leave them as they are.
+  if (shaped_time < span) return false;
+
+  float times[2 * kMaxImpulses];
+  int count = 0;
+  for (const Impulse &i : impulses_) {
+    times[count++] = i.time;
+    times[count++] = i.time + shaped_time;
+  }
+  std::sort(times, times + count);
+  auto speed_at = [&](float t) {
+    float fraction = 0;
+    for (const Impulse &i : impulses_) {
+      const float progress = (t - i.time) / shaped_time;
+      fraction += i.amplitude * std::clamp(progress, 0.0f, 1.0f);
+    }
+    return v0 + (v1 - v0) * fraction;
+  };
+  float prev_time = 0;
+  float prev_speed = v0;
+  for (int i = 1; i < count; ++i) {
+    if (times[i] <= prev_time) continue;
+    const float speed = (i == count - 1) ? v1 : speed_at(times[i]);
+    pieces->push_back(
+      {prev_speed, speed, (prev_speed + speed) / 2 * (times[i] - prev_time)});
+    prev_time = times[i];
+    prev_speed = speed;
+  }
+  return true;
+}
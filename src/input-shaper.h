@@ -0,0 +1,74 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_INPUT_SHAPER_H_
+#define _BEAGLEG_INPUT_SHAPER_H_
+
+#include <string_view>
+#include <vector>
+
+// Input shaping suppresses the ringing of the machine at a resonance
+// frequency: each change of acceleration is split into a few smaller changes,
+// spaced in time such that the vibrations they excite cancel each other out.
+class InputShaper {
+ public:
+  enum class Type {
+    NONE = 0,
+    ZV,   // Zero vibration: two impulses, shortest, sensitive to freq errors.
+    ZVD,  // Zero vibration and derivative: three impulses, more robust.
+    MZV,  // Modified ZV: three impulses, between ZV and ZVD.
+  };
+
+  // Parse "none", "zv", "zvd" or "mzv" (any case). Returns false if unknown.
+  static bool ParseType(std::string_view name, Type *type);
+
+  // Shaper of "type" for a resonance at "frequency" (Hz) with the given
+  // "damping_ratio" (0..1). A non-positive frequency disables shaping.
+  InputShaper(Type type, float frequency, float damping_ratio);
+
+  bool enabled() const { return !impulses_.empty(); }
+
+  // Time between the first and the last impulse in seconds.
+  float duration() const;
+
+  // A piece of a shaped ramp with linear speed change from v0 to v1.
+  struct Piece {
+    float v0;
+    float v1;
+    float distance;
+  };
+
+  // Shape the linear velocity ramp from "v0" to "v1" over "distance",
+  // keeping the distance and the speeds at both ends. Speed and distance
+  // can be in any unit, e.g. steps/s and steps. Appends the pieces of
+  // constant acceleration to "pieces". Returns false and appends nothing if
+  // the ramp is too short to fit the shaper.
+  bool ShapeRamp(float v0, float v1, float distance,
+                 std::vector<Piece> *pieces) const;
+
+ private:
+  static constexpr int kMaxImpulses = 3;
+
+  struct Impulse {
+    float amplitude;  // Fraction of the change; all amplitudes sum up to 1.
+    float time;       // Seconds after the first impulse.
+  };
+  std::vector<Impulse> impulses_;
+};
+
+#endif  // _BEAGLEG_INPUT_SHAPER_H_
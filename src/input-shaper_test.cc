@@ -0,0 +1,116 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "input-shaper.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+TEST(InputShaper, ParseType) {
+  InputShaper::Type type;
+  EXPECT_TRUE(InputShaper::ParseType("MZV", &type));
+  EXPECT_EQ(InputShaper::Type::MZV, type);
+  EXPECT_TRUE(InputShaper::ParseType("none", &type));
+  EXPECT_EQ(InputShaper::Type::NONE, type);
+  EXPECT_FALSE(InputShaper::ParseType("foo", &type));
+}
+
+TEST(InputShaper, DisabledWithoutFrequency) {
+  EXPECT_FALSE(InputShaper(InputShaper::Type::ZV, 0, 0.1).enabled());
+  EXPECT_FALSE(InputShaper(InputShaper::Type::NONE, 40, 0.1).enabled());
+  EXPECT_TRUE(InputShaper(InputShaper::Type::ZV, 40, 0.1).enabled());
+}
+
+TEST(InputShaper, Duration) {
+  // Undamped: half a period for ZV, a full one for ZVD.
+  EXPECT_FLOAT_EQ(1 / 80.0,
+                  InputShaper(InputShaper::Type::ZV, 40, 0).duration());
+  EXPECT_FLOAT_EQ(1 / 40.0,
+                  InputShaper(InputShaper::Type::ZVD, 40, 0).duration());
+  EXPECT_FLOAT_EQ(0.75 / 40.0,
+                  InputShaper(InputShaper::Type::MZV, 40, 0).duration());
+}
+
+// Residual vibration at the resonance after the ramp, relative to that of
+// the unshaped ramp. Each change of acceleration at the start and end of the
+// pieces excites an oscillation; these add up as complex amplitudes.
+static float ResidualVibration(const std::vector<InputShaper::Piece> &pieces,
+                               float freq, float damping) {
+  const float omega = 2 * M_PI * freq;
+  const float omega_d = omega * sqrtf(1 - damping * damping);
+  float end_time = 0;
+  for (const InputShaper::Piece &p : pieces) {
+    end_time += 2 * p.distance / (p.v0 + p.v1);
+  }
+  float re = 0, im = 0;
+  auto add_change = [&](float t, float accel_change) {
+    const float weight = accel_change * expf(damping * omega * (t - end_time));
+    re += weight * cosf(omega_d * t);
+    im += weight * sinf(omega_d * t);
+  };
+  float t = 0, prev_accel = 0, max_accel = 0;
+  for (const InputShaper::Piece &p : pieces) {
+    const float duration = 2 * p.distance / (p.v0 + p.v1);
+    const float accel = (p.v1 - p.v0) / duration;
+    add_change(t, accel - prev_accel);
+    max_accel = std::max(max_accel, accel);
+    prev_accel = accel;
+    t += duration;
+  }
+  add_change(t, -prev_accel);
+  return hypotf(re, im) / max_accel;
+}
+
+TEST(InputShaper, RampKeepsDistanceAndCancelsVibration) {
+  // Reference: the unshaped ramp leaves the machine ringing.
+  EXPECT_GT(ResidualVibration({{100, 5000, 600}}, 40, 0.1), 0.1);
+  for (const InputShaper::Type type :
+       {InputShaper::Type::ZV, InputShaper::Type::ZVD,
+        InputShaper::Type::MZV}) {
+    const InputShaper shaper(type, 40, 0.1);
+    std::vector<InputShaper::Piece> pieces;
+    ASSERT_TRUE(shaper.ShapeRamp(100, 5000, 600, &pieces));
+    ASSERT_GE(pieces.size(), 3u);
+    EXPECT_FLOAT_EQ(100, pieces.front().v0);
+    EXPECT_FLOAT_EQ(5000, pieces.back().v1);
+    float distance = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      distance += pieces[i].distance;
+      if (i > 0) {
+        EXPECT_FLOAT_EQ(pieces[i - 1].v1, pieces[i].v0);
+      }
+    }
+    EXPECT_NEAR(600, distance, 0.1);
+    EXPECT_LT(ResidualVibration(pieces, 40, 0.1), 0.01);
+  }
+}
+
+TEST(InputShaper, ShortRampIsNotShaped) {
+  const InputShaper shaper(InputShaper::Type::ZVD, 20, 0.1);
+  std::vector<InputShaper::Piece> pieces;
+  EXPECT_FALSE(shaper.ShapeRamp(0, 1000, 10, &pieces));  // 20ms ramp.
+  EXPECT_TRUE(pieces.empty());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,91 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "job-queue.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "common/logging.h"
+#include "common/string-util.h"
+
+// Only G-code files are jobs; anything else in the spool directory, such as
+// notes or files of other tools, is left alone.
+static bool IsGCodeFile(std::string_view name) {
+  const size_t dot = name.find_last_of('.');
+  if (dot == std::string_view::npos) return false;
+  const std::string suffix = ToLower(name.substr(dot + 1));
+  return suffix == "gcode" || suffix == "gco" || suffix == "g" ||
+         suffix == "nc" || suffix == "ngc";
+}
+
+// Files modified more recently than this might still be being copied.
+static constexpr int kSettleSeconds = 3;
+
+void JobQueue::AddFile(const std::string &filename) {
+  files_.push_back(filename);
+}
+
+void JobQueue::SetSpoolDirectory(const std::string &dir) { spool_dir_ = dir; }
+
+std::string JobQueue::Next() {
+  if (files_.empty() && !spool_dir_.empty()) ScanSpoolDirectory();
+  if (files_.empty()) return "";
+  std::string result = files_.front();
+  files_.pop_front();
+  return result;
+}
+
+void JobQueue::ScanSpoolDirectory() {
+  DIR *dir = opendir(spool_dir_.c_str());
+  if (dir == nullptr) {
+    Log_error("Can't read spool directory %s", spool_dir_.c_str());
+    return;
+  }
+  const time_t now = time(nullptr);
+  std::vector<std::pair<std::string, bool>> names;  // Name, settled.
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != nullptr) {
+    if (entry->d_name[0] == '.') continue;
+    if (!IsGCodeFile(entry->d_name)) continue;
+    if (entry->d_name <= last_spooled_) continue;  // Done already.
+    const std::string path = spool_dir_ + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    names.emplace_back(entry->d_name, now - st.st_mtime >= kSettleSeconds);
+  }
+  closedir(dir);
+
+  std::sort(names.begin(), names.end());
+  for (const auto &name : names) {
+    // Jobs after one that is still arriving have to wait for it.
+    if (!name.second) {
+      Log_info("Spool: %s was just modified, not taking it yet.",
+               name.first.c_str());
+      break;
+    }
+    files_.push_back(spool_dir_ + "/" + name.first);
+    last_spooled_ = name.first;
+  }
+}
@@ -0,0 +1,58 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_JOB_QUEUE_H_
+#define _BEAGLEG_JOB_QUEUE_H_
+
+#include <deque>
+#include <string>
+
+// Queue of G-code files to run back-to-back as one continuous stream of
+// motion, so that the machine doesn't stop between the jobs.
+//
+// Jobs are either given explicitly or picked up from a spool directory.
+// The spool directory is looked at again whenever the queue runs empty, so
+// files dropped in while jobs are running are picked up as long as their
+// names sort after the last job from that directory. Only G-code files
+// (.gcode, .gco, .g, .nc or .ngc) are taken. Files starting with a dot are
+// ignored, so that an upload can be written under a hidden name first and
+// renamed when complete; that is the safe way to add a job. Files modified
+// within the last few seconds are not taken yet, as they might still be
+// being copied; neither are the files sorting after them.
+class JobQueue {
+ public:
+  // Add a file to the end of the queue.
+  void AddFile(const std::string &filename);
+
+  // Take jobs from the G-code files in "dir", in order of their names,
+  // after the files added explicitly.
+  void SetSpoolDirectory(const std::string &dir);
+
+  // Returns the filename of the next job and removes it from the queue, or
+  // an empty string if there are no more jobs.
+  std::string Next();
+
+ private:
+  void ScanSpoolDirectory();
+
+  std::deque<std::string> files_;
+  std::string spool_dir_;
+  std::string last_spooled_;  // Name of the last job from the spool dir.
+};
+
+#endif  // _BEAGLEG_JOB_QUEUE_H_
@@ -0,0 +1,144 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "job-queue.h"
+
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "gcode-parser/parser-checkpoints.h"
+#include "time-index.h"
+
+class JobQueueTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/job-queue-test.XXXXXX";
+    spool_dir_ = mkdtemp(dir_template);
+  }
+  void TearDown() override {
+    for (const std::string &file : files_) unlink(file.c_str());
+    rmdir(spool_dir_.c_str());
+  }
+
+  // Create a file in the spool directory, last modified "age" seconds ago.
+  std::string Spool(const char *name, int age = 60) {
+    const std::string path = spool_dir_ + "/" + name;
+    FILE *f = fopen(path.c_str(), "w");
+    fputs("G1 X10\n", f);
+    fclose(f);
+    SetAge(path, age);
+    files_.push_back(path);
+    return path;
+  }
+
+  static void SetAge(const std::string &path, int age) {
+    const struct timeval modified = {time(nullptr) - age, 0};
+    const struct timeval times[2] = {modified, modified};
+    EXPECT_EQ(0, utimes(path.c_str(), times));
+  }
+
+  std::string spool_dir_;
+  std::vector<std::string> files_;
+};
+
+TEST_F(JobQueueTest, ExplicitFilesInOrder) {
+  JobQueue jobs;
+  jobs.AddFile("b.gcode");
+  jobs.AddFile("a.gcode");
+  EXPECT_EQ("b.gcode", jobs.Next());
+  EXPECT_EQ("a.gcode", jobs.Next());
+  EXPECT_EQ("", jobs.Next());
+}
+
+TEST_F(JobQueueTest, SpoolDirectoryInNameOrderAfterFiles) {
+  const std::string second = Spool("002.gcode");
+  const std::string first = Spool("001.gcode");
+  Spool(".upload-in-progress.gcode");
+  JobQueue jobs;
+  jobs.AddFile("start.gcode");
+  jobs.SetSpoolDirectory(spool_dir_);
+  EXPECT_EQ("start.gcode", jobs.Next());
+  EXPECT_EQ(first, jobs.Next());
+  EXPECT_EQ(second, jobs.Next());
+  EXPECT_EQ("", jobs.Next());
+}
+
+TEST_F(JobQueueTest, SpoolDirectoryOnlyTakesGCodeFiles) {
+  const std::string gcode = Spool("001.gcode");
+  const std::string nc = Spool("002.NC");
+  Spool("003.txt");
+  Spool("004");
+  JobQueue jobs;
+  jobs.SetSpoolDirectory(spool_dir_);
+  EXPECT_EQ(gcode, jobs.Next());
+  EXPECT_EQ(nc, jobs.Next());
+  EXPECT_EQ("", jobs.Next());
+}
+
+TEST_F(JobQueueTest, SpoolDirectorySkipsSidecarFiles) {
+  const std::string gcode = Spool("001.gcode");
+  for (const std::string &sidecar : {TimeIndex::IndexFile(gcode),
+                                     ParserCheckpoints::IndexFile(gcode)}) {
+    const std::string name = sidecar.substr(spool_dir_.size() + 1);
+    Spool(name.c_str());
+    Spool((name + ".tmp").c_str());
+  }
+  JobQueue jobs;
+  jobs.SetSpoolDirectory(spool_dir_);
+  EXPECT_EQ(gcode, jobs.Next());
+  EXPECT_EQ("", jobs.Next());
+}
+
+TEST_F(JobQueueTest, SpoolDirectoryPicksUpNewFiles) {
+  const std::string first = Spool("001.gcode");
+  JobQueue jobs;
+  jobs.SetSpoolDirectory(spool_dir_);
+  EXPECT_EQ(first, jobs.Next());
+
+  // Jobs already done are not repeated, new ones are picked up.
+  const std::string second = Spool("002.gcode");
+  EXPECT_EQ(second, jobs.Next());
+  EXPECT_EQ("", jobs.Next());
+}
+
+TEST_F(JobQueueTest, SpoolDirectoryWaitsForFilesBeingCopied) {
+  const std::string first = Spool("001.gcode");
+  const std::string copying = Spool("002.gcode", 0);
+  const std::string third = Spool("003.gcode");
+  JobQueue jobs;
+  jobs.SetSpoolDirectory(spool_dir_);
+  EXPECT_EQ(first, jobs.Next());
+  EXPECT_EQ("", jobs.Next());  // Keeps the order: third waits as well.
+
+  SetAge(copying, 10);
+  EXPECT_EQ(copying, jobs.Next());
+  EXPECT_EQ(third, jobs.Next());
+  EXPECT_EQ("", jobs.Next());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,457 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "kinematics.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "common/string-util.h"
+#include "gcode-machine-control.h"
+
+bool Kinematics::ParseType(std::string_view name, Type *type) {
+  const std::string choice = ToLower(name);
+  if (choice == "cartesian") {
+    *type = Type::CARTESIAN;
+  } else if (choice == "corexy" || choice == "hbot") {
+    *type = Type::COREXY;
+  } else if (choice == "delta") {
+    *type = Type::DELTA;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static int MaxSteps(const LinearSegmentSteps &segment) {
+  int result = 0;
+  for (const int steps : segment.steps) result = std::max(result, abs(steps));
+  return result;
+}
+
+Kinematics::Kinematics(HardwareMapping *hardware_mapping, SegmentQueue *backend)
+    : backend_(backend) {
+  for (int i = 0; i < 3; ++i) {
+    axis_motors_[i] = hardware_mapping->GetMotorMap((GCodeParserAxis)i);
+  }
+}
+
+void Kinematics::GetCartesianSteps(const LinearSegmentSteps &segment,
+                                   int steps[3]) const {
+  for (int i = 0; i < 3; ++i) {
+    steps[i] = 0;
+    for (int motor = 0; motor < BEAGLEG_NUM_MOTORS; ++motor) {
+      if (axis_motors_[i] & (1 << motor)) {
+        steps[i] = segment.steps[motor];
+        break;
+      }
+    }
+  }
+}
+
+void Kinematics::SetMotorSteps(const int steps[3],
+                               LinearSegmentSteps *segment) const {
+  for (int i = 0; i < 3; ++i) {
+    for (int motor = 0; motor < BEAGLEG_NUM_MOTORS; ++motor) {
+      if (axis_motors_[i] & (1 << motor)) segment->steps[motor] = steps[i];
+    }
+  }
+}
+
+bool Kinematics::GetPhysicalStatus(PhysicalStatus *status) {
+  if (!backend_->GetPhysicalStatus(status)) return false;
+  int motors[3] = {};
+  for (int i = 0; i < 3; ++i) {
+    for (int motor = 0; motor < BEAGLEG_NUM_MOTORS; ++motor) {
+      if (axis_motors_[i] & (1 << motor)) {
+        motors[i] = status->pos_steps[motor];
+        break;
+      }
+    }
+  }
+  int cartesian[3];
+  ToCartesian(motors, cartesian);
+  for (int i = 0; i < 3; ++i) {
+    for (int motor = 0; motor < BEAGLEG_NUM_MOTORS; ++motor) {
+      if (axis_motors_[i] & (1 << motor)) {
+        status->pos_steps[motor] = cartesian[i];
+      }
+    }
+  }
+  return true;
+}
+
+void Kinematics::SetExternalPosition(int motor, int position_steps) {
+  bool is_cartesian = false;
+  for (int i = 0; i < 3; ++i) {
+    if (axis_motors_[i] & (1 << motor)) {
+      position_[i] = position_steps;
+      is_cartesian = true;
+    }
+  }
+  if (!is_cartesian) {
+    backend_->SetExternalPosition(motor, position_steps);
+    return;
+  }
+  // Changing one axis might change the position of all motors.
+  int motors[3];
+  ToMotors(position_, motors);
+  for (int i = 0; i < 3; ++i) {
+    for (int m = 0; m < BEAGLEG_NUM_MOTORS; ++m) {
+      if (axis_motors_[i] & (1 << m)) {
+        backend_->SetExternalPosition(m, motors[i]);
+      }
+    }
+  }
+}
+
+namespace {
+// Motors X and Y both move the head along belts: X = X + Y, Y = X - Y.
+// This is linear, so the segments can be converted one to one.
+class CoreXYKinematics : public Kinematics {
+ public:
+  CoreXYKinematics(const MachineControlConfig &config,
+                   HardwareMapping *hardware_mapping, SegmentQueue *backend)
+      : Kinematics(hardware_mapping, backend) {
+    // Motors X and Y have the limits configured for their axis.
+    for (int i = 0; i < 2; ++i) {
+      const GCodeParserAxis axis = (GCodeParserAxis)i;
+      const float steps_per_mm = config.steps_per_mm[axis];
+      max_motor_speed_[i] = config.max_feedrate[axis] * steps_per_mm;
+      max_motor_accel_[i] = config.acceleration[axis] * steps_per_mm;
+    }
+  }
+
+  bool Enqueue(const LinearSegmentSteps &segment) final {
+    LinearSegmentSteps out;
+    ToMotorSegment(segment, &out);
+    int cartesian[3];
+    GetCartesianSteps(segment, cartesian);
+    for (int i = 0; i < 3; ++i) position_[i] += cartesian[i];
+    return backend_->Enqueue(out);
+  }
+
+  bool MoveUntilInput(const LinearSegmentSteps &segment, float accel,
+                      const InputTrigger &input, int *trigger_steps,
+                      int *moved_steps) final {
+    LinearSegmentSteps out;
+    const float factor = ToMotorSegment(segment, &out);
+    if (!backend_->MoveUntilInput(out, accel * factor, input, trigger_steps,
+                                  moved_steps)) {
+      return false;
+    }
+    // Back to steps of the cartesian defining axis. The position is unknown
+    // until set with SetExternalPosition().
+    if (*trigger_steps >= 0) {
+      *trigger_steps = std::lround(*trigger_steps / factor);
+    }
+    *moved_steps = std::lround(*moved_steps / factor);
+    return true;
+  }
+
+  // A diagonal move only needs one of the motors, but at up to twice the
+  // speed of the axes.
+  void LimitSpeed(const int cartesian_steps[3], int defining_steps,
+                  double *speed, double *accel) const final {
+    int motors[3];
+    ToMotors(cartesian_steps, motors);
+    for (int i = 0; i < 2; ++i) {
+      if (motors[i] == 0) continue;
+      const double ratio = 1.0 * defining_steps / abs(motors[i]);
+      if (max_motor_speed_[i] > 0) {
+        *speed = std::min(*speed, max_motor_speed_[i] * ratio);
+      }
+      if (max_motor_accel_[i] > 0) {
+        *accel = std::min(*accel, max_motor_accel_[i] * ratio);
+      }
+    }
+  }
+
+ protected:
+  void ToMotors(const int cartesian[3], int motors[3]) const final {
+    motors[0] = cartesian[0] + cartesian[1];
+    motors[1] = cartesian[0] - cartesian[1];
+    motors[2] = cartesian[2];
+  }
+
+  void ToCartesian(const int motors[3], int cartesian[3]) const final {
+    cartesian[0] = (motors[0] + motors[1]) / 2;
+    cartesian[1] = (motors[0] - motors[1]) / 2;
+    cartesian[2] = motors[2];
+  }
+
+ private:
+  // Convert the steps of "in" to the motors in "out". Returns the factor the
+  // speed of the defining motor changed by.
+  float ToMotorSegment(const LinearSegmentSteps &in, LinearSegmentSteps *out) {
+    int cartesian[3], motors[3];
+    GetCartesianSteps(in, cartesian);
+    ToMotors(cartesian, motors);  // Linear, so this works on differences.
+    *out = in;
+    SetMotorSteps(motors, out);
+    const int in_steps = MaxSteps(in);
+    const float factor = in_steps ? 1.0f * MaxSteps(*out) / in_steps : 1.0f;
+    out->v0 *= factor;
+    out->v1 *= factor;
+    out->laser_power_per_speed /= factor;
+    return factor;
+  }
+
+  float max_motor_speed_[2];  // steps/s
+  float max_motor_accel_[2];  // steps/s^2
+};
+
+// Linear delta: three towers around the center of the XY range, each with a
+// carriage moved by one motor. The effector hangs on arms of equal length from
+// the carriages. Moves are split into short linear pieces, for which the
+// carriage positions are calculated in batches.
+class DeltaKinematics : public Kinematics {
+ public:
+  DeltaKinematics(const MachineControlConfig &config,
+                  HardwareMapping *hardware_mapping, SegmentQueue *backend)
+      : Kinematics(hardware_mapping, backend),
+        arm_squared_(config.delta_arm_length * config.delta_arm_length),
+        segments_per_second_(config.delta_segments_per_second) {
+    const float center_x = config.move_range_mm[AXIS_X] / 2;
+    const float center_y = config.move_range_mm[AXIS_Y] / 2;
+    for (int i = 0; i < 3; ++i) {
+      // Towers at 210, 330 and 90 degrees; X and Y in front, Z in the back.
+      const float angle = (210 + 120 * i) * M_PI / 180;
+      tower_x_[i] = center_x + config.delta_radius * cosf(angle);
+      tower_y_[i] = center_y + config.delta_radius * sinf(angle);
+      steps_per_mm_[i] = config.steps_per_mm[(GCodeParserAxis)i];
+    }
+  }
+
+  bool Enqueue(const LinearSegmentSteps &segment) final {
+    int cartesian[3];
+    GetCartesianSteps(segment, cartesian);
+    if (cartesian[0] == 0 && cartesian[1] == 0) {
+      // Vertical moves are linear: all carriages move the same.
+      const int motors[3] = {cartesian[2], cartesian[2], cartesian[2]};
+      LinearSegmentSteps out = segment;
+      SetMotorSteps(motors, &out);
+      position_[2] += cartesian[2];
+      for (int &m : motor_position_) m += cartesian[2];
+      return backend_->Enqueue(out);
+    }
+    return EnqueueSplit(segment, cartesian);
+  }
+
+  bool MoveUntilInput(const LinearSegmentSteps &segment, float accel,
+                      const InputTrigger &input, int *trigger_steps,
+                      int *moved_steps) final {
+    int cartesian[3];
+    GetCartesianSteps(segment, cartesian);
+    if (cartesian[0] != 0 || cartesian[1] != 0) return false;  // Not linear.
+    const int motors[3] = {cartesian[2], cartesian[2], cartesian[2]};
+    LinearSegmentSteps out = segment;
+    SetMotorSteps(motors, &out);
+    return backend_->MoveUntilInput(out, accel, input, trigger_steps,
+                                    moved_steps);
+  }
+
+  void SetExternalPosition(int motor, int position_steps) final {
+    Kinematics::SetExternalPosition(motor, position_steps);
+    ToMotors(position_, motor_position_);
+  }
+
+  // The effector needs to be within arm length of all the towers. This is
+  // an intersection of discs, so every move between reachable positions
+  // stays reachable.
+  bool IsReachable(const int cartesian[3]) const final {
+    const float x = cartesian[0] / steps_per_mm_[0];
+    const float y = cartesian[1] / steps_per_mm_[1];
+    for (int i = 0; i < 3; ++i) {
+      const float dx = x - tower_x_[i];
+      const float dy = y - tower_y_[i];
+      if (dx * dx + dy * dy > arm_squared_) return false;
+    }
+    return true;
+  }
+
+ protected:
+  void ToMotors(const int cartesian[3], int motors[3]) const final {
+    float x = cartesian[0] / steps_per_mm_[0];
+    float y = cartesian[1] / steps_per_mm_[1];
+    float z = cartesian[2] / steps_per_mm_[2];
+    float height[3][kBatchSize];
+    CarriageHeights(&x, &y, &z, 1, height);
+    for (int i = 0; i < 3; ++i) {
+      motors[i] = std::lround(height[i][0] * steps_per_mm_[i]);
+    }
+  }
+
+  // The effector is where the spheres of arm length around the carriages
+  // meet, below them.
+  void ToCartesian(const int motors[3], int cartesian[3]) const final {
+    double p[3][3];
+    for (int i = 0; i < 3; ++i) {
+      p[i][0] = tower_x_[i];
+      p[i][1] = tower_y_[i];
+      p[i][2] = motors[i] / steps_per_mm_[i];
+    }
+    double ex[3], ey[3], ez[3], p13[3];
+    double d = 0;
+    for (int k = 0; k < 3; ++k) {
+      ex[k] = p[1][k] - p[0][k];
+      p13[k] = p[2][k] - p[0][k];
+      d += ex[k] * ex[k];
+    }
+    d = sqrt(d);
+    for (double &v : ex) v /= d;
+    const double i = ex[0] * p13[0] + ex[1] * p13[1] + ex[2] * p13[2];
+    double ey_len = 0;
+    for (int k = 0; k < 3; ++k) {
+      ey[k] = p13[k] - i * ex[k];
+      ey_len += ey[k] * ey[k];
+    }
+    ey_len = sqrt(ey_len);
+    for (double &v : ey) v /= ey_len;
+    const double j = ey[0] * p13[0] + ey[1] * p13[1] + ey[2] * p13[2];
+    ez[0] = ex[1] * ey[2] - ex[2] * ey[1];
+    ez[1] = ex[2] * ey[0] - ex[0] * ey[2];
+    ez[2] = ex[0] * ey[1] - ex[1] * ey[0];
+    if (ez[2] > 0) {
+      for (double &v : ez) v = -v;  // Downwards.
+    }
+
+    // All spheres have the same radius.
+    const double x = d / 2;
+    const double y = (i * i + j * j) / (2 * j) - i * x / j;
+    const double z = sqrt(std::max(arm_squared_ - x * x - y * y, 0.0));
+    for (int k = 0; k < 3; ++k) {
+      const double pos = p[0][k] + x * ex[k] + y * ey[k] + z * ez[k];
+      cartesian[k] = std::lround(pos * steps_per_mm_[k]);
+    }
+  }
+
+ private:
+  static constexpr int kBatchSize = 32;
+
+  // Carriage height of each tower for a batch of "count" effector positions.
+  // Kept free of branches on plain arrays so that the compiler can vectorize
+  // the loops. Targets out of reach are rejected before (IsReachable()); the
+  // clamp only guards against rounding right at the edge.
+  void CarriageHeights(const float *x, const float *y, const float *z,
+                       int count, float height[3][kBatchSize]) const {
+    for (int tower = 0; tower < 3; ++tower) {
+      const float tx = tower_x_[tower];
+      const float ty = tower_y_[tower];
+      float *const h = height[tower];
+      for (int i = 0; i < count; ++i) {
+        const float dx = x[i] - tx;
+        const float dy = y[i] - ty;
+        h[i] = z[i] + sqrtf(std::max(arm_squared_ - dx * dx - dy * dy, 0.0f));
+      }
+    }
+  }
+
+  // Split the segment into pieces short enough in time to follow the curve
+  // of the carriages closely. Other motors, such as the extruder, are
+  // distributed over the pieces in proportion.
+  bool EnqueueSplit(const LinearSegmentSteps &segment,
+                    const int cartesian[3]) {
+    const int defining_steps = MaxSteps(segment);
+    const float duration = (segment.v0 + segment.v1 > 0)
+                             ? 2 * defining_steps / (segment.v0 + segment.v1)
+                             : 0;
+    const int pieces =
+      std::clamp((int)ceilf(duration * segments_per_second_), 1,
+                 defining_steps);
+    const float v0_squared = segment.v0 * segment.v0;
+    const float dv_squared = segment.v1 * segment.v1 - v0_squared;
+
+    int start[3];
+    for (int i = 0; i < 3; ++i) start[i] = position_[i];
+    int other_done[BEAGLEG_NUM_MOTORS] = {};
+    float prev_fraction = 0;
+    float prev_speed = segment.v0;
+    LinearSegmentSteps piece = segment;
+    float x[kBatchSize], y[kBatchSize], z[kBatchSize];
+    float height[3][kBatchSize];
+    for (int first = 1; first <= pieces; first += kBatchSize) {
+      const int count = std::min(kBatchSize, pieces - first + 1);
+      for (int b = 0; b < count; ++b) {
+        const float fraction = 1.0f * (first + b) / pieces;
+        x[b] = (start[0] + fraction * cartesian[0]) / steps_per_mm_[0];
+        y[b] = (start[1] + fraction * cartesian[1]) / steps_per_mm_[1];
+        z[b] = (start[2] + fraction * cartesian[2]) / steps_per_mm_[2];
+      }
+      CarriageHeights(x, y, z, count, height);
+
+      for (int b = 0; b < count; ++b) {
+        const float fraction = 1.0f * (first + b) / pieces;
+        for (int m = 0; m < BEAGLEG_NUM_MOTORS; ++m) {
+          const int until = std::lround(fraction * segment.steps[m]);
+          piece.steps[m] = until - other_done[m];
+          other_done[m] = until;
+        }
+        int motors[3];
+        for (int i = 0; i < 3; ++i) {
+          const int pos = std::lround(height[i][b] * steps_per_mm_[i]);
+          motors[i] = pos - motor_position_[i];
+          motor_position_[i] = pos;
+        }
+        SetMotorSteps(motors, &piece);
+
+        // Constant acceleration: speed squared is linear with the distance.
+        const float speed = sqrtf(v0_squared + dv_squared * fraction);
+        const int motor_steps = MaxSteps(piece);
+        if (motor_steps > 0) {
+          const float factor =
+            motor_steps / (defining_steps * (fraction - prev_fraction));
+          piece.v0 = prev_speed * factor;
+          piece.v1 = speed * factor;
+          piece.laser_power_per_speed = segment.laser_power_per_speed / factor;
+          if (!backend_->Enqueue(piece)) return false;
+          piece.spindle_pwm = piece.fan_pwm = -1;  // Switched with the first.
+        }
+        prev_fraction = fraction;
+        prev_speed = speed;
+      }
+    }
+    for (int i = 0; i < 3; ++i) position_[i] += cartesian[i];
+    return true;
+  }
+
+  const float arm_squared_;
+  const float segments_per_second_;
+  float tower_x_[3];
+  float tower_y_[3];
+  float steps_per_mm_[3];
+  int motor_position_[3] = {};  // Carriages at the end of the queue.
+};
+}  // namespace
+
+Kinematics *Kinematics::Create(const MachineControlConfig &config,
+                               HardwareMapping *hardware_mapping,
+                               SegmentQueue *backend) {
+  switch (config.kinematics) {
+  case Type::CARTESIAN: return nullptr;
+  case Type::COREXY:
+    return new CoreXYKinematics(config, hardware_mapping, backend);
+  case Type::DELTA:
+    return new DeltaKinematics(config, hardware_mapping, backend);
+  }
+  return nullptr;
+}
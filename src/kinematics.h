@@ -0,0 +1,93 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_KINEMATICS_H_
+#define _BEAGLEG_KINEMATICS_H_
+
+#include <string_view>
+
+#include "hardware-mapping.h"
+#include "segment-queue.h"
+
+struct MachineControlConfig;
+
+// Kinematics of machines whose motors don't move the X, Y and Z axes
+// directly.
+//
+// The Planner plans the motion in the cartesian space of the axes and
+// assigns their steps to the motors mapped to X, Y and Z. This SegmentQueue
+// sits between the Planner and the motor backend and converts these to the
+// steps of the motors that actually need to move; all other motors are
+// passed through. Towards the Planner, positions (SetExternalPosition(),
+// GetPhysicalStatus()) stay in cartesian steps.
+class Kinematics : public SegmentQueue {
+ public:
+  enum class Type {
+    CARTESIAN = 0,  // Motors move the axes directly; no Kinematics needed.
+    COREXY,         // Motors X = X + Y, Y = X - Y. Same for H-bot.
+    DELTA,          // Linear delta; motors X, Y, Z drive the three towers.
+  };
+
+  // Parse "cartesian", "corexy", "hbot" or "delta" (any case).
+  static bool ParseType(std::string_view name, Type *type);
+
+  // Create the kinematics as configured, sending the motor steps to
+  // "backend" (not owned). Returns nullptr for cartesian machines, which
+  // don't need a conversion.
+  static Kinematics *Create(const MachineControlConfig &config,
+                            HardwareMapping *hardware_mapping,
+                            SegmentQueue *backend);
+
+  bool Dwell(float seconds) final { return backend_->Dwell(seconds); }
+  void MotorEnable(bool on) final { backend_->MotorEnable(on); }
+  void WaitQueueEmpty() final { backend_->WaitQueueEmpty(); }
+  float GetQueuedSeconds() final { return backend_->GetQueuedSeconds(); }
+  bool GetPhysicalStatus(PhysicalStatus *status) final;
+  void SetExternalPosition(int motor, int position_steps) override;
+
+  // Whether the machine can reach the cartesian position in steps.
+  virtual bool IsReachable(const int cartesian[3]) const { return true; }
+
+  // Reduce the "speed" and "accel" of a move by "cartesian_steps", given in
+  // steps per second (squared) of its "defining_steps", so that none of the
+  // motors goes over its limit.
+  virtual void LimitSpeed(const int cartesian_steps[3], int defining_steps,
+                          double *speed, double *accel) const {}
+
+ protected:
+  Kinematics(HardwareMapping *hardware_mapping, SegmentQueue *backend);
+
+  // Motor positions in steps for the cartesian position in steps.
+  virtual void ToMotors(const int cartesian[3], int motors[3]) const = 0;
+
+  // Cartesian position in steps for the motor positions in steps.
+  virtual void ToCartesian(const int motors[3], int cartesian[3]) const = 0;
+
+  // Read the cartesian steps of X, Y and Z from "segment".
+  void GetCartesianSteps(const LinearSegmentSteps &segment,
+                         int steps[3]) const;
+
+  // Assign "steps" of the three motors for X, Y and Z to "segment".
+  void SetMotorSteps(const int steps[3], LinearSegmentSteps *segment) const;
+
+  HardwareMapping::MotorBitmap axis_motors_[3];  // Motors of X, Y and Z.
+  int position_[3] = {};  // Cartesian position at the end of the queue.
+  SegmentQueue *const backend_;
+};
+
+#endif  // _BEAGLEG_KINEMATICS_H_
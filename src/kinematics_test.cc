@@ -0,0 +1,210 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "kinematics.h"
+
+#include <gtest/gtest.h>
+#include <math.h>
+
+#include <memory>
+#include <vector>
+
+#include "gcode-machine-control.h"
+#include "hardware-mapping.h"
+#include "segment-queue.h"
+
+namespace {
+// Records the segments and keeps track of the motor positions.
+class RecordingQueue : public SegmentQueue {
+ public:
+  bool Enqueue(const LinearSegmentSteps &segment) final {
+    segments.push_back(segment);
+    for (int m = 0; m < BEAGLEG_NUM_MOTORS; ++m) {
+      position[m] += segment.steps[m];
+    }
+    return true;
+  }
+  bool Dwell(float) final { return true; }
+  void MotorEnable(bool) final {}
+  void WaitQueueEmpty() final {}
+  float GetQueuedSeconds() final { return 0; }
+  bool GetPhysicalStatus(PhysicalStatus *status) final {
+    for (int m = 0; m < BEAGLEG_NUM_MOTORS; ++m) {
+      status->pos_steps[m] = position[m];
+    }
+    return true;
+  }
+  void SetExternalPosition(int motor, int steps) final {
+    position[motor] = steps;
+  }
+
+  std::vector<LinearSegmentSteps> segments;
+  int position[BEAGLEG_NUM_MOTORS] = {};
+};
+
+class KinematicsTest : public ::testing::Test {
+ protected:
+  KinematicsTest() {
+    for (int i = 0; i < 4; ++i) {
+      hardware_.AddMotorMapping((GCodeParserAxis)i, i + 1, false);
+      config_.steps_per_mm[(GCodeParserAxis)i] = 100;
+      config_.move_range_mm[(GCodeParserAxis)i] = 200;
+    }
+  }
+
+  void Create(Kinematics::Type type) {
+    config_.kinematics = type;
+    kinematics_.reset(Kinematics::Create(config_, &hardware_, &backend_));
+    ASSERT_TRUE(kinematics_ != nullptr);
+  }
+
+  static LinearSegmentSteps Move(int x, int y, int z, int e, float v) {
+    LinearSegmentSteps segment = {};
+    segment.steps[0] = x;
+    segment.steps[1] = y;
+    segment.steps[2] = z;
+    segment.steps[3] = e;
+    segment.v0 = segment.v1 = v;
+    return segment;
+  }
+
+  MachineControlConfig config_;
+  HardwareMapping hardware_;
+  RecordingQueue backend_;
+  std::unique_ptr<Kinematics> kinematics_;
+};
+}  // namespace
+
+TEST_F(KinematicsTest, CartesianNeedsNoConversion) {
+  EXPECT_EQ(nullptr, Kinematics::Create(config_, &hardware_, &backend_));
+}
+
+TEST_F(KinematicsTest, CoreXYMotorSteps) {
+  Create(Kinematics::Type::COREXY);
+  kinematics_->Enqueue(Move(100, 50, 7, 3, 1000));
+  ASSERT_EQ(1u, backend_.segments.size());
+  const LinearSegmentSteps &out = backend_.segments[0];
+  EXPECT_EQ(150, out.steps[0]);
+  EXPECT_EQ(50, out.steps[1]);
+  EXPECT_EQ(7, out.steps[2]);
+  EXPECT_EQ(3, out.steps[3]);
+  EXPECT_FLOAT_EQ(1500, out.v0);  // Speed of the now defining motor X.
+  EXPECT_FLOAT_EQ(1500, out.v1);
+
+  kinematics_->Enqueue(Move(0, 100, 0, 0, 1000));
+  EXPECT_EQ(100, backend_.segments[1].steps[0]);
+  EXPECT_EQ(-100, backend_.segments[1].steps[1]);
+  EXPECT_FLOAT_EQ(1000, backend_.segments[1].v0);
+}
+
+TEST_F(KinematicsTest, CoreXYPositions) {
+  Create(Kinematics::Type::COREXY);
+  kinematics_->SetExternalPosition(0, 300);
+  kinematics_->SetExternalPosition(1, 100);
+  EXPECT_EQ(400, backend_.position[0]);
+  EXPECT_EQ(200, backend_.position[1]);
+  kinematics_->Enqueue(Move(-50, 20, 0, 0, 1000));
+
+  PhysicalStatus status;
+  ASSERT_TRUE(kinematics_->GetPhysicalStatus(&status));
+  EXPECT_EQ(250, status.pos_steps[0]);
+  EXPECT_EQ(120, status.pos_steps[1]);
+}
+
+TEST_F(KinematicsTest, CoreXYLimitsMotorSpeed) {
+  config_.max_feedrate[AXIS_X] = config_.max_feedrate[AXIS_Y] = 100;
+  config_.acceleration[AXIS_X] = config_.acceleration[AXIS_Y] = 1000;
+  Create(Kinematics::Type::COREXY);
+
+  // Along X, both motors move as far as the axis.
+  const int along_x[3] = {1000, 0, 0};
+  double speed = 20000, accel = 200000;
+  kinematics_->LimitSpeed(along_x, 1000, &speed, &accel);
+  EXPECT_DOUBLE_EQ(10000, speed);
+  EXPECT_DOUBLE_EQ(100000, accel);
+
+  // Diagonal: motor X moves twice the steps of the defining axis.
+  const int diagonal[3] = {1000, 1000, 0};
+  speed = 10000, accel = 100000;
+  kinematics_->LimitSpeed(diagonal, 1000, &speed, &accel);
+  EXPECT_DOUBLE_EQ(5000, speed);
+  EXPECT_DOUBLE_EQ(50000, accel);
+
+  // Slow enough already.
+  speed = 1000, accel = 10000;
+  kinematics_->LimitSpeed(diagonal, 1000, &speed, &accel);
+  EXPECT_DOUBLE_EQ(1000, speed);
+  EXPECT_DOUBLE_EQ(10000, accel);
+}
+
+TEST_F(KinematicsTest, DeltaSplitsMovesAndFollowsCarriages) {
+  config_.delta_radius = 100;
+  config_.delta_arm_length = 200;
+  config_.delta_segments_per_second = 100;
+  Create(Kinematics::Type::DELTA);
+  // Start in the center, 10mm above the bed.
+  kinematics_->SetExternalPosition(0, 100 * 100);
+  kinematics_->SetExternalPosition(1, 100 * 100);
+  kinematics_->SetExternalPosition(2, 10 * 100);
+  const int carriage = lround((10 + sqrt(200 * 200 - 100 * 100)) * 100);
+  for (int tower = 0; tower < 3; ++tower) {
+    EXPECT_EQ(carriage, backend_.position[tower]);
+  }
+
+  // 50mm along X at 50mm/s with 10mm of extrusion: 1 second, 100 pieces.
+  kinematics_->Enqueue(Move(5000, 0, 0, 1000, 5000));
+  EXPECT_EQ(100u, backend_.segments.size());
+  int extruded = 0;
+  for (const LinearSegmentSteps &segment : backend_.segments) {
+    extruded += segment.steps[3];
+  }
+  EXPECT_EQ(1000, extruded);
+
+  PhysicalStatus status;
+  ASSERT_TRUE(kinematics_->GetPhysicalStatus(&status));
+  EXPECT_NEAR(150 * 100, status.pos_steps[0], 2);
+  EXPECT_NEAR(100 * 100, status.pos_steps[1], 2);
+  EXPECT_NEAR(10 * 100, status.pos_steps[2], 2);
+
+  // Vertical moves are passed through to all carriages in one piece.
+  backend_.segments.clear();
+  kinematics_->Enqueue(Move(0, 0, 500, 0, 1000));
+  ASSERT_EQ(1u, backend_.segments.size());
+  for (int tower = 0; tower < 3; ++tower) {
+    EXPECT_EQ(500, backend_.segments[0].steps[tower]);
+  }
+}
+
+TEST_F(KinematicsTest, DeltaRejectsPositionsOutOfReach) {
+  config_.delta_radius = 100;
+  config_.delta_arm_length = 150;
+  config_.delta_segments_per_second = 100;
+  Create(Kinematics::Type::DELTA);
+  const int center[3] = {100 * 100, 100 * 100, 0};
+  EXPECT_TRUE(kinematics_->IsReachable(center));
+  // Towers are 100mm from the center, the one of Z in the back.
+  const int near_z_tower[3] = {100 * 100, 150 * 100, 0};
+  EXPECT_TRUE(kinematics_->IsReachable(near_z_tower));
+  const int away_from_z_tower[3] = {100 * 100, 40 * 100, 0};
+  EXPECT_FALSE(kinematics_->IsReachable(away_from_z_tower));
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
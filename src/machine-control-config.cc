@@ -21,6 +21,7 @@
 
 #include <stdlib.h>
 
+#include "common/hash.h"
 #include "common/logging.h"
 #include "common/string-util.h"
 #include "config-parser.h"
@@ -45,6 +46,14 @@ MachineControlConfig::MachineControlConfig() {
   auto_motor_disable_seconds = -1;
   auto_fan_disable_seconds = -1;
   auto_fan_pwm = 0;
+  underrun_margin_ms = 100;
+  kinematics = Kinematics::Type::CARTESIAN;
+  delta_radius = 0;
+  delta_arm_length = 0;
+  delta_segments_per_second = 100;
+  for (const GCodeParserAxis axis : AllAxes()) {
+    input_shaper_damping[axis] = 0.1;
+  }
 }
 
 namespace {
@@ -92,6 +101,12 @@ class MachineControlConfigReader : public ConfigParser::Reader {
       ACCEPT_VALUE("auto-fan-disable-seconds", Int,
                    &config_->auto_fan_disable_seconds);
       ACCEPT_VALUE("auto-fan-pwm", Int, &config_->auto_fan_pwm);
+      ACCEPT_VALUE("underrun-margin-ms", Int, &config_->underrun_margin_ms);
+      ACCEPT_EXPR("delta-radius", &config_->delta_radius);
+      ACCEPT_EXPR("delta-arm-length", &config_->delta_arm_length);
+      ACCEPT_EXPR("delta-segments-per-second",
+                  &config_->delta_segments_per_second);
+      if (name == "kinematics") return SetKinematics(line_no, value);
       return false;
     }
 
@@ -109,7 +124,18 @@ class MachineControlConfigReader : public ConfigParser::Reader {
 
       ACCEPT_EXPR("range", &config_->move_range_mm[current_axis_]);
 
+      ACCEPT_EXPR("input-shaper-freq",
+                  &config_->input_shaper_freq[current_axis_]);
+      ACCEPT_EXPR("input-shaper-damping",
+                  &config_->input_shaper_damping[current_axis_]);
+
+      ACCEPT_EXPR("pressure-advance",
+                  &config_->pressure_advance[current_axis_]);
+
       if (name == "home-pos") return SetHomePos(line_no, current_axis_, value);
+      if (name == "input-shaper") {
+        return SetInputShaper(line_no, current_axis_, value);
+      }
     }
     ReportError(line_no, StringPrintf("Unexpected configuration option '%s'",
                                       name.c_str()));
@@ -144,6 +170,27 @@ class MachineControlConfigReader : public ConfigParser::Reader {
     return true;
   }
 
+  bool SetKinematics(int line_no, const std::string &value) {
+    if (Kinematics::ParseType(value, &config_->kinematics)) return true;
+    ReportError(line_no,
+                StringPrintf("kinematics: valid values are 'cartesian', "
+                             "'corexy', 'hbot' or 'delta', but got '%s'",
+                             value.c_str()));
+    return false;
+  }
+
+  bool SetInputShaper(int line_no, enum GCodeParserAxis axis,
+                      const std::string &value) {
+    if (InputShaper::ParseType(value, &config_->input_shaper[axis])) {
+      return true;
+    }
+    ReportError(line_no,
+                StringPrintf("input-shaper[%c]: valid values are 'none', "
+                             "'zv', 'zvd' or 'mzv', but got '%s'",
+                             gcodep_axis2letter(axis), value.c_str()));
+    return false;
+  }
+
   MachineControlConfig *const config_;
   enum GCodeParserAxis current_axis_;
   std::string current_section_;
@@ -154,3 +201,36 @@ bool MachineControlConfig::ConfigureFromFile(const ConfigParser &parser) {
   MachineControlConfigReader reader(this);
   return parser.EmitConfigValues(&reader);
 }
+
+uint64_t MachineControlConfig::Fingerprint() const {
+  Fnv1aHash hash;
+  hash.AddValue(steps_per_mm)
+    .AddValue(move_range_mm)
+    .AddValue(max_feedrate)
+    .AddValue(acceleration)
+    .AddValue(max_probe_feedrate)
+    .AddValue(input_shaper)
+    .AddValue(input_shaper_freq)
+    .AddValue(input_shaper_damping)
+    .AddValue(pressure_advance)
+    .AddValue(kinematics)
+    .AddValue(delta_radius)
+    .AddValue(delta_arm_length)
+    .AddValue(delta_segments_per_second)
+    .AddValue(speed_factor)
+    .AddValue(threshold_angle)
+    .AddValue(speed_tune_angle)
+    .Add(home_order)
+    .AddValue(homing_trigger)
+    .AddValue(auto_motor_disable_seconds)
+    .AddValue(auto_fan_disable_seconds)
+    .AddValue(auto_fan_pwm)
+    .AddValue(acknowledge_lines)
+    .AddValue(require_homing)
+    .AddValue(range_check)
+    .Add(clamp_to_range)
+    .AddValue(debug_print)
+    .AddValue(synchronous)
+    .AddValue(enable_pause);
+  return hash.value();
+}
@@ -54,6 +54,8 @@ TEST(MachineControlConfig, AxisMapping) {
     "max-acceleration = 4242\n"
     "range = 987\n"
     "home-pos = max\n"
+    "input-shaper = ZVD\n"
+    "input-shaper-freq = 42.5\n"
 
     "[ Y-Axis ]\n"
     "home-pos = min\n"  // Different home pos.
@@ -68,6 +70,10 @@ TEST(MachineControlConfig, AxisMapping) {
   EXPECT_FLOAT_EQ(987.0f, config.move_range_mm[AXIS_X]);
   EXPECT_EQ(HardwareMapping::TRIGGER_MAX, config.homing_trigger[AXIS_X]);
   EXPECT_EQ(HardwareMapping::TRIGGER_MIN, config.homing_trigger[AXIS_Y]);
+  EXPECT_EQ(InputShaper::Type::ZVD, config.input_shaper[AXIS_X]);
+  EXPECT_FLOAT_EQ(42.5f, config.input_shaper_freq[AXIS_X]);
+  EXPECT_FLOAT_EQ(0.1f, config.input_shaper_damping[AXIS_X]);  // default
+  EXPECT_EQ(InputShaper::Type::NONE, config.input_shaper[AXIS_Y]);
 }
 
 #if 0
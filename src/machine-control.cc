@@ -32,33 +32,50 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cmath>
 #include <memory>
+#include <set>
 
+#include "common/fanout-stream.h"
 #include "common/fd-mux.h"
 #include "common/logging.h"
 #include "common/string-util.h"
 #include "config-parser.h"
 #include "gcode-machine-control.h"
+#include "gcode-parser/compiled-gcode.h"
 #include "gcode-parser/gcode-parser.h"
 #include "gcode-parser/gcode-streamer.h"
+#include "gcode-parser/parser-checkpoints.h"
 #include "hardware-mapping.h"
+#include "job-queue.h"
 #include "motion-queue-motor-operations.h"
 #include "motion-queue.h"
 #include "pru-hardware-interface.h"
+#include "segment-cache.h"
 #include "segment-queue.h"
 #include "sim-audio-out.h"
 #include "sim-firmware.h"
 #include "spindle-control.h"
+#include "status-shm.h"
+#include "status-telemetry.h"
+#include "time-index.h"
+
+// How often the --status-shm page is updated.
+static constexpr unsigned kStatusPageUpdateMs = 10;
 
 static int usage(const char *prog, const char *msg) {
   if (msg) {
     fprintf(stderr, "\033[1m\033[31m%s\033[0m\n\n", msg);
   }
   fprintf(stderr,
-          "Usage: %s [options] [<gcode-filename>]\n"
+          "Usage: %s [options] [<gcode-filename>...]\n"
+          "The gcode-filename can also be a file compiled with "
+          "gcode-compile.\nSeveral files are run back-to-back as one job "
+          "queue without stopping in between.\n"
           "Options:\n",
           prog);
   fprintf(
@@ -66,9 +83,26 @@ static int usage(const char *prog, const char *msg) {
     "  -c, --config <config-file> : Configuration file. (Required)\n"
     "  -p, --port <port>          : Listen on this TCP port for GCode.\n"
     "  -b, --bind-addr <bind-ip>  : Bind to this IP (Default: 0.0.0.0).\n"
+    "      --unix-socket <path>   : Listen on this unix domain socket for "
+    "GCode. Local senders can also pass an open file.\n"
     "  -l, --logfile <logfile>    : Logfile to use. If empty, messages go to "
     "syslog (Default: /dev/stderr).\n"
     "      --param <paramfile>    : Parameter file to use.\n"
+    "      --spool-dir <dir>      : Add the G-code files in this directory "
+    "to the job queue, in order of their names. Files arriving while "
+    "running are picked up once unchanged for a few seconds; copy under "
+    "a .dot-name and rename.\n"
+    "      --resume-line <line>   : Start the gcode-file at this line in "
+    "the state the program has there, e.g. to continue after a crash.\n"
+    "      --segment-cache <dir>  : Cache planned motion of gcode-files in "
+    "this directory and replay it on the next run of the same file.\n"
+    "      --parse-ahead          : Read and pre-lex G-code in a separate "
+    "thread (Default: off).\n"
+    "      --credit-window <n>    : Instead of 'ok' for each line, let "
+    "senders pipeline up to <n> lines; flow control with 'credits' "
+    "messages.\n"
+    "      --status-shm <name>    : Publish machine status in this POSIX "
+    "shared memory page, e.g. /beagleg-status.\n"
     "  -d, --daemon               : Run as daemon.\n"
     "      --priv <uid>[:<gid>]   : After opening GPIO: drop privileges to "
     "this (default: daemon:daemon)\n"
@@ -155,13 +189,91 @@ static bool drop_privileges(std::string_view privs) {
   return true;
 }
 
-// Reads the given "gcode_filename" with GCode and operates machine with it.
-static void send_file_to_machine(GCodeMachineControl *machine,
-                                 GCodeStreamer *streamer,
-                                 const char *gcode_filename) {
-  machine->SetMsgOut(stderr);
-  int fd = open(gcode_filename, O_RDONLY);
-  streamer->ConnectStream(fd, stderr);
+// Progress of the job read by the streamer, determined with the time index
+// of its file.
+class JobProgress {
+ public:
+  JobProgress(const MachineControlConfig &config, GCodeStreamer *streamer,
+              SegmentQueue *motor_queue)
+      : config_(config), streamer_(streamer), motor_queue_(motor_queue) {}
+
+  // Start tracking the job read from "gcode_filename". Its time index is
+  // loaded or built in the background. There is no time index for
+  // compiled G-code.
+  void StartJob(const std::string &gcode_filename) {
+    skipped_lines_ = 0;
+    index_.reset();
+    if (IsCompiledGCodeFile(gcode_filename.c_str())) return;
+    index_.reset(new TimeIndex());
+    index_->StartLoadOrBuild(gcode_filename, config_);
+  }
+
+  // The current job has been resumed after its first "lines" lines.
+  void SkipLines(int lines) { skipped_lines_ = lines; }
+
+  // Get the current line and the percentage done and seconds remaining.
+  // Returns false if not known (yet).
+  bool Get(int *line, float *percent, float *remaining_seconds) const {
+    if (!index_ || !index_->ready() || index_->total_seconds() <= 0) {
+      return false;
+    }
+    *line = skipped_lines_ + streamer_->lines_processed();
+    // Like while building the index, the time of the line is the time the
+    // motion queue got so far. Some of it is not executed yet.
+    const float done = std::max(
+      0.0f, index_->SecondsAtLine(*line) - motor_queue_->GetQueuedSeconds());
+    *percent = 100.0f * done / index_->total_seconds();
+    *remaining_seconds = index_->total_seconds() - done;
+    return true;
+  }
+
+ private:
+  const MachineControlConfig &config_;
+  GCodeStreamer *const streamer_;
+  SegmentQueue *const motor_queue_;
+  std::unique_ptr<TimeIndex> index_;
+  int skipped_lines_ = 0;
+};
+
+// Opens the next G-code file from the "jobs" to be read by the streamer.
+// Returns the file descriptor or -1 if there are no more jobs.
+static int open_next_job(JobQueue *jobs, JobProgress *progress) {
+  std::string gcode_filename;
+  while (!(gcode_filename = jobs->Next()).empty()) {
+    Log_info("Starting job %s", gcode_filename.c_str());
+    const int fd = open(gcode_filename.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      progress->StartJob(gcode_filename);
+      return fd;
+    }
+    Log_error("Skipping job %s: %s", gcode_filename.c_str(), strerror(errno));
+  }
+  return -1;
+}
+
+// Let the "parser" continue the G-code file "fd" at "line" in the state the
+// program has there, as if all the lines before had run. With the parser
+// checkpoints of the file, only a few lines need to be parsed for that.
+// Positions "fd" at the start of the line. Returns false on failure.
+static bool resume_at_line(const std::string &gcode_filename, int fd,
+                           int line, const GCodeParser::Config &parser_cfg,
+                           GCodeParser *parser, JobProgress *progress) {
+  ParserCheckpoints checkpoints;
+  if (!checkpoints.LoadOrBuild(gcode_filename, parser_cfg)) {
+    Log_error("Can't read %s to resume it.", gcode_filename.c_str());
+    return false;
+  }
+  off_t offset;
+  if (!checkpoints.Seek(fd, line - 1, parser_cfg, parser, &offset) ||
+      lseek(fd, offset, SEEK_SET) < 0) {
+    Log_error("Can't resume %s at line %d: it has %d lines, and resuming "
+              "inside of while loops is not possible.",
+              gcode_filename.c_str(), line, checkpoints.lines());
+    return false;
+  }
+  progress->SkipLines(line - 1);
+  Log_info("Resuming %s at line %d", gcode_filename.c_str(), line);
+  return true;
 }
 
 // Open server. Return file-descriptor or -1 if listen fails.
@@ -195,15 +307,87 @@ static int open_server(const char *bind_addr, int port) {
   return s;
 }
 
+// Open a unix domain socket server on "path". An old socket file at that
+// path is replaced. Return file-descriptor or -1 on failure.
+static int open_unix_server(const char *path) {
+  struct sockaddr_un serv_addr = {};
+  serv_addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(serv_addr.sun_path)) {
+    Log_error("Unix socket path too long: %s", path);
+    return -1;
+  }
+  strncpy(serv_addr.sun_path, path, sizeof(serv_addr.sun_path) - 1);
+  int s = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (s < 0) {
+    Log_error("creating unix socket: %s", strerror(errno));
+    return -1;
+  }
+  unlink(path);  // Left over from a previous run.
+  if (bind(s, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    Log_error("Trouble binding to %s: %s", path, strerror(errno));
+    close(s);
+    return -1;
+  }
+  return s;
+}
+
+static bool set_nonblocking(int fd) {
+  // We need to set the fd to non blocking in order to avoid
+  // blocking reads caused by spurious situations in Linux.
+  // http://man7.org/linux/man-pages/man2/select.2.html#BUGS
+  const int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+    Log_error("fcntl(): %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+// All G-code connections, from any of the listeners, feed the one
+// GCodeStreamer.
+// Only one connection can control the machine at a time. Connections coming
+// in while there is one become read-only observers, that get a copy of all
+// the messages sent to the controlling connection.
+struct GCodeInput {
+  GCodeInput(GCodeStreamer *s, FanoutStream *msg) : streamer(s), messages(msg) {
+    streamer->set_on_disconnect([this]() {
+      messages->SetPrimary(-1);
+      if (file_sender >= 0) close(file_sender);
+      file_sender = -1;
+    });
+  }
+
+  GCodeStreamer *const streamer;
+  FanoutStream *const messages;
+  int file_sender = -1;  // Connection that passed the file we are reading.
+};
+
+// Hand a new connection to the streamer, or let it observe if another one
+// is already in control.
+static void connect_gcode_stream(GCodeInput *input, int connection,
+                                 const char *peer) {
+  if (input->streamer->IsStreaming()) {
+    // There is only one machine after all, so only one can control it.
+    Log_info("Accepting observer connection from %s\n", peer);
+    dprintf(connection,
+            "// Another connection controls the machine. "
+            "Observing its messages.\n");
+    input->messages->AddObserver(connection);
+    return;
+  }
+
+  Log_info("Accepting new connection from %s\n", peer);
+  input->messages->SetPrimary(connection);
+  input->streamer->ConnectStream(connection, input->messages->stream());
+}
+
 // Accept connections and receive GCode.
-// Only one connection can be active at a time.
 // Socket must already be opened by open_server(). "bind_addr" and "port"
 // are just FYI information for nicer log-messages.
 static void run_gcode_server(int listen_socket, FDMultiplexer *event_server,
-                             GCodeMachineControl *machine,
-                             GCodeStreamer *streamer, const char *bind_addr,
+                             GCodeInput *input, const char *bind_addr,
                              int port) {
-  if (listen(listen_socket, 2) < 0) {
+  if (listen(listen_socket, 16) < 0) {
     Log_error("listen(fd=%d) failed: %s", listen_socket, strerror(errno));
     return;
   }
@@ -211,84 +395,197 @@ static void run_gcode_server(int listen_socket, FDMultiplexer *event_server,
   Log_info("Ready to accept GCode-connections on %s:%d",
            bind_addr ? bind_addr : "0.0.0.0", port);
 
-  event_server->RunOnReadable(
-    listen_socket, [listen_socket, machine, streamer]() {
-      struct sockaddr_in client;
-      socklen_t socklen = sizeof(client);
-      int connection =
-        accept(listen_socket, (struct sockaddr *)&client, &socklen);
-      if (connection < 0) {
-        Log_error("accept(): %s", strerror(errno));
-        return true;
-      }
+  event_server->RunOnReadable(listen_socket, [listen_socket, input]() {
+    struct sockaddr_in client;
+    socklen_t socklen = sizeof(client);
+    int connection =
+      accept(listen_socket, (struct sockaddr *)&client, &socklen);
+    if (connection < 0) {
+      Log_error("accept(): %s", strerror(errno));
+      return true;
+    }
+    if (!set_nonblocking(connection)) {
+      close(connection);
+      return true;
+    }
 
-      // We need to set the fd to non blocking in order to avoid
-      // blocking reads caused by spurious situations in Linux.
-      // http://man7.org/linux/man-pages/man2/select.2.html#BUGS
-      const int flags = fcntl(connection, F_GETFL, 0);
-      if (flags < 0) {
-        Log_error("fcntl(): %s", strerror(errno));
-        return true;
-      }
-      if (fcntl(connection, F_SETFL, flags | O_NONBLOCK) < 0) {
-        Log_error("fcntl(): %s", strerror(errno));
-        return true;
-      }
+    char ip_buffer[INET_ADDRSTRLEN];
+    const char *print_ip =
+      inet_ntop(AF_INET, &client.sin_addr, ip_buffer, sizeof(ip_buffer));
+    connect_gcode_stream(input, connection, print_ip);
+    return true;
+  });
+}
 
-      if (streamer->IsStreaming()) {
-        // For now, only one. Though we could have multiple.
-        dprintf(connection,
-                "// Sorry, can only handle one connection at a time."
-                "There is only one machine after all.\n");
-        close(connection);
-        return true;
-      }
+// If the peer passed a file descriptor with SCM_RIGHTS, return it, otherwise
+// -1. Nothing of regular G-code sent on the connection is consumed.
+static int receive_passed_fd(int connection) {
+  char byte;
+  struct iovec iov = {&byte, 1};
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(int))];
+  } control;
+  struct msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  // Peeking hands us our own copy of a passed file descriptor.
+  if (recvmsg(connection, &msg, MSG_PEEK | MSG_CMSG_CLOEXEC) <= 0) return -1;
+  struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS) {
+    return -1;
+  }
+  int fd;
+  memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+  // Consume the byte the file descriptor came with. Without a control
+  // buffer, the kernel drops its copy of the file descriptor.
+  if (recv(connection, &byte, 1, 0) < 0) {
+    Log_error("recv(): %s", strerror(errno));
+  }
+  return fd;
+}
 
-      char ip_buffer[INET_ADDRSTRLEN];
-      const char *print_ip =
-        inet_ntop(AF_INET, &client.sin_addr, ip_buffer, sizeof(ip_buffer));
-      Log_info("Accepting new connection from %s\n", print_ip);
+// Accept G-code connections on a unix domain socket. Besides sending G-code
+// like on the TCP port, local senders can pass an open file with SCM_RIGHTS
+// (together with one arbitrary byte), which is then read directly. The
+// connection receives the responses and is closed once the file is done.
+static void run_unix_gcode_server(int listen_socket,
+                                  FDMultiplexer *event_server,
+                                  GCodeInput *input, const char *path) {
+  if (listen(listen_socket, 16) < 0) {
+    Log_error("listen(fd=%d) failed: %s", listen_socket, strerror(errno));
+    return;
+  }
+
+  Log_info("Ready to accept GCode-connections on unix socket %s", path);
 
-      FILE *msg_stream = fdopen(connection, "w");
-      machine->SetMsgOut(msg_stream);
-      streamer->ConnectStream(connection, msg_stream);
+  event_server->RunOnReadable(listen_socket, [listen_socket, event_server,
+                                              input]() {
+    int connection = accept(listen_socket, NULL, NULL);
+    if (connection < 0) {
+      Log_error("accept(): %s", strerror(errno));
+      return true;
+    }
+    if (!set_nonblocking(connection)) {
+      close(connection);
       return true;
+    }
+
+    // Wait for the first data to see if we get passed a file.
+    event_server->RunOnReadable(connection, [connection, event_server,
+                                             input]() {
+      const int file_fd = receive_passed_fd(connection);
+      // This watch is only removed after we return, so the streamer can
+      // only take over the connection at the end of the cycle.
+      event_server->RunAtEndOfCycle([connection, file_fd, input]() {
+        if (file_fd < 0) {
+          connect_gcode_stream(input, connection, "unix socket");
+          return false;
+        }
+        if (input->streamer->IsStreaming()) {
+          dprintf(connection, "// Machine busy with another connection.\n");
+          close(file_fd);
+          close(connection);
+          return false;
+        }
+        Log_info("Reading G-code from file passed on unix socket.");
+        input->file_sender = connection;
+        input->messages->SetPrimary(connection);
+        input->streamer->ConnectStream(file_fd, input->messages->stream());
+        return false;
+      });
+      return false;
     });
+    return true;
+  });
 }
 
 // THIS IS A SAMPLE ONLY at this point. We need to come up with a proper
 // definition first what we want from a status server.
+// Sockets of the status server. While running G-code files, the status
+// server is closed after the last job, so that we exit when done.
+struct StatusServer {
+  bool closed = false;
+  int listen_socket = -1;
+  std::set<int> connections;
+
+  // The handlers see the sockets shut down and remove themselves.
+  void Close() {
+    closed = true;
+    if (listen_socket >= 0) shutdown(listen_socket, SHUT_RDWR);
+    for (int conn : connections) shutdown(conn, SHUT_RDWR);
+  }
+};
+
 // https://github.com/hzeller/beagleg/issues/38
 // At this point: whenever it receives the character 'p' it prints the
-// position as json.
+// position as json, 's' prints the machine status; while running a job
+// whose time index is known, also its progress.
+// "t<rate>\n" subscribes to a stream of status records with the given rate
+// in Hz (1..1000), only containing what changed; "t0\n" unsubscribes.
 static void run_status_server(const char *bind_addr, int port,
                               FDMultiplexer *event_server,
-                              GCodeMachineControl *machine) {
+                              GCodeMachineControl *machine,
+                              StatusTelemetry *telemetry,
+                              const JobProgress *progress,
+                              StatusServer *server) {
   const int listen_socket = open_server(bind_addr, port);
   if (listen_socket < 0) return;
   if (listen(listen_socket, 2) < 0) {
     Log_error("listen(fd=%d) failed: %s", listen_socket, strerror(errno));
     return;
   }
+  server->listen_socket = listen_socket;
 
   Log_info("Starting experimental status server on port %d", port);
 
   event_server->RunOnReadable(listen_socket, [listen_socket, machine,
-                                              event_server]() {
+                                              event_server, telemetry,
+                                              progress, server]() {
     struct sockaddr_in client;
     socklen_t socklen = sizeof(client);
     int conn = accept(listen_socket, (struct sockaddr *)&client, &socklen);
     if (conn < 0) {
+      if (server->closed) {
+        close(listen_socket);
+        return false;
+      }
       Log_error("accept(): %s", strerror(errno));
       return true;
     }
+    server->connections.insert(conn);
 
-    event_server->RunOnReadable(conn, [conn, machine]() {
+    // Rate of a subscription currently being received; -1 if none.
+    auto subscription_rate = std::make_shared<int>(-1);
+    event_server->RunOnReadable(conn, [conn, machine, telemetry, progress,
+                                       server, subscription_rate]() {
       char query;
       if (read(conn, &query, 1) <= 0) {
+        telemetry->Unsubscribe(conn);
+        server->connections.erase(conn);
         close(conn);
         return false;
       }
+      if (*subscription_rate >= 0) {
+        if (isdigit(query)) {
+          *subscription_rate = *subscription_rate * 10 + (query - '0');
+          if (*subscription_rate > 1000) *subscription_rate = 1000;
+          return true;
+        }
+        if (*subscription_rate == 0) {
+          telemetry->Unsubscribe(conn);
+        } else {
+          telemetry->Subscribe(conn, *subscription_rate);
+        }
+        *subscription_rate = -1;
+        return true;
+      }
+      if (query == 't') {
+        *subscription_rate = 0;
+      }
       if (query == 'p') {
         AxesRegister pos;
         machine->GetCurrentPosition(&pos);
@@ -303,9 +600,10 @@ static void run_status_server(const char *bind_addr, int port,
         GCodeMachineControl::EStopState estop_status =
           machine->GetEStopStatus();
         GCodeMachineControl::HomingState home_status = machine->GetHomeStatus();
-        // JSON {"estop":"status", "homed":"status", "motors":bool}
+        // JSON {"estop":"status", "homed":"status", "motors":bool
+        //       [, "job":{"line":int, "progress":fval, "remaining_s":fval}]}
         dprintf(
-          conn, "{\"estop\":\"%s\", \"homed\":\"%s\", \"motors\":%s}\n",
+          conn, "{\"estop\":\"%s\", \"homed\":\"%s\", \"motors\":%s",
           estop_status == GCodeMachineControl::EStopState::NONE   ? "none"
           : estop_status == GCodeMachineControl::EStopState::SOFT ? "soft"
           : estop_status == GCodeMachineControl::EStopState::HARD ? "hard"
@@ -317,6 +615,15 @@ static void run_status_server(const char *bind_addr, int port,
           : home_status == GCodeMachineControl::HomingState::HOMED ? "yes"
                                                                    : "unknown",
           machine->GetMotorsEnabled() ? "true" : "false");
+        int line;
+        float percent, remaining;
+        if (progress->Get(&line, &percent, &remaining)) {
+          dprintf(conn,
+                  ", \"job\":{\"line\":%d, \"progress\":%.1f, "
+                  "\"remaining_s\":%.0f}",
+                  line, percent, remaining);
+        }
+        dprintf(conn, "}\n");
       }
       return true;
     });
@@ -324,6 +631,16 @@ static void run_status_server(const char *bind_addr, int port,
   });
 }
 
+static void SampleMachineStatus(GCodeMachineControl *machine,
+                                MachineStatusSample *sample) {
+  machine->GetCurrentPosition(&sample->position);
+  sample->estop = machine->GetEStopStatus();
+  sample->homing = machine->GetHomeStatus();
+  sample->motors_enabled = machine->GetMotorsEnabled();
+  sample->queue_depth = machine->GetPlannerQueueDepth();
+  sample->aux_bits = machine->GetAuxBits();
+}
+
 // Create an absolute filename from a path, without the file not needed
 // to exist (so works where realpath() doesn't)
 static std::string MakeAbsoluteFile(const char *in) {
@@ -339,6 +656,8 @@ int main(int argc, char *argv[]) {
   bool simulation_output = false;
   const char *logfile = NULL;
   std::string paramfile;
+  std::string segment_cache_dir;
+  std::string spool_dir;
   const char *config_file = NULL;
   bool as_daemon = false;
   const char *privs = "daemon:daemon";
@@ -356,7 +675,14 @@ int main(int argc, char *argv[]) {
     OPT_PRIVS,
     OPT_ENABLE_M111,
     OPT_PARAM_FILE,
-    OPT_STATUS_SERVER
+    OPT_STATUS_SERVER,
+    OPT_SEGMENT_CACHE,
+    OPT_PARSE_AHEAD,
+    OPT_CREDIT_WINDOW,
+    OPT_STATUS_SHM,
+    OPT_UNIX_SOCKET,
+    OPT_SPOOL_DIR,
+    OPT_RESUME_LINE,
   };
 
   // clang-format off
@@ -374,6 +700,7 @@ int main(int argc, char *argv[]) {
     // Optional
     { "port",               required_argument, NULL, 'p'},
     { "bind-addr",          required_argument, NULL, 'b'},
+    { "unix-socket",        required_argument, NULL, OPT_UNIX_SOCKET },
     { "loop",               optional_argument, NULL, OPT_LOOP },
     { "logfile",            required_argument, NULL, 'l'},
     { "param",              required_argument, NULL, OPT_PARAM_FILE },
@@ -381,6 +708,12 @@ int main(int argc, char *argv[]) {
     { "priv",               required_argument, NULL, OPT_PRIVS },
     { "allow-m111",         no_argument,       NULL, OPT_ENABLE_M111 },
     { "status-server",      required_argument, NULL, OPT_STATUS_SERVER },
+    { "segment-cache",      required_argument, NULL, OPT_SEGMENT_CACHE },
+    { "spool-dir",          required_argument, NULL, OPT_SPOOL_DIR },
+    { "resume-line",        required_argument, NULL, OPT_RESUME_LINE },
+    { "parse-ahead",        no_argument,       NULL, OPT_PARSE_AHEAD },
+    { "credit-window",      required_argument, NULL, OPT_CREDIT_WINDOW },
+    { "status-shm",         required_argument, NULL, OPT_STATUS_SHM },
 
     // Not yet mentioned in --help. Possibly rarely useful.
     { "noack-ok",           no_argument,       NULL, OPT_DISABLE_ACK_OK },
@@ -400,6 +733,11 @@ int main(int argc, char *argv[]) {
   bool dont_require_homing = false;
   bool disable_range_check = false;
   bool allow_m111 = false;
+  bool parse_ahead = false;
+  int credit_window = 0;
+  int resume_line = 0;
+  const char *status_shm_name = NULL;
+  const char *unix_socket_path = NULL;
   config.threshold_angle = 10;
   config.speed_tune_angle = 60;
   FILE *wav_output = nullptr;
@@ -440,7 +778,20 @@ int main(int argc, char *argv[]) {
       break;
     case 'p': listen_port = atoi(optarg); break;
     case OPT_STATUS_SERVER: status_server_port = atoi(optarg); break;
+    case OPT_SEGMENT_CACHE:
+      segment_cache_dir = MakeAbsoluteFile(optarg);
+      break;
+    case OPT_SPOOL_DIR: spool_dir = MakeAbsoluteFile(optarg); break;
+    case OPT_RESUME_LINE:
+      resume_line = atoi(optarg);
+      if (resume_line < 1) {
+        return usage(argv[0], "--resume-line needs to be >= 1");
+      }
+      break;
     case 'b': bind_addr = strdup(optarg); break;  // NOLINT: leak ok.
+    case OPT_UNIX_SOCKET:
+      unix_socket_path = strdup(optarg);  // NOLINT: leak ok.
+      break;
     case 'l': logfile = strdup(optarg); break;    // NOLINT: leak ok.
     case OPT_PARAM_FILE: paramfile = MakeAbsoluteFile(optarg); break;
     case 'd': as_daemon = true; break;
@@ -453,6 +804,16 @@ int main(int argc, char *argv[]) {
       break;
     case OPT_PRIVS: privs = strdup(optarg); break;  // NOLINT: leak ok.
     case OPT_ENABLE_M111: allow_m111 = true; break;
+    case OPT_PARSE_AHEAD: parse_ahead = true; break;
+    case OPT_CREDIT_WINDOW:
+      credit_window = atoi(optarg);
+      if (credit_window <= 0) {
+        return usage(argv[0], "--credit-window needs to be > 0");
+      }
+      // Credits replace the per-line acknowledgement.
+      config.acknowledge_lines = false;
+      break;
+    case OPT_STATUS_SHM: status_shm_name = strdup(optarg); break;  // NOLINT
     case OPT_HELP: return usage(argv[0], NULL);
     default:
       // Deprecated, or unknown, option
@@ -470,9 +831,17 @@ int main(int argc, char *argv[]) {
                  "Choose one: --homing-required or --nohoming-required.");
   }
 
-  const bool has_filename = (optind < argc);
-  if (!(has_filename ^ (listen_port > 0))) {
-    return usage(argv[0], "Choose one: <gcode-filename> or --port <port>.");
+  const bool has_filename = (optind < argc || !spool_dir.empty());
+  const bool single_file = (optind + 1 == argc && spool_dir.empty());
+  const bool has_server = (listen_port > 0 || unix_socket_path != NULL);
+  if (!(has_filename ^ has_server)) {
+    return usage(argv[0],
+                 "Choose one: <gcode-filename>/--spool-dir or --port <port> "
+                 "and/or "
+                 "--unix-socket <path>.");
+  }
+  if (resume_line > 0 && !single_file) {
+    return usage(argv[0], "--resume-line needs exactly one gcode-filename.");
   }
 
   // As daemon, we use whatever the user chose as logfile
@@ -547,13 +916,21 @@ int main(int argc, char *argv[]) {
   //      someone is alrady listening (starting as daemon twice?).
   //  (b) open socket while we have not dropped privileges yet.
   int listen_socket = -1;
-  if (!has_filename) {
+  if (!has_filename && listen_port > 0) {
     listen_socket = open_server(bind_addr, listen_port);
     if (listen_socket < 0) {
       Log_error("Exiting. Couldn't bind to socket to listen.");
       return 1;
     }
   }
+  int unix_listen_socket = -1;
+  if (!has_filename && unix_socket_path) {
+    unix_listen_socket = open_unix_server(unix_socket_path);
+    if (unix_listen_socket < 0) {
+      Log_error("Exiting. Couldn't bind to unix socket to listen.");
+      return 1;
+    }
+  }
 
   // The backend for our stepmotor control. We either talk to the PRU or
   // just ignore them on dummy.
@@ -594,12 +971,26 @@ int main(int argc, char *argv[]) {
   MotionQueueMotorOperations motor_operations(&hardware_mapping,
                                               motion_backend);
 
+  // With a segment cache, the segments sent to the motors are recorded, so
+  // that the next run of the same file doesn't need parsing and planning.
+  const bool use_segment_cache =
+    single_file && resume_line == 0 && !segment_cache_dir.empty();
+  SegmentCacheRecorder segment_recorder(&motor_operations);
+  SegmentQueue *segment_queue =
+    use_segment_cache ? (SegmentQueue *)&segment_recorder : &motor_operations;
+
   GCodeMachineControl *machine_control = GCodeMachineControl::Create(
-    config, &motor_operations, &hardware_mapping, spindle.get(), stderr);
+    config, segment_queue, &hardware_mapping, spindle.get(), stderr);
   if (machine_control == NULL) {
     Log_error("Exiting. Cannot initialize machine control.");
     return 1;
   }
+  SegmentCacheGuard segment_cache_guard(&segment_recorder,
+                                        machine_control->ParseEventReceiver());
+  GCodeParser::EventReceiver *const receiver =
+    use_segment_cache ? &segment_cache_guard
+                      : machine_control->ParseEventReceiver();
+
   GCodeParser::Config parser_cfg(paramfile);
   parser_cfg.allow_m111 = allow_m111;
   GCodeParser::Config::ParamMap parameters;
@@ -607,27 +998,128 @@ int main(int argc, char *argv[]) {
   parser_cfg.LoadParams();
 
   machine_control->GetHomePos(&parser_cfg.machine_origin);
-  GCodeParser *parser =
-    new GCodeParser(parser_cfg, machine_control->ParseEventReceiver());
-  GCodeStreamer *streamer = new GCodeStreamer(
-    &event_server, parser, machine_control->ParseEventReceiver());
+  GCodeParser *parser = new GCodeParser(parser_cfg, receiver);
+  GCodeStreamer *streamer = new GCodeStreamer(&event_server, parser, receiver);
+  FanoutStream messages(&event_server);
+  GCodeInput gcode_input(streamer, &messages);
+  streamer->set_parse_ahead(parse_ahead);
+  streamer->set_credit_window(credit_window);
+  JobQueue job_queue;
+  JobProgress job_progress(config, streamer, &motor_operations);
+  StatusServer status_server;
+  SegmentCacheReplay segment_replay(&motor_operations);
   int ret = 0;
   if (has_filename) {
+    machine_control->SetMsgOut(stderr);
+    bool replay_from_cache = false;
     const char *filename = argv[optind];
-    send_file_to_machine(machine_control, streamer, filename);
+    const uint64_t cache_key =
+      use_segment_cache
+        ? SegmentCacheKey(filename, config, hardware_mapping, parser_cfg)
+        : 0;
+    if (cache_key) {
+      const std::string cache_file =
+        SegmentCacheFile(segment_cache_dir, cache_key);
+      const int cache_fd = open(cache_file.c_str(), O_RDONLY);
+      replay_from_cache =
+        cache_fd >= 0 && segment_replay.Map(cache_fd, cache_key);
+      if (replay_from_cache) {
+        Log_info("Replaying %s from segment cache %s", filename,
+                 cache_file.c_str());
+        // Like a compiled file, the cache is fed in batches from the event
+        // loop, so E-Stop, pause and status are handled in between. Once
+        // motion is queued, there is no going back to parsing the file.
+        event_server.RunOnReadable(cache_fd, [&segment_replay, &status_server,
+                                              machine_control, cache_fd,
+                                              cache_file]() {
+          static constexpr int kMaxOperations = 256;
+          if (machine_control->CheckMotionAllowed() &&
+              segment_replay.Continue(kMaxOperations)) {
+            return true;
+          }
+          if (!segment_replay.success()) {
+            Log_error("Stopped replaying segment cache %s",
+                      cache_file.c_str());
+          }
+          close(cache_fd);
+          status_server.Close();
+          return false;
+        });
+      } else {
+        if (cache_fd >= 0) close(cache_fd);
+        segment_recorder.StartRecording(cache_file, cache_key);
+      }
+    }
+    if (!replay_from_cache) {
+      for (int i = optind; i < argc; ++i) job_queue.AddFile(argv[i]);
+      if (!spool_dir.empty()) job_queue.SetSpoolDirectory(spool_dir);
+    }
+    // The next job is fed to the same planner as soon as the previous one
+    // is read, so the machine doesn't come to a halt in between.
+    auto next_job = [&job_queue, &job_progress, &status_server]() {
+      const int fd = open_next_job(&job_queue, &job_progress);
+      if (fd < 0) status_server.Close();
+      return fd;
+    };
+    streamer->set_next_stream(next_job);
+    if (resume_line > 0 && IsCompiledGCodeFile(filename)) {
+      Log_error("Can't resume compiled G-code %s.", filename);
+      return 1;
+    }
+    const int fd = replay_from_cache ? -1 : next_job();
+    if (fd >= 0 && resume_line > 0 &&
+        !resume_at_line(filename, fd, resume_line, parser_cfg, parser,
+                        &job_progress)) {
+      return 1;
+    }
+    if (fd >= 0) streamer->ConnectStream(fd, stderr);
   } else {
-    run_gcode_server(listen_socket, &event_server, machine_control, streamer,
-                     bind_addr, listen_port);
+    machine_control->SetMsgOut(messages.stream());
+    if (listen_socket >= 0) {
+      run_gcode_server(listen_socket, &event_server, &gcode_input, bind_addr,
+                       listen_port);
+    }
+    if (unix_listen_socket >= 0) {
+      run_unix_gcode_server(unix_listen_socket, &event_server, &gcode_input,
+                            unix_socket_path);
+    }
   }
 
-  if (status_server_port > 0 && !has_filename) {
+  StatusTelemetry telemetry(
+    &event_server, [machine_control](MachineStatusSample *sample) {
+      SampleMachineStatus(machine_control, sample);
+    });
+  if (status_server_port > 0 && !status_server.closed) {
     run_status_server(bind_addr, status_server_port, &event_server,
-                      machine_control);
+                      machine_control, &telemetry, &job_progress,
+                      &status_server);
   }
 
-  event_server.Loop();  // Run service until Ctrl-C or all sockets closed.
+  // Created after dropping privileges, so that we can remove it on exit.
+  StatusSharedMemory status_page;
+  if (status_shm_name && status_page.Create(status_shm_name)) {
+    Log_info("Publishing status in shared memory %s", status_shm_name);
+    event_server.RunEvery(
+      kStatusPageUpdateMs, [machine_control, motion_backend, &status_page]() {
+        MachineStatusSample sample;
+        SampleMachineStatus(machine_control, &sample);
+        status_page.Publish(sample, motion_backend->GetPendingElements(NULL));
+        return true;
+      });
+  }
+
+  // Run service until Ctrl-C or all sockets closed.
+  const uint64_t parameters_fingerprint = parameters.Fingerprint();
+  ret = event_server.Loop();
   Log_info("Exiting.");
 
+  // Replaying doesn't change parameters, e.g. work offsets set with G10.
+  if (parameters.Fingerprint() != parameters_fingerprint) {
+    segment_recorder.Invalidate("program changes parameters");
+  }
+  // Only a program that ran until the end is worth caching.
+  if (ret == 0) segment_recorder.Commit();
+
   delete streamer;
   delete parser;
   delete machine_control;
@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <strings.h>
 
+#include <algorithm>
 #include <deque>
 
 #include "common/logging.h"
@@ -45,6 +46,11 @@
 // accumulate too much error.
 #define MAX_STEPS_PER_SEGMENT (65535 / LOOPS_PER_STEP)
 
+// With velocity-scaled laser power, the power is updated at the beginning of
+// each segment. Acceleration and deceleration are split into this many
+// pieces, each with the power for its average speed.
+#define LASER_RAMP_DIVISIONS 8
+
 // TODO: don't store this singleton like, but keep in user_data of the
 // MotorOperations
 static float hardware_frequency_limit_ = 1e6;  // Don't go over 1 Mhz
@@ -102,6 +108,8 @@ struct HistoryPositionInfo {
 struct MotionQueueMotorOperations::HistorySegment {
   HistoryPositionInfo pos_info[MOTION_MOTOR_COUNT];
   uint16_t aux_bits;
+  uint32_t loops;  // Total loops of the segment and their estimated
+  float seconds;   // execution time; to know how much motion is buffered.
 };
 
 MotionQueueMotorOperations::MotionQueueMotorOperations(HardwareMapping *hw,
@@ -117,13 +125,10 @@ MotionQueueMotorOperations::~MotionQueueMotorOperations() {
   delete shadow_queue_;
 }
 
-bool MotionQueueMotorOperations::EnqueueInternal(
-  const LinearSegmentSteps &param, int defining_axis_steps) {
-  struct MotionSegment new_element = {};
-  new_element.direction_bits = 0;
-
-  // The new segment is based on the previous position.
-  struct HistorySegment history_segment = shadow_queue_->front();
+void MotionQueueMotorOperations::PrepareElement(
+  const LinearSegmentSteps &param, int defining_axis_steps,
+  MotionSegment *element, HistorySegment *history) {
+  element->direction_bits = 0;
 
   // The defining_axis_steps is the number of steps of the axis that requires
   // the most number of steps. All the others are a fraction of the steps.
@@ -135,23 +140,40 @@ bool MotionQueueMotorOperations::EnqueueInternal(
   for (int i = 0; i < MOTION_MOTOR_COUNT; ++i) {
     bool flip = hardware_mapping_->IsMotorFlipped(i);
     if (param.steps[i] < 0) {
-      if (!flip) new_element.direction_bits |= (1 << i);
-      history_segment.pos_info[i].sign = -1;
+      if (!flip) element->direction_bits |= (1 << i);
+      history->pos_info[i].sign = -1;
     } else {
-      if (flip) new_element.direction_bits |= (1 << i);
-      history_segment.pos_info[i].sign = 1;
+      if (flip) element->direction_bits |= (1 << i);
+      history->pos_info[i].sign = 1;
     }
-    history_segment.pos_info[i].position_steps += param.steps[i];
+    history->pos_info[i].position_steps += param.steps[i];
     const uint64_t delta = abs(param.steps[i]);
-    new_element.fractions[i] = delta * max_fraction / defining_axis_steps;
-    history_segment.pos_info[i].fraction = new_element.fractions[i];
+    element->fractions[i] = delta * max_fraction / defining_axis_steps;
+    history->pos_info[i].fraction = element->fractions[i];
   }
 
-  history_segment.aux_bits = param.aux_bits;
-  shadow_queue_->push_front(history_segment);
+  history->aux_bits = param.aux_bits;
+  element->aux = param.aux_bits;
+}
+
+bool MotionQueueMotorOperations::EnqueueInternal(
+  const LinearSegmentSteps &param, int defining_axis_steps) {
+  struct MotionSegment new_element = {};
+
+  // The new segment is based on the previous position.
+  struct HistorySegment history_segment = shadow_queue_->front();
+  PrepareElement(param, defining_axis_steps, &new_element, &history_segment);
 
   // TODO: clamp acceleration to be a minimum value.
   const int total_loops = LOOPS_PER_STEP * defining_axis_steps;
+  history_segment.loops = total_loops;
+  const float avg_speed =
+    (clip_hardware_frequency_limit(param.v0) +
+     clip_hardware_frequency_limit(param.v1)) / 2;
+  history_segment.seconds =
+    avg_speed > 0 ? defining_axis_steps / avg_speed : 0;
+  shadow_queue_->push_front(history_segment);
+
   // There are three cases: either we accelerate, travel or decelerate.
   if (param.v0 == param.v1) {
     // Travel
@@ -204,12 +226,56 @@ bool MotionQueueMotorOperations::EnqueueInternal(
                                              acceleration));
   }
 
+  if (param.laser_power_per_speed > 0) {
+    const float duty =
+      param.laser_power_per_speed * (param.v0 + param.v1) / 2;
+    SetLaserPower(std::min(duty, 1.0f), &new_element);
+  }
+
   new_element.aux = param.aux_bits;
   new_element.state = STATE_FILLED;
   backend_->MotorEnable(true);
   return backend_->Enqueue(&new_element);
 }
 
+void MotionQueueMotorOperations::SetLaserPower(float duty,
+                                               MotionSegment *element) {
+  uint32_t reg_address = 0;
+  uint32_t reg_value = 0;
+  if (!hardware_mapping_->GetPWMOutputRegister(
+        HardwareMapping::NamedOutput::SPINDLE_SPEED, duty, &reg_address,
+        &reg_value)) {
+    reg_address = reg_value = 0;
+  }
+  element->pwm_register = reg_address;
+  element->pwm_value = reg_value;
+}
+
+// The motion hardware can update one PWM register per element, so each
+// changed output gets its own element without steps before the segment.
+bool MotionQueueMotorOperations::EnqueuePWMChange(
+  HardwareMapping::NamedOutput output, float duty, uint16_t aux_bits) {
+  if (duty < 0) return true;  // Unchanged.
+  uint32_t reg_address = 0;
+  uint32_t reg_value = 0;
+  if (!hardware_mapping_->GetPWMOutputRegister(output, std::min(duty, 1.0f),
+                                               &reg_address, &reg_value)) {
+    return true;  // Not a PWM output the hardware can switch.
+  }
+  struct HistorySegment history_segment = shadow_queue_->front();
+  history_segment.aux_bits = aux_bits;
+  history_segment.loops = 0;
+  history_segment.seconds = 0;
+  shadow_queue_->push_front(history_segment);
+
+  struct MotionSegment pwm_element = {};
+  pwm_element.pwm_register = reg_address;
+  pwm_element.pwm_value = reg_value;
+  pwm_element.aux = aux_bits;
+  pwm_element.state = STATE_FILLED;
+  return backend_->Enqueue(&pwm_element);
+}
+
 bool MotionQueueMotorOperations::GetPhysicalStatus(PhysicalStatus *status) {
   // Shrink the queue
   uint32_t loops;
@@ -245,14 +311,10 @@ void MotionQueueMotorOperations::SetExternalPosition(int axis, int steps) {
     history_segment.pos_info[axis].sign = 1;
     history_segment.pos_info[axis].position_steps = steps;
   }
+  history_segment.loops = 0;  // Not a segment executed by the backend.
+  history_segment.seconds = 0;
   shadow_queue_->push_front(history_segment);
-  // Shrink the queue and remove the elements that we are not interested
-  // in anymore.
-  // TODO: We need to find a way to get the maximum number of elements
-  // of the shadow queue (ie backend_->GetQueueStats()?)
-  const int buffer_size = backend_->GetPendingElements(NULL);
-  const int new_size = buffer_size > 0 ? buffer_size : 1;
-  shadow_queue_->resize(new_size);
+  ShrinkShadowQueue();
 }
 
 static int get_defining_axis_steps(const LinearSegmentSteps &param) {
@@ -267,9 +329,19 @@ static int get_defining_axis_steps(const LinearSegmentSteps &param) {
 
 bool MotionQueueMotorOperations::Enqueue(const LinearSegmentSteps &segment) {
   const int defining_axis_steps = get_defining_axis_steps(segment);
-  bool ret;
-
-  if (defining_axis_steps == 0) {
+  int divisions = (defining_axis_steps / MAX_STEPS_PER_SEGMENT) + 1;
+  if (segment.laser_power_per_speed > 0 && segment.v0 != segment.v1) {
+    divisions = std::max(
+      divisions, std::min(LASER_RAMP_DIVISIONS, defining_axis_steps));
+  }
+  bool ret = EnqueuePWMChange(HardwareMapping::NamedOutput::SPINDLE_SPEED,
+                              segment.spindle_pwm, segment.aux_bits) &&
+             EnqueuePWMChange(HardwareMapping::NamedOutput::FAN,
+                              segment.fan_pwm, segment.aux_bits);
+
+  if (!ret) {
+    // Aborted.
+  } else if (defining_axis_steps == 0) {
     // The new segment is based on the previous position.
     struct HistorySegment history_segment = shadow_queue_->front();
 
@@ -279,15 +351,16 @@ bool MotionQueueMotorOperations::Enqueue(const LinearSegmentSteps &segment) {
     empty_element.state = STATE_FILLED;
 
     history_segment.aux_bits = segment.aux_bits;
+    history_segment.loops = 0;
+    history_segment.seconds = 0;
     shadow_queue_->push_front(history_segment);
 
     ret = backend_->Enqueue(&empty_element);
-  } else if (defining_axis_steps > MAX_STEPS_PER_SEGMENT) {
-    // We have more steps that we can enqueue in one chunk, so let's cut
-    // it in pieces.
+  } else if (divisions > 1) {
+    // We have more steps that we can enqueue in one chunk, or need finer
+    // laser power steps, so let's cut it in pieces.
     const double a =
       (sqd(segment.v1) - sqd(segment.v0)) / (2.0 * defining_axis_steps);
-    const int divisions = (defining_axis_steps / MAX_STEPS_PER_SEGMENT) + 1;
     int64_t hires_steps_per_div[BEAGLEG_NUM_MOTORS];
     for (int i = 0; i < BEAGLEG_NUM_MOTORS; ++i) {
       // (+1 to fix rounding trouble in the LSB)
@@ -301,6 +374,7 @@ bool MotionQueueMotorOperations::Enqueue(const LinearSegmentSteps &segment) {
 
     output.aux_bits =
       segment.aux_bits;  // use the original Aux bits for all segments
+    output.laser_power_per_speed = segment.laser_power_per_speed;
     for (int d = 0; d < divisions; ++d) {
       for (int i = 0; i < BEAGLEG_NUM_MOTORS; ++i) {
         hires_step_accumulator[i] += hires_steps_per_div[i];
@@ -327,13 +401,192 @@ bool MotionQueueMotorOperations::Enqueue(const LinearSegmentSteps &segment) {
   } else {
     ret = EnqueueInternal(segment, defining_axis_steps);
   }
-  // Shrink the queue and remove the elements that we are not interested
-  // in anymore.
-  // TODO: We need to find a way to get the maximum number of elements
-  // of the shadow queue (ie backend_->GetQueueStats()?)
+
+  if (ret && segment.laser_power_per_speed > 0 && segment.v1 == 0 &&
+      defining_axis_steps > 0) {
+    // Came to a stop. Switch off the laser, otherwise it would stay at the
+    // power of the last piece of the deceleration.
+    struct HistorySegment history_segment = shadow_queue_->front();
+    history_segment.loops = 0;
+    history_segment.seconds = 0;
+    shadow_queue_->push_front(history_segment);
+
+    struct MotionSegment laser_off = {};
+    laser_off.aux = segment.aux_bits;
+    laser_off.state = STATE_FILLED;
+    SetLaserPower(0, &laser_off);
+    ret = backend_->Enqueue(&laser_off);
+  }
+  ShrinkShadowQueue();
+  return ret;
+}
+
+// The dwell is a segment without steps, that just spends the time in the
+// travel phase. The loop delay is limited to 32 bit, so longer dwells are
+// split into several loops.
+// Delays need to be at least kMinTravelDelayCycles (see CalculateDelay and
+// UpdateQueueStatus in motor-interface-pru.p); shorter leftovers are dropped.
+bool MotionQueueMotorOperations::Dwell(float seconds) {
+  static constexpr double kMaxDelayCycles = 1 << 30;  // ~10 seconds
+  static constexpr int kMaxLoops = 65535;
+  double remaining_cycles = round(seconds * TIMER_FREQUENCY);
+  bool ret = true;
+  while (ret && remaining_cycles >= kMinTravelDelayCycles) {
+    int loops = std::min(
+      kMaxLoops, (int)ceil(remaining_cycles / kMaxDelayCycles));
+    const uint32_t delay_cycles =
+      (uint32_t)std::min(kMaxDelayCycles, floor(remaining_cycles / loops));
+    // Instead of leaving a tiny remainder of the division, the first loops
+    // are one cycle longer.
+    const double remainder = remaining_cycles - (double)loops * delay_cycles;
+    if (remainder > 0 && remainder < loops) {
+      ret = EnqueueDwell(remainder, delay_cycles + 1);
+      loops -= remainder;
+      remaining_cycles -= remainder * (delay_cycles + 1);
+    }
+    if (ret) ret = EnqueueDwell(loops, delay_cycles);
+    remaining_cycles -= (double)loops * delay_cycles;
+  }
+  ShrinkShadowQueue();
+  return ret;
+}
+
+bool MotionQueueMotorOperations::EnqueueDwell(int loops,
+                                              uint32_t delay_cycles) {
+  // Stays in the same position, with the same aux bits.
+  struct HistorySegment history_segment = shadow_queue_->front();
+  for (HistoryPositionInfo &pos_info : history_segment.pos_info) {
+    pos_info.fraction = 0;
+  }
+  history_segment.loops = loops;
+  history_segment.seconds = (double)loops * delay_cycles / TIMER_FREQUENCY;
+  shadow_queue_->push_front(history_segment);
+
+  struct MotionSegment dwell_element = {};
+  dwell_element.loops_travel = loops;
+  dwell_element.travel_delay_cycles = delay_cycles;
+  dwell_element.aux = history_segment.aux_bits;
+  dwell_element.state = STATE_FILLED;
+  return backend_->Enqueue(&dwell_element);
+}
+
+// Shrink the queue and remove the elements that we are not interested
+// in anymore.
+// TODO: We need to find a way to get the maximum number of elements
+// of the shadow queue (ie backend_->GetQueueStats()?)
+void MotionQueueMotorOperations::ShrinkShadowQueue() {
   const int buffer_size = backend_->GetPendingElements(NULL);
   const int new_size = buffer_size > 0 ? buffer_size : 1;
   shadow_queue_->resize(new_size);
+}
+
+float MotionQueueMotorOperations::GetQueuedSeconds() {
+  uint32_t remaining_loops;
+  const int buffer_size = backend_->GetPendingElements(&remaining_loops);
+  if (buffer_size <= 0) return 0;
+  shadow_queue_->resize(buffer_size);
+
+  // All but the last element are still waiting to be executed, the last one
+  // is in progress. Its time is interpolated linearly.
+  float result = 0;
+  for (int i = 0; i < buffer_size - 1; ++i) {
+    result += (*shadow_queue_)[i].seconds;
+  }
+  const HistorySegment &head = shadow_queue_->back();
+  if (head.loops > 0) {
+    result += head.seconds * std::min(remaining_loops, head.loops) / head.loops;
+  }
+  return result;
+}
+
+bool MotionQueueMotorOperations::MoveUntilInput(
+  const LinearSegmentSteps &segment, float accel, const InputTrigger &input,
+  int *trigger_steps, int *moved_steps) {
+  static constexpr int kMaxPhaseSteps = 65535 / LOOPS_PER_STEP;
+  const int defining_axis_steps = get_defining_axis_steps(segment);
+  const float speed = clip_hardware_frequency_limit(segment.v1);
+  if (accel <= 0 || speed <= 0) return false;
+  const int ramp_steps = round2int(sq(speed) / (2.0f * accel));
+  if (ramp_steps > kMaxPhaseSteps) return false;
+
+  *trigger_steps = -1;
+  *moved_steps = 0;
+
+  // Each element is a complete acceleration, travel and deceleration, so
+  // that the hardware can ramp down from anywhere within it. Moves longer
+  // than what fits in one element are done in multiple pieces.
+  // We have to know if the input triggered before sending the next piece,
+  // so the machine comes to a halt after each one: a long seek stops
+  // briefly every 2 * ramp_steps + kMaxPhaseSteps steps.
+  int steps_done = 0;
+  bool ret = true;
+  while (ret && steps_done < defining_axis_steps) {
+    const int remaining = defining_axis_steps - steps_done;
+    const int chunk = std::min(remaining, 2 * ramp_steps + kMaxPhaseSteps);
+    LinearSegmentSteps piece = segment;
+    for (int i = 0; i < MOTION_MOTOR_COUNT; ++i) {
+      piece.steps[i] = std::lround((double)segment.steps[i] *
+                                   (steps_done + chunk) / defining_axis_steps) -
+                       std::lround((double)segment.steps[i] * steps_done /
+                                   defining_axis_steps);
+    }
+
+    struct MotionSegment element = {};
+    struct HistorySegment history_segment = shadow_queue_->front();
+    PrepareElement(piece, chunk, &element, &history_segment);
+
+    const int piece_ramp = std::min(ramp_steps, chunk / 2);
+    const float peak_speed =
+      piece_ramp < ramp_steps ? sqrtf(2.0f * accel * piece_ramp) : speed;
+    element.loops_accel = element.loops_decel = LOOPS_PER_STEP * piece_ramp;
+    element.loops_travel = LOOPS_PER_STEP * (chunk - 2 * piece_ramp);
+    element.accel_series_index = 0;
+    element.hires_accel_cycles = round2int(
+      (1 << DELAY_CYCLE_SHIFT) * calcAccelerationCurveValueAt(0, accel));
+    // The time the hardware spends checking the input makes up for part of
+    // the delay. The ramps are just a little slower because of it.
+    element.travel_delay_cycles = std::max<int>(
+      kMinTravelDelayCycles,
+      round2int(TIMER_FREQUENCY / (LOOPS_PER_STEP * peak_speed)) -
+        kStopInputCheckCycles);
+    element.stop_register = input.input_register;
+    element.stop_mask = input.mask;
+    element.stop_match = input.match;
+    element.stop_loops_left = STOP_NOT_TRIGGERED;
+    element.state = STATE_FILLED;
+
+    const uint32_t total_loops = LOOPS_PER_STEP * chunk;
+    history_segment.loops = total_loops;
+    history_segment.seconds =
+      2 * peak_speed / accel + (chunk - 2 * piece_ramp) / peak_speed;
+
+    backend_->MotorEnable(true);
+    ret = backend_->Enqueue(&element);
+    if (!ret) break;  // Nothing of this piece moved.
+    shadow_queue_->push_front(history_segment);
+    backend_->WaitQueueEmpty();
+
+    uint32_t loops_left;
+    uint32_t decel_loops;
+    if (backend_->GetLastStop(&loops_left, &decel_loops)) {
+      const int done =
+        (total_loops - loops_left + decel_loops) / LOOPS_PER_STEP;
+      *trigger_steps =
+        steps_done + (total_loops - loops_left) / LOOPS_PER_STEP;
+      // We didn't go all the way; correct the position we are at.
+      HistorySegment &actual = shadow_queue_->front();
+      for (int i = 0; i < MOTION_MOTOR_COUNT; ++i) {
+        const int piece_done =
+          std::lround((double)piece.steps[i] * done / chunk);
+        actual.pos_info[i].position_steps -= piece.steps[i] - piece_done;
+      }
+      steps_done += done;
+      break;
+    }
+    steps_done += chunk;
+  }
+  *moved_steps = steps_done;
+  ShrinkShadowQueue();
   return ret;
 }
 
@@ -27,25 +27,47 @@
 
 class MotionQueueMotorOperations : public SegmentQueue {
  public:
+  // The PRU subtracts 4 delay loops of overhead from each travel delay, so
+  // delays need to be longer than that.
+  static constexpr uint32_t kMinTravelDelayCycles = 5;
+
+  // Delay cycles (two CPU cycles each) the PRU spends per loop checking the
+  // input of a segment that stops at an input. Most of it is reading the
+  // GPIO register over the interconnect, which varies, so it is an estimate.
+  static constexpr uint32_t kStopInputCheckCycles = 20;
+
   // Initialize motor operations, sending planned results into the motion
   // backend.
   MotionQueueMotorOperations(HardwareMapping *hw, MotionQueue *backend);
   ~MotionQueueMotorOperations() override;
 
   bool Enqueue(const LinearSegmentSteps &segment) final;
+  bool Dwell(float seconds) final;
   void MotorEnable(bool on) final;
   void WaitQueueEmpty() final;
+  float GetQueuedSeconds() final;
   bool GetPhysicalStatus(PhysicalStatus *status) final;
   void SetExternalPosition(int axis, int position_steps) final;
+  bool MoveUntilInput(const LinearSegmentSteps &segment, float accel,
+                      const InputTrigger &input, int *trigger_steps,
+                      int *moved_steps) final;
 
  private:
+  struct HistorySegment;
+
   bool EnqueueInternal(const LinearSegmentSteps &param,
                        int defining_axis_steps);
+  void PrepareElement(const LinearSegmentSteps &param, int defining_axis_steps,
+                      MotionSegment *element, HistorySegment *history);
+  bool EnqueueDwell(int loops, uint32_t delay_cycles);
+  void ShrinkShadowQueue();
+  void SetLaserPower(float duty, MotionSegment *element);
+  bool EnqueuePWMChange(HardwareMapping::NamedOutput output, float duty,
+                        uint16_t aux_bits);
 
   HardwareMapping *const hardware_mapping_;
   MotionQueue *backend_;
 
-  struct HistorySegment;
   std::deque<struct HistorySegment> *shadow_queue_;
 };
 
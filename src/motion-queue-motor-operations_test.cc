@@ -12,10 +12,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <vector>
+
 #include "common/container.h"
 #include "common/logging.h"
 #include "hardware-mapping.h"
 #include "motion-queue.h"
+#include "motor-interface-constants.h"
 #include "segment-queue.h"
 
 class MockMotionQueue final : public MotionQueue {
@@ -23,9 +26,12 @@ class MockMotionQueue final : public MotionQueue {
   MockMotionQueue() : remaining_loops_(0), queue_size_(0) {}
 
   bool Enqueue(MotionSegment *segment) final {
+    if (accept_segments == 0) return false;
+    if (accept_segments > 0) --accept_segments;
     remaining_loops_ =
       segment->loops_accel + segment->loops_travel + segment->loops_decel;
     queue_size_++;
+    enqueued.push_back(*segment);
     return true;
   }
 
@@ -36,6 +42,12 @@ class MockMotionQueue final : public MotionQueue {
     if (head_item_progress) *head_item_progress = remaining_loops_;
     return queue_size_;
   }
+  bool GetLastStop(uint32_t *loops_left, uint32_t *decel_loops) final {
+    if (stop_loops_left == STOP_NOT_TRIGGERED) return false;
+    *loops_left = stop_loops_left;
+    *decel_loops = stop_decel_loops;
+    return true;
+  }
 
   void SimRun(const uint32_t executed_loops, const unsigned int buffer_size) {
     assert(buffer_size <= queue_size_);
@@ -44,6 +56,11 @@ class MockMotionQueue final : public MotionQueue {
     queue_size_ = buffer_size;
   }
 
+  std::vector<MotionSegment> enqueued;
+  uint32_t stop_loops_left = STOP_NOT_TRIGGERED;  // What GetLastStop() reports
+  uint32_t stop_decel_loops = 0;
+  int accept_segments = -1;  // Segments accepted before refusing; -1: all
+
  private:
   uint32_t remaining_loops_;
   unsigned int queue_size_;
@@ -202,8 +219,179 @@ TEST(RealtimePosition, zero_loops_edge) {
   EXPECT_THAT(expected, ::testing::ContainerEq(status.pos_steps));
 }
 
+// A dwell is a segment without steps, only taking time.
+TEST(MotionQueueMotorOperations, DwellEnqueuesTimedSegmentWithoutSteps) {
+  HardwareMapping hw;
+  MockMotionQueue motion_backend;
+  MotionQueueMotorOperations motor_operations(&hw, &motion_backend);
+
+  const LinearSegmentSteps kSegment = {
+    0 /* v0 */, 0 /* v1 */, 0x3 /* aux */, {1000, 0, 0, 0, 0, 0, 0, 0}};
+  motor_operations.Enqueue(kSegment);
+  motion_backend.enqueued.clear();
+
+  // Long enough to need more than one loop of maximum delay.
+  ASSERT_TRUE(motor_operations.Dwell(30.0f));
+  ASSERT_GE(motion_backend.enqueued.size(), 1u);
+  double cycles = 0;
+  for (const MotionSegment &s : motion_backend.enqueued) {
+    EXPECT_EQ(0u, s.loops_accel);
+    EXPECT_EQ(0u, s.loops_decel);
+    EXPECT_EQ(0x3, s.aux);
+    for (int m = 0; m < MOTION_MOTOR_COUNT; ++m) {
+      EXPECT_EQ(0u, s.fractions[m]);
+    }
+    cycles += (double)s.loops_travel * s.travel_delay_cycles;
+  }
+  EXPECT_NEAR(30.0 * TIMER_FREQUENCY, cycles, 0.001 * TIMER_FREQUENCY);
+
+  // Position did not change.
+  motion_backend.SimRun(0, 0);
+  PhysicalStatus status;
+  ASSERT_TRUE(motor_operations.GetPhysicalStatus(&status));
+  EXPECT_EQ(1000, status.pos_steps[0]);
+}
+
+// Splitting long dwells must not leave tiny delays, as the PRU subtracts
+// its loop overhead from each of them.
+TEST(MotionQueueMotorOperations, DwellDelaysAreAbovePruCorrection) {
+  HardwareMapping hw;
+  MockMotionQueue motion_backend;
+  MotionQueueMotorOperations motor_operations(&hw, &motion_backend);
+
+  for (const float seconds : {10.746f, 21.4748f, 30.0f, 0.0001f, 1e-8f}) {
+    motion_backend.enqueued.clear();
+    ASSERT_TRUE(motor_operations.Dwell(seconds));
+    double cycles = 0;
+    for (const MotionSegment &s : motion_backend.enqueued) {
+      EXPECT_GE(s.travel_delay_cycles,
+                MotionQueueMotorOperations::kMinTravelDelayCycles)
+        << seconds;
+      cycles += (double)s.loops_travel * s.travel_delay_cycles;
+    }
+    EXPECT_NEAR(round(seconds * TIMER_FREQUENCY), cycles,
+                MotionQueueMotorOperations::kMinTravelDelayCycles)
+      << seconds;
+  }
+}
+
+TEST(MotionQueueMotorOperations, QueuedSecondsOfPendingSegments) {
+  HardwareMapping hw;
+  MockMotionQueue motion_backend;
+  MotionQueueMotorOperations motor_operations(&hw, &motion_backend);
+  EXPECT_EQ(0, motor_operations.GetQueuedSeconds());
+
+  // One second of travel, twice, followed by half a second dwell.
+  const LinearSegmentSteps kSegment = {
+    1000 /* v0 */, 1000 /* v1 */, 0 /* aux */, {1000, 0, 0, 0, 0, 0, 0, 0}};
+  motor_operations.Enqueue(kSegment);
+  motor_operations.Enqueue(kSegment);
+  motor_operations.Dwell(0.5f);
+
+  // First segment done, half of the second executed.
+  motion_backend.SimRun(1000, 2);
+  EXPECT_NEAR(1.0, motor_operations.GetQueuedSeconds(), 1e-3);
+
+  motion_backend.SimRun(0, 0);
+  EXPECT_EQ(0, motor_operations.GetQueuedSeconds());
+}
+
 int main(int argc, char *argv[]) {
   Log_init("/dev/stderr");
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
 }
+
+// With velocity scaled laser power, ramps are cut into pieces so that the power
+// can follow the speed; coming to a stop switches the laser off.
+TEST(MotionQueueMotorOperations, LaserRampsAreSplitIntoPieces) {
+  HardwareMapping hw;
+  MockMotionQueue motion_backend;
+  MotionQueueMotorOperations motor_operations(&hw, &motion_backend);
+
+  LinearSegmentSteps ramp = {
+    0 /* v0 */, 10000 /* v1 */, 0 /* aux */, {1000, 0, 0, 0, 0, 0, 0, 0}};
+  motor_operations.Enqueue(ramp);
+  EXPECT_EQ(1u, motion_backend.enqueued.size());  // Regular: one segment.
+  motion_backend.enqueued.clear();
+
+  ramp.laser_power_per_speed = 1e-4;
+  motor_operations.Enqueue(ramp);
+  EXPECT_GT(motion_backend.enqueued.size(), 1u);
+  motion_backend.enqueued.clear();
+
+  LinearSegmentSteps stop = {
+    10000 /* v0 */, 0 /* v1 */, 0 /* aux */, {1000, 0, 0, 0, 0, 0, 0, 0}};
+  stop.laser_power_per_speed = 1e-4;
+  motor_operations.Enqueue(stop);
+  ASSERT_GT(motion_backend.enqueued.size(), 2u);
+  const MotionSegment &last = motion_backend.enqueued.back();
+  EXPECT_EQ(0u, last.loops_accel + last.loops_travel + last.loops_decel);
+
+  motion_backend.SimRun(0, 0);
+  PhysicalStatus status;
+  ASSERT_TRUE(motor_operations.GetPhysicalStatus(&status));
+  EXPECT_EQ(3000, status.pos_steps[0]);
+}
+
+TEST(MotionQueueMotorOperations, MoveUntilInputStopsAtTrigger) {
+  HardwareMapping hw;
+  MockMotionQueue motion_backend;
+  MotionQueueMotorOperations motor_operations(&hw, &motion_backend);
+
+  const InputTrigger input = {0x4804c138, 1 << 3, 0};
+  LinearSegmentSteps seek = {
+    0 /* v0 */, 10000 /* v1 */, 0 /* aux */, {-1000, 0, 0, 0, 0, 0, 0, 0}};
+  // Triggers after 400 steps, then ramps down within 50 steps.
+  motion_backend.stop_loops_left = 2 * (1000 - 400);
+  motion_backend.stop_decel_loops = 2 * 50;
+
+  int trigger_steps, moved_steps;
+  ASSERT_TRUE(motor_operations.MoveUntilInput(seek, 1e6, input, &trigger_steps,
+                                              &moved_steps));
+  ASSERT_EQ(1u, motion_backend.enqueued.size());
+  const MotionSegment &element = motion_backend.enqueued[0];
+  EXPECT_EQ(2 * 50, element.loops_accel);  // 10000^2 / (2 * 1e6) steps
+  EXPECT_EQ(2 * 900, element.loops_travel);
+  EXPECT_EQ(2 * 50, element.loops_decel);
+  // 10000 steps/s, minus the time the hardware spends checking the input.
+  EXPECT_EQ(TIMER_FREQUENCY / (2 * 10000) -
+              MotionQueueMotorOperations::kStopInputCheckCycles,
+            element.travel_delay_cycles);
+  EXPECT_EQ(input.input_register, element.stop_register);
+  EXPECT_EQ(input.mask, element.stop_mask);
+  EXPECT_EQ(input.match, element.stop_match);
+
+  EXPECT_EQ(400, trigger_steps);
+  EXPECT_EQ(450, moved_steps);
+
+  motion_backend.SimRun(0, 0);
+  PhysicalStatus status;
+  ASSERT_TRUE(motor_operations.GetPhysicalStatus(&status));
+  EXPECT_EQ(-450, status.pos_steps[0]);
+}
+
+TEST(MotionQueueMotorOperations, MoveUntilInputStopsWhenBackendRefuses) {
+  HardwareMapping hw;
+  MockMotionQueue motion_backend;
+  MotionQueueMotorOperations motor_operations(&hw, &motion_backend);
+
+  const InputTrigger input = {0x4804c138, 1 << 3, 0};
+  LinearSegmentSteps seek = {
+    0 /* v0 */, 10000 /* v1 */, 0 /* aux */, {-100000, 0, 0, 0, 0, 0, 0, 0}};
+  motion_backend.accept_segments = 1;  // Only the first piece goes through.
+
+  int trigger_steps, moved_steps;
+  EXPECT_FALSE(motor_operations.MoveUntilInput(seek, 1e6, input,
+                                               &trigger_steps, &moved_steps));
+  ASSERT_EQ(1u, motion_backend.enqueued.size());
+  const int piece_steps = 2 * 50 + 65535 / 2;
+  EXPECT_EQ(-1, trigger_steps);
+  EXPECT_EQ(piece_steps, moved_steps);
+
+  // Only the piece that was accepted shows up in the position.
+  motion_backend.SimRun(0, 0);
+  PhysicalStatus status;
+  ASSERT_TRUE(motor_operations.GetPhysicalStatus(&status));
+  EXPECT_EQ(-piece_steps, status.pos_steps[0]);
+}
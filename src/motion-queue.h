@@ -67,6 +67,23 @@ struct MotionSegment {
   uint32_t
     fractions[MOTION_MOTOR_COUNT];  // fixed point fractions to add each step.
 
+  // PwmUpdate (needs to match PwmUpdate in motor-interface-pru.p)
+  // If pwm_register is non-zero, pwm_value is written to that address at the
+  // start of the segment; e.g. to change a PWM duty cycle in sync with motion.
+  uint32_t pwm_register;
+  uint32_t pwm_value;
+
+  // StopInput (needs to match StopInput in motor-interface-pru.p)
+  // If stop_register is non-zero, the segment ramps down to a stop as soon as
+  // (*stop_register & stop_mask) == stop_match. The hardware then reports
+  // where that happened in the last two fields; the host initializes
+  // stop_loops_left with STOP_NOT_TRIGGERED.
+  uint32_t stop_register;
+  uint32_t stop_mask;
+  uint32_t stop_match;
+  uint32_t stop_loops_left;   // Loops not done yet when the input triggered.
+  uint32_t stop_decel_loops;  // Loops spent ramping down after that.
+
 #if JERK_EXPERIMENT
   /*
    * The following not handled yet in PRU, just experimental in sim right now.
@@ -77,6 +94,8 @@ struct MotionSegment {
 #endif
 } __attribute__((packed));
 
+#define STOP_NOT_TRIGGERED 0xffffffff
+
 namespace internal {
 // Layout of the status register
 // Assuming atomicity of 32 bit boundaries
@@ -118,6 +137,14 @@ class MotionQueue {
   // The return parameter head_item_progress is set to the number
   // of not yet executed loops in the item currenly being executed.
   virtual int GetPendingElements(uint32_t *head_item_progress) = 0;
+
+  // After WaitQueueEmpty(): if the last enqueued segment had a stop input that
+  // triggered, returns true and the values the hardware reported in
+  // stop_loops_left and stop_decel_loops. Returns false otherwise or if stop
+  // inputs are not supported.
+  virtual bool GetLastStop(uint32_t *loops_left, uint32_t *decel_loops) {
+    return false;
+  }
 };
 
 // Standard implementation.
@@ -137,6 +164,7 @@ class PRUMotionQueue final : public MotionQueue {
   void MotorEnable(bool on) final;
   void Shutdown(bool flush_queue) final;
   int GetPendingElements(uint32_t *head_item_progress) final;
+  bool GetLastStop(uint32_t *loops_left, uint32_t *decel_loops) final;
 
  private:
   bool Init();
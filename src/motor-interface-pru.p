@@ -27,7 +27,8 @@
 #define PRU0_ARM_INTERRUPT 19
 #define CONST_PRUDRAM	   C24
 
-#define QUEUE_ELEMENT_SIZE (SIZE(QueueHeader) + SIZE(TravelParameters))
+#define QUEUE_ELEMENT_SIZE (SIZE(QueueHeader) + SIZE(TravelParameters) + SIZE(PwmUpdate) + SIZE(StopInput))
+#define STOP_INPUT_OFFSET (SIZE(QueueHeader) + SIZE(TravelParameters) + SIZE(PwmUpdate))
 #define QUEUE_OFFSET 4
 
 #define PARAM_START r7
@@ -65,6 +66,25 @@
 	.u8 direction_bits
 .ends
 
+;; Optional register write at the beginning of the segment. Used to change
+;; the duty cycle of a PWM timer in sync with the motion.
+.struct PwmUpdate
+	.u32 pwm_register	 // Address to write to. 0 for no update.
+	.u32 pwm_value
+.ends
+
+;; Optional input to watch while executing the segment, e.g. an endstop
+;; while homing. Once (input & mask) == match, the segment ramps down from
+;; its current speed, mirroring the acceleration done so far. The trigger
+;; point and length of that ramp are written back for the host.
+.struct StopInput
+	.u32 stop_register	 // Input register to read. 0 for none.
+	.u32 stop_mask
+	.u32 stop_match
+	.u32 stop_loops_left	 // Written on trigger: loops left at that point.
+	.u32 stop_decel_loops	 // Written on trigger: loops of the ramp down.
+.ends
+
 ;; counter states of the motors
 #define STATE_START r20   	; after PARAM_END
 #define STATE_END r27
@@ -215,6 +235,18 @@ QUEUE_READ:
 	MOV r3, travel_params.aux
 	CALL SetAuxBits
 
+	;; PWM update, if requested. Uses scratch registers.
+	.assign PwmUpdate, r4, r5, pwm_update
+	ADD r0, r2, SIZE(QueueHeader) + SIZE(TravelParameters)
+	LBCO pwm_update, CONST_PRUDRAM, r0, SIZE(pwm_update)
+	QBEQ PWM_UPDATE_DONE, pwm_update.pwm_register, 0
+	SBBO pwm_update.pwm_value, pwm_update.pwm_register, 0, 4
+PWM_UPDATE_DONE:
+
+	;; Input to stop at, if any. r29 holds its register while running.
+	ADD r0, r2, STOP_INPUT_OFFSET
+	LBCO r29, CONST_PRUDRAM, r0, 4
+
 	ZERO &mstate, SIZE(mstate)	; clear the motor states
 	ZERO &r3, 4			; initialize delay calculation state register.
 
@@ -239,6 +271,7 @@ QUEUE_READ:
 	;; parameter:         r7..r19
 	;; motor-state:       r20..r27
 	;; status-variable:   r28
+	;; stop input:        r29
 	;; call/ret:          r30
 STEP_GEN:
 	MOV r0, 0
@@ -278,6 +311,37 @@ STEP_DELAY:				; Create time delay between steps.
 	SUB r1, r1, 1                   ; two cycles per loop.
 	QBNE STEP_DELAY, r1, 0
 
+	;; Not watching an input: next step. This takes the same cycles as a
+	;; plain JMP, so the timing of regular segments is not affected.
+	QBEQ STEP_GEN, r29, 0
+
+	;; Check the input to stop at. The host shortens the travel delay of
+	;; these segments by the cycles spent here (kStopInputCheckCycles).
+	LBBO r0, r29, 0, 4			; read input register
+	ADD r1, r2, STOP_INPUT_OFFSET + 4
+	LBCO r4, CONST_PRUDRAM, r1, 8		; r4 = stop_mask, r5 = stop_match
+	AND r0, r0, r4
+	QBNE STOP_INPUT_DONE, r0, r5
+	;; Triggered. Only once per segment.
+	MOV r29, 0
+	MOV r0, r28
+	MOV r0.b3, 0				; loops left in the segment.
+	ADD r1, r1, 8
+	SBCO r0, CONST_PRUDRAM, r1, 4		; -> stop_loops_left
+	;; Already decelerating ? Then we just finish that.
+	QBNE STOP_RAMP_DOWN, travel_params.loops_accel, 0
+	QBEQ STOP_RAMP_DONE, travel_params.loops_travel, 0
+STOP_RAMP_DOWN:
+	ZERO &travel_params.loops_accel, 4	; loops_accel = loops_travel = 0
+	MOV travel_params.loops_decel, travel_params.accel_series_index.w0
+	ZERO &r28, 3				; Status: only the ramp is left.
+	ADD r28, r28, travel_params.loops_decel
+STOP_RAMP_DONE:
+	MOV r0, 0
+	MOV r0.w0, travel_params.loops_decel
+	ADD r1, r1, 4
+	SBCO r0, CONST_PRUDRAM, r1, 4		; -> stop_decel_loops
+STOP_INPUT_DONE:
 	JMP STEP_GEN
 
 DONE_STEP_GEN:
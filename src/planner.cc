@@ -20,19 +20,25 @@
 
 #include <math.h>
 
+#include <algorithm>
 #include <cmath>  // We use these functions as they work type-agnostic
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
 #include <sstream>
+#include <vector>
 
+#include "bed-mesh.h"
 #include "common/container.h"
 #include "common/logging.h"
 #include "gcode-machine-control.h"
 #include "gcode-parser/gcode-parser.h"
 #include "hardware-mapping.h"
+#include "input-shaper.h"
+#include "kinematics.h"
 #include "segment-queue.h"
 
 #define PLANNING_BUFFER_CAPACITY 1024
@@ -65,6 +71,9 @@ struct AxisTarget {
   double speed;        // Maximum speed of the defining axis (steps/s).
   double accel;        // Maximum acceleration of the defining axis (steps/s^2).
   uint16_t aux_bits;   // Auxillary bits in this segment; set with M42
+  float laser_power;   // Velocity scaled power at full speed; 0 if unused.
+  float spindle_pwm;   // Spindle speed and fan PWM duty cycles.
+  float fan_pwm;
   double dx, dy, dz;   // 3D delta_steps in real units (mm)
   double len;          // 3D length (mm)
 
@@ -218,7 +227,17 @@ class Planner::Impl {
                               enum GCodeParserAxis axis, int steps);
 
   bool issue_motor_move_if_possible(bool flush_planning_queue = false);
+  const InputShaper *shaper_for(const AxisTarget &target) const;
+  void advance_pressure(const AxisTarget &target, double total_steps,
+                        int ramp_steps, double end_speed, double fraction,
+                        LinearSegmentSteps *ramp);
+  bool enqueue_ramp(const LinearSegmentSteps &ramp, const InputShaper *shaper);
+  bool issue_output_change(uint16_t aux_bits, float spindle_pwm,
+                           float fan_pwm);
+  bool release_pressure_advance();
   bool machine_move(const AxesRegister &axis, float feedrate);
+  bool IsReachable(const AxesRegister &axis) const;
+  bool mesh_compensated_move(const AxesRegister &axis, float feedrate);
   void bring_path_to_halt();
 
   // Avoid division by zero if there is no config defined for axis.
@@ -231,7 +250,11 @@ class Planner::Impl {
   double euclidian_speed(const struct AxisTarget *t);
 
   void GetCurrentPosition(AxesRegister *pos);
+  void GetTargetPosition(AxesRegister *pos);
   int DirectDrive(GCodeParserAxis axis, float distance, float v0, float v1);
+  bool DirectDriveToSwitch(GCodeParserAxis axis, float distance, float speed,
+                           HardwareMapping::AxisTrigger trigger,
+                           int *trigger_steps, int *moved_steps);
   void SetExternalPosition(GCodeParserAxis axis, float pos);
 
   bool SetLookahead(int size) {
@@ -240,11 +263,25 @@ class Planner::Impl {
     return true;
   }
   int Lookahead() const { return lookahead_size_; }
-  static constexpr int GetMaxLookahead() { return PLANNING_BUFFER_CAPACITY; }
+  void SetVelocityScaledPower(float duty) { laser_power_ = duty; }
+  void SetSpindlePWM(float duty) { spindle_pwm_ = duty; }
+  void SetFanPWM(float duty) { fan_pwm_ = duty; }
+  // The offset already applied stays until the next move replaces it.
+  void SetBedMesh(const BedMesh *mesh) { bed_mesh_ = mesh; }
+  bool Enqueue(const AxesRegister &axis, float feedrate);
+  // The first element is the position we already handed out.
+  int PendingSegments() const { return planning_buffer_.size() - 1; }
+  // The RingDeque holds one element less than its CAPACITY.
+  static constexpr int GetMaxLookahead() {
+    return PLANNING_BUFFER_CAPACITY - 1;
+  }
 
  private:
   const struct MachineControlConfig *const cfg_;
   HardwareMapping *const hardware_mapping_;
+  // Converts the steps of the cartesian axes to the motors, unless they are
+  // the same. Declared before motor_ops_, which might point to it.
+  std::unique_ptr<Kinematics> kinematics_;
   SegmentQueue *const motor_ops_;
 
   struct PlanningSegment {
@@ -286,13 +323,37 @@ class Planner::Impl {
   int num_segments_ready_ = 0;
 
   // Number of maximum planning steps allow to enqueue.
-  size_t lookahead_size_ = PLANNING_BUFFER_CAPACITY;
+  size_t lookahead_size_ = GetMaxLookahead();
 
   // Pre-calculated per axis limits in steps, steps/s, steps/s^2
   // All arrays are indexed by axis.
   AxesRegister max_axis_speed_;  // max travel speed hz
   AxesRegister max_axis_accel_;  // acceleration hz/s
 
+  // Per axis; indexed by GCodeParserAxis.
+  std::vector<InputShaper> input_shapers_;
+  std::vector<InputShaper::Piece> shaped_pieces_;  // Re-used for each ramp.
+
+  // Steps the pressure advanced axes are ahead of their planned position.
+  StepsAxesRegister advance_steps_;
+
+  // Aux bits of the last segment sent to the motor backend.
+  HardwareMapping::AuxBitmap last_aux_bits_;
+
+  // Laser power for newly planned segments; see SetVelocityScaledPower().
+  float laser_power_ = 0;
+
+  // PWM outputs for newly planned segments and the last sent to the backend.
+  float spindle_pwm_ = 0;
+  float fan_pwm_ = 0;
+  float last_spindle_pwm_ = 0;
+  float last_fan_pwm_ = 0;
+
+  // Bed height compensation; see SetBedMesh().
+  const BedMesh *bed_mesh_ = nullptr;
+  float applied_z_offset_ = 0;          // Z-offset added to the last target.
+  std::vector<float> mesh_crossings_;  // Re-used to avoid allocations.
+
   bool path_halted_;
   bool position_known_;
 };
@@ -400,7 +461,9 @@ Planner::Impl::Impl(const MachineControlConfig *config,
                     SegmentQueue *motor_backend)
     : cfg_(config),
       hardware_mapping_(hardware_mapping),
-      motor_ops_(motor_backend),
+      kinematics_(Kinematics::Create(*config, hardware_mapping, motor_backend)),
+      motor_ops_(kinematics_ ? kinematics_.get() : motor_backend),
+      last_aux_bits_(hardware_mapping->GetAuxBits()),
       path_halted_(true),
       position_known_(true) {
   // Initial machine position. We assume the homed position here, which is
@@ -420,6 +483,9 @@ Planner::Impl::Impl(const MachineControlConfig *config,
     max_axis_speed_[i] = cfg_->max_feedrate[i] * cfg_->steps_per_mm[i];
     const float accel = cfg_->acceleration[i] * cfg_->steps_per_mm[i];
     max_axis_accel_[i] = accel;
+    input_shapers_.emplace_back(cfg_->input_shaper[i],
+                                cfg_->input_shaper_freq[i],
+                                cfg_->input_shaper_damping[i]);
   }
 #if 0
   fprintf(stderr, "\nmax_accelerations:\n[");
@@ -448,6 +514,79 @@ double Planner::Impl::euclidian_speed(const struct AxisTarget *t) {
   return t->speed * speed_factor;
 }
 
+// Of the axes moving in "target", the shaper with the longest duration, which
+// is the one for the lowest resonance frequency.
+const InputShaper *Planner::Impl::shaper_for(const AxisTarget &target) const {
+  const InputShaper *result = nullptr;
+  for (const GCodeParserAxis a : AllAxes()) {
+    const InputShaper &shaper = input_shapers_[a];
+    if (target.delta_steps[a] == 0 || !shaper.enabled()) continue;
+    if (!result || shaper.duration() > result->duration()) result = &shaper;
+  }
+  return result;
+}
+
+// Enqueue an acceleration or deceleration ramp, split into the pieces of the
+// input shaped speed profile. All motors keep their relative number of steps.
+bool Planner::Impl::enqueue_ramp(const LinearSegmentSteps &ramp,
+                                 const InputShaper *shaper) {
+  int defining_steps = 0;
+  for (const int steps : ramp.steps) {
+    defining_steps = std::max(defining_steps, abs(steps));
+  }
+  shaped_pieces_.clear();
+  if (!shaper ||
+      !shaper->ShapeRamp(ramp.v0, ramp.v1, defining_steps, &shaped_pieces_)) {
+    return motor_ops_->Enqueue(ramp);
+  }
+  LinearSegmentSteps piece = ramp;
+  int steps_done[BEAGLEG_NUM_MOTORS] = {};
+  float distance = 0;
+  for (size_t i = 0; i < shaped_pieces_.size(); ++i) {
+    distance += shaped_pieces_[i].distance;
+    const bool is_last = (i == shaped_pieces_.size() - 1);
+    const float fraction = is_last ? 1.0f : distance / defining_steps;
+    bool has_steps = false;
+    for (int m = 0; m < BEAGLEG_NUM_MOTORS; ++m) {
+      const int until = std::lround(fraction * ramp.steps[m]);
+      piece.steps[m] = until - steps_done[m];
+      steps_done[m] = until;
+      has_steps |= (piece.steps[m] != 0);
+    }
+    if (!has_steps) continue;
+    piece.v0 = shaped_pieces_[i].v0;
+    piece.v1 = shaped_pieces_[i].v1;
+    if (!motor_ops_->Enqueue(piece)) return false;
+  }
+  return true;
+}
+
+// Pressure advance: the extruder is ahead by coefficient * axis speed, so
+// that the nozzle pressure follows the speed. Add the steps to get from the
+// current advance to that at the "end_speed" of the ramp. The ramp keeps its
+// direction and defining axis, so the advance might lag behind on short ramps
+// and catches up on the next.
+void Planner::Impl::advance_pressure(const AxisTarget &target,
+                                     double total_steps, int ramp_steps,
+                                     double end_speed, double fraction,
+                                     LinearSegmentSteps *ramp) {
+  for (const GCodeParserAxis a : AllAxes()) {
+    const float coefficient = cfg_->pressure_advance[a];
+    // Only extruding, not on retracts or moves of the extruder alone.
+    if (coefficient <= 0 || target.delta_steps[a] <= 0 ||
+        a == target.defining_axis) {
+      continue;
+    }
+    const int planned = std::lround(fraction * target.delta_steps[a]);
+    const int wanted_advance = std::lround(
+      coefficient * end_speed * target.delta_steps[a] / total_steps);
+    const int steps = std::clamp(planned + wanted_advance - advance_steps_[a],
+                                 0, ramp_steps);
+    advance_steps_[a] += steps - planned;
+    assign_steps_to_motors(ramp, a, steps);
+  }
+}
+
 // Select a starting chunk of the planned trajectory and send to the backend.
 // if flush_planning_queue is true, we flush the planned trajectory and commit
 // to the planned motion until reaching zero speed.
@@ -491,8 +630,12 @@ bool Planner::Impl::issue_motor_move_if_possible(
   for (uint32_t i = 0; i < num_segments; ++i) {
     segment = planning_buffer_[0];
 
-    memset(&move_command, 0, sizeof(move_command));
+    move_command = {};
     move_command.aux_bits = segment->target.aux_bits;
+    if (segment->target.laser_power > 0 && segment->target.speed > 0) {
+      move_command.laser_power_per_speed =
+        segment->target.laser_power / segment->target.speed;
+    }
     memcpy(&accel_command, &move_command, sizeof(accel_command));
     memcpy(&decel_command, &move_command, sizeof(decel_command));
 
@@ -537,9 +680,31 @@ bool Planner::Impl::issue_motor_move_if_possible(
 
     if (cfg_->synchronous) motor_ops_->WaitQueueEmpty();
 
-    if (segment->planned.accel) ret = motor_ops_->Enqueue(accel_command);
+    if (defining_axis_steps > 0) {
+      ret = issue_output_change(last_aux_bits_, segment->target.spindle_pwm,
+                                segment->target.fan_pwm);
+    }
+
+    if (segment->planned.accel) {
+      advance_pressure(segment->target, defining_axis_steps,
+                       segment->planned.accel, segment->planned.v1,
+                       accel_fraction, &accel_command);
+    }
+    if (segment->planned.decel) {
+      advance_pressure(segment->target, defining_axis_steps,
+                       segment->planned.decel, segment->planned.v2,
+                       decel_fraction, &decel_command);
+    }
+
+    const InputShaper *shaper = shaper_for(segment->target);
+    if (segment->planned.accel && ret) {
+      ret = enqueue_ramp(accel_command, shaper);
+    }
     if (has_move && ret) ret = motor_ops_->Enqueue(move_command);
-    if (segment->planned.decel && ret) ret = motor_ops_->Enqueue(decel_command);
+    if (segment->planned.decel && ret) {
+      ret = enqueue_ramp(decel_command, shaper);
+    }
+    last_aux_bits_ = move_command.aux_bits;
 
     // We always keep one segment to keep track of the last
     // position and aux values.
@@ -575,8 +740,23 @@ bool Planner::Impl::issue_motor_move_if_possible(
 //    that will always end up at 0 speed.
 // 4: Enqueue the front of the planning buffer to the motors if certain
 //    conditions occur.
+bool Planner::Impl::IsReachable(const AxesRegister &axis) const {
+  if (!kinematics_) return true;
+  int cartesian[3];
+  for (int i = 0; i < 3; ++i) {
+    const GCodeParserAxis a = (GCodeParserAxis)i;
+    cartesian[i] = std::lround(axis[a] * cfg_->steps_per_mm[a]);
+  }
+  return kinematics_->IsReachable(cartesian);
+}
+
 bool Planner::Impl::machine_move(const AxesRegister &axis, float feedrate) {
   assert(position_known_);  // call SetExternalPosition() after DirectDrive()
+  if (!IsReachable(axis)) {
+    Log_error("Move to (%.3f, %.3f) is out of reach of the machine.",
+              axis[AXIS_X], axis[AXIS_Y]);
+    return false;
+  }
 
   // We always assume there's enough space to store a new segment and that we
   // have at least one segment.
@@ -621,6 +801,9 @@ bool Planner::Impl::machine_move(const AxesRegister &axis, float feedrate) {
   assert(max_steps > 0);
 
   new_pos->aux_bits = hardware_mapping_->GetAuxBits();
+  new_pos->laser_power = laser_power_;
+  new_pos->spindle_pwm = spindle_pwm_;
+  new_pos->fan_pwm = fan_pwm_;
   new_pos->defining_axis = defining_axis;
 
   // Work out the real units values for the euclidian axes now to avoid
@@ -662,6 +845,16 @@ bool Planner::Impl::machine_move(const AxesRegister &axis, float feedrate) {
     clamp_defining_axis_limit(new_pos->delta_steps, cfg_->acceleration,
                               defining_axis, cfg_->steps_per_mm);
 
+  // Motors that move several axes might have to go faster than each of them.
+  if (kinematics_) {
+    const int cartesian_steps[3] = {new_pos->delta_steps[AXIS_X],
+                                    new_pos->delta_steps[AXIS_Y],
+                                    new_pos->delta_steps[AXIS_Z]};
+    kinematics_->LimitSpeed(cartesian_steps, max_steps, &new_pos->speed,
+                            &new_pos->accel);
+    new_pos->start_speed = std::min(new_pos->start_speed, new_pos->speed);
+  }
+
   // Run the planning algorithm.
   // Update the planning_buffer_.planned struct, as well as
   // redefine starting and final speeds.
@@ -672,11 +865,94 @@ bool Planner::Impl::machine_move(const AxesRegister &axis, float feedrate) {
   return ret;
 }
 
-void Planner::Impl::bring_path_to_halt() {
-  if (path_halted_) return;
+// Split the move where it crosses a bed mesh cell, so that the interpolated
+// Z-offset is exact at each end point and linear in between.
+bool Planner::Impl::mesh_compensated_move(const AxesRegister &axis,
+                                          float feedrate) {
+  AxesRegister start;
+  GetTargetPosition(&start);
+
+  mesh_crossings_.clear();
+  bed_mesh_->GetCellCrossings(start[AXIS_X], start[AXIS_Y], axis[AXIS_X],
+                              axis[AXIS_Y], &mesh_crossings_);
+  AxesRegister point;
+  for (const float t : mesh_crossings_) {
+    for (const GCodeParserAxis a : AllAxes()) {
+      point[a] = (t < 1.0f) ? start[a] + t * (axis[a] - start[a]) : axis[a];
+    }
+    const float offset = bed_mesh_->OffsetAt(point[AXIS_X], point[AXIS_Y]);
+    point[AXIS_Z] += offset;
+    // The rest of the move makes no sense if a point can't be reached;
+    // the offset only applies to points that became the target.
+    if (!machine_move(point, feedrate)) return false;
+    applied_z_offset_ = offset;
+  }
+  return true;
+}
+
+bool Planner::Impl::Enqueue(const AxesRegister &axis, float feedrate) {
+  if (bed_mesh_) return mesh_compensated_move(axis, feedrate);
+  if (!machine_move(axis, feedrate)) return false;
+  applied_z_offset_ = 0;  // Leaves the offset of a previous bed mesh.
+  return true;
+}
 
+void Planner::Impl::bring_path_to_halt() {
   // Flush the queue.
-  issue_motor_move_if_possible(true);
+  if (!path_halted_) issue_motor_move_if_possible(true);
+  release_pressure_advance();
+
+  // Aux bits and PWM outputs changed after the last move didn't have a
+  // segment to travel with yet.
+  issue_output_change(hardware_mapping_->GetAuxBits(), spindle_pwm_, fan_pwm_);
+}
+
+// Standing still, there is no pressure to keep up. Deceleration ramps that are
+// too short to take back all the advance leave the extruders ahead, so move
+// them back to their planned position.
+bool Planner::Impl::release_pressure_advance() {
+  bool ret = true;
+  for (const GCodeParserAxis a : AllAxes()) {
+    const int advance = advance_steps_[a];
+    if (advance == 0) continue;
+    float speed = max_axis_speed_[a];
+    if (max_axis_accel_[a] > 0) {
+      speed = std::min(speed, sqrtf(max_axis_accel_[a] * abs(advance)));
+    }
+    if (speed <= 0) continue;
+
+    // Accelerate for half of the way, decelerate for the other half.
+    struct LinearSegmentSteps ramp_up = {};
+    ramp_up.aux_bits = last_aux_bits_;
+    struct LinearSegmentSteps ramp_down = ramp_up;
+    assign_steps_to_motors(&ramp_up, a, -advance / 2);
+    assign_steps_to_motors(&ramp_down, a, -advance + advance / 2);
+    ramp_up.v1 = ramp_down.v0 = speed;
+    if (advance / 2 != 0 && ret) ret = motor_ops_->Enqueue(ramp_up);
+    if (ret) ret = motor_ops_->Enqueue(ramp_down);
+    advance_steps_[a] = 0;
+  }
+  return ret;
+}
+
+// Send changed outputs along an empty segment, so that they take effect when
+// the preceding motion is done.
+bool Planner::Impl::issue_output_change(uint16_t aux_bits, float spindle_pwm,
+                                        float fan_pwm) {
+  if (aux_bits == last_aux_bits_ && spindle_pwm == last_spindle_pwm_ &&
+      fan_pwm == last_fan_pwm_) {
+    return true;
+  }
+  struct LinearSegmentSteps output_command = {};
+  output_command.aux_bits = aux_bits;
+  if (spindle_pwm != last_spindle_pwm_) {
+    output_command.spindle_pwm = spindle_pwm;
+  }
+  if (fan_pwm != last_fan_pwm_) output_command.fan_pwm = fan_pwm;
+  last_aux_bits_ = aux_bits;
+  last_spindle_pwm_ = spindle_pwm;
+  last_fan_pwm_ = fan_pwm;
+  return motor_ops_->Enqueue(output_command);
 }
 
 // Compute the backard pass of <segment_to_plan> given the
@@ -904,6 +1180,17 @@ void Planner::Impl::GetCurrentPosition(AxesRegister *pos) {
   }
 }
 
+void Planner::Impl::GetTargetPosition(AxesRegister *pos) {
+  pos->zero();
+  const AxisTarget &last = planning_buffer_.back()->target;
+  for (const GCodeParserAxis a : AllAxes()) {
+    if (cfg_->steps_per_mm[a] != 0) {
+      (*pos)[a] = last.position_steps[a] / cfg_->steps_per_mm[a];
+    }
+  }
+  (*pos)[AXIS_Z] -= applied_z_offset_;  // As requested, without the bed mesh.
+}
+
 int Planner::Impl::DirectDrive(GCodeParserAxis axis, float distance, float v0,
                                float v1) {
   bring_path_to_halt();  // Precondition. Let's just do it for good measure.
@@ -921,6 +1208,7 @@ int Planner::Impl::DirectDrive(GCodeParserAxis axis, float distance, float v0,
     move_command.v1 = max_axis_speed_[axis];
 
   move_command.aux_bits = hardware_mapping_->GetAuxBits();
+  last_aux_bits_ = move_command.aux_bits;
 
   const int segment_move_steps = std::lround(distance * steps_per_mm);
   assign_steps_to_motors(&move_command, axis, segment_move_steps);
@@ -931,9 +1219,42 @@ int Planner::Impl::DirectDrive(GCodeParserAxis axis, float distance, float v0,
   return segment_move_steps;
 }
 
+bool Planner::Impl::DirectDriveToSwitch(GCodeParserAxis axis, float distance,
+                                        float speed,
+                                        HardwareMapping::AxisTrigger trigger,
+                                        int *trigger_steps, int *moved_steps) {
+  InputTrigger input;
+  if (!hardware_mapping_->GetAxisSwitchInput(axis, trigger, &input))
+    return false;
+
+  bring_path_to_halt();  // Precondition. Let's just do it for good measure.
+
+  const float steps_per_mm = cfg_->steps_per_mm[axis];
+  struct LinearSegmentSteps move_command = {};
+  move_command.v1 =
+    std::min(speed * steps_per_mm, (float)max_axis_speed_[axis]);
+  move_command.aux_bits = hardware_mapping_->GetAuxBits();
+  last_aux_bits_ = move_command.aux_bits;
+  const int segment_move_steps = std::lround(distance * steps_per_mm);
+  assign_steps_to_motors(&move_command, axis, segment_move_steps);
+
+  if (!motor_ops_->MoveUntilInput(move_command, max_axis_accel_[axis], input,
+                                  trigger_steps, moved_steps)) {
+    return false;
+  }
+  position_known_ = false;
+  if (segment_move_steps < 0) {
+    *moved_steps = -*moved_steps;
+    if (*trigger_steps > 0) *trigger_steps = -*trigger_steps;
+  }
+  return true;
+}
+
 void Planner::Impl::SetExternalPosition(GCodeParserAxis axis, float pos) {
   assert(path_halted_ && planning_buffer_.size() == 1);  // Precondition.
   position_known_ = true;
+  if (axis == AXIS_Z) applied_z_offset_ = 0;
+  advance_steps_[axis] = 0;
 
   const int motor_position = std::lround(pos * cfg_->steps_per_mm[axis]);
   planning_buffer_.back()->target.position_steps[axis] = motor_position;
@@ -955,7 +1276,7 @@ Planner::Planner(const MachineControlConfig *config,
 Planner::~Planner() { delete impl_; }
 
 bool Planner::Enqueue(const AxesRegister &target_pos, float speed) {
-  return impl_->machine_move(target_pos, speed);
+  return impl_->Enqueue(target_pos, speed);
 }
 
 void Planner::BringPathToHalt() { impl_->bring_path_to_halt(); }
@@ -964,11 +1285,27 @@ void Planner::GetCurrentPosition(AxesRegister *pos) {
   impl_->GetCurrentPosition(pos);
 }
 
+void Planner::GetTargetPosition(AxesRegister *pos) {
+  impl_->GetTargetPosition(pos);
+}
+
+bool Planner::IsReachable(const AxesRegister &pos) const {
+  return impl_->IsReachable(pos);
+}
+
 int Planner::DirectDrive(GCodeParserAxis axis, float distance, float v0,
                          float v1) {
   return impl_->DirectDrive(axis, distance, v0, v1);
 }
 
+bool Planner::DirectDriveToSwitch(GCodeParserAxis axis, float distance,
+                                  float speed,
+                                  HardwareMapping::AxisTrigger trigger,
+                                  int *trigger_steps, int *moved_steps) {
+  return impl_->DirectDriveToSwitch(axis, distance, speed, trigger,
+                                    trigger_steps, moved_steps);
+}
+
 void Planner::SetExternalPosition(GCodeParserAxis axis, float pos) {
   impl_->SetExternalPosition(axis, pos);
 }
@@ -977,6 +1314,18 @@ bool Planner::SetLookahead(int size) { return impl_->SetLookahead(size); }
 
 int Planner::Lookahead() const { return impl_->Lookahead(); }
 
+void Planner::SetVelocityScaledPower(float duty) {
+  impl_->SetVelocityScaledPower(duty);
+}
+
+void Planner::SetSpindlePWM(float duty) { impl_->SetSpindlePWM(duty); }
+
+void Planner::SetFanPWM(float duty) { impl_->SetFanPWM(duty); }
+
+void Planner::SetBedMesh(const BedMesh *mesh) { impl_->SetBedMesh(mesh); }
+
+int Planner::PendingSegments() const { return impl_->PendingSegments(); }
+
 // Get the maximum allowed lookahead size.
 int Planner::GetMaxLookahead() const {
   return Planner::Impl::GetMaxLookahead();
@@ -20,9 +20,10 @@
 #define _BEAGLEG_PLANNER_H_
 
 #include "gcode-parser/gcode-parser.h"  // AxesRegister
+#include "hardware-mapping.h"               // AxisTrigger
 
+class BedMesh;
 struct MachineControlConfig;
-class HardwareMapping;
 class SegmentQueue;
 
 // The planner receives a sequence of desired target positions.
@@ -36,7 +37,8 @@ class Planner {
   ~Planner();
 
   // Enqueue a new target position to go to in a linear movement from
-  // the current position.
+  // the current position. With a bed mesh set, the Z-offset of the bed is
+  // added to the target and the move is split where it crosses grid cells.
   // Returns true if successful, false if aborted
   bool Enqueue(const AxesRegister &target_pos, float speed);
 
@@ -48,6 +50,20 @@ class Planner {
   // TODO(Leonardo): get actual position of the motor at this moment.
   void GetCurrentPosition(AxesRegister *pos);
 
+  // Get the position the last enqueued move will end at. Unlike
+  // GetCurrentPosition(), this includes moves still in the planning buffer
+  // and is the position as given to Enqueue(), without the bed mesh offset.
+  void GetTargetPosition(AxesRegister *pos);
+
+  // Whether the kinematics of the machine can reach the position at all,
+  // e.g. a delta machine only within the length of its arms. Enqueue()
+  // refuses moves to positions that can't be reached.
+  bool IsReachable(const AxesRegister &pos) const;
+
+  // Number of segments waiting in the planning buffer that have not been
+  // handed to the motor backend yet.
+  int PendingSegments() const;
+
   // Drive an axis directly. Should only be used for cases such as
   // homing which require direct motor driving.
   //
@@ -59,6 +75,18 @@ class Planner {
   // Returns the number of steps the stepmotor for that axis did.
   int DirectDrive(GCodeParserAxis axis, float distance, float v0, float v1);
 
+  // Like DirectDrive(), but move at full "speed" (mm/s) for up to "distance"
+  // and ramp down as soon as the "trigger" switch of the axis fires, which is
+  // watched by the realtime hardware. Sets "trigger_steps" to the steps done
+  // when the switch fired (-1 if it didn't) and "moved_steps" to the steps
+  // including the ramp down. Same preconditions as DirectDrive().
+  //
+  // Returns false if the switch can't be watched by the hardware; the caller
+  // needs to fall back to DirectDrive() in small steps then.
+  bool DirectDriveToSwitch(GCodeParserAxis axis, float distance, float speed,
+                           HardwareMapping::AxisTrigger trigger,
+                           int *trigger_steps, int *moved_steps);
+
   // Set the current absolute position of the given axis from an
   // machine move outside of the control of the Planner.
   // Precondition: BringPathToHalt() had been called before.
@@ -76,6 +104,21 @@ class Planner {
   // Get the maximum allowed lookahead size.
   int GetMaxLookahead() const;
 
+  // Set the laser power (fraction of full duty cycle) at the programmed
+  // feedrate for the following moves; it is scaled with the actual speed
+  // while accelerating or decelerating. 0 disables velocity scaled power.
+  void SetVelocityScaledPower(float duty);
+
+  // Set the duty cycle of the spindle speed or fan PWM output. Like the aux
+  // bits, it changes in sequence with the moves, when the motion planned
+  // before is done.
+  void SetSpindlePWM(float duty);
+  void SetFanPWM(float duty);
+
+  // Compensate Z for the bed height given in the "mesh" (not owned, must
+  // outlive its use) in the following moves. nullptr switches it off.
+  void SetBedMesh(const BedMesh *mesh);
+
  private:
   class Impl;
   Impl *const impl_;
@@ -11,6 +11,7 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "bed-mesh.h"
 #include "common/container.h"
 #include "common/logging.h"
 #include "gcode-machine-control.h"
@@ -122,6 +123,8 @@ class FakeMotorOperations : public SegmentQueue {
 
   void MotorEnable(bool on) final {}
   void WaitQueueEmpty() final {}
+  float GetQueuedSeconds() final { return 0; }
+  bool Dwell(float seconds) final { return true; }
   bool GetPhysicalStatus(PhysicalStatus *status) final { return false; }
   void SetExternalPosition(int axis, int steps) final {}
 
@@ -189,11 +192,11 @@ class PlannerHarness {
     delete config_;
   }
 
-  void Enqueue(const AxesRegister &target, float feed) {
+  bool Enqueue(const AxesRegister &target, float feed) {
     assert(!finished_);  // Can only call if segments() has not been called.
     // fprintf(stderr, "NewPos: (%.1f, %.1f)\n", target[AXIS_X],
     // target[AXIS_Y]);
-    planner_->Enqueue(target, feed);
+    return planner_->Enqueue(target, feed);
   }
 
   const std::vector<LinearSegmentSteps> &segments() {
@@ -205,9 +208,14 @@ class PlannerHarness {
   }
 
   MachineControlConfig *GetConfig() const { return config_; }
+  HardwareMapping *hardware() { return &simulated_hardware_; }
 
   int GeneratedSegmentsCount() const { return motor_ops_.SegmentsCount(); }
   bool SetLookahead(int size) { return planner_->SetLookahead(size); }
+  void SetBedMesh(const BedMesh *mesh) { planner_->SetBedMesh(mesh); }
+  void GetTargetPosition(AxesRegister *pos) {
+    planner_->GetTargetPosition(pos);
+  }
   int Lookahead() const { return planner_->Lookahead(); }
   int GetMaxLookahead() const { return planner_->GetMaxLookahead(); }
 
@@ -564,6 +572,210 @@ TEST(PlannerTest, ShortSegment_EdgeCases) {
   }
 }
 
+// Aux bits travel with the segments of the following move; changes that
+// are not followed by a move are flushed with an empty segment when halting.
+TEST(PlannerTest, AuxBitsAreQueuedWithoutHaltingThePath) {
+  PlannerHarness plantest;
+  AxesRegister pos;
+  pos[AXIS_X] = 100;
+  plantest.Enqueue(pos, 1000);
+  plantest.hardware()->UpdateAuxBits(1, true);
+  pos[AXIS_X] = 200;
+  plantest.Enqueue(pos, 1000);
+  plantest.hardware()->UpdateAuxBits(2, true);
+
+  const std::vector<LinearSegmentSteps> &segments = plantest.segments();
+  ASSERT_GE(segments.size(), 3u);
+  EXPECT_EQ(0, segments.front().aux_bits);
+  bool seen_first_aux = false;
+  for (size_t i = 0; i < segments.size() - 1; ++i) {
+    if (segments[i].aux_bits == 0) continue;
+    EXPECT_EQ(1, segments[i].aux_bits);
+    if (!seen_first_aux) {
+      EXPECT_GT(segments[i].v0, 0);  // Still moving when the bit changes.
+      seen_first_aux = true;
+    }
+  }
+  EXPECT_TRUE(seen_first_aux);
+  const LinearSegmentSteps &last = segments.back();
+  EXPECT_EQ(3, last.aux_bits);
+  for (int steps : last.steps) EXPECT_EQ(0, steps);
+}
+
+TEST(PlannerTest, BedMeshCompensatesZAlongTheMove) {
+  PlannerHarness plantest;
+  // Ridge along Y at X=50, 1mm higher than the sides.
+  const BedMesh mesh(0, 0, 100, 100, 3, 2, {0, 1, 0, 0, 1, 0});
+  plantest.SetBedMesh(&mesh);
+  AxesRegister pos;
+  pos[AXIS_X] = 100;
+  pos[AXIS_Y] = 10;
+  plantest.Enqueue(pos, 100);
+
+  const int z_motor = 2;  // Motor 3, see PlannerHarness
+  const int z_steps = plantest.GetConfig()->steps_per_mm[AXIS_Z];
+  int z = 0, max_z = 0;
+  for (const LinearSegmentSteps &segment : plantest.segments()) {
+    z += segment.steps[z_motor];
+    max_z = std::max(z, max_z);
+  }
+  EXPECT_EQ(z_steps, max_z);  // Top of the ridge.
+  EXPECT_EQ(0, z);            // Back on the level of the start.
+}
+
+// Callers continue from the target position, so it must not contain the
+// bed mesh offset, otherwise it would be added again.
+TEST(PlannerTest, BedMeshTargetPositionIsUncompensated) {
+  PlannerHarness plantest;
+  const BedMesh mesh(0, 0, 100, 100, 3, 2, {0, 1, 0, 0, 1, 0});
+  plantest.SetBedMesh(&mesh);
+  AxesRegister pos;
+  pos[AXIS_X] = 50;  // Top of the ridge.
+  pos[AXIS_Y] = 10;
+  pos[AXIS_Z] = 5;
+  plantest.Enqueue(pos, 100);
+
+  AxesRegister target;
+  plantest.GetTargetPosition(&target);
+  EXPECT_FLOAT_EQ(50, target[AXIS_X]);
+  EXPECT_FLOAT_EQ(5, target[AXIS_Z]);
+
+  // Enabling the same mesh again keeps the offset the position is at.
+  plantest.SetBedMesh(&mesh);
+  plantest.GetTargetPosition(&target);
+  EXPECT_FLOAT_EQ(5, target[AXIS_Z]);
+  pos[AXIS_Y] = 90;  // Along the ridge: no Z move.
+  plantest.Enqueue(pos, 100);
+
+  const int z_motor = 2;  // Motor 3, see PlannerHarness
+  const int z_steps = plantest.GetConfig()->steps_per_mm[AXIS_Z];
+  int z = 0;
+  for (const LinearSegmentSteps &segment : plantest.segments()) {
+    z += segment.steps[z_motor];
+  }
+  EXPECT_EQ(6 * z_steps, z);
+}
+
+// A move leaving the reach of the machine stops at the last mesh point that
+// could be reached; the target position is that point without its offset.
+TEST(PlannerTest, BedMeshMoveStopsAtFirstUnreachablePoint) {
+  MachineControlConfig *config = new MachineControlConfig();
+  InitTestConfig(config, 1.0f);
+  config->move_range_mm[AXIS_X] = 200;
+  config->move_range_mm[AXIS_Y] = 200;
+  config->kinematics = Kinematics::Type::DELTA;
+  config->delta_radius = 100;  // Z tower at (100, 200).
+  config->delta_arm_length = 150;
+  config->delta_segments_per_second = 100;
+  PlannerHarness plantest(0, 0, config);
+  // Ridge along Y at X=100, 1mm higher than the sides.
+  const BedMesh mesh(0, 0, 200, 200, 3, 2, {0, 1, 0, 0, 1, 0});
+  plantest.SetBedMesh(&mesh);
+  AxesRegister pos;
+  pos[AXIS_X] = 50;
+  pos[AXIS_Y] = 100;
+  pos[AXIS_Z] = 5;
+  ASSERT_TRUE(plantest.Enqueue(pos, 100));
+
+  // Crosses the ridge at (100, 60), but ends too far from the Z tower.
+  pos[AXIS_X] = 150;
+  pos[AXIS_Y] = 20;
+  EXPECT_FALSE(plantest.Enqueue(pos, 100));
+  AxesRegister target;
+  plantest.GetTargetPosition(&target);
+  EXPECT_NEAR(100, target[AXIS_X], 1e-3);
+  EXPECT_NEAR(60, target[AXIS_Y], 1e-3);
+  EXPECT_NEAR(5, target[AXIS_Z], 1e-3);
+}
+
+TEST(PlannerTest, InputShaperSplitsRamps) {
+  MachineControlConfig *config = new MachineControlConfig();
+  InitTestConfig(config);
+  config->input_shaper[AXIS_X] = InputShaper::Type::ZV;
+  config->input_shaper_freq[AXIS_X] = 10;
+  PlannerHarness plantest(0, 0, config);
+  AxesRegister pos;
+  pos[AXIS_X] = 10;
+  plantest.Enqueue(pos, 20);  // 0.2s acceleration, 2mm.
+
+  const std::vector<LinearSegmentSteps> &segments = plantest.segments();
+  EXPECT_EQ(7u, segments.size());  // 3 pieces accel, travel, 3 pieces decel.
+  int steps = 0;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    steps += segments[i].steps[0];
+    if (i > 0) {
+      EXPECT_NEAR(segments[i - 1].v1, segments[i].v0, 0.01);
+    }
+  }
+  EXPECT_EQ(10 * 1000, steps);
+  EXPECT_EQ(0, segments.front().v0);
+  EXPECT_EQ(0, segments.back().v1);
+}
+
+TEST(PlannerTest, PressureAdvancePushesExtruderAheadWhileAccelerating) {
+  MachineControlConfig *config = new MachineControlConfig();
+  InitTestConfig(config);
+  config->steps_per_mm[AXIS_E] = 1000;
+  config->max_feedrate[AXIS_E] = 100;
+  config->acceleration[AXIS_E] = 10000;
+  config->pressure_advance[AXIS_E] = 0.1;
+  PlannerHarness plantest(0, 0, config);
+  plantest.hardware()->AddMotorMapping(AXIS_E, 4, false);
+  AxesRegister pos;
+  pos[AXIS_X] = 10;
+  pos[AXIS_E] = 1;
+  plantest.Enqueue(pos, 20);  // 2mm acceleration to 20mm/s, E at 2mm/s
+
+  const int e_motor = 3;
+  const std::vector<LinearSegmentSteps> &segments = plantest.segments();
+  ASSERT_EQ(3u, segments.size());
+  // Plain ratio 1:10 in the travel; 0.1s * 2mm/s = 0.2mm = 200 steps ahead
+  // after the acceleration, back to the planned position after deceleration.
+  EXPECT_EQ(segments[1].steps[0] / 10, segments[1].steps[e_motor]);
+  EXPECT_EQ(segments[0].steps[0] / 10 + 200, segments[0].steps[e_motor]);
+  EXPECT_EQ(segments[2].steps[0] / 10 - 200, segments[2].steps[e_motor]);
+  int e_steps = 0;
+  for (const LinearSegmentSteps &segment : segments) {
+    e_steps += segment.steps[e_motor];
+  }
+  EXPECT_EQ(1000, e_steps);
+}
+
+// Below 2 * acceleration * coefficient, the deceleration is too short to take
+// back the advance; it is moved back when coming to a halt.
+TEST(PlannerTest, PressureAdvanceIsReleasedAtHalt) {
+  MachineControlConfig *config = new MachineControlConfig();
+  InitTestConfig(config);
+  config->steps_per_mm[AXIS_E] = 1000;
+  config->max_feedrate[AXIS_E] = 100;
+  config->acceleration[AXIS_E] = 10000;
+  config->pressure_advance[AXIS_E] = 0.1;
+  PlannerHarness plantest(0, 0, config);
+  plantest.hardware()->AddMotorMapping(AXIS_E, 4, false);
+  AxesRegister pos;
+  pos[AXIS_X] = 10;
+  pos[AXIS_E] = 1;
+  plantest.Enqueue(pos, 10);  // E at 1mm/s, decelerating at 10mm/s^2.
+
+  const int e_motor = 3;
+  const std::vector<LinearSegmentSteps> &segments = plantest.segments();
+  // 0.1mm advance, but the deceleration only extrudes 0.05mm.
+  ASSERT_EQ(5u, segments.size());
+  EXPECT_EQ(segments[0].steps[0] / 10 + 100, segments[0].steps[e_motor]);
+  EXPECT_EQ(0, segments[2].steps[e_motor]);
+  for (int i = 3; i < 5; ++i) {
+    EXPECT_EQ(0, segments[i].steps[0]);
+    EXPECT_EQ(-25, segments[i].steps[e_motor]);
+  }
+  EXPECT_EQ(0, segments[3].v0);
+  EXPECT_EQ(0, segments[4].v1);
+  int e_steps = 0;
+  for (const LinearSegmentSteps &segment : segments) {
+    e_steps += segment.steps[e_motor];
+  }
+  EXPECT_EQ(1000, e_steps);
+}
+
 TEST(PlannerTest, CornerMove_90Degrees) {
   const float kThresholdAngle = 5.0f;
   const float kSpeedTuneAngle = 0.0f;
@@ -971,6 +1183,19 @@ TEST(PlannerTest, StraightLine_DifferentLookahead) {
   }
 }
 
+// With the maximum lookahead, the planning buffer is full before the first
+// segment goes out; it must not overflow.
+TEST(PlannerTest, StraightLine_MaxLookaheadFillsPlanningBuffer) {
+  PlannerHarness plantest;
+  const int max_lookahead = plantest.GetMaxLookahead();
+  AxesRegister pos = {};
+  for (int i = 0; i < 2 * max_lookahead; ++i) {
+    pos[AXIS_X] += 1;
+    plantest.Enqueue(pos, 10000);
+  }
+  EXPECT_GT(plantest.GeneratedSegmentsCount(), 0u);  // Some went out already.
+}
+
 int main(int argc, char *argv[]) {
   Log_init("/dev/stderr");
   ::testing::InitGoogleTest(&argc, argv);
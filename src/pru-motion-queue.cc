@@ -162,6 +162,16 @@ void PRUMotionQueue::WaitQueueEmpty() {
   }
 }
 
+bool PRUMotionQueue::GetLastStop(uint32_t *loops_left, uint32_t *decel_loops) {
+  volatile const MotionSegment *last =
+    &pru_data_->ring_buffer[RingbufferOffset(queue_pos_, -1)];
+  if (last->stop_register == 0 || last->stop_loops_left == STOP_NOT_TRIGGERED)
+    return false;
+  *loops_left = last->stop_loops_left;
+  *decel_loops = last->stop_decel_loops;
+  return true;
+}
+
 void PRUMotionQueue::MotorEnable(bool on) {
   hardware_mapping_->EnableMotors(on);
 }
@@ -93,6 +93,7 @@
 
 struct pwm_timer_data {
   volatile uint32_t *regs;
+  uint32_t base;  // Physical address of the registers.
   int pwm_freq;
   uint32_t resolution;
   float duty_cycle;
@@ -142,6 +143,11 @@ void pwm_timer_start(uint32_t gpio_def, bool start) {
   }
 }
 
+bool pwm_timer_is_running(uint32_t gpio_def) {
+  struct pwm_timer_data *timer = pwm_timer_get_data(gpio_def);
+  return timer && timer->running;
+}
+
 void pwm_timer_set_duty(uint32_t gpio_def, float duty_cycle) {
   struct pwm_timer_data *timer = pwm_timer_get_data(gpio_def);
   if (!timer) return;
@@ -169,6 +175,26 @@ void pwm_timer_set_duty(uint32_t gpio_def, float duty_cycle) {
   timer->duty_cycle = duty_cycle;
 }
 
+bool pwm_timer_get_match(uint32_t gpio_def, float duty_cycle,
+                         uint32_t *reg_address, uint32_t *value) {
+  struct pwm_timer_data *timer = pwm_timer_get_data(gpio_def);
+  if (!timer || !timer->pwm_freq) return false;
+  if (duty_cycle < 0.0) duty_cycle = 0.0;
+  if (duty_cycle > 1.0) duty_cycle = 1.0;
+
+  // Same as in pwm_timer_set_duty(), but we can't change the load register
+  // here, so the match is clamped to stay within the valid range.
+  const uint32_t start = timer->regs[TLDR / 4];
+  uint32_t dc =
+    TIMER_OVERFLOW - ((uint32_t)(timer->resolution * (1.0 - duty_cycle)));
+  if (TIMER_OVERFLOW - dc <= 2) dc = TIMER_OVERFLOW - 2;
+  if (dc - start <= 2) dc = start + 3;
+
+  *reg_address = timer->base + TMAR;
+  *value = dc;
+  return true;
+}
+
 static void pwm_timer_calc_resolution(struct pwm_timer_data *timer,
                                       int pwm_freq) {
   float pwm_period = 1.0 / pwm_freq;
@@ -277,21 +303,25 @@ bool pwm_timers_map() {
   if (!pwm_timers_enable_clocks(fd)) goto exit;
 
   timers[0].regs = map_port(fd, TIMER_MMAP_SIZE, TIMER4_BASE);
+  timers[0].base = TIMER4_BASE;
   if (timers[0].regs == MAP_FAILED) {
     perror("mmap() TIMER4");
     goto exit;
   }
   timers[1].regs = map_port(fd, TIMER_MMAP_SIZE, TIMER5_BASE);
+  timers[1].base = TIMER5_BASE;
   if (timers[1].regs == MAP_FAILED) {
     perror("mmap() TIMER5");
     goto exit;
   }
   timers[2].regs = map_port(fd, TIMER_MMAP_SIZE, TIMER6_BASE);
+  timers[2].base = TIMER6_BASE;
   if (timers[2].regs == MAP_FAILED) {
     perror("mmap() TIMER6");
     goto exit;
   }
   timers[3].regs = map_port(fd, TIMER_MMAP_SIZE, TIMER7_BASE);
+  timers[3].base = TIMER7_BASE;
   if (timers[3].regs == MAP_FAILED) {
     perror("mmap() TIMER7");
     goto exit;
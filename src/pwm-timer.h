@@ -27,10 +27,20 @@
 // Start/stop the PWM timer
 void pwm_timer_start(uint32_t gpio_def, bool start);
 
+// Returns true if the PWM timer is running.
+bool pwm_timer_is_running(uint32_t gpio_def);
+
 // Set the PWM timer duty cycle
 void pwm_timer_set_duty(uint32_t gpio_def, float duty_cycle);
 void pwm_timer_set_freq(uint32_t gpio_def, int pwm_freq);
 
+// Get the physical address of the timer's match register and the value to
+// write there to change the duty cycle of the running PWM. This allows
+// other processors, such as the PRU, to update it. Returns false if the
+// gpio is not a PWM timer.
+bool pwm_timer_get_match(uint32_t gpio_def, float duty_cycle,
+                         uint32_t *reg_address, uint32_t *value);
+
 bool pwm_timers_map();
 void pwm_timers_unmap();
 
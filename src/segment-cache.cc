@@ -0,0 +1,404 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "segment-cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/hash.h"
+#include "common/logging.h"
+#include "common/string-util.h"
+
+namespace {
+struct CacheHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+};
+
+constexpr char kMagic[4] = {'B', 'G', 'S', 'C'};
+constexpr uint32_t kVersion = 3;
+
+enum Opcode : char {
+  OP_ENQUEUE = 'e',
+  OP_MOTOR_ENABLE = 'm',
+  OP_WAIT_QUEUE_EMPTY = 'w',
+  OP_DWELL = 'd',
+};
+
+// Calls "fun" with the content of the file mmap()ed into memory.
+template <typename Fun>
+bool WithMappedFile(const char *filename, Fun fun) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void *const mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapped == MAP_FAILED) return false;
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+  const bool result = fun((const char *)mapped, (size_t)st.st_size);
+  munmap(mapped, st.st_size);
+  return result;
+}
+}  // namespace
+
+uint64_t SegmentCacheKey(const char *gcode_filename,
+                         const MachineControlConfig &config,
+                         const HardwareMapping &hardware_mapping,
+                         const GCodeParser::Config &parser_config) {
+  Fnv1aHash hash;
+  hash.AddValue(kVersion);
+  const bool could_read =
+    WithMappedFile(gcode_filename, [&hash](const char *data, size_t len) {
+      hash.Add(data, len);
+      return true;
+    });
+  if (!could_read) return 0;
+  hash.AddValue(config.Fingerprint()).AddValue(hardware_mapping.Fingerprint());
+  hash.AddValue(parser_config.machine_origin);
+  if (parser_config.parameters) {
+    hash.AddValue(parser_config.parameters->Fingerprint());
+  }
+  return hash.value();
+}
+
+std::string SegmentCacheFile(const std::string &cache_dir, uint64_t key) {
+  return StringPrintf("%s/%016llx.segments", cache_dir.c_str(),
+                      (unsigned long long)key);
+}
+
+SegmentCacheRecorder::SegmentCacheRecorder(SegmentQueue *delegate)
+    : delegate_(delegate) {}
+
+SegmentCacheRecorder::~SegmentCacheRecorder() { Discard(); }
+
+bool SegmentCacheRecorder::StartRecording(const std::string &cache_file,
+                                          uint64_t key) {
+  Discard();
+  cache_file_ = cache_file;
+  tmp_file_ = cache_file + ".tmp";
+  out_ = fopen(tmp_file_.c_str(), "wb");
+  if (!out_) {
+    Log_error("Can't write segment cache %s: %s", tmp_file_.c_str(),
+              strerror(errno));
+    return false;
+  }
+  CacheHeader header = {};
+  memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.key = key;
+  fwrite(&header, sizeof(header), 1, out_);
+  return true;
+}
+
+void SegmentCacheRecorder::Invalidate(const char *reason) {
+  if (!out_) return;
+  Log_info("Segment cache: not caching this program (%s).", reason);
+  Discard();
+}
+
+void SegmentCacheRecorder::Discard() {
+  if (!out_) return;
+  fclose(out_);
+  out_ = nullptr;
+  unlink(tmp_file_.c_str());
+}
+
+bool SegmentCacheRecorder::Commit() {
+  if (!out_) return false;
+  const bool write_ok = !ferror(out_);
+  const bool close_ok = (fclose(out_) == 0);
+  out_ = nullptr;
+  if (!write_ok || !close_ok ||
+      rename(tmp_file_.c_str(), cache_file_.c_str()) != 0) {
+    Log_error("Couldn't write segment cache %s", cache_file_.c_str());
+    unlink(tmp_file_.c_str());
+    return false;
+  }
+  Log_info("Segment cache: wrote %s", cache_file_.c_str());
+  return true;
+}
+
+void SegmentCacheRecorder::Record(char op, const void *data, size_t len) {
+  if (!out_) return;
+  fwrite(&op, sizeof(op), 1, out_);
+  if (len) fwrite(data, len, 1, out_);
+}
+
+bool SegmentCacheRecorder::Enqueue(const LinearSegmentSteps &segment) {
+  Record(OP_ENQUEUE, &segment, sizeof(segment));
+  return delegate_->Enqueue(segment);
+}
+
+bool SegmentCacheRecorder::Dwell(float seconds) {
+  Record(OP_DWELL, &seconds, sizeof(seconds));
+  return delegate_->Dwell(seconds);
+}
+
+void SegmentCacheRecorder::MotorEnable(bool on) {
+  const uint8_t enable = on;
+  Record(OP_MOTOR_ENABLE, &enable, sizeof(enable));
+  delegate_->MotorEnable(on);
+}
+
+void SegmentCacheRecorder::WaitQueueEmpty() {
+  Record(OP_WAIT_QUEUE_EMPTY, nullptr, 0);
+  delegate_->WaitQueueEmpty();
+}
+
+float SegmentCacheRecorder::GetQueuedSeconds() {
+  return delegate_->GetQueuedSeconds();
+}
+
+bool SegmentCacheRecorder::GetPhysicalStatus(PhysicalStatus *status) {
+  return delegate_->GetPhysicalStatus(status);
+}
+
+void SegmentCacheRecorder::SetExternalPosition(int axis, int position_steps) {
+  // Only happens when the position is determined by the environment,
+  // e.g. switches. Can't reproduce that.
+  Invalidate("position set externally");
+  delegate_->SetExternalPosition(axis, position_steps);
+}
+
+bool SegmentCacheRecorder::MoveUntilInput(const LinearSegmentSteps &segment,
+                                          float accel,
+                                          const InputTrigger &input,
+                                          int *trigger_steps,
+                                          int *moved_steps) {
+  Invalidate("move until input");
+  return delegate_->MoveUntilInput(segment, accel, input, trigger_steps,
+                                   moved_steps);
+}
+
+SegmentCacheGuard::SegmentCacheGuard(SegmentCacheRecorder *recorder,
+                                     GCodeParser::EventReceiver *delegate)
+    : recorder_(recorder), delegate_(delegate) {}
+
+// A move that the machine refused depends on its state (e.g. homing
+// required) and might well succeed next time.
+bool SegmentCacheGuard::CheckMove(bool success) {
+  if (!success) recorder_->Invalidate("move not executed");
+  return success;
+}
+
+void SegmentCacheGuard::gcode_start(GCodeParser *parser) {
+  delegate_->gcode_start(parser);
+}
+void SegmentCacheGuard::gcode_finished(bool end_of_stream) {
+  delegate_->gcode_finished(end_of_stream);
+}
+void SegmentCacheGuard::inform_origin_offset(const AxesRegister &offset,
+                                             const char *named_offset) {
+  delegate_->inform_origin_offset(offset, named_offset);
+}
+void SegmentCacheGuard::gcode_command_done(char letter, float val) {
+  delegate_->gcode_command_done(letter, val);
+}
+void SegmentCacheGuard::gcode_block_done() { delegate_->gcode_block_done(); }
+void SegmentCacheGuard::input_idle(bool is_first) {
+  delegate_->input_idle(is_first);
+}
+void SegmentCacheGuard::wait_for_start() {
+  recorder_->Invalidate("waits for start switch");
+  delegate_->wait_for_start();
+}
+void SegmentCacheGuard::go_home(AxisBitmap_t axis_bitmap) {
+  recorder_->Invalidate("homing");
+  delegate_->go_home(axis_bitmap);
+}
+bool SegmentCacheGuard::probe_axis(float feed_mm_p_sec,
+                                   enum GCodeParserAxis axis,
+                                   float *probed_position) {
+  recorder_->Invalidate("probing");
+  return delegate_->probe_axis(feed_mm_p_sec, axis, probed_position);
+}
+void SegmentCacheGuard::change_spindle_speed(float value) {
+  recorder_->Invalidate("spindle control");
+  delegate_->change_spindle_speed(value);
+}
+void SegmentCacheGuard::set_speed_factor(float factor) {
+  delegate_->set_speed_factor(factor);
+}
+void SegmentCacheGuard::set_fanspeed(float speed) {
+  recorder_->Invalidate("fan control");
+  delegate_->set_fanspeed(speed);
+}
+void SegmentCacheGuard::set_temperature(float degrees_c) {
+  recorder_->Invalidate("temperature control");
+  delegate_->set_temperature(degrees_c);
+}
+void SegmentCacheGuard::wait_temperature() {
+  recorder_->Invalidate("temperature control");
+  delegate_->wait_temperature();
+}
+void SegmentCacheGuard::dwell(float time_ms) {
+  delegate_->dwell(time_ms);  // Queued as SegmentQueue::Dwell()
+}
+void SegmentCacheGuard::motors_enable(bool enable) {
+  delegate_->motors_enable(enable);
+}
+void SegmentCacheGuard::clamp_to_range(AxisBitmap_t affected,
+                                       AxesRegister *axes) {
+  delegate_->clamp_to_range(affected, axes);
+}
+bool SegmentCacheGuard::coordinated_move(float feed_mm_p_sec,
+                                         const AxesRegister &absolute_pos) {
+  return CheckMove(delegate_->coordinated_move(feed_mm_p_sec, absolute_pos));
+}
+bool SegmentCacheGuard::rapid_move(float feed_mm_p_sec,
+                                   const AxesRegister &absolute_pos) {
+  return CheckMove(delegate_->rapid_move(feed_mm_p_sec, absolute_pos));
+}
+bool SegmentCacheGuard::arc_move(float feed_mm_p_sec,
+                                 GCodeParserAxis normal_axis, bool clockwise,
+                                 const AxesRegister &start,
+                                 const AxesRegister &center,
+                                 const AxesRegister &end) {
+  return CheckMove(delegate_->arc_move(feed_mm_p_sec, normal_axis, clockwise,
+                                       start, center, end));
+}
+bool SegmentCacheGuard::spline_move(float feed_mm_p_sec,
+                                    const AxesRegister &start,
+                                    const AxesRegister &cp1,
+                                    const AxesRegister &cp2,
+                                    const AxesRegister &end) {
+  return CheckMove(
+    delegate_->spline_move(feed_mm_p_sec, start, cp1, cp2, end));
+}
+const char *SegmentCacheGuard::unprocessed(char letter, float value,
+                                           const char *rest_of_line) {
+  // Aux outputs are switched with the aux_bits of the segments and M400 is
+  // only waiting for the queue, so these are captured in the recording.
+  const int code = (int)value;
+  const bool captured_in_segments =
+    letter == 'M' && ((code >= 7 && code <= 11) ||
+                      (code >= 62 && code <= 65) || code == 400);
+  if (!captured_in_segments) {
+    recorder_->Invalidate(StringPrintf("%c%d", letter, code).c_str());
+  }
+  return delegate_->unprocessed(letter, value, rest_of_line);
+}
+
+// Do the operation at "pos" on "queue". If "queue" is null, only verifies
+// that it is well-formed. Returns the start of the next operation or
+// nullptr on failure.
+static const char *ReplayOperation(const char *pos, const char *end,
+                                   SegmentQueue *queue) {
+  LinearSegmentSteps segment;
+  float seconds;
+  const char op = *pos++;
+  switch (op) {
+  case OP_ENQUEUE:
+    if ((size_t)(end - pos) < sizeof(segment)) return nullptr;
+    memcpy(&segment, pos, sizeof(segment));
+    if (queue && !queue->Enqueue(segment)) return nullptr;
+    return pos + sizeof(segment);
+  case OP_MOTOR_ENABLE:
+    if (pos >= end) return nullptr;
+    if (queue) queue->MotorEnable(*pos != 0);
+    return pos + 1;
+  case OP_WAIT_QUEUE_EMPTY:
+    if (queue) queue->WaitQueueEmpty();
+    return pos;
+  case OP_DWELL:
+    if ((size_t)(end - pos) < sizeof(seconds)) return nullptr;
+    memcpy(&seconds, pos, sizeof(seconds));
+    if (queue && !queue->Dwell(seconds)) return nullptr;
+    return pos + sizeof(seconds);
+  }
+  return nullptr;
+}
+
+SegmentCacheReplay::SegmentCacheReplay(SegmentQueue *queue) : queue_(queue) {}
+
+SegmentCacheReplay::~SegmentCacheReplay() { Unmap(); }
+
+void SegmentCacheReplay::Unmap() {
+  if (mapping_) munmap(mapping_, mapping_size_);
+  mapping_ = nullptr;
+  pos_ = end_ = nullptr;
+  ok_ = false;
+}
+
+bool SegmentCacheReplay::Map(int fd, uint64_t key) {
+  Unmap();
+  struct stat st;
+  CacheHeader header;
+  if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(header)) return false;
+  void *const mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (mapped == MAP_FAILED) return false;
+  const char *const data = (const char *)mapped;
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.key != key) {
+    munmap(mapped, st.st_size);
+    return false;
+  }
+  // Don't start any motion if we'd have to stop half-way.
+  const char *const end = data + st.st_size;
+  for (const char *pos = data + sizeof(header); pos < end;) {
+    pos = ReplayOperation(pos, end, nullptr);
+    if (pos == nullptr) {
+      Log_error("Corrupt segment cache.");
+      munmap(mapped, st.st_size);
+      return false;
+    }
+  }
+  madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+  mapping_ = mapped;
+  mapping_size_ = st.st_size;
+  pos_ = data + sizeof(header);
+  end_ = end;
+  ok_ = true;
+  return true;
+}
+
+bool SegmentCacheReplay::Continue(int max_operations) {
+  for (int i = 0; ok_ && pos_ < end_ && i < max_operations; ++i) {
+    const char *const next = ReplayOperation(pos_, end_, queue_);
+    if (next == nullptr) {
+      ok_ = false;  // The queue refused it, e.g. in E-Stop.
+    } else {
+      pos_ = next;
+    }
+  }
+  return ok_ && pos_ < end_;
+}
+
+bool ReplaySegmentCache(const std::string &cache_file, uint64_t key,
+                        SegmentQueue *queue) {
+  const int fd = open(cache_file.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+  SegmentCacheReplay replay(queue);
+  const bool mapped = replay.Map(fd, key);
+  close(fd);
+  if (!mapped) return false;
+  while (replay.Continue(1024)) {
+  }
+  return replay.success();
+}
@@ -0,0 +1,190 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_SEGMENT_CACHE_H_
+#define _BEAGLEG_SEGMENT_CACHE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+
+#include "gcode-machine-control.h"
+#include "gcode-parser/gcode-parser.h"
+#include "hardware-mapping.h"
+#include "segment-queue.h"
+
+// Cache of the planned motion of a G-code file.
+//
+// Running the same program with the same machine configuration results in
+// exactly the same sequence of LinearSegmentSteps. The SegmentCacheRecorder
+// records that sequence while a program runs; later runs can replay it from
+// the cache file straight into the SegmentQueue, bypassing parsing and
+// planning altogether.
+//
+// Only the SegmentQueue operations are recorded, so the cache is limited to
+// programs whose effect is entirely described by them: motion, dwell and aux
+// bits. Programs doing anything else, such as homing, probing, switching
+// the spindle or waiting for temperatures, are not cached; the
+// SegmentCacheGuard watches out for these.
+
+// Returns the cache key for the given G-code file when run with the given
+// configuration, machine origin and parameters such as the work offsets.
+// Returns 0 if the file can not be read.
+//
+// Replaying does not change the parameters, so a program that does, e.g.
+// with G10 or G92, must not be cached; compare the parameters'
+// Fingerprint() before and after recording.
+uint64_t SegmentCacheKey(const char *gcode_filename,
+                         const MachineControlConfig &config,
+                         const HardwareMapping &hardware_mapping,
+                         const GCodeParser::Config &parser_config);
+
+// Returns the name of the cache file for "key" in directory "cache_dir".
+std::string SegmentCacheFile(const std::string &cache_dir, uint64_t key);
+
+// A SegmentQueue that passes all operations on to a delegate, while
+// recording them into a cache file.
+class SegmentCacheRecorder : public SegmentQueue {
+ public:
+  // Does not take ownership of "delegate".
+  explicit SegmentCacheRecorder(SegmentQueue *delegate);
+  ~SegmentCacheRecorder() override;
+
+  // Start recording the operations for the program with the given "key".
+  // Until Commit() is called, the recording goes to a temporary file.
+  bool StartRecording(const std::string &cache_file, uint64_t key);
+
+  // Mark the current recording as not cacheable, as the program did things
+  // that can not be reproduced by replaying the segments.
+  void Invalidate(const char *reason);
+
+  // Finish recording. If the recording is still valid, it becomes the
+  // cache file, otherwise it is discarded. Returns true if the cache file
+  // has been written.
+  bool Commit();
+
+  bool Enqueue(const LinearSegmentSteps &segment) final;
+  bool Dwell(float seconds) final;
+  void MotorEnable(bool on) final;
+  void WaitQueueEmpty() final;
+  float GetQueuedSeconds() final;
+  bool GetPhysicalStatus(PhysicalStatus *status) final;
+  void SetExternalPosition(int axis, int position_steps) final;
+  bool MoveUntilInput(const LinearSegmentSteps &segment, float accel,
+                      const InputTrigger &input, int *trigger_steps,
+                      int *moved_steps) final;
+
+ private:
+  void Record(char op, const void *data, size_t len);
+  void Discard();
+
+  SegmentQueue *const delegate_;
+  std::string cache_file_;
+  std::string tmp_file_;
+  FILE *out_ = nullptr;
+};
+
+// EventReceiver that passes all events on to a delegate, but invalidates
+// the recording of "recorder" on any event whose effect is not entirely
+// captured by the SegmentQueue operations.
+class SegmentCacheGuard : public GCodeParser::EventReceiver {
+ public:
+  // Does not take ownership of the parameters.
+  SegmentCacheGuard(SegmentCacheRecorder *recorder,
+                    GCodeParser::EventReceiver *delegate);
+
+  void gcode_start(GCodeParser *parser) final;
+  void gcode_finished(bool end_of_stream) final;
+  void inform_origin_offset(const AxesRegister &offset,
+                            const char *named_offset) final;
+  void gcode_command_done(char letter, float val) final;
+  void gcode_block_done() final;
+  void input_idle(bool is_first) final;
+  void wait_for_start() final;
+  void go_home(AxisBitmap_t axis_bitmap) final;
+  bool probe_axis(float feed_mm_p_sec, enum GCodeParserAxis axis,
+                  float *probed_position) final;
+  void change_spindle_speed(float value) final;
+  void set_speed_factor(float factor) final;
+  void set_fanspeed(float speed) final;
+  void set_temperature(float degrees_c) final;
+  void wait_temperature() final;
+  void dwell(float time_ms) final;
+  void motors_enable(bool enable) final;
+  void clamp_to_range(AxisBitmap_t affected, AxesRegister *axes) final;
+  bool coordinated_move(float feed_mm_p_sec,
+                        const AxesRegister &absolute_pos) final;
+  bool rapid_move(float feed_mm_p_sec, const AxesRegister &absolute_pos) final;
+  bool arc_move(float feed_mm_p_sec, GCodeParserAxis normal_axis,
+                bool clockwise, const AxesRegister &start,
+                const AxesRegister &center, const AxesRegister &end) final;
+  bool spline_move(float feed_mm_p_sec, const AxesRegister &start,
+                   const AxesRegister &cp1, const AxesRegister &cp2,
+                   const AxesRegister &end) final;
+  const char *unprocessed(char letter, float value,
+                          const char *rest_of_line) final;
+
+ private:
+  bool CheckMove(bool success);
+
+  SegmentCacheRecorder *const recorder_;
+  GCodeParser::EventReceiver *const delegate_;
+};
+
+// Replays a cache file into a SegmentQueue, a limited number of operations
+// at a time, so that an event loop can do other work in between, e.g.
+// check the E-Stop and pause switches.
+class SegmentCacheReplay {
+ public:
+  // Does not take ownership of "queue".
+  explicit SegmentCacheReplay(SegmentQueue *queue);
+  ~SegmentCacheReplay();
+
+  SegmentCacheReplay(const SegmentCacheReplay &) = delete;
+  SegmentCacheReplay &operator=(const SegmentCacheReplay &) = delete;
+
+  // Memory map the cache file "fd" for replaying. The file descriptor is not
+  // needed after this call and can be closed. Returns false if the file was
+  // not recorded for "key" or is corrupt; nothing is replayed then.
+  bool Map(int fd, uint64_t key);
+
+  // Replay up to "max_operations" operations. Returns true while there is
+  // more to replay, false at the end or if the queue refused an operation.
+  bool Continue(int max_operations);
+
+  // Returns true if the whole cache has been replayed.
+  bool success() const { return ok_ && pos_ == end_; }
+
+ private:
+  void Unmap();
+
+  SegmentQueue *const queue_;
+  void *mapping_ = nullptr;
+  size_t mapping_size_ = 0;
+  const char *pos_ = nullptr;
+  const char *end_ = nullptr;
+  bool ok_ = false;
+};
+
+// Replay the cache file into "queue" at once. Returns false if the file
+// does not exist, was not recorded for "key" or could not be replayed.
+bool ReplaySegmentCache(const std::string &cache_file, uint64_t key,
+                        SegmentQueue *queue);
+
+#endif  // _BEAGLEG_SEGMENT_CACHE_H_
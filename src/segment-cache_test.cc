@@ -0,0 +1,270 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "segment-cache.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "common/string-util.h"
+
+// Segment queue that logs all operations into a string.
+class LoggingSegmentQueue : public SegmentQueue {
+ public:
+  const std::string &log() const { return log_; }
+
+  // Number of segments accepted before Enqueue() fails, e.g. in E-Stop.
+  void set_accept_segments(int count) { accept_segments_ = count; }
+
+  bool Enqueue(const LinearSegmentSteps &s) final {
+    if (accept_segments_ == 0) return false;
+    if (accept_segments_ > 0) --accept_segments_;
+    log_ += StringPrintf("enqueue %.1f %.1f %x %d %d\n", s.v0, s.v1,
+                         s.aux_bits, s.steps[0], s.steps[1]);
+    return true;
+  }
+  bool Dwell(float seconds) final {
+    log_ += StringPrintf("dwell %.3f\n", seconds);
+    return true;
+  }
+  void MotorEnable(bool on) final { log_ += StringPrintf("motors %d\n", on); }
+  void WaitQueueEmpty() final { log_ += "wait\n"; }
+  float GetQueuedSeconds() final { return 0; }
+  bool GetPhysicalStatus(PhysicalStatus *status) final { return false; }
+  void SetExternalPosition(int axis, int steps) final {
+    log_ += StringPrintf("set-position %d %d\n", axis, steps);
+  }
+
+ private:
+  std::string log_;
+  int accept_segments_ = -1;
+};
+
+class SegmentCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    char dir_template[] = "/tmp/segment-cache-test.XXXXXX";
+    cache_dir_ = mkdtemp(dir_template);
+    cache_file_ = SegmentCacheFile(cache_dir_, 42);
+  }
+  void TearDown() override {
+    unlink(cache_file_.c_str());
+    rmdir(cache_dir_.c_str());
+  }
+
+  static void SendOperations(SegmentQueue *queue) {
+    LinearSegmentSteps segment = {};
+    queue->MotorEnable(true);
+    for (int i = 0; i < 10; ++i) {
+      segment.v0 = i * 100;
+      segment.v1 = (i + 1) * 100;
+      segment.aux_bits = i;
+      segment.steps[0] = i * 7;
+      segment.steps[1] = -i * 3;
+      queue->Enqueue(segment);
+    }
+    queue->Dwell(0.25);
+    queue->WaitQueueEmpty();
+    queue->MotorEnable(false);
+  }
+
+  std::string cache_dir_;
+  std::string cache_file_;
+};
+
+TEST_F(SegmentCacheTest, ReplayIsSameAsRecording) {
+  LoggingSegmentQueue recorded;
+  {
+    SegmentCacheRecorder recorder(&recorded);
+    ASSERT_TRUE(recorder.StartRecording(cache_file_, 42));
+    SendOperations(&recorder);
+    EXPECT_TRUE(recorder.Commit());
+  }
+
+  LoggingSegmentQueue replayed;
+  EXPECT_TRUE(ReplaySegmentCache(cache_file_, 42, &replayed));
+  EXPECT_EQ(recorded.log(), replayed.log());
+  EXPECT_NE(std::string::npos, replayed.log().find("enqueue 900.0 1000.0 9"));
+
+  // Different key (e.g. changed config) does not replay.
+  LoggingSegmentQueue not_replayed;
+  EXPECT_FALSE(ReplaySegmentCache(cache_file_, 43, &not_replayed));
+  EXPECT_EQ("", not_replayed.log());
+}
+
+TEST_F(SegmentCacheTest, ReplayContinuesInBatches) {
+  LoggingSegmentQueue recorded;
+  {
+    SegmentCacheRecorder recorder(&recorded);
+    ASSERT_TRUE(recorder.StartRecording(cache_file_, 42));
+    SendOperations(&recorder);
+    EXPECT_TRUE(recorder.Commit());
+  }
+
+  LoggingSegmentQueue replayed;
+  SegmentCacheReplay replay(&replayed);
+  const int fd = open(cache_file_.c_str(), O_RDONLY);
+  ASSERT_TRUE(replay.Map(fd, 42));
+  close(fd);
+  EXPECT_TRUE(replay.Continue(2));
+  EXPECT_EQ("motors 1\nenqueue 0.0 100.0 0 0 0\n", replayed.log());
+  EXPECT_FALSE(replay.success());
+  while (replay.Continue(2)) {
+  }
+  EXPECT_TRUE(replay.success());
+  EXPECT_EQ(recorded.log(), replayed.log());
+}
+
+TEST_F(SegmentCacheTest, ReplayStopsWhenQueueRefusesSegment) {
+  LoggingSegmentQueue recorded;
+  {
+    SegmentCacheRecorder recorder(&recorded);
+    ASSERT_TRUE(recorder.StartRecording(cache_file_, 42));
+    SendOperations(&recorder);
+    EXPECT_TRUE(recorder.Commit());
+  }
+
+  LoggingSegmentQueue replayed;
+  replayed.set_accept_segments(3);
+  SegmentCacheReplay replay(&replayed);
+  const int fd = open(cache_file_.c_str(), O_RDONLY);
+  ASSERT_TRUE(replay.Map(fd, 42));
+  close(fd);
+  EXPECT_FALSE(replay.Continue(100));
+  EXPECT_FALSE(replay.success());
+  const std::string stopped_log = replayed.log();
+  EXPECT_EQ(std::string::npos, stopped_log.find("enqueue 300.0"));
+  EXPECT_NE(std::string::npos, stopped_log.find("enqueue 200.0"));
+
+  // Nothing is replayed after the failure.
+  replayed.set_accept_segments(-1);
+  EXPECT_FALSE(replay.Continue(100));
+  EXPECT_EQ(stopped_log, replayed.log());
+}
+
+TEST_F(SegmentCacheTest, InvalidatedRecordingIsNotWritten) {
+  LoggingSegmentQueue recorded;
+  SegmentCacheRecorder recorder(&recorded);
+  ASSERT_TRUE(recorder.StartRecording(cache_file_, 42));
+  SendOperations(&recorder);
+  recorder.SetExternalPosition(0, 1000);  // Happens when homing.
+  EXPECT_FALSE(recorder.Commit());
+  EXPECT_NE(0, access(cache_file_.c_str(), F_OK));
+
+  // All operations are passed on regardless.
+  EXPECT_NE(std::string::npos, recorded.log().find("set-position 0 1000"));
+}
+
+TEST_F(SegmentCacheTest, UncommittedRecordingIsDiscarded) {
+  LoggingSegmentQueue recorded;
+  {
+    SegmentCacheRecorder recorder(&recorded);
+    ASSERT_TRUE(recorder.StartRecording(cache_file_, 42));
+    SendOperations(&recorder);
+  }
+  LoggingSegmentQueue replayed;
+  EXPECT_FALSE(ReplaySegmentCache(cache_file_, 42, &replayed));
+  EXPECT_NE(0, access((cache_file_ + ".tmp").c_str(), F_OK));
+}
+
+TEST_F(SegmentCacheTest, TruncatedCacheDoesNotStartMotion) {
+  LoggingSegmentQueue recorded;
+  {
+    SegmentCacheRecorder recorder(&recorded);
+    ASSERT_TRUE(recorder.StartRecording(cache_file_, 42));
+    SendOperations(&recorder);
+    EXPECT_TRUE(recorder.Commit());
+  }
+  FILE *f = fopen(cache_file_.c_str(), "r+");
+  fseek(f, 0, SEEK_END);
+  ASSERT_EQ(0, ftruncate(fileno(f), ftell(f) - 10));
+  fclose(f);
+
+  LoggingSegmentQueue replayed;
+  EXPECT_FALSE(ReplaySegmentCache(cache_file_, 42, &replayed));
+  EXPECT_EQ("", replayed.log());
+}
+
+TEST(SegmentCacheKey, DependsOnFileAndConfig) {
+  char filename[] = "/tmp/segment-cache-key.XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(10, write(fd, "G1 X10 Y10", 10));
+
+  MachineControlConfig config;
+  HardwareMapping hardware;
+  GCodeParser::Config parser_config;
+  const uint64_t key =
+    SegmentCacheKey(filename, config, hardware, parser_config);
+  EXPECT_NE(0u, key);
+  EXPECT_EQ(key, SegmentCacheKey(filename, config, hardware, parser_config));
+
+  config.acceleration[AXIS_X] = 1234;
+  EXPECT_NE(key, SegmentCacheKey(filename, config, hardware, parser_config));
+
+  MachineControlConfig other_config;
+  hardware.AddMotorMapping(AXIS_X, 1, false);
+  EXPECT_NE(key,
+            SegmentCacheKey(filename, other_config, hardware, parser_config));
+
+  HardwareMapping other_hardware;
+  ASSERT_EQ(1, write(fd, "\n", 1));
+  EXPECT_NE(key, SegmentCacheKey(filename, other_config, other_hardware,
+                                parser_config));
+  close(fd);
+  unlink(filename);
+
+  EXPECT_EQ(0u, SegmentCacheKey(filename, other_config, other_hardware,
+                                parser_config));
+}
+
+TEST(SegmentCacheKey, DependsOnParametersAndOrigin) {
+  char filename[] = "/tmp/segment-cache-key.XXXXXX";
+  const int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(10, write(fd, "G1 X10 Y10", 10));
+  close(fd);
+
+  MachineControlConfig config;
+  HardwareMapping hardware;
+  GCodeParser::Config parser_config;
+  GCodeParser::Config::ParamMap parameters;
+  parser_config.parameters = &parameters;
+  const uint64_t key =
+    SegmentCacheKey(filename, config, hardware, parser_config);
+
+  parameters.Set(5221, 100);  // G54 X offset.
+  const uint64_t offset_key =
+    SegmentCacheKey(filename, config, hardware, parser_config);
+  EXPECT_NE(key, offset_key);
+
+  parser_config.machine_origin[AXIS_Z] = 100;
+  EXPECT_NE(offset_key,
+            SegmentCacheKey(filename, config, hardware, parser_config));
+  unlink(filename);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -39,6 +39,24 @@ struct LinearSegmentSteps {
   uint16_t aux_bits;  // Aux-bits to switch.
 
   int steps[BEAGLEG_NUM_MOTORS];  // Steps for axis. Negative for reverse.
+
+  // Velocity-scaled laser power: if non-zero, the laser PWM duty cycle
+  // follows the speed, at this duty cycle per step/s. Keeps the energy per
+  // distance constant in acceleration and deceleration.
+  float laser_power_per_speed = 0;
+
+  // PWM duty cycles of the spindle speed and the fan outputs, switched at
+  // the beginning of the segment. Negative values leave them unchanged.
+  float spindle_pwm = -1;
+  float fan_pwm = -1;
+};
+
+// A digital input, such as an endstop, described as a memory mapped register
+// so that the realtime hardware can watch it while moving.
+struct InputTrigger {
+  uint32_t input_register;  // Address of the register to read.
+  uint32_t mask;            // Bits of the register to look at.
+  uint32_t match;           // Value of these bits when triggered.
 };
 
 // Struct used to return data about the currently executed steps
@@ -60,6 +78,12 @@ class SegmentQueue {
   // Returns true if the move was added, false if aborted
   virtual bool Enqueue(const LinearSegmentSteps &segment) = 0;
 
+  // Enqueue a pause of "seconds" in which the motors stand still. It is
+  // executed in sequence with the segments before and after it, so the
+  // caller doesn't need to wait for the queue to drain.
+  // Returns true if the pause was added, false if aborted
+  virtual bool Dwell(float seconds) = 0;
+
   // Waits for the queue to be empty and Enables/disables motors according to
   // the given boolean value (Right now, motors cannot be individually
   // addressed).
@@ -68,6 +92,10 @@ class SegmentQueue {
   // Wait, until all elements in the ring-buffer are consumed.
   virtual void WaitQueueEmpty() = 0;
 
+  // Estimated time in seconds until all elements currently in the queue are
+  // executed. Returns 0 if this can't be determined.
+  virtual float GetQueuedSeconds() = 0;
+
   // Get the absolute position and auxes status the motors currently
   // in, and the end of the exeuction queue.
   // Returns 'true' if the status was available and is updated.
@@ -77,6 +105,21 @@ class SegmentQueue {
   // source (e.g. homing). This will allow accurate reporting of the
   // PhysicalStatus.
   virtual void SetExternalPosition(int axis, int position_steps) = 0;
+
+  // Move "segment", accelerating from standstill with "accel" (steps/s^2) to
+  // the speed v1 and ramping down again at the end. As soon as the "input"
+  // triggers, ramp down from wherever we are. Waits until the motion is done.
+  // Sets "trigger_steps" to the steps of the defining axis done when the input
+  // triggered, or -1 if it didn't, and "moved_steps" to the steps done in
+  // total.
+  // Returns false if the input can't be watched in realtime; nothing is moved
+  // then. Also returns false if the backend refused a piece of the motion,
+  // e.g. in E-Stop; "moved_steps" has the steps done until then.
+  virtual bool MoveUntilInput(const LinearSegmentSteps &segment, float accel,
+                              const InputTrigger &input, int *trigger_steps,
+                              int *moved_steps) {
+    return false;
+  }
 };
 
 #endif  // _BEAGLEG_MOTOR_OPERATIONS_H_
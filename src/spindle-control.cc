@@ -17,7 +17,7 @@
  * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-// At this point, we only have two spindle implementations, for now just kept
+// At this point, we only have a few spindle implementations, for now just kept
 // in one file.
 
 #include "spindle-control.h"
@@ -105,26 +105,49 @@ class SpindleConfigReader : public ConfigParser::Reader {
   SpindleConfig *const config_;
 };
 
+// Outputs that change the hardware right away.
+class ImmediateSpindleOutputs final : public SpindleOutputs {
+ public:
+  explicit ImmediateSpindleOutputs(HardwareMapping *hardware_mapping)
+      : hardware_mapping_(hardware_mapping) {}
+
+  void SetAux(HardwareMapping::NamedOutput out, bool is_on) final {
+    hardware_mapping_->UpdateAuxBitmap(out, is_on);
+    hardware_mapping_->SetAuxOutputs();
+  }
+  void SetSpeedPWM(float duty) final {
+    hardware_mapping_->SetPWMOutput(HardwareMapping::NamedOutput::SPINDLE_SPEED,
+                                    duty);
+  }
+  void Delay(int ms) final { sleep_ms(ms); }
+  void Sync() final {}
+
+ private:
+  HardwareMapping *const hardware_mapping_;
+};
+
 // Convenience base-class for all our spindles.
 class BaseSpindle : public Spindle {
  public:
   BaseSpindle(const SpindleConfig &config, HardwareMapping *hardware_mapping)
-      : config_(config), hardware_mapping_(hardware_mapping) {}
+      : config_(config),
+        hardware_mapping_(hardware_mapping),
+        immediate_outputs_(hardware_mapping),
+        outputs_(&immediate_outputs_) {}
 
   virtual bool Init() { return true; }
   void On(bool ccw, int rpm) override = 0;
   void Off() override = 0;
 
-  // Right now, this sets the output immediately, but we might want to do this
-  // along with the move if this is a laser.
-  void set_output_synchronous(HardwareMapping::NamedOutput out, bool is_on) {
-    hardware_mapping_->UpdateAuxBitmap(out, is_on);
-    hardware_mapping_->SetAuxOutputs();
+  void SetOutputs(SpindleOutputs *outputs) final {
+    outputs_ = outputs ? outputs : &immediate_outputs_;
   }
 
  protected:
   const SpindleConfig config_;
   HardwareMapping *const hardware_mapping_;
+  ImmediateSpindleOutputs immediate_outputs_;
+  SpindleOutputs *outputs_;
 
   bool is_off_ = true;
   bool is_ccw_ = false;
@@ -166,16 +189,15 @@ class PWMSpindle : public BaseSpindle {
 
     // Turn on spindle power if necessary.
     if (is_off_) {
-      set_output_synchronous(HardwareMapping::NamedOutput::SPINDLE, true);
-      sleep_ms(config_.pwr_delay_ms);
+      outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE, true);
+      outputs_->Delay(config_.pwr_delay_ms);
     }
 
     // direction change? ramp down spindle
     if (ccw != is_ccw_) ramp_down();
 
     // set the spindle direction
-    set_output_synchronous(HardwareMapping::NamedOutput::SPINDLE_DIRECTION,
-                           ccw);
+    outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE_DIRECTION, ccw);
     is_ccw_ = ccw;
 
     // ramp the spindle to the target speed
@@ -186,14 +208,13 @@ class PWMSpindle : public BaseSpindle {
       if ((epsilon < 0 && duty_cycle_ < target) ||
           (epsilon > 0 && duty_cycle_ > target))
         duty_cycle_ = target;
-      hardware_mapping_->SetPWMOutput(
-        HardwareMapping::NamedOutput::SPINDLE_SPEED, duty_cycle_);
-      sleep_ms(kRampDelayMs);
+      outputs_->SetSpeedPWM(duty_cycle_);
+      outputs_->Delay(kRampDelayMs);
     }
 
     // optionally delay before continuing
     if (is_off_) {
-      sleep_ms(config_.on_delay_ms);
+      outputs_->Delay(config_.on_delay_ms);
       is_off_ = false;
     }
 
@@ -204,8 +225,8 @@ class PWMSpindle : public BaseSpindle {
 
   void Off() final {
     ramp_down();
-    sleep_ms(config_.off_delay_ms);
-    set_output_synchronous(HardwareMapping::NamedOutput::SPINDLE, false);
+    outputs_->Delay(config_.off_delay_ms);
+    outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE, false);
     is_off_ = true;
     Log_debug("PWMSpindle: off");
   }
@@ -217,13 +238,57 @@ class PWMSpindle : public BaseSpindle {
         duty_cycle_ -= kRampEpsilon;
       else
         duty_cycle_ = 0;
-      hardware_mapping_->SetPWMOutput(
-        HardwareMapping::NamedOutput::SPINDLE_SPEED, duty_cycle_);
-      sleep_ms(kRampDelayMs);
+      outputs_->SetSpeedPWM(duty_cycle_);
+      outputs_->Delay(kRampDelayMs);
     }
   }
 };
 
+// A laser is switched on and off instantaneously; its power is then driven by
+// the motion queue along with the movement, proportional to the speed, so that
+// acceleration and deceleration don't burn more material than the cruise.
+class LaserSpindle final : public BaseSpindle {
+ public:
+  LaserSpindle(const SpindleConfig &config, HardwareMapping *hardware_mapping)
+      : BaseSpindle(config, hardware_mapping) {
+    Log_debug("LaserSpindle");
+  }
+
+  static bool CheckRequiredHardware(const SpindleConfig &config,
+                                    const HardwareMapping *hw) {
+    if (!hw->HasPWMMapping(HardwareMapping::NamedOutput::SPINDLE_SPEED)) {
+      Log_info("Laser needs 'spindle-speed' PWM output to control power.");
+      return false;
+    }
+    return true;
+  }
+
+  void On(bool ccw, int rpm) final {
+    if (is_off_) {
+      outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE, true);
+      is_off_ = false;
+    }
+    // Run the PWM timer with a minimal duty cycle; the motion queue
+    // updates the actual power with each segment.
+    outputs_->SetSpeedPWM(kLaserIdleDuty);
+    duty_cycle_ = std::min((float)rpm / config_.max_rpm, 1.0f);
+    Log_debug("LaserSpindle: on at %d (power: %f)", rpm, duty_cycle_);
+  }
+
+  void Off() final {
+    outputs_->SetSpeedPWM(0);
+    outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE, false);
+    is_off_ = true;
+    duty_cycle_ = 0;
+    Log_debug("LaserSpindle: off");
+  }
+
+  float VelocityScaledPower() const final { return duty_cycle_; }
+
+ private:
+  static constexpr float kLaserIdleDuty = 1e-6;
+};
+
 class PololuSMCSpindle final : public BaseSpindle {
  private:
   // clang-format off
@@ -393,10 +458,13 @@ class PololuSMCSpindle final : public BaseSpindle {
     }
 
     if (is_off_) {
-      set_output_synchronous(HardwareMapping::NamedOutput::SPINDLE, true);
-      sleep_ms(config_.pwr_delay_ms);
-      exit_safe_start();
+      outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE, true);
+      outputs_->Delay(config_.pwr_delay_ms);
     }
+    // The controller is talked to directly, so the outputs need to be
+    // up to date.
+    outputs_->Sync();
+    if (is_off_) exit_safe_start();
 
     // scale the desired RPM to the MAX_SPEED of the SMC
     int speed = std::min(rpm * MAX_SPEED / config_.max_rpm, (int)MAX_SPEED);
@@ -421,6 +489,7 @@ class PololuSMCSpindle final : public BaseSpindle {
   void Off() final {
     if (fd_ == -1) return;
 
+    outputs_->Sync();
     const unsigned char command = CMD_STOP_MOTOR;
     send(&command, 1);
 
@@ -432,7 +501,7 @@ class PololuSMCSpindle final : public BaseSpindle {
       speed = static_cast<int16_t>(get_variable(SPEED));
     };
 
-    set_output_synchronous(HardwareMapping::NamedOutput::SPINDLE, false);
+    outputs_->SetAux(HardwareMapping::NamedOutput::SPINDLE, false);
     is_off_ = true;
     Log_debug("PololuSMCSpindle: off");
   }
@@ -608,6 +677,9 @@ Spindle *Spindle::CreateFromConfig(const SpindleConfig &config,
   if (config.type == "simple-pwm" &&
       PWMSpindle::CheckRequiredHardware(config, hardware_mapping)) {
     spindle.reset(new PWMSpindle(config, hardware_mapping));
+  } else if (config.type == "laser" &&
+             LaserSpindle::CheckRequiredHardware(config, hardware_mapping)) {
+    spindle.reset(new LaserSpindle(config, hardware_mapping));
   } else if (config.type == "pololu-smc" &&
              PololuSMCSpindle::CheckRequiredHardware(config,
                                                      hardware_mapping)) {
@@ -21,8 +21,8 @@
 #define BEAGLEG_SPINDLE_CONTROL_
 
 #include "common/string-util.h"
+#include "hardware-mapping.h"
 
-class HardwareMapping;
 class ConfigParser;
 
 // Spindle configuration as read from config file.
@@ -43,6 +43,27 @@ struct SpindleConfig {
   bool allow_ccw = false;
 };
 
+// The outputs a spindle is controlled with. By default, the spindle changes
+// them immediately; machine control replaces them with outputs that are
+// switched in sequence with the queued motion (see Spindle::SetOutputs()).
+class SpindleOutputs {
+ public:
+  virtual ~SpindleOutputs() {}
+
+  // Switch the aux output "out" on or off.
+  virtual void SetAux(HardwareMapping::NamedOutput out, bool is_on) = 0;
+
+  // Set the duty cycle of the spindle speed PWM output.
+  virtual void SetSpeedPWM(float duty) = 0;
+
+  // Wait for "ms" milliseconds before the following changes.
+  virtual void Delay(int ms) = 0;
+
+  // Wait until all changes so far have taken effect. Needed before
+  // communicating with the spindle outside of these outputs.
+  virtual void Sync() = 0;
+};
+
 class Spindle {
  public:
   // Factory for a spindle given the configuration. Returns an instance
@@ -54,11 +75,21 @@ class Spindle {
 
   virtual ~Spindle() {}
 
+  // Use "outputs" (not owned, must outlive its use) to control the spindle.
+  // nullptr switches back to immediately changing the hardware.
+  virtual void SetOutputs(SpindleOutputs *outputs) = 0;
+
   // Turn spindle on clockwise (M3) or counterclockwise (M4) at speed (Sxx)
   virtual void On(bool ccw, int rpm) = 0;
 
   // Turn spindle off (M5)
   virtual void Off() = 0;
+
+  // Power as fraction of full PWM duty cycle at the programmed feedrate, if
+  // this spindle wants its power to follow the speed of the movement (lasers).
+  // The planner then scales the power with the actual speed along
+  // acceleration and deceleration. Returns 0 for regular spindles.
+  virtual float VelocityScaledPower() const { return 0; }
 };
 
 #endif  // BEAGLEG_SPINDLE_CONTROL_
@@ -0,0 +1,98 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "status-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <new>
+
+#include "common/logging.h"
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Sequence counter needs to work across processes");
+
+StatusSharedMemory::~StatusSharedMemory() {
+  if (!page_) return;
+  munmap(page_, sizeof(StatusPage));
+  shm_unlink(name_.c_str());
+}
+
+bool StatusSharedMemory::Create(const char *name) {
+  const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd < 0) {
+    Log_error("Can't create status page %s: %s", name, strerror(errno));
+    return false;
+  }
+  fchmod(fd, 0644);  // Independent of umask: readers are other users.
+  if (ftruncate(fd, sizeof(StatusPage)) < 0) {
+    Log_error("Can't size status page %s: %s", name, strerror(errno));
+    close(fd);
+    shm_unlink(name);
+    return false;
+  }
+  void *mapping = mmap(NULL, sizeof(StatusPage), PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    Log_error("Can't map status page %s: %s", name, strerror(errno));
+    shm_unlink(name);
+    return false;
+  }
+  name_ = name;
+  page_ = new (mapping) StatusPage();
+  page_->version = kStatusPageVersion;
+  page_->sequence.store(0);
+  // Written last, so that readers only see a fully initialized page.
+  std::atomic_thread_fence(std::memory_order_release);
+  page_->magic = kStatusPageMagic;
+  return true;
+}
+
+void StatusSharedMemory::Publish(const MachineStatusSample &sample,
+                                 int motion_queue_depth) {
+  if (!page_) return;
+  StatusPagePayload payload;
+  memset(&payload, 0, sizeof(payload));
+  payload.update_count = page_->payload.update_count + 1;
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  payload.timestamp_ms = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+  for (const GCodeParserAxis a : AllAxes()) {
+    payload.position[a] = sample.position[a];
+  }
+  payload.planner_queue_depth = sample.queue_depth;
+  payload.motion_queue_depth = motion_queue_depth;
+  payload.aux_bits = sample.aux_bits;
+  payload.estop = (uint8_t)sample.estop;
+  payload.homing = (uint8_t)sample.homing;
+  payload.motors_enabled = sample.motors_enabled;
+
+  // Prepare everything above, so that the window in which readers have to
+  // retry is as short as a memcpy().
+  const uint32_t seq = page_->sequence.load(std::memory_order_relaxed);
+  page_->sequence.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy((void *)&page_->payload, &payload, sizeof(payload));
+  page_->sequence.store(seq + 2, std::memory_order_release);
+}
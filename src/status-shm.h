@@ -0,0 +1,103 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_STATUS_SHM_H_
+#define _BEAGLEG_STATUS_SHM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <string>
+
+#include "gcode-parser/gcode-parser.h"
+#include "status-telemetry.h"
+
+// Machine status published in a POSIX shared memory page, so that local
+// programs can read it without going through a socket.
+//
+// The page is guarded by a sequence counter (seqlock): the writer makes the
+// counter odd while updating the payload and even again when done. Readers
+// never block the writer; they copy the payload and retry if the counter
+// changed in the meantime or was odd. See TryReadStatusPage() below.
+//
+// The layout is fixed; readers should check magic and version.
+static constexpr uint32_t kStatusPageMagic = 0x54534742;  // "BGST"
+static constexpr uint32_t kStatusPageVersion = 1;
+
+struct StatusPagePayload {
+  uint64_t update_count;                // Incremented with each update.
+  uint32_t timestamp_ms;                // CLOCK_MONOTONIC in milliseconds.
+  float position[GCODE_NUM_AXES];       // Position relative to origin.
+  int32_t planner_queue_depth;          // Segments waiting to be planned.
+  int32_t motion_queue_depth;           // Segments waiting in the PRU queue.
+  uint16_t aux_bits;                    // Current aux bits.
+  uint8_t estop;                        // 0: none, 1: soft, 2: hard
+  uint8_t homing;                       // 0: never, 1: motors unpowered, 2: yes
+  uint8_t motors_enabled;               // 0 or 1
+};
+
+struct StatusPage {
+  uint32_t magic;
+  uint32_t version;
+  std::atomic<uint32_t> sequence;
+  StatusPagePayload payload;
+};
+
+// Single attempt to read a consistent snapshot of the payload. Returns false
+// if the writer was busy; just try again.
+inline bool TryReadStatusPage(const StatusPage *page, StatusPagePayload *out) {
+  const uint32_t before = page->sequence.load(std::memory_order_acquire);
+  if (before & 1) return false;
+  memcpy(out, (const void *)&page->payload, sizeof(*out));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return page->sequence.load(std::memory_order_relaxed) == before;
+}
+
+// Read a consistent snapshot of the payload.
+inline void ReadStatusPage(const StatusPage *page, StatusPagePayload *out) {
+  while (!TryReadStatusPage(page, out)) {
+  }
+}
+
+// Writer side, used by machine-control.
+class StatusSharedMemory {
+ public:
+  StatusSharedMemory() {}
+  ~StatusSharedMemory();
+
+  StatusSharedMemory(const StatusSharedMemory &) = delete;
+  StatusSharedMemory &operator=(const StatusSharedMemory &) = delete;
+
+  // Create the shared memory object "name" (such as "/beagleg-status", see
+  // shm_open(3)) readable by everyone. It is removed again on destruction.
+  // Returns false on failure.
+  bool Create(const char *name);
+
+  // Publish the sample. "motion_queue_depth" is the number of segments in
+  // the motion queue.
+  void Publish(const MachineStatusSample &sample, int motion_queue_depth);
+
+  const StatusPage *page() const { return page_; }
+
+ private:
+  std::string name_;
+  StatusPage *page_ = nullptr;
+};
+
+#endif  // _BEAGLEG_STATUS_SHM_H_
@@ -0,0 +1,98 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "status-shm.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+
+static std::string TestPageName() {
+  return "/beagleg-status-test-" + std::to_string(getpid());
+}
+
+TEST(StatusSharedMemory, ReaderSeesPublishedSnapshot) {
+  const std::string name = TestPageName();
+  StatusSharedMemory writer;
+  ASSERT_TRUE(writer.Create(name.c_str()));
+
+  // Map it like a separate reader process would.
+  const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  ASSERT_GE(fd, 0);
+  void *mapping = mmap(NULL, sizeof(StatusPage), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  ASSERT_NE(MAP_FAILED, mapping);
+  const StatusPage *page = (const StatusPage *)mapping;
+  EXPECT_EQ(kStatusPageMagic, page->magic);
+  EXPECT_EQ(kStatusPageVersion, page->version);
+
+  MachineStatusSample sample;
+  sample.position[AXIS_X] = 12.5;
+  sample.position[AXIS_E] = -1;
+  sample.estop = GCodeMachineControl::EStopState::SOFT;
+  sample.homing = GCodeMachineControl::HomingState::HOMED;
+  sample.motors_enabled = true;
+  sample.queue_depth = 7;
+  sample.aux_bits = 0x42;
+  writer.Publish(sample, 3);
+  writer.Publish(sample, 4);
+
+  StatusPagePayload payload;
+  ReadStatusPage(page, &payload);
+  EXPECT_EQ(2u, payload.update_count);
+  EXPECT_FLOAT_EQ(12.5, payload.position[AXIS_X]);
+  EXPECT_FLOAT_EQ(-1, payload.position[AXIS_E]);
+  EXPECT_EQ(1, payload.estop);
+  EXPECT_EQ(2, payload.homing);
+  EXPECT_EQ(1, payload.motors_enabled);
+  EXPECT_EQ(7, payload.planner_queue_depth);
+  EXPECT_EQ(4, payload.motion_queue_depth);
+  EXPECT_EQ(0x42, payload.aux_bits);
+  munmap(mapping, sizeof(StatusPage));
+}
+
+TEST(StatusSharedMemory, ReaderRetriesWhileWriterIsBusy) {
+  const std::string name = TestPageName();
+  StatusSharedMemory writer;
+  ASSERT_TRUE(writer.Create(name.c_str()));
+  StatusPage *page = const_cast<StatusPage *>(writer.page());
+  StatusPagePayload payload;
+  EXPECT_TRUE(TryReadStatusPage(page, &payload));
+
+  page->sequence.fetch_add(1);  // Simulate update in progress.
+  EXPECT_FALSE(TryReadStatusPage(page, &payload));
+  page->sequence.fetch_add(1);
+  EXPECT_TRUE(TryReadStatusPage(page, &payload));
+}
+
+TEST(StatusSharedMemory, PageIsRemovedOnDestruction) {
+  const std::string name = TestPageName();
+  {
+    StatusSharedMemory writer;
+    ASSERT_TRUE(writer.Create(name.c_str()));
+  }
+  EXPECT_LT(shm_open(name.c_str(), O_RDONLY, 0), 0);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
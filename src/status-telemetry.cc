@@ -0,0 +1,197 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "status-telemetry.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+struct StatusTelemetry::Subscriber {
+  int fd;
+  bool active = true;
+  bool due = false;
+  bool has_previous = false;
+  MachineStatusSample previous;
+  std::string pending;  // Partially written record.
+};
+
+static int64_t monotonic_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const char *EStopName(GCodeMachineControl::EStopState state) {
+  switch (state) {
+  case GCodeMachineControl::EStopState::NONE: return "none";
+  case GCodeMachineControl::EStopState::SOFT: return "soft";
+  case GCodeMachineControl::EStopState::HARD: return "hard";
+  }
+  return "unknown";
+}
+
+static const char *HomingName(GCodeMachineControl::HomingState state) {
+  switch (state) {
+  case GCodeMachineControl::HomingState::NEVER_HOMED: return "no";
+  case GCodeMachineControl::HomingState::HOMED_BUT_MOTORS_UNPOWERED:
+    return "maybe";
+  case GCodeMachineControl::HomingState::HOMED: return "yes";
+  }
+  return "unknown";
+}
+
+// Positions are printed with three decimals; smaller changes are noise.
+static long ToMicrons(float value) { return lroundf(value * 1000); }
+
+std::string EncodeStatusDelta(const MachineStatusSample *previous,
+                              const MachineStatusSample &current,
+                              uint32_t timestamp_ms) {
+  std::string fields;
+  char buffer[64];
+  for (const GCodeParserAxis a : AllAxes()) {
+    if (previous &&
+        ToMicrons(previous->position[a]) == ToMicrons(current.position[a])) {
+      continue;
+    }
+    snprintf(buffer, sizeof(buffer), ", \"%c_axis\":%.3f",
+             tolower(gcodep_axis2letter(a)), current.position[a]);
+    fields.append(buffer);
+  }
+  if (!previous || previous->estop != current.estop) {
+    snprintf(buffer, sizeof(buffer), ", \"estop\":\"%s\"",
+             EStopName(current.estop));
+    fields.append(buffer);
+  }
+  if (!previous || previous->homing != current.homing) {
+    snprintf(buffer, sizeof(buffer), ", \"homed\":\"%s\"",
+             HomingName(current.homing));
+    fields.append(buffer);
+  }
+  if (!previous || previous->motors_enabled != current.motors_enabled) {
+    fields.append(current.motors_enabled ? ", \"motors\":true"
+                                         : ", \"motors\":false");
+  }
+  if (!previous || previous->queue_depth != current.queue_depth) {
+    snprintf(buffer, sizeof(buffer), ", \"queue\":%d", current.queue_depth);
+    fields.append(buffer);
+  }
+  if (!previous || previous->aux_bits != current.aux_bits) {
+    snprintf(buffer, sizeof(buffer), ", \"aux\":%u", current.aux_bits);
+    fields.append(buffer);
+  }
+  if (fields.empty()) return fields;
+
+  snprintf(buffer, sizeof(buffer), "{\"ms\":%u", timestamp_ms);
+  return buffer + fields + "}\n";
+}
+
+StatusTelemetry::StatusTelemetry(FDMultiplexer *event_server,
+                                 const Sampler &sampler)
+    : event_server_(event_server), sampler_(sampler),
+      start_ms_(monotonic_ms()) {}
+
+StatusTelemetry::~StatusTelemetry() {
+  for (auto &s : subscribers_) s.second->active = false;
+}
+
+bool StatusTelemetry::Subscribe(int fd, int rate_hz) {
+  if (rate_hz < 1 || rate_hz > 1000) return false;
+  Unsubscribe(fd);  // Timers can't be changed, so start over.
+  auto subscriber = std::make_shared<Subscriber>();
+  subscriber->fd = fd;
+  subscribers_[fd] = subscriber;
+
+  // The first record is sent right away.
+  subscriber->due = true;
+  ScheduleSample();
+  event_server_->RunEvery(1000 / rate_hz, [this, subscriber]() {
+    if (!subscriber->active) return false;
+    subscriber->due = true;
+    ScheduleSample();
+    return true;
+  });
+  return true;
+}
+
+void StatusTelemetry::Unsubscribe(int fd) {
+  auto found = subscribers_.find(fd);
+  if (found == subscribers_.end()) return;
+  found->second->active = false;  // Timer stops with next call.
+  subscribers_.erase(found);
+}
+
+// Several subscribers might be due in the same cycle; the machine state
+// is only sampled once at the end of it.
+void StatusTelemetry::ScheduleSample() {
+  if (sample_scheduled_) return;
+  sample_scheduled_ = true;
+  event_server_->RunAtEndOfCycle([this]() {
+    sample_scheduled_ = false;
+    SampleAndPublish();
+    return false;
+  });
+}
+
+void StatusTelemetry::SampleAndPublish() {
+  MachineStatusSample sample;
+  sampler_(&sample);
+  const uint32_t timestamp_ms = monotonic_ms() - start_ms_;
+  for (auto &s : subscribers_) {
+    Subscriber *subscriber = s.second.get();
+    if (!subscriber->due) continue;
+    subscriber->due = false;
+    Send(subscriber, sample, timestamp_ms);
+  }
+}
+
+void StatusTelemetry::Send(Subscriber *subscriber,
+                           const MachineStatusSample &sample,
+                           uint32_t timestamp_ms) {
+  const bool continuation = !subscriber->pending.empty();
+  if (continuation) {
+    // Finish the partially written record first. The records we skip
+    // meanwhile are covered by sending the full status afterwards.
+    subscriber->has_previous = false;
+  } else {
+    subscriber->pending =
+      EncodeStatusDelta(subscriber->has_previous ? &subscriber->previous
+                                                 : nullptr,
+                        sample, timestamp_ms);
+    if (subscriber->pending.empty()) return;  // Nothing changed.
+    subscriber->previous = sample;
+    subscriber->has_previous = true;
+  }
+
+  const ssize_t written =
+    send(subscriber->fd, subscriber->pending.data(),
+         subscriber->pending.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+  if (written < 0) {
+    if ((errno == EAGAIN || errno == EWOULDBLOCK) && continuation) return;
+    // Either not a byte of the record went out, then we just skip it, or
+    // the connection is gone, which the owner of the fd will notice.
+    subscriber->pending.clear();
+    subscriber->has_previous = false;
+    return;
+  }
+  subscriber->pending.erase(0, written);
+}
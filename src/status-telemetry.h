@@ -0,0 +1,99 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_STATUS_TELEMETRY_H_
+#define _BEAGLEG_STATUS_TELEMETRY_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "common/fd-mux.h"
+#include "gcode-machine-control.h"
+#include "gcode-parser/gcode-parser.h"
+
+// A snapshot of the machine state as sent to telemetry subscribers.
+struct MachineStatusSample {
+  AxesRegister position;
+  GCodeMachineControl::EStopState estop = GCodeMachineControl::EStopState::NONE;
+  GCodeMachineControl::HomingState homing =
+    GCodeMachineControl::HomingState::NEVER_HOMED;
+  bool motors_enabled = false;
+  int queue_depth = 0;
+  uint16_t aux_bits = 0;
+};
+
+// Encode "current" as JSON object on a single line, only containing the
+// fields that differ from "previous", and the timestamp. If "previous" is
+// nullptr, all fields are included. Returns an empty string if nothing
+// changed. Positions are compared in the resolution they are printed with.
+std::string EncodeStatusDelta(const MachineStatusSample *previous,
+                              const MachineStatusSample &current,
+                              uint32_t timestamp_ms);
+
+// Pushes the machine status to subscribed connections at their chosen rate.
+//
+// Each subscriber first gets the full status, then only the fields that
+// changed since the last record it got. All subscribers that are due
+// within the same FDMultiplexer cycle share a single sample of the machine
+// state, which is taken at the end of that cycle.
+//
+// Subscribers are written to without blocking. If a subscriber can't keep
+// up, its records are skipped until it has caught up; it then gets the full
+// status again.
+class StatusTelemetry {
+ public:
+  // Function that fills the current machine status.
+  typedef std::function<void(MachineStatusSample *)> Sampler;
+
+  StatusTelemetry(FDMultiplexer *event_server, const Sampler &sampler);
+  ~StatusTelemetry();
+
+  StatusTelemetry(const StatusTelemetry &) = delete;
+  StatusTelemetry &operator=(const StatusTelemetry &) = delete;
+
+  // Send status records to "fd" with "rate_hz" records per second (1..1000).
+  // Subscribing an already subscribed "fd" changes its rate.
+  // The file descriptor is not owned; call Unsubscribe() before closing it.
+  // Returns false if the rate is out of range.
+  bool Subscribe(int fd, int rate_hz);
+
+  // Stop sending records to "fd".
+  void Unsubscribe(int fd);
+
+  int subscriber_count() const { return subscribers_.size(); }
+
+ private:
+  struct Subscriber;
+
+  void ScheduleSample();
+  void SampleAndPublish();
+  void Send(Subscriber *subscriber, const MachineStatusSample &sample,
+            uint32_t timestamp_ms);
+
+  FDMultiplexer *const event_server_;
+  const Sampler sampler_;
+  const int64_t start_ms_;
+  std::map<int, std::shared_ptr<Subscriber>> subscribers_;
+  bool sample_scheduled_ = false;
+};
+
+#endif  // _BEAGLEG_STATUS_TELEMETRY_H_
@@ -0,0 +1,121 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "status-telemetry.h"
+
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+
+class TestMultiplexer : public FDMultiplexer {
+ public:
+  TestMultiplexer() : FDMultiplexer(10) {}
+  using FDMultiplexer::SingleCycle;
+};
+
+static std::string ReadAvailable(int fd) {
+  char buf[4096];
+  const ssize_t r = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+  return r > 0 ? std::string(buf, r) : "";
+}
+
+TEST(StatusTelemetry, EncodeDeltaOnlyContainsChanges) {
+  MachineStatusSample previous;
+  previous.position[AXIS_X] = 10;
+  const std::string full = EncodeStatusDelta(nullptr, previous, 5);
+  EXPECT_EQ(0u, full.find("{\"ms\":5, \"x_axis\":10.000, \"y_axis\":0.000"));
+  EXPECT_NE(std::string::npos, full.find("\"estop\":\"none\""));
+  EXPECT_NE(std::string::npos, full.find("\"homed\":\"no\""));
+  EXPECT_NE(std::string::npos, full.find("\"queue\":0, \"aux\":0}\n"));
+
+  MachineStatusSample current = previous;
+  EXPECT_EQ("", EncodeStatusDelta(&previous, current, 7));
+
+  current.position[AXIS_X] = 10.0001;  // Below printed resolution.
+  current.position[AXIS_Y] = 2.5;
+  current.queue_depth = 3;
+  EXPECT_EQ("{\"ms\":7, \"y_axis\":2.500, \"queue\":3}\n",
+            EncodeStatusDelta(&previous, current, 7));
+}
+
+TEST(StatusTelemetry, SubscribersGetFullThenDeltaRecords) {
+  TestMultiplexer mux;
+  int sockets[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+  mux.RunOnReadable(sockets[0], []() { return true; });  // Keep loop alive.
+
+  int samples = 0;
+  MachineStatusSample state;
+  StatusTelemetry telemetry(&mux, [&](MachineStatusSample *sample) {
+    ++samples;
+    *sample = state;
+  });
+  EXPECT_FALSE(telemetry.Subscribe(sockets[0], 0));
+  EXPECT_FALSE(telemetry.Subscribe(sockets[0], 2000));
+  ASSERT_TRUE(telemetry.Subscribe(sockets[0], 500));
+  EXPECT_EQ(1, telemetry.subscriber_count());
+
+  EXPECT_TRUE(mux.SingleCycle(100));
+  EXPECT_EQ(1, samples);
+  EXPECT_NE(std::string::npos, ReadAvailable(sockets[1]).find("\"x_axis\""));
+
+  // Nothing changed: samples are taken, but no records sent.
+  while (samples < 3) EXPECT_TRUE(mux.SingleCycle(100));
+  EXPECT_EQ("", ReadAvailable(sockets[1]));
+
+  state.aux_bits = 5;
+  while (samples < 4) EXPECT_TRUE(mux.SingleCycle(100));
+  const std::string delta = ReadAvailable(sockets[1]);
+  EXPECT_NE(std::string::npos, delta.find(", \"aux\":5}\n"));
+  EXPECT_EQ(std::string::npos, delta.find("x_axis"));
+
+  telemetry.Unsubscribe(sockets[0]);
+  EXPECT_EQ(0, telemetry.subscriber_count());
+  for (int i = 0; i < 5; ++i) EXPECT_TRUE(mux.SingleCycle(5));
+  EXPECT_EQ(4, samples);
+
+  close(sockets[0]);
+  close(sockets[1]);
+}
+
+TEST(StatusTelemetry, SubscribersDueInSameCycleShareOneSample) {
+  TestMultiplexer mux;
+  int a[2], b[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, a));
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, b));
+  mux.RunOnReadable(a[0], []() { return true; });
+
+  int samples = 0;
+  StatusTelemetry telemetry(&mux, [&](MachineStatusSample *sample) {
+    ++samples;
+  });
+  telemetry.Subscribe(a[0], 100);
+  telemetry.Subscribe(b[0], 100);
+  EXPECT_TRUE(mux.SingleCycle(100));
+  EXPECT_EQ(1, samples);
+  EXPECT_EQ(ReadAvailable(a[1]), ReadAvailable(b[1]));
+
+  for (int fd : {a[0], a[1], b[0], b[1]}) close(fd);
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,235 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "time-index.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+#include "common/hash.h"
+#include "common/logging.h"
+#include "common/mapped-line-reader.h"
+#include "common/string-util.h"
+#include "gcode-machine-control.h"
+#include "gcode-parser/gcode-parser.h"
+#include "hardware-mapping.h"
+#include "segment-queue.h"
+
+namespace {
+struct IndexHeader {
+  char magic[4];
+  uint32_t version;
+  uint64_t key;
+  int32_t lines;
+  float total_seconds;
+};
+
+constexpr char kMagic[4] = {'B', 'G', 'T', 'I'};
+constexpr uint32_t kVersion = 1;
+
+// Accumulates the time the motors would take for the segments.
+class TimeAccountingSegmentQueue : public SegmentQueue {
+ public:
+  float seconds() const { return seconds_; }
+
+  bool Enqueue(const LinearSegmentSteps &param) final {
+    int max_steps = 0;
+    for (int i = 0; i < BEAGLEG_NUM_MOTORS; ++i) {
+      const int steps = abs(param.steps[i]);
+      if (steps > max_steps) max_steps = steps;
+    }
+    if (max_steps == 0) return true;  // Only setting aux bits.
+    seconds_ += 2 * max_steps / (param.v0 + param.v1);
+    return true;
+  }
+  bool Dwell(float seconds) final {
+    seconds_ += seconds;
+    return true;
+  }
+  void MotorEnable(bool on) final {}
+  void WaitQueueEmpty() final {}
+  float GetQueuedSeconds() final { return 0; }
+  bool GetPhysicalStatus(PhysicalStatus *status) final { return false; }
+  void SetExternalPosition(int axis, int pos) final {}
+
+ private:
+  double seconds_ = 0;
+};
+}  // namespace
+
+TimeIndex::TimeIndex() : ready_(false), cancel_(false) {}
+
+TimeIndex::~TimeIndex() {
+  cancel_.store(true);
+  if (thread_.joinable()) thread_.join();
+}
+
+std::string TimeIndex::IndexFile(const std::string &gcode_filename) {
+  return HiddenSidecarFile(gcode_filename, ".time-index");
+}
+
+uint64_t TimeIndex::Key(const std::string &gcode_filename,
+                        const MachineControlConfig &config) {
+  struct stat st;
+  if (stat(gcode_filename.c_str(), &st) != 0) return 0;
+  Fnv1aHash hash;
+  hash.AddValue(kVersion)
+    .AddValue((uint64_t)st.st_size)
+    .AddValue((int64_t)st.st_mtim.tv_sec)
+    .AddValue((int64_t)st.st_mtim.tv_nsec)
+    .AddValue(config.Fingerprint());
+  return hash.value();
+}
+
+bool TimeIndex::Build(int fd, const MachineControlConfig &config) {
+  MappedLineReader reader;
+  if (!reader.Map(fd)) return false;
+
+  // Same as gcode-print-stats: we only want to know the time.
+  MachineControlConfig plan_config = config;
+  plan_config.range_check = false;
+  plan_config.require_homing = false;
+  HardwareMapping hardware;  // We never initialize, just sim mode.
+  TimeAccountingSegmentQueue time_queue;
+  std::unique_ptr<GCodeMachineControl> machine_control(
+    GCodeMachineControl::Create(plan_config, &time_queue, &hardware, nullptr,
+                                nullptr));
+  if (!machine_control) return false;
+  GCodeParser::EventReceiver *const receiver =
+    machine_control->ParseEventReceiver();
+  GCodeParser::Config parser_cfg;
+  GCodeParser::Config::ParamMap parameters;
+  parser_cfg.parameters = &parameters;
+  GCodeParser parser(parser_cfg, receiver);
+
+  entries_.clear();
+  lines_ = 0;
+  std::string_view line;
+  for (;;) {
+    if (lines_ % kLinesPerEntry == 0) {
+      if (cancel_.load(std::memory_order_relaxed)) return false;
+      entries_.push_back({reader.consumed(), time_queue.seconds(), 0});
+    }
+    if (!reader.ReadLine(&line)) break;
+    parser.ParseBlock(line, nullptr);
+    ++lines_;
+  }
+  receiver->gcode_finished(true);  // Flush the planning buffer.
+  total_seconds_ = time_queue.seconds();
+  return true;
+}
+
+bool TimeIndex::Save(const std::string &index_file, uint64_t key) const {
+  const std::string tmp_file = index_file + ".tmp";
+  FILE *out = fopen(tmp_file.c_str(), "wb");
+  if (!out) return false;
+  IndexHeader header;
+  memcpy(header.magic, kMagic, sizeof(header.magic));
+  header.version = kVersion;
+  header.key = key;
+  header.lines = lines_;
+  header.total_seconds = total_seconds_;
+  bool success = fwrite(&header, sizeof(header), 1, out) == 1;
+  success &= fwrite(entries_.data(), sizeof(Entry), entries_.size(), out) ==
+             entries_.size();
+  success &= (fclose(out) == 0);
+  // Only a complete file gets its final name.
+  if (!success || rename(tmp_file.c_str(), index_file.c_str()) != 0) {
+    unlink(tmp_file.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool TimeIndex::Load(const std::string &index_file, uint64_t key) {
+  FILE *in = fopen(index_file.c_str(), "rb");
+  if (!in) return false;
+  IndexHeader header;
+  bool success = fread(&header, sizeof(header), 1, in) == 1 &&
+                 memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 &&
+                 header.version == kVersion && header.key == key &&
+                 header.lines >= 0;
+  if (success) {
+    entries_.resize(header.lines / kLinesPerEntry + 1);
+    success = fread(entries_.data(), sizeof(Entry), entries_.size(), in) ==
+              entries_.size();
+    lines_ = header.lines;
+    total_seconds_ = header.total_seconds;
+  }
+  fclose(in);
+  if (!success) entries_.clear();
+  return success;
+}
+
+void TimeIndex::StartLoadOrBuild(const std::string &gcode_filename,
+                                 const MachineControlConfig &config) {
+  thread_ = std::thread([this, gcode_filename, config]() {
+    LoadOrBuild(gcode_filename, config);
+  });
+}
+
+void TimeIndex::LoadOrBuild(const std::string &gcode_filename,
+                            const MachineControlConfig &config) {
+  const uint64_t key = Key(gcode_filename, config);
+  if (key == 0) return;
+  const std::string index_file = IndexFile(gcode_filename);
+  if (!Load(index_file, key)) {
+    const int fd = open(gcode_filename.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    const bool built = Build(fd, config);
+    close(fd);
+    if (!built) return;
+    if (!Save(index_file, key)) {
+      Log_info("Can't store time index %s; keeping it in memory only.",
+               index_file.c_str());
+    }
+  }
+  ready_.store(true, std::memory_order_release);
+}
+
+float TimeIndex::SecondsAtLine(int line) const {
+  if (line >= lines_) return total_seconds_;
+  if (line <= 0) return 0;
+  const size_t i = line / kLinesPerEntry;
+  const int start_line = i * kLinesPerEntry;
+  const int end_line = std::min(start_line + kLinesPerEntry, lines_);
+  const float start_seconds = entries_[i].seconds;
+  const float end_seconds =
+    (i + 1 < entries_.size()) ? entries_[i + 1].seconds : total_seconds_;
+  return start_seconds + (end_seconds - start_seconds) *
+                           (line - start_line) / (end_line - start_line);
+}
+
+float TimeIndex::SecondsAtOffset(uint64_t offset) const {
+  auto next = std::upper_bound(
+    entries_.begin(), entries_.end(), offset,
+    [](uint64_t value, const Entry &e) { return value < e.offset; });
+  if (next == entries_.begin()) return 0;
+  if (next == entries_.end()) return total_seconds_;
+  const Entry &start = *(next - 1);
+  return start.seconds + (next->seconds - start.seconds) *
+                           (offset - start.offset) /
+                           (next->offset - start.offset);
+}
@@ -0,0 +1,113 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _BEAGLEG_TIME_INDEX_H_
+#define _BEAGLEG_TIME_INDEX_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct MachineControlConfig;  // gcode-machine-control.h
+
+// Index of a G-code file that maps lines to the time it takes to run the
+// program up to there, determined by planning the file with the real
+// Planner. Used to report progress and the remaining time of a running job.
+//
+// Every kLinesPerEntry lines, the byte offset and the total planned time of
+// the segments that came out of the planner so far are recorded. The
+// segments still in the planning buffer are not accounted for yet; the
+// same is true while running the file, so the times match what the motion
+// queue got at that line.
+//
+// As planning a large file takes a while, the index is stored next to the
+// G-code file and only rebuilt if the file or the configuration changed.
+class TimeIndex {
+ public:
+  static constexpr int kLinesPerEntry = 32;
+
+  TimeIndex();
+  ~TimeIndex();
+
+  TimeIndex(const TimeIndex &) = delete;
+  TimeIndex &operator=(const TimeIndex &) = delete;
+
+  // Name of the file the index of "gcode_filename" is stored in: a hidden
+  // file next to it, so that it is not taken as a job from a spool
+  // directory.
+  static std::string IndexFile(const std::string &gcode_filename);
+
+  // Key of the index of "gcode_filename" run with "config". Changes with
+  // the file and the configuration. Returns 0 if the file can not be read.
+  static uint64_t Key(const std::string &gcode_filename,
+                      const MachineControlConfig &config);
+
+  // Plan the G-code file "fd" with "config" and record the times. The file
+  // needs to be a regular file; it is not closed.
+  // Returns false if the file can not be read or building was cancelled.
+  bool Build(int fd, const MachineControlConfig &config);
+
+  // Store and load the index with the given "key". Load() fails if the
+  // stored index has a different key.
+  bool Save(const std::string &index_file, uint64_t key) const;
+  bool Load(const std::string &index_file, uint64_t key);
+
+  // Load the stored index of "gcode_filename" if it is up to date,
+  // otherwise build it and store it next to the file. Done in a separate
+  // thread; ready() tells when it is available.
+  void StartLoadOrBuild(const std::string &gcode_filename,
+                        const MachineControlConfig &config);
+
+  // Returns true once the index is complete. Only then, the following
+  // accessors can be used.
+  bool ready() const { return ready_.load(std::memory_order_acquire); }
+
+  int lines() const { return lines_; }
+  float total_seconds() const { return total_seconds_; }
+
+  // Planned seconds until the given number of lines have been read.
+  // Interpolated between the entries.
+  float SecondsAtLine(int line) const;
+
+  // Planned seconds until the given number of bytes have been read.
+  float SecondsAtOffset(uint64_t offset) const;
+
+ private:
+  struct Entry {
+    uint64_t offset;
+    float seconds;
+    uint32_t reserved;
+  };
+
+  void LoadOrBuild(const std::string &gcode_filename,
+                   const MachineControlConfig &config);
+
+  std::vector<Entry> entries_;  // Entry i is for line i * kLinesPerEntry.
+  int lines_ = 0;
+  float total_seconds_ = 0;
+
+  std::thread thread_;
+  std::atomic<bool> ready_;
+  std::atomic<bool> cancel_;
+};
+
+#endif  // _BEAGLEG_TIME_INDEX_H_
@@ -0,0 +1,136 @@
+/* -*- mode: c++; c-basic-offset: 2; indent-tabs-mode: nil; -*-
+ * (c) 2026 Henner Zeller <h.zeller@acm.org>
+ *
+ * This file is part of BeagleG. http://github.com/hzeller/beagleg
+ *
+ * BeagleG is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BeagleG is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BeagleG.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "time-index.h"
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "gcode-machine-control.h"
+
+class TimeIndexTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    for (int i = 0; i <= AXIS_Z; ++i) {
+      const GCodeParserAxis axis = (GCodeParserAxis)i;
+      config_.steps_per_mm[axis] = 100;
+      config_.acceleration[axis] = 1000;
+      config_.max_feedrate[axis] = 1000;
+    }
+    config_.threshold_angle = 0;
+    config_.speed_tune_angle = 0;
+
+    char filename[] = "/tmp/time-index-test.XXXXXX";
+    const int fd = mkstemp(filename);
+    gcode_file_ = filename;
+    // Back and forth; every 10mm move ramps up to 100mm/s and down again
+    // in 0.2 seconds.
+    FILE *f = fdopen(fd, "w");
+    for (int i = 0; i < 1500; ++i) fputs("G1 X10 F6000\nG1 X0\n", f);
+    fclose(f);
+  }
+  void TearDown() override {
+    unlink(TimeIndex::IndexFile(gcode_file_).c_str());
+    unlink(gcode_file_.c_str());
+  }
+
+  bool Build(TimeIndex *index) {
+    const int fd = open(gcode_file_.c_str(), O_RDONLY);
+    const bool result = index->Build(fd, config_);
+    close(fd);
+    return result;
+  }
+
+  MachineControlConfig config_;
+  std::string gcode_file_;
+};
+
+TEST_F(TimeIndexTest, TimeOfLinesAndOffsets) {
+  TimeIndex index;
+  ASSERT_TRUE(Build(&index));
+  EXPECT_EQ(3000, index.lines());
+  EXPECT_NEAR(600.0, index.total_seconds(), 1.0);
+
+  EXPECT_EQ(0, index.SecondsAtLine(0));
+  // The moves still in the planning buffer are not accounted for yet.
+  EXPECT_EQ(0, index.SecondsAtLine(900));
+  EXPECT_NEAR((2000 - 1023) * 0.2, index.SecondsAtLine(2000), 1.0);
+  EXPECT_EQ(index.total_seconds(), index.SecondsAtLine(3000));
+  float last = 0;
+  for (int line = 0; line <= 3000; ++line) {
+    EXPECT_GE(index.SecondsAtLine(line), last) << line;
+    last = index.SecondsAtLine(line);
+  }
+
+  // Each pair of lines is 19 bytes.
+  EXPECT_FLOAT_EQ(index.SecondsAtLine(2048), index.SecondsAtOffset(1024 * 19));
+  EXPECT_EQ(index.total_seconds(), index.SecondsAtOffset(1500 * 19));
+  EXPECT_EQ(0, index.SecondsAtOffset(0));
+}
+
+TEST_F(TimeIndexTest, SaveAndLoad) {
+  TimeIndex index;
+  ASSERT_TRUE(Build(&index));
+  const std::string index_file = TimeIndex::IndexFile(gcode_file_);
+  ASSERT_TRUE(index.Save(index_file, 42));
+
+  TimeIndex loaded;
+  EXPECT_FALSE(loaded.Load(index_file, 43));  // Stale.
+  ASSERT_TRUE(loaded.Load(index_file, 42));
+  EXPECT_EQ(index.lines(), loaded.lines());
+  EXPECT_EQ(index.total_seconds(), loaded.total_seconds());
+  EXPECT_EQ(index.SecondsAtLine(77), loaded.SecondsAtLine(77));
+}
+
+TEST_F(TimeIndexTest, KeyDependsOnConfiguration) {
+  const uint64_t key = TimeIndex::Key(gcode_file_, config_);
+  EXPECT_NE(0u, key);
+  EXPECT_EQ(key, TimeIndex::Key(gcode_file_, config_));
+  MachineControlConfig other_config = config_;
+  other_config.acceleration[AXIS_X] = 500;
+  EXPECT_NE(key, TimeIndex::Key(gcode_file_, other_config));
+  EXPECT_EQ(0u, TimeIndex::Key("/non/existent", config_));
+}
+
+TEST_F(TimeIndexTest, BuiltInBackgroundAndStoredNextToFile) {
+  {
+    TimeIndex index;
+    index.StartLoadOrBuild(gcode_file_, config_);
+    for (int i = 0; i < 500 && !index.ready(); ++i) usleep(10000);
+    ASSERT_TRUE(index.ready());
+    EXPECT_NEAR(600.0, index.total_seconds(), 1.0);
+  }
+  EXPECT_EQ(0, access(TimeIndex::IndexFile(gcode_file_).c_str(), F_OK));
+
+  // The next time, the stored index is used.
+  TimeIndex index;
+  index.StartLoadOrBuild(gcode_file_, config_);
+  for (int i = 0; i < 500 && !index.ready(); ++i) usleep(10000);
+  ASSERT_TRUE(index.ready());
+  EXPECT_EQ(3000, index.lines());
+}
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}